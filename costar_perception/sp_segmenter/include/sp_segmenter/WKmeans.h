@@ -7,6 +7,10 @@ struct protoT{
 };
 
 void HierKmeans(const std::vector<protoT> &proto_set, cv::Mat &centers, int K);
+// flat K-means with mini-batch updates followed by Hamerly-bounded Lloyd iterations, see flatKmeans
+void MiniBatchKmeans(const std::vector<protoT> &proto_set, cv::Mat &centers, int K);
+// run HierKmeans and MiniBatchKmeans on the same protos, report wall-clock and energy of both
+void CompareKmeans(const std::vector<protoT> &proto_set, cv::Mat &centers, int K);
  
 class WKmeans{
 public:
@@ -39,6 +43,8 @@ public:
     ~sparseK();
 
     void AddData(cv::Mat data);
+    // appends the protos by swapping their elements, protos is cleared
+    void AddProtos(std::vector<protoT> &protos);
     void LoadProtos(std::vector<protoT> &proto_set_){proto_set = proto_set_;fea_len = proto_set[0].elems[proto_set[0].elems.size()-1].index;}
     std::vector<float> W_Cluster(cv::Mat &centers, int K, std::vector< std::vector<protoT> > &protoByCluster);
     void setThreadNum(int thread_num_){ omp_set_num_threads(thread_num_);thread_num = thread_num_;}
@@ -61,4 +67,77 @@ private:
     int thread_num;		//omp_get_num_threads()
     size_t total_count;		//0
     bool weight_flag;		//flagging the weighted kmeans
-};
\ No newline at end of file
+};
+
+// Dictionary learner on a flat (CSR) copy of the protos, the protos are only referenced by index
+class flatKmeans {
+public:
+    flatKmeans();
+    ~flatKmeans();
+
+    void LoadProtos(const std::vector<protoT> &proto_set);
+    // returns the energy of each cluster, i.e. the sum of the distances to its center
+    std::vector<float> W_Cluster(cv::Mat &centers, int K);
+    // energy of the given centers on the loaded protos
+    float Energy(const cv::Mat &centers);
+    
+    void setBatchSize(int batch_size_){batch_size = batch_size_;}
+    void setBatchIter(int batch_iter_){batch_iter = batch_iter_;}
+    void setMaxIter(int max_iter_){max_iter = max_iter_;}
+    void setThreadNum(int thread_num_){ omp_set_num_threads(thread_num_);thread_num = thread_num_;}
+
+private:
+    void Initialize(cv::Mat &centers, int K);       //k-means++ on a random sample
+    void MiniBatch(cv::Mat &centers, int K);        //mini-batch center updates
+    void Refine(cv::Mat &centers, int K);           //Lloyd iterations with Hamerly-style bounds per group of centers
+    void GroupCenters(const cv::Mat &centers, int G);
+    
+    float distFunc2(int i, const float *center, float center_sq) const;   //squared distance of proto i to a dense center
+    int nearestCenter(int i, const cv::Mat &centers, const std::vector<float> &center_sq, float &min_dist2, float &second_dist2) const;
+    
+    int fea_len;                    //-1
+    int proto_num;
+    std::vector<size_t> row_s;      //entries of proto i are [row_s[i], row_s[i+1])
+    std::vector<int> col_idx;
+    std::vector<float> vals;
+    std::vector<float> sq_norm;
+    std::vector<int> labels;
+    std::vector<int> center_group;
+    std::vector< std::vector<int> > group_members;
+    
+    int batch_size;                 //1024
+    int batch_iter;                 //100
+    int max_iter;                   //100
+    int thread_num;                 //omp_get_num_threads()
+};
+
+// Collects feature rows added concurrently from an omp parallel loop into per-thread
+// shards and merges them into a sparseK once. With max_num > 0 only a uniform sample
+// of at most max_num rows is kept: every row draws a random key and the rows with the
+// smallest keys survive (bottom-k reservoir), so memory stays around max_num rows.
+class protoAccumulator {
+public:
+    protoAccumulator(size_t max_num_ = 0, int shard_num = omp_get_max_threads());
+    ~protoAccumulator();
+
+    void reserve(size_t num_per_shard);
+    // adds every row of data to the shard of the calling thread
+    void AddData(const cv::Mat &data);
+    void MergeInto(sparseK &cluster);
+
+    size_t getSeenNum() const {return total_seen;}
+
+private:
+    double keyBound(size_t seen) const;         //rows with a bigger key can not be in the final sample
+    
+    struct shardT{
+        std::vector<protoT> protos;
+        std::vector<double> keys;
+        size_t prune_size;
+        unsigned int seed;
+        char pad[64];           //keep the shards of different threads on different cache lines
+    };
+    std::vector<shardT> shards;
+    size_t max_num;             //0: keep every row
+    size_t total_seen;
+};
@@ -0,0 +1,55 @@
+/*
+ * File:   featureCache.h
+ *
+ * On-disk cache of the per-scene stages of spPooler::init()/lightInit() and Hier_Pooler::getHierFea().
+ * Every stage is stored under the content hash of its input and the parameters it depends on:
+ *   <cache_path>/<cloud hash>/normals_<radius>.pcd
+ *   <cache_path>/<cloud hash>/sp_<down_ss and supervoxel params>.{pcd,lbl.pcd,idx}
+ *   <cache_path>/<data hash>/hier_<Hier_Pooler params>.fea
+ * so changing the pooling or SVM parameters reuses all of them, and a changed radius or down_ss
+ * only recomputes the stages that depend on it.
+ */
+
+#ifndef FEATURE_CACHE_H
+#define FEATURE_CACHE_H
+
+#include <stdint.h>
+#include "sp_segmenter/features.h"
+
+// 64-bit FNV-1a, seed with the previous hash to chain several buffers
+uint64_t hashBytes(const void *ptr, size_t len, uint64_t seed = 14695981039346656037ULL);
+uint64_t hashCloud(const pcl::PointCloud<PointT>::Ptr cloud, uint64_t seed = 14695981039346656037ULL);
+uint64_t hashNormals(const pcl::PointCloud<NormalT>::Ptr normals, uint64_t seed = 14695981039346656037ULL);
+std::string hashToString(uint64_t hash);
+
+class featureCache{
+public:
+    // an empty path disables the cache
+    featureCache(std::string cache_path = "");
+    ~featureCache(){}
+
+    bool enabled() const {return cache_path.empty() == false;}
+
+    // normals of a cloud computed with radius
+    bool loadNormals(uint64_t cloud_hash, float radius, pcl::PointCloud<NormalT>::Ptr normals);
+    void saveNormals(uint64_t cloud_hash, float radius, const pcl::PointCloud<NormalT>::Ptr normals);
+
+    // level 0 superpixels of spExt, param_key from spExt::getParamKey()
+    bool loadSuperpixels(uint64_t cloud_hash, std::string param_key, pcl::PointCloud<PointT>::Ptr down_cloud,
+            pcl::PointCloud<PointLT>::Ptr label_cloud, IDXSET &segs_to_cloud, std::multimap<uint32_t, uint32_t> &graph);
+    void saveSuperpixels(uint64_t cloud_hash, std::string param_key, const pcl::PointCloud<PointT>::Ptr down_cloud,
+            const pcl::PointCloud<PointLT>::Ptr label_cloud, const IDXSET &segs_to_cloud, const std::multimap<uint32_t, uint32_t> &graph);
+
+    // same as producer.getHierFea(data, 0), keyed by the cloud, normals and down_cloud of data
+    std::vector<cv::Mat> getHierFea(Hier_Pooler &producer, MulInfoT &data);
+
+private:
+    std::string stagePath(uint64_t hash, std::string name);
+    // write to a temporary file and rename it, so concurrent readers never see a partial stage
+    bool commitFile(std::string tmp_name, std::string name);
+    std::string tmpName(std::string name);
+
+    std::string cache_path;
+};
+
+#endif  /* FEATURE_CACHE_H */
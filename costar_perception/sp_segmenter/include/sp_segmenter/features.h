@@ -9,6 +9,7 @@
 #define FEATURES_H
 
 #include "sp_segmenter/utility/utility.h"
+#include "sp_segmenter/quantizedSVM.h"
 //#include "../omp/ompcore.h"
 
 struct Hypo{
@@ -141,6 +142,15 @@ cv::Mat multiFPFHPool(const std::vector< boost::shared_ptr<Pooler_L0> > &pooler_
 
 std::vector<cv::Mat> multiPool_raw(const std::vector< boost::shared_ptr<Pooler_L0> > &pooler_set, const MulInfoT &inst, const std::vector<cv::Mat> &local_fea);
 
+// Neighborhoods of the pooling centers in compressed sparse row form,
+// the neighbors of center i are idx[ptr[i]] ... idx[ptr[i+1]-1]
+struct NeighborGraph{
+    std::vector<int> ptr;   // rows()+1 offsets into idx
+    std::vector<int> idx;   // point indices of all neighborhoods, concatenated
+    
+    int rows() const {return ptr.empty() ? 0 : ptr.size() - 1;}
+};
+
 class Hier_Pooler{
 public:
     Hier_Pooler(float rad = 0.03);
@@ -151,6 +161,8 @@ public:
     std::vector<cv::Mat> getRawFea(MulInfoT &data, int layer, size_t max_num);
     
     void setRatio(float rr_) {ratio=rr_;}
+    // radius, ratio and a hash of the dictionaries, identifies the output of getHierFea() for featureCache
+    std::string getParamKey() const;
     std::vector<int> LoadDict_L0(std::string path, std::string colorK, std::string depthK, std::string jointK="");
     std::vector<int> LoadDict_L1(std::string dict_path, std::vector<std::string> dictK);
     std::vector<int> LoadDict_L2(std::string dict_path, std::vector<std::string> dictK);
@@ -163,10 +175,18 @@ private:
     void computeRaw_L0(MulInfoT &data, cv::Mat &depth_fea, cv::Mat &color_fea, float rad = 0.03);
     
     
+    // LAB and XYZ neighborhoods within radius[0] and radius[1] of the centers idxs (all points if idxs is empty),
+    // built once and shared by every pool type and layer
+    void buildNeighborGraphs(const MulInfoT &data, const std::vector<size_t> &idxs, const float radius[2], NeighborGraph &lab_graph, NeighborGraph &xyz_graph);
+    // sum or max of the rows of feas over each neighborhood of graph, L2 normalized, one row per center
+    cv::Mat PoolGraph(const NeighborGraph &graph, const cv::Mat &feas, bool max_pool);
+    
     std::vector<cv::Mat> PoolLayer_L1(const MulInfoT &data, const std::vector<cv::Mat> code_L0, std::vector<size_t> idxs, bool max_pool=true);
+    std::vector<cv::Mat> PoolLayer_L1(const NeighborGraph &lab_graph, const NeighborGraph &xyz_graph, const std::vector<cv::Mat> &code_L0, bool max_pool=true);
     std::vector<cv::Mat> EncodeLayer_L1(const std::vector<cv::Mat> rawfea_L1);
     
     std::vector<cv::Mat> PoolLayer_L2(const MulInfoT &data, const std::vector<cv::Mat> code_L1, std::vector<size_t> idxs, bool max_pool=true);
+    std::vector<cv::Mat> PoolLayer_L2(const NeighborGraph &lab_graph, const NeighborGraph &xyz_graph, const std::vector<cv::Mat> &code_L1, bool max_pool=true);
     std::vector<cv::Mat> EncodeLayer_L2(const std::vector<cv::Mat> rawfea_L2);
     
     cv::Mat dict_color_L0, dict_depth_L0, dict_joint_L0;
@@ -202,14 +222,21 @@ public:
     void setCameraParams(float fx_, float fy_, float center_x_, float center_y_);
     void setTarget(size_t label);
     
+    // suppress overlapping hypotheses, e.g. collected over several box sizes, boxes are rescaled to ap_ratio = 1
+    std::vector<Hypo> nonmax_suppress(std::vector<Hypo> &hypo_set);
+    
 private:
     //void CloudOn2D(const MulInfoT &data, cv::Mat &uv, cv::Mat &map2d);
     void Pooling(const cv::Rect &reg, sparseVec &pooled_fea);   
-    std::vector<Hypo> nonmax_suppress(std::vector<Hypo> &hypo_set);
     
     void Reset();
     std::vector<int> getPoolIdx(cv::Mat lab);
     
+    // integral maps of the per-cell model responses w*feature, rebuilt once per frame and model
+    void buildScoreMaps(const model* obj_model);
+    // decision values of the pooled and cell-normalized window, false if the window is empty
+    bool scoreWindow(const cv::Rect &reg, double *dec_values);
+    
     float fx, fy;
     float center_x, center_y;
     int img_w, img_h;
@@ -231,6 +258,15 @@ private:
     
     //change per frame
     std::vector<cv::Mat> int_imgs;  //reset prior to each new coming frame
+    
+    //score maps of the current model, change per frame
+    const model* score_model;
+    int score_nr_w;
+    std::vector<double> score_bias;
+    std::vector<int> cell_s_idx;                //valid dims of cell k are [cell_s_idx[k], cell_s_idx[k+1])
+    std::vector<const float*> valid_int_ptr;    //int_imgs data of each valid dim
+    std::vector<float> valid_w;                 //model weights of each valid dim
+    std::vector<cv::Mat> score_imgs;            //cell k, row i at k*score_nr_w+i
     cv::Mat int_map2d, int_uv;
     pcl::PointCloud<PointT>::Ptr cur_down_cloud;
     
@@ -246,6 +282,12 @@ public:
     pcl::PointCloud<PointT>::Ptr getCloud();
     pcl::PointCloud<PointLT>::Ptr getLabels();
     IDXSET getSegsToCloud();
+    const std::multimap<uint32_t, uint32_t> &getGraph() const {return graph;}
+    // down_ss and superpixel parameters, identifies the level 0 superpixels for featureCache
+    std::string getParamKey() const;
+    // restore level 0 from a previous extraction with the same parameters instead of LoadPointCloud()
+    void setSPLevel0(const pcl::PointCloud<PointT>::Ptr down_cloud_, const pcl::PointCloud<PointLT>::Ptr label_cloud_, 
+                    const IDXSET &segs_to_cloud_, const std::multimap<uint32_t, uint32_t> &graph_);
     
     IDXSET getSPIdx(int level);
     std::vector<pcl::PointCloud<PointT>::Ptr> getSPCloud(int level);
@@ -288,6 +330,8 @@ private:
     void buildOneSPLevel(int level);
 };
 
+class featureCache;
+
 // implementation is at sp.cpp
 class spPooler{
 public:
@@ -300,11 +344,17 @@ public:
     
 //    pcl::PointCloud<PointT>::Ptr semanticSegment(const std::vector<model*> &model_set, int level);
     std::vector<cv::Mat> gethardNegtive(const model *model_set, int level, bool max_pool = false);
+    // hard negatives of level 0..model_set.size()-1 with model_set[level], level 0 is scored first and
+    // higher level superpixels made only of segments rejected by the level 0 model with a decision
+    // margin >= reject_margin are not pooled, the number of skipped superpixels is added to skip_num
+    std::vector< std::vector<cv::Mat> > gethardNegtiveCascade(const std::vector<model*> &model_set, float reject_margin, bool max_pool = false, size_t *skip_num = NULL);
 
     // load the svm model and the order of superpixels level
     // level means order of superpixels for classification
     // right now I only provide level=0,1,2 for classification, 
     void InputSemantics(const model *model_set, int level, bool reset = false, bool max_pool = false);
+    // same as above with the int8 quantized model, see quantizedSVM.h
+    void InputSemantics(const quantizedModel &qmodel, int level, bool reset = false, bool max_pool = false);
 
     // get the result of the SVM
     pcl::PointCloud<PointLT>::Ptr getSemanticLabels();
@@ -315,18 +365,25 @@ public:
     // If not use SIFT pooling!!! Use this light version.
     void lightInit(const pcl::PointCloud<PointT>::Ptr cloud, Hier_Pooler& cshot_producer, float radius, float down_ss = 0.005);
     void reset();
+    // reuse the normals, superpixels and CSHOT features cached on disk in init() and lightInit(), NULL to disable
+    void setCache(featureCache *cache_) {cache = cache_;}
     
     void extractForeground(bool constrained_flag);
     
 private:
     
     pcl::PointCloud<PointT>::Ptr refineScene(const pcl::PointCloud<PointT>::Ptr scene);
+    pcl::PointCloud<NormalT>::Ptr getNormals(const pcl::PointCloud<PointT>::Ptr cloud, uint64_t cloud_hash, float radius);
+    void extractSuperpixels(const pcl::PointCloud<PointT>::Ptr cloud, uint64_t cloud_hash);
 //    std::vector<cv::Mat> combineRawALL(const IDXSET &idx_set, bool max_pool = false);
     std::vector<cv::Mat> combineRaw(const std::vector< std::vector<cv::Mat> > &raw_set, const IDXSET &idx_set, bool max_pool = false, bool normalized = true);
 //    std::vector<cv::Mat> getSPRawFea(const IDXSET &idx_set, bool max_pool);
             
     std::vector<cv::Mat> getSPFea(const IDXSET &idx_set, bool max_pool = false, bool normalized = true);
     
+    void resetResponses(int model_num, bool reset);
+    void updateResponses(const std::vector<int> &idxs, int cur_label, float cur_score);
+    
     MulInfoT data;
     spExt ext_sp;
     
@@ -351,6 +408,7 @@ private:
     bool max_pool_flag;
     
     size_t sp_num;
+    featureCache *cache;
 };
 
 #endif //features_h
\ No newline at end of file
@@ -0,0 +1,328 @@
+//
+//  object_persistence.h
+//
+//  Persistent store of detected objects that is kept across segmentation
+//  calls. Objects are partitioned by model class (integer class id), poses
+//  are updated in place and new detections are matched to the stored objects
+//  with an optimal (Hungarian) assignment instead of a greedy nearest search.
+//
+
+#ifndef object_persistence_h
+#define object_persistence_h
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// objectPose and orientation fixer
+#include "sp_segmenter/spatial_pose.h"
+
+struct persistentObject {
+    objectPose object;      // pose, timestamp, tfName and TF index of the object
+    int classID;            // index of the model class in the store
+    double firstSeen;       // timestamp of the first detection
+    unsigned int age;       // number of updates in which the object was detected
+    unsigned int missed;    // consecutive updates in which the object was not detected
+    std::size_t memberSlot; // position inside the class partition
+};
+
+// Solve the assignment problem for a rows x cols cost matrix with the Hungarian method.
+// Returns for every row the assigned column, or -1 if the row is left unassigned (rows > cols).
+inline std::vector<int> hungarianAssignment(const std::vector<std::vector<double> > &cost)
+{
+    const std::size_t rows = cost.size();
+    const std::size_t cols = rows > 0 ? cost[0].size() : 0;
+    std::vector<int> assignment(rows, -1);
+    if (rows == 0 || cols == 0) return assignment;
+
+    // the solver below needs n <= m, solve the transposed problem otherwise
+    const bool transposed = rows > cols;
+    const std::size_t n = transposed ? cols : rows;
+    const std::size_t m = transposed ? rows : cols;
+
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<double> u(n + 1, 0.), v(m + 1, 0.), minv(m + 1);
+    std::vector<std::size_t> p(m + 1, 0), way(m + 1, 0);
+    std::vector<bool> used(m + 1);
+
+    for (std::size_t i = 1; i <= n; i++)
+    {
+        p[0] = i;
+        std::size_t j0 = 0;
+        std::fill(minv.begin(), minv.end(), inf);
+        std::fill(used.begin(), used.end(), false);
+        do
+        {
+            used[j0] = true;
+            const std::size_t i0 = p[j0];
+            std::size_t j1 = 0;
+            double delta = inf;
+            for (std::size_t j = 1; j <= m; j++)
+            {
+                if (used[j]) continue;
+                const double c = transposed ? cost[j - 1][i0 - 1] : cost[i0 - 1][j - 1];
+                const double cur = c - u[i0] - v[j];
+                if (cur < minv[j]) { minv[j] = cur; way[j] = j0; }
+                if (minv[j] < delta) { delta = minv[j]; j1 = j; }
+            }
+            for (std::size_t j = 0; j <= m; j++)
+            {
+                if (used[j]) { u[p[j]] += delta; v[j] -= delta; }
+                else minv[j] -= delta;
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+
+        do
+        {
+            const std::size_t j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+
+    for (std::size_t j = 1; j <= m; j++)
+    {
+        if (p[j] == 0) continue;
+        if (transposed) assignment[j - 1] = p[j] - 1;
+        else assignment[p[j] - 1] = j - 1;
+    }
+    return assignment;
+}
+
+class objectPersistenceStore
+{
+public:
+    // matchDistance: maximum distance (m) between a stored object and a new detection to be matched
+    // maxMissedUpdates: number of consecutive updates an undetected object is kept before removal
+    objectPersistenceStore(const double &matchDistance = 0.025, const unsigned int &maxMissedUpdates = 0)
+    : matchDistance_(matchDistance), maxMissedUpdates_(maxMissedUpdates) {}
+
+    void setMatchDistance(const double &matchDistance) { matchDistance_ = matchDistance; }
+    void setMaxMissedUpdates(const unsigned int &maxMissedUpdates) { maxMissedUpdates_ = maxMissedUpdates; }
+
+    // return integer id of the model class, registering it if it is new
+    int classID(const std::string &model_name)
+    {
+        std::map<std::string, int>::const_iterator it = classIDs_.find(model_name);
+        if (it != classIDs_.end()) return it->second;
+        int id = classNames_.size();
+        classIDs_[model_name] = id;
+        classNames_.push_back(model_name);
+        classMembers_.push_back(std::vector<std::size_t>());
+        return id;
+    }
+
+    const std::string &className(const int &id) const { return classNames_.at(id); }
+
+    std::size_t size() const { return objects_.size(); }
+    bool empty() const { return objects_.empty(); }
+
+    // live objects are stored contiguously
+    const std::vector<persistentObject> &getAllObjects() const { return objects_; }
+
+    std::vector<poseT> getAllPoses() const
+    {
+        std::vector<poseT> poses;
+        poses.reserve(objects_.size());
+        for (const persistentObject &o : objects_) poses.push_back(o.object.pose);
+        return poses;
+    }
+
+    void clear()
+    {
+        objects_.clear();
+        tfSlot_.clear();
+        for (std::vector<std::size_t> &members : classMembers_) members.clear();
+    }
+
+    // replace the store content with the new poses, normalized to the base rotation
+    void create(const std::map<std::string, objectSymmetry> &objectDict, std::vector<poseT> &all_poses,
+        const double &timestamp, std::map<std::string, unsigned int> &objectTFindex,
+        const Eigen::Quaternion<double> baseRotationInput = Eigen::Quaternion<double>(1,0,0,0))
+    {
+        clear();
+        Eigen::Quaternion<float> baseRotation(baseRotationInput.w(),baseRotationInput.x(),baseRotationInput.y(),baseRotationInput.z());
+        normalizeAllModelOrientation<float>(all_poses, baseRotation, objectDict);
+        for (const poseT &p: all_poses) insertObject(p, timestamp, objectTFindex);
+    }
+
+    // match the new poses to the stored objects of the same class and update them in place
+    void update(const std::map<std::string, objectSymmetry> &objectDict, const std::vector<poseT> &all_poses,
+        const double &timestamp, std::map<std::string, unsigned int> &objectTFindex,
+        const Eigen::Quaternion<double> baseRotationInput = Eigen::Quaternion<double>(1,0,0,0))
+    {
+        std::cerr << "Old store size: " << objects_.size() << std::endl;
+        Eigen::Quaternion<float> baseRotation(baseRotationInput.w(),baseRotationInput.x(),baseRotationInput.y(),baseRotationInput.z());
+
+        // split the new poses by class
+        std::vector<std::vector<std::size_t> > posesPerClass(classMembers_.size());
+        for (std::size_t i = 0; i < all_poses.size(); i++) {
+            std::size_t id = classID(all_poses[i].model_name);
+            if (id >= posesPerClass.size()) posesPerClass.resize(id + 1);
+            posesPerClass[id].push_back(i);
+        }
+        posesPerClass.resize(classMembers_.size());
+
+        std::vector<bool> poseMatched(all_poses.size(), false);
+        std::vector<std::size_t> toRemove;
+        // cost of a gated pair, larger than any valid match
+        const double gatedCost = 1e3 * (matchDistance_ + 1.);
+
+        for (std::size_t c = 0; c < classMembers_.size(); c++)
+        {
+            const std::vector<std::size_t> &members = classMembers_[c];
+            const std::vector<std::size_t> &newPoses = posesPerClass[c];
+            std::vector<int> assignment(members.size(), -1);
+
+            if (!members.empty() && !newPoses.empty())
+            {
+                std::vector<std::vector<double> > cost(members.size(), std::vector<double>(newPoses.size()));
+                for (std::size_t i = 0; i < members.size(); i++)
+                {
+                    const Eigen::Vector3f &oldShift = objects_[members[i]].object.pose.shift;
+                    for (std::size_t j = 0; j < newPoses.size(); j++)
+                    {
+                        double dist = (all_poses[newPoses[j]].shift - oldShift).norm();
+                        cost[i][j] = dist <= matchDistance_ ? dist : gatedCost;
+                    }
+                }
+                assignment = hungarianAssignment(cost);
+                for (std::size_t i = 0; i < members.size(); i++)
+                    if (assignment[i] >= 0 && cost[i][assignment[i]] > matchDistance_) assignment[i] = -1;
+            }
+
+            for (std::size_t i = 0; i < members.size(); i++)
+            {
+                persistentObject &o = objects_[members[i]];
+                if (assignment[i] < 0)
+                {
+                    if (++o.missed > maxMissedUpdates_) toRemove.push_back(members[i]);
+                    continue;
+                }
+                // the pose exists in the store, update it in place
+                const poseT &p = all_poses[newPoses[assignment[i]]];
+                poseMatched[newPoses[assignment[i]]] = true;
+                Eigen::Quaternion<float> rotation = normalizeModelOrientation<float>(p, o.object.pose, objectDict.find(p.model_name)->second);
+                o.object.pose = p;
+                o.object.pose.rotation = rotation;
+                o.object.timestamp = timestamp;
+                o.age++;
+                o.missed = 0;
+            }
+        }
+
+        // remove from the back so that swapped-in objects are never removed twice
+        std::sort(toRemove.rbegin(), toRemove.rend());
+        for (std::size_t slot : toRemove) removeObject(slot);
+
+        // new poses
+        for (std::size_t i = 0; i < all_poses.size(); i++)
+        {
+            if (poseMatched[i]) continue;
+            poseT p = all_poses[i];
+            p.rotation = normalizeModelOrientation<float>(p.rotation, baseRotation, objectDict.find(p.model_name)->second);
+            insertObject(p, timestamp, objectTFindex);
+        }
+        std::cerr << "New store size: " << objects_.size() << std::endl;
+    }
+
+    // update only the object with the given TF name using the first pose of the same class
+    void updateOne(const std::string &tfToUpdate, const std::map<std::string, objectSymmetry> &objectDict,
+        const std::vector<poseT> &all_poses, const double &timestamp,
+        std::map<std::string, unsigned int> &objectTFindex,
+        const Eigen::Quaternion<double> baseRotationInput = Eigen::Quaternion<double>(1,0,0,0))
+    {
+        if (all_poses.size() < 1) {
+            std::cerr << "No poses to use for updating TF data\n";
+            return; //Do nothing
+        }
+
+        std::map<std::string, std::size_t>::const_iterator it = tfSlot_.find(tfToUpdate);
+        if (it == tfSlot_.end())
+        {
+            Eigen::Quaternion<float> baseRotation(baseRotationInput.w(),baseRotationInput.x(),baseRotationInput.y(),baseRotationInput.z());
+            poseT p = all_poses.front();
+            p.rotation = normalizeModelOrientation<float>(p.rotation, baseRotation, objectDict.find(p.model_name)->second);
+            insertObject(p, timestamp, objectTFindex, tfToUpdate);
+            return;
+        }
+
+        persistentObject &o = objects_[it->second];
+        for (const poseT &p: all_poses) {
+            if (p.model_name != o.object.pose.model_name) continue; //Do nothing to pose from different object type
+            // use old orientation as the base rotation
+            Eigen::Quaternion<float> rotation = normalizeModelOrientation<float>(p.rotation, o.object.pose.rotation, objectDict.find(p.model_name)->second);
+            o.object.pose = p;
+            o.object.pose.rotation = rotation;
+            o.object.timestamp = timestamp;
+            o.age++;
+            o.missed = 0;
+            return;
+        }
+        std::cerr << "No pose of type " << o.object.pose.model_name << " found for " << tfToUpdate << std::endl;
+    }
+
+private:
+    void insertObject(const poseT &p, const double &timestamp, std::map<std::string, unsigned int> &objectTFindex,
+        const std::string &tfName = std::string())
+    {
+        persistentObject o;
+        o.object.pose = p;
+        o.object.timestamp = timestamp;
+        o.object.index = ++objectTFindex[p.model_name];
+        if (tfName.empty())
+        {
+            std::stringstream child;
+            // Does not have tracking yet, can not keep the label on object.
+            child << "obj_" << p.model_name << "_" << o.object.index;
+            o.object.tfName = child.str();
+        }
+        else o.object.tfName = tfName;
+        o.classID = classID(p.model_name);
+        o.firstSeen = timestamp;
+        o.age = 1;
+        o.missed = 0;
+
+        std::vector<std::size_t> &members = classMembers_[o.classID];
+        o.memberSlot = members.size();
+        members.push_back(objects_.size());
+        tfSlot_[o.object.tfName] = objects_.size();
+        objects_.push_back(o);
+    }
+
+    // swap the object with the last one and pop, keeping the storage dense
+    void removeObject(const std::size_t &slot)
+    {
+        persistentObject &o = objects_[slot];
+        std::vector<std::size_t> &members = classMembers_[o.classID];
+        objects_[members.back()].memberSlot = o.memberSlot;
+        members[o.memberSlot] = members.back();
+        members.pop_back();
+        tfSlot_.erase(o.object.tfName);
+
+        const std::size_t last = objects_.size() - 1;
+        if (slot != last)
+        {
+            objects_[slot] = objects_[last];
+            const persistentObject &moved = objects_[slot];
+            classMembers_[moved.classID][moved.memberSlot] = slot;
+            tfSlot_[moved.object.tfName] = slot;
+        }
+        objects_.pop_back();
+    }
+
+    double matchDistance_;
+    unsigned int maxMissedUpdates_;
+
+    std::vector<persistentObject> objects_;
+    std::vector<std::vector<std::size_t> > classMembers_;
+    std::map<std::string, int> classIDs_;
+    std::vector<std::string> classNames_;
+    std::map<std::string, std::size_t> tfSlot_;
+};
+
+#endif /* object_persistence_h */
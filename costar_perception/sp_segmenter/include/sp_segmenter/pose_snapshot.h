@@ -0,0 +1,97 @@
+//
+//  pose_snapshot.h
+//
+//  Double buffered snapshot of the latest segmented object poses, shared
+//  in process between the segmentation services, the TF publisher loop and
+//  the tracker. The single writer fills the inactive buffer and flips it in
+//  with one atomic store (RCU style), readers copy the active buffer without
+//  taking a lock. Every snapshot carries a version, so readers can skip the
+//  copy when nothing changed since their last read.
+//
+
+#ifndef pose_snapshot_h
+#define pose_snapshot_h
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ros/ros.h>
+
+#include "sp_segmenter/utility/utility.h"
+
+struct objectPoseSnapshot
+{
+    unsigned long version; // 0 until the first snapshot is published
+    ros::Time stamp; // stamp of the point cloud the poses were found in
+    std::string frame_id; // frame of the poses
+    std::vector<poseT> poses; // object poses in frame_id
+    std::vector<std::string> tfNames; // TF frame of each pose
+    bool seedTracker; // true if the tracker should seed new tracking points from these poses
+
+    objectPoseSnapshot() : version(0), seedTracker(false) {}
+};
+
+class objectPoseSnapshotBuffer
+{
+private:
+    objectPoseSnapshot buffers[2];
+    std::atomic<unsigned int> active; // buffer that readers use
+    std::atomic<unsigned long> latestVersion;
+    mutable std::atomic<int> readers[2]; // readers inside each buffer
+
+public:
+    objectPoseSnapshotBuffer() : active(0), latestVersion(0)
+    {
+        readers[0] = 0;
+        readers[1] = 0;
+    }
+
+    // version of the newest snapshot, 0 if there is none yet
+    unsigned long version() const { return latestVersion.load(); }
+
+    // Publish a new snapshot and return its version. There must be only one
+    // writer at a time, semanticSegmentation publishes while holding objectMutex.
+    unsigned long publish(const objectPoseSnapshot &snapshot)
+    {
+        const unsigned int next = 1 - active.load();
+
+        // grace period: readers that entered the inactive buffer before the last flip have to leave it
+        while (readers[next].load() > 0)
+            std::this_thread::yield();
+
+        buffers[next] = snapshot;
+        buffers[next].version = latestVersion.load() + 1;
+        active.store(next);
+        latestVersion.store(buffers[next].version);
+        return buffers[next].version;
+    }
+
+    // Copy the newest snapshot into out if its version differs from lastVersion.
+    // Returns false and leaves out untouched if there is no newer snapshot.
+    bool read(objectPoseSnapshot &out, const unsigned long &lastVersion = 0) const
+    {
+        if (latestVersion.load() == lastVersion)
+            return false;
+
+        unsigned int current;
+        while (true)
+        {
+            current = active.load();
+            readers[current]++;
+            // the writer may have flipped in between, then this buffer is about to be overwritten
+            if (active.load() == current)
+                break;
+            readers[current]--;
+        }
+
+        bool changed = buffers[current].version != lastVersion;
+        if (changed)
+            out = buffers[current];
+        readers[current]--;
+        return changed;
+    }
+};
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * File:   quantizedSVM.h
+ *
+ * int8 quantized linear SVM for superpixel classification.
+ * Features and weights are stored as int8 with one float scale per block of
+ * QUANT_BLOCK values, dot products are accumulated in int32.
+ */
+
+#ifndef QUANTIZED_SVM_H
+#define QUANTIZED_SVM_H
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "liblinear/linear.h"
+
+#define QUANT_BLOCK 32
+
+// int8 feature vector, padded with zeros to a multiple of QUANT_BLOCK
+struct quantizedFea
+{
+    std::vector<int8_t> data;
+    std::vector<float> scale;       // one scale per block
+};
+
+void quantizeFea(const float *fea, int dim, quantizedFea &qfea);
+void quantizeFea(const cv::Mat &fea, quantizedFea &qfea);
+
+// dot product of two int8 blocks of QUANT_BLOCK values
+int32_t dotInt8Block(const int8_t *a, const int8_t *b);
+
+class quantizedModel{
+public:
+    quantizedModel();
+    quantizedModel(const model *cur_model);
+    ~quantizedModel(){}
+
+    // quantize the weights of a liblinear model trained on dense features plus the bias column
+    void build(const model *cur_model);
+    bool empty() const {return dim <= 0;}
+
+    int getNrClass() const {return nr_class;}
+    int getDim() const {return dim;}
+
+    // same label and decision values as predict_values() of liblinear
+    double predictValues(const quantizedFea &qfea, double *dec_values) const;
+
+private:
+    int nr_class;
+    int nr_w;
+    int dim;                        // feature dimension without the bias column
+    int block_num;
+    std::vector<int> label;
+    std::vector<int8_t> weights;    // nr_w rows of block_num*QUANT_BLOCK
+    std::vector<float> scales;      // nr_w rows of block_num
+    std::vector<double> bias;       // bias contribution of each row
+};
+
+// report the accuracy of the float and the quantized model on a problem (e.g. a held-out set)
+// returns quantized accuracy - float accuracy
+double evalQuantizedModel(const model *cur_model, const quantizedModel &qmodel, const problem &prob);
+
+#endif  /* QUANTIZED_SVM_H */
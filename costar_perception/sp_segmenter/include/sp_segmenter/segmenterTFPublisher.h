@@ -0,0 +1,72 @@
+#ifndef SP_TF_PUBLISHER
+#define SP_TF_PUBLISHER
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+#include <tf/transform_broadcaster.h>
+
+#include "sp_segmenter/segmenterTFObject.h"
+
+// Keeps the stamped transforms of all segmented objects between publications
+// and sends them as one tf message. Object parameters are written to the
+// parameter server only when they change.
+class segmentedObjectTFPublisher
+{
+private:
+    std::vector<tf::StampedTransform> transforms;
+    std::string parent;
+    std::map<std::string, std::string> publishedParams;
+public:
+
+    // rebuild the cached transforms, only needed when the objects or the parent frame change
+    void setObjects(const std::vector<segmentedObjectTF> &objects, const std::string &parent)
+    {
+        this->parent = parent;
+        transforms.clear();
+        transforms.reserve(objects.size());
+        for (std::size_t i = 0; i < objects.size(); i++)
+            transforms.push_back(objects.at(i).generateStampedTransform(parent));
+    }
+
+    const std::string &getParent() const { return parent; }
+
+    // restamp the cached transforms and broadcast them in a single message
+    void publish(tf::TransformBroadcaster &br)
+    {
+        if (transforms.empty()) return;
+        const ros::Time now = ros::Time::now();
+        for (std::size_t i = 0; i < transforms.size(); i++)
+            transforms[i].stamp_ = now;
+        br.sendTransform(transforms);
+    }
+
+    // remove the entries left under the namespace by a previous run, called once at startup
+    void clearParams(const std::string &paramNamespace)
+    {
+        ros::param::del(paramNamespace);
+        publishedParams.clear();
+    }
+
+    // write the new parameters, deleting the ones that are no longer present
+    void updateParams(const std::map<std::string, std::string> &params)
+    {
+        for (std::map<std::string, std::string>::const_iterator it = publishedParams.begin(); it != publishedParams.end(); ++it)
+        {
+            if (params.find(it->first) == params.end())
+                ros::param::del(it->first);
+        }
+
+        for (std::map<std::string, std::string>::const_iterator it = params.begin(); it != params.end(); ++it)
+        {
+            std::map<std::string, std::string>::const_iterator old = publishedParams.find(it->first);
+            if (old == publishedParams.end() || old->second != it->second)
+                ros::param::set(it->first, it->second);
+        }
+        publishedParams = params;
+    }
+};
+
+#endif
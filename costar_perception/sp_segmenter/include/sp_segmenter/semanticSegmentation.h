@@ -23,6 +23,8 @@
 #include <tf/transform_listener.h>
 #include <tf_conversions/tf_eigen.h>
 
+#include <boost/thread/mutex.hpp>
+
 #include <costar_objrec_msgs/DetectedObject.h>
 #include <costar_objrec_msgs/DetectedObjectList.h>
 
@@ -32,15 +34,29 @@
 // chi objrec ransac utils
 #include <eigen3/Eigen/src/Geometry/Quaternion.h>
 // contains function to normalize the orientation of symmetric object
-#include "sp_segmenter/spatial_pose.h"
+#include "sp_segmenter/object_persistence.h"
 //#include "sp_segmenter/symmetricOrientationRealignment.h"
 #include "sp_segmenter/table_segmenter.h"
 
 // ros service messages for segmenting gripper
 #include "sp_segmenter/segmentInGripper.h"
 #include "sp_segmenter/segmenterTFObject.h"
+#include "sp_segmenter/segmenterTFPublisher.h"
+#include "sp_segmenter/pose_snapshot.h"
 
 #define OBJECT_MAX 100
+
+// per request state, so that table and gripper requests can run concurrently
+struct segmentationContext
+{
+    sensor_msgs::PointCloud2ConstPtr inputCloud; // the cloud this request works on
+    std::string objRecRANSACdetector;
+    bool doingGripperSegmentation;
+    std::string targetTFtoUpdate;
+
+    segmentationContext() : doingGripperSegmentation(false) {}
+};
+
 class semanticSegmentation
 {
 private:
@@ -48,15 +64,18 @@ private:
     
     bool classReady, useTFinsteadOfPoses;
     // TF related
-    bool hasTF, doingGripperSegmentation;
+    bool hasTF;
     bool useObjectPersistence;
-    objectRtree segmentedObjectTree;
+    objectPersistenceStore segmentedObjectTree;
 
-    // std::vector<value> sp_segmenter_detectedPoses; // value: std::pair<point3d,objectPose>. see spatial_pose.h
     std::string targetNormalObjectTF;
-    std::string targetTFtoUpdate;
     bool setObjectOrientationTarget;
     std::vector<segmentedObjectTF> segmentedObjectTFV;
+    segmentedObjectTFPublisher tfPublisher;
+
+    // latest object poses for publishTF and the tracker, published after every segmentation
+    objectPoseSnapshotBuffer poseSnapshot;
+    objectPoseSnapshot publishedTFSnapshot; // only used by publishTF
 
     // TODO(ahundt): re-enable this to use previous positions of each object
     // the object poses result in TF. depreciate, used TF instead
@@ -80,8 +99,14 @@ private:
     ros::ServiceServer segmentGripper;
     bool useBinarySVM, useMultiClassSVM;
     
+    // objectMutex protects the object tree, TF index and TF publication
+    // cloudMutex protects the cached point clouds
+    // tableMutex protects haveTable, tableConvexHull, table_transform and table_corner_published,
+    // the hull is replaced and never modified once it is set
+    boost::mutex objectMutex, cloudMutex, tableMutex;
+
     // Point cloud related
-    sensor_msgs::PointCloud2 inputCloud; // cache the point cloud
+    sensor_msgs::PointCloud2ConstPtr inputCloud; // cache the point cloud
     pcl::PointCloud<PointT>::Ptr tableConvexHull; // for object in table segmentation
     double aboveTableMin, aboveTableMax; // point cloud need to be this value above the table in meters
 
@@ -100,6 +125,9 @@ private:
     std::vector< boost::shared_ptr<Pooler_L0> > lab_pooler_set;
     std::vector<model*> binary_models;
     std::vector<model*> multi_models;
+    bool useQuantizedSVM;
+    std::vector<quantizedModel> binary_qmodels;
+    std::vector<quantizedModel> multi_qmodels;
     float radius, ratio;
     float down_ss;
     double pairWidth;
@@ -109,6 +137,9 @@ private:
     
     std::vector<boost::shared_ptr<greedyObjRansac> > objrec;
     boost::shared_ptr<greedyObjRansac> combinedObjRec;
+    // ObjRecRANSAC keeps its recognition state internally, one request at a time per detector
+    std::vector<boost::shared_ptr<boost::mutex> > objrecMutex;
+    boost::mutex combinedObjRecMutex;
     std::vector<std::string> model_name;
     std::vector<ModelT> mesh_set;
     
@@ -129,11 +160,15 @@ private:
    
 protected:
 //    void visualizeLabels(const pcl::PointCloud<PointLT>::Ptr label_cloud, pcl::visualization::PCLVisualizer::Ptr viewer, uchar colors[][3]);
-    std::vector<poseT> spSegmenterCallback(const pcl::PointCloud<PointT>::Ptr full_cloud, pcl::PointCloud<PointLT> & final_cloud);
+    std::vector<poseT> spSegmenterCallback(const segmentationContext &context, const pcl::PointCloud<PointT>::Ptr full_cloud, pcl::PointCloud<PointLT> & final_cloud);
     bool getAndSaveTable (const sensor_msgs::PointCloud2 &pc);
-    void updateCloudData (const sensor_msgs::PointCloud2 &pc);
+    // finds the table if there is none yet and publishes its corners once, false while there is no table
+    bool updateTable (const sensor_msgs::PointCloud2 &pc);
+    // snapshot of the table for one segmentation, false if there is no table yet
+    bool getTable (pcl::PointCloud<PointT>::Ptr &hull, tf::Transform &transform);
+    void updateCloudData (const sensor_msgs::PointCloud2ConstPtr &pc);
     void initializeSemanticSegmentation();
-    void populateTFMapFromTree();
+    void populateTFMapFromTree(const std::string &frame_id, const ros::Time &stamp, const bool &seedTracker);
     void cropPointCloud(pcl::PointCloud<PointT>::Ptr &cloud_input, 
       const Eigen::Affine3f& camera_tf_in_table, 
       const Eigen::Vector3f& box_size);
@@ -143,7 +178,7 @@ public:
     ~semanticSegmentation();
     void setNodeHandle(const ros::NodeHandle &nh);
     void publishTF();
-    void callbackPoses(const sensor_msgs::PointCloud2 &inputCloud);
+    void callbackPoses(const sensor_msgs::PointCloud2ConstPtr &inputCloud);
     bool serviceCallback (std_srvs::Empty::Request& request, std_srvs::Empty::Response& response);
     bool serviceCallbackGripper (sp_segmenter::segmentInGripper::Request & request, sp_segmenter::segmentInGripper::Response& response);
 };
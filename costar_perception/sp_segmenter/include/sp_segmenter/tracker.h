@@ -18,6 +18,7 @@
 #include <tf/transform_broadcaster.h>
 
 #include "sp_segmenter/klttracker.h"
+#include "sp_segmenter/pose_snapshot.h"
 #include "sp_segmenter/utility/utility.h"
 
 class Tracker
@@ -27,6 +28,8 @@ class Tracker
   bool addTracker(const ModelT& mesh);
   void generateTrackingPoints(ros::Time stamp,
     const std::vector<poseT>& poses);
+  // new snapshots of this buffer seed the trackers from the seeding thread
+  void setPoseSnapshot(const objectPoseSnapshotBuffer* snapshot);
 
   private:
 
@@ -49,6 +52,7 @@ class Tracker
   void publishTf(const Eigen::Matrix4f& tf, std::string name, std::string base_frame, 
     ros::Time stamp);
   void monitorQueue();
+  void monitorSnapshot();
   void cameraInfoCallback(const sensor_msgs::CameraInfoConstPtr &ci);
   void imageCallback(const sensor_msgs::ImageConstPtr &im);
   void depthImageCallback(const sensor_msgs::ImageConstPtr &dep);
@@ -60,12 +64,15 @@ class Tracker
   ros::Subscriber cam_info_sub, image_sub, depth_image_sub;
   sensor_msgs::CameraInfo cam_info;
 
-  boost::thread callback_thread;
+  boost::thread callback_thread, seed_thread;
   boost::mutex klt_mutex, history_mutex, track_time_mutex;
   ros::CallbackQueue callback_queue;
 
   TrackingMap trackers; ///> map from model names to trackers
 
+  std::atomic<const objectPoseSnapshotBuffer*> pose_snapshot; ///> source of the seeding poses
+  objectPoseSnapshot seed_snapshot; ///> last snapshot read for seeding, only used by the seeding thread
+
   std::vector<std::pair<ros::Time, cv::Mat> > image_history;
   std::vector<std::pair<ros::Time, cv::Mat> > depth_history;
 
@@ -0,0 +1,60 @@
+/*
+ * File:   bitClique.h
+ *
+ * Maximum clique search on a bitset adjacency matrix (branch and bound with greedy coloring
+ * bounds computed on bitsets). The top-level branches are searched in parallel with a shared
+ * incumbent, and an optional time budget stops the search with the best clique found so far.
+ * The size of the returned clique is exact when the search completes; among cliques of equal
+ * size the one returned may differ between runs.
+ */
+
+#ifndef BIT_CLIQUE_H
+#define BIT_CLIQUE_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+class bitClique{
+public:
+    bitClique(int num);
+    ~bitClique(){}
+
+    // undirected edge, self loops are ignored
+    void addEdge(int i, int j);
+    bool connected(int i, int j) const {return (adj[i * word_num + (j >> 6)] >> (j & 63)) & 1;}
+    int size() const {return num;}
+
+    // time_budget in seconds, <= 0 for no limit; complete is set to false if the budget ran out
+    std::vector<int> solve(double time_budget = -1, bool *complete = NULL);
+
+private:
+    // per-thread search buffers
+    struct searchState{
+        std::vector<int> cur;
+        std::vector< std::vector<uint64_t> > cand;     // candidate set of each depth
+        std::vector< std::vector<int> > order;         // vertices of each depth in color order
+        std::vector< std::vector<int> > colors;
+        std::vector<uint64_t> uncolored, color_class;  // scratch of colorSort()
+        long nodes;
+    };
+
+    void colorSort(const std::vector<uint64_t> &P, std::vector<int> &order, std::vector<int> &colors, searchState &st) const;
+    void expand(int depth, searchState &st);
+    bool timeUp(searchState &st);
+    void updateBest(const std::vector<int> &cur);
+
+    int num;
+    int word_num;
+    std::vector<uint64_t> adj;          // input adjacency, word_num words per row
+
+    // shared by the search threads
+    std::vector<int> perm;              // reordered vertex -> input vertex
+    std::vector<uint64_t> radj;         // adjacency of the reordered vertices
+    std::vector<int> best;
+    int best_size;
+    bool abort_flag;
+    double deadline;
+};
+
+#endif  /* BIT_CLIQUE_H */
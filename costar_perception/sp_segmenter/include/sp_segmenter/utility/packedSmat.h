@@ -0,0 +1,57 @@
+/*
+ * File:   packedSmat.h
+ *
+ * Packed CSR version of the .smat files written by saveCvMatSparse().
+ * The rows are stored as liblinear feature_node arrays, already terminated by the
+ * bias term and the end node of FormFeaSparseMat(), so a memory-mapped file can be
+ * handed to liblinear without copying any row.
+ *
+ * Layout: magic[8], node size, rows, cols, node num (uint64),
+ *         row offsets (rows+1 uint64, in nodes), feature_node[node num]
+ */
+
+#ifndef PACKED_SMAT_H
+#define PACKED_SMAT_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "liblinear/linear.h"
+
+// convert an .smat file into the packed format, keeping only the column pieces in inds (all if empty)
+// the columns are renumbered as readSoluSparse_piecewise() does, returns the number of rows or -1
+long packSmat(std::string smat_name, std::string packed_name, const std::vector< std::pair<int, int> > &inds);
+
+class packedSmat{
+public:
+    packedSmat();
+    ~packedSmat();
+
+    // map the file read-only (copy-on-write), returns false if it is missing or not a packed file
+    bool open(std::string filename);
+    void close();
+
+    size_t getRows() const {return rows;}
+    size_t getCols() const {return cols;}
+
+    // the row ends with the bias term (index cols+1, value -1) and the end node (index -1)
+    feature_node *getRow(size_t r) const {return nodes + row_ptr[r];}
+
+private:
+    packedSmat(const packedSmat &);
+    packedSmat &operator=(const packedSmat &);
+
+    void *map_ptr;
+    size_t map_len;
+    size_t rows;
+    size_t cols;
+    const uint64_t *row_ptr;
+    feature_node *nodes;
+};
+
+// form a liblinear problem from the rows [r1, r2) of each mapped file, only prob.x and prob.y
+// are allocated (free them with free()), the rows point into the mappings that must stay open
+// r2 < 0 means until the last row
+void FormPackedProblem(const std::vector<packedSmat*> &mats, const std::vector<int> &labels, problem &prob, long r1 = 0, long r2 = -1);
+
+#endif  /* PACKED_SMAT_H */
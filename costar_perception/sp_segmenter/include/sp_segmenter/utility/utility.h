@@ -1,6 +1,7 @@
 #pragma once
 #include "typedef.h"
 #include "mcqd.h"
+#include "bitClique.h"
 #include "liblinear/linear.h"
 
 #define MAX_SEGMENT 100
@@ -110,6 +111,8 @@ void transformKeys(std::vector<keyT> &keys, const Eigen::Matrix4f &trans);
 pcl::PointCloud<myPointXYZ>::Ptr uniformSampleCloud(const pcl::PointCloud<myPointXYZ>::Ptr cloud, int num);
 
 std::vector< std::vector<int> > maximalClique(const Eigen::MatrixXi &adj_mat);
+// time_budget in seconds shared by the whole call, <= 0 for an exact search
+std::vector< std::vector<int> > maximalClique(const Eigen::MatrixXi &adj_mat, double time_budget);
 
 void saveUndirectedGraph(const Eigen::MatrixXi &adj, std::string filename);
 
@@ -138,6 +141,28 @@ void saveCvMatSparse(std::string filename, const cv::Mat &data);
 
 void saveCvMatSparse(std::string filename, const std::vector< sparseVec> &data, int dim);
 
+// writes the same file as saveCvMatSparse() one row at a time, the header is patched by close()
+// not thread-safe, guard append() when rows come from several threads
+class smatWriter{
+public:
+    smatWriter();
+    ~smatWriter();
+    
+    bool open(std::string filename);
+    // a 1 x cols row, all rows must have the same number of columns
+    void append(const cv::Mat &row);
+    // returns the number of rows written, the file is removed if no row was written
+    size_t close();
+    
+    size_t getRows() const {return rows;}
+private:
+    std::string filename;
+    std::ofstream out;
+    size_t cols;
+    size_t rows;
+    size_t num;
+};
+
 void GenSVMParamter(parameter &param, float CC);
 
 void saveCvMatSparse(std::string filename, const cv::Mat &data);
@@ -1,6 +1,11 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
 #include <opencv2/core/core.hpp>
 
 #include "sp_segmenter/features.h"
+#include "sp_segmenter/featureCache.h"
 
 Hier_Pooler::Hier_Pooler(float rad)
 {
@@ -12,11 +17,33 @@ Hier_Pooler::Hier_Pooler(float rad)
     pool_type_num = 4;
     
     pool_radius_L0 = rad;
+    pool_radius_L1[0] = 0.05;
+    pool_radius_L1[1] = 0.05;
+    pool_radius_L2[0] = 0.05;
+    pool_radius_L2[1] = 0.05;
     ratio = 0;  //ratio = 0.05;
 }
 
 Hier_Pooler::~Hier_Pooler(){}
 
+std::string Hier_Pooler::getParamKey() const
+{
+    const cv::Mat *dicts[3] = {&dict_color_L0, &dict_depth_L0, &dict_joint_L0};
+    uint64_t dict_hash = hashBytes(NULL, 0);
+    for( int i = 0 ; i < 3 ; i++ )
+    {
+        cv::Mat cur_dict = dicts[i]->isContinuous() ? *dicts[i] : dicts[i]->clone();
+        int dims[2] = {cur_dict.rows, cur_dict.cols};
+        dict_hash = hashBytes(dims, sizeof(dims), dict_hash);
+        if( cur_dict.empty() == false )
+            dict_hash = hashBytes(cur_dict.data, cur_dict.total() * cur_dict.elemSize(), dict_hash);
+    }
+    
+    std::stringstream ss;
+    ss << "r" << pool_radius_L0 << "_rt" << ratio << "_d" << hashToString(dict_hash);
+    return ss.str();
+}
+
 std::vector<int> Hier_Pooler::LoadDict_L0(std::string dict_path, std::string colorK, std::string depthK, std::string jointK)
 {
     int tmp;
@@ -156,95 +183,126 @@ std::vector<cv::Mat> Hier_Pooler::EncodeLayer_L0(const cv::Mat &depth_fea, const
     return fea_codes;
 }
 
-std::vector<cv::Mat> Hier_Pooler::PoolLayer_L1(const MulInfoT &data, const std::vector<cv::Mat> code_L0, std::vector<size_t> idxs, bool max_pool)
+void Hier_Pooler::buildNeighborGraphs(const MulInfoT &data, const std::vector<size_t> &idxs, const float radius[2], NeighborGraph &lab_graph, NeighborGraph &xyz_graph)
 {
-    int num;
-    bool subsampling = false;
-    if( idxs.empty() == true )
-        num = data.cloud->size();
-    else
-    {
-        subsampling = true;
-        num = idxs.size();
-    }
-    pcl::PointCloud<PointT>::ConstPtr temp_ptr = data.xyz_tree->getInputCloud();
-    int total_num = temp_ptr->size();
+    int num = idxs.empty() == true ? data.cloud->size() : idxs.size();
     
-    // Build Neighborhood Index
+    // Build Neighborhood Index, the searches of different centers are independent
     std::vector< std::vector<int> > lab_neighs(num);
     std::vector< std::vector<int> > xyz_neighs(num);
     
-    cv::Mat lab_ptr = data.rgb;
-    for( int i = 0 ; i < num ; i++ )
+    const cv::Mat &lab_ptr = data.rgb;
+    #pragma omp parallel
     {
-        int cur_idx = subsampling == true ? idxs[i] : i;
-        
-        myPointXYZ cur_lab_elem;
-        cur_lab_elem.x = lab_ptr.at<float>(cur_idx, 0);
-        cur_lab_elem.y = lab_ptr.at<float>(cur_idx, 1);
-        cur_lab_elem.z = lab_ptr.at<float>(cur_idx, 2);
-        
-        std::vector<float> cur_lab_dists;
-        std::vector<int> cur_lab_neighs;
-        data.lab_tree->radiusSearch(cur_lab_elem, pool_radius_L1[0], cur_lab_neighs, cur_lab_dists, total_num);
-        lab_neighs[i] = cur_lab_neighs;    
+        std::vector<float> cur_dists;
+        #pragma omp for schedule(dynamic, 64)
+        for( int i = 0 ; i < num ; i++ )
+        {
+            int cur_idx = idxs.empty() == true ? i : idxs[i];
+            
+            myPointXYZ cur_lab_elem;
+            cur_lab_elem.x = lab_ptr.at<float>(cur_idx, 0);
+            cur_lab_elem.y = lab_ptr.at<float>(cur_idx, 1);
+            cur_lab_elem.z = lab_ptr.at<float>(cur_idx, 2);
+            
+            // max_nn = 0 returns all neighbors within the radius
+            data.lab_tree->radiusSearch(cur_lab_elem, radius[0], lab_neighs[i], cur_dists, 0);
+            data.xyz_tree->radiusSearch(data.cloud->at(cur_idx), radius[1], xyz_neighs[i], cur_dists, 0);
+        }
+    }
+    
+    // Pack into CSR
+    std::vector< std::vector<int> > *neighs[2] = {&lab_neighs, &xyz_neighs};
+    NeighborGraph *graphs[2] = {&lab_graph, &xyz_graph};
+    for( int k = 0 ; k < 2 ; k++ )
+    {
+        NeighborGraph &graph = *graphs[k];
+        graph.ptr.resize(num + 1);
+        graph.ptr[0] = 0;
+        for( int i = 0 ; i < num ; i++ )
+            graph.ptr[i+1] = graph.ptr[i] + neighs[k]->at(i).size();
         
-        std::vector<float> cur_xyz_dists;
-        std::vector<int> cur_xyz_neighs;
-        data.xyz_tree->radiusSearch(data.cloud->at(cur_idx), pool_radius_L1[1], cur_xyz_neighs, cur_xyz_dists, total_num);
-        xyz_neighs[i] = cur_xyz_neighs;
+        graph.idx.resize(graph.ptr[num]);
+        #pragma omp parallel for
+        for( int i = 0 ; i < num ; i++ )
+        {
+            std::copy(neighs[k]->at(i).begin(), neighs[k]->at(i).end(), graph.idx.begin() + graph.ptr[i]);
+            std::vector<int>().swap(neighs[k]->at(i));
+        }
+    }
+}
+
+cv::Mat Hier_Pooler::PoolGraph(const NeighborGraph &graph, const cv::Mat &feas, bool max_pool)
+{
+    int num = graph.rows();
+    int dim = feas.cols;
+    cv::Mat pooled = cv::Mat::zeros(num, dim, CV_32FC1);
+    
+    // sparse (graph) times dense (feas) product, with max instead of sum for max pooling
+    #pragma omp parallel for schedule(dynamic, 64)
+    for( int i = 0 ; i < num ; i++ )
+    {
+        float *out = pooled.ptr<float>(i);
+        for( int k = graph.ptr[i] ; k < graph.ptr[i+1] ; k++ )
+        {
+            const float *in = feas.ptr<float>(graph.idx[k]);
+            if( max_pool == false )
+            {
+                for( int d = 0 ; d < dim ; d++ )
+                    out[d] += in[d];
+            }
+            else
+            {
+                for( int d = 0 ; d < dim ; d++ )
+                    if( in[d] > out[d] )
+                        out[d] = in[d];
+            }
+        }
         
-        //std::cerr << cur_lab_neighs.size() << " " << cur_xyz_neighs.size() << " " << total_num << std::endl;
-        //std::cin.get();
+        // Normalize Pool Raw Vector, same as cv::normalize
+        double norm = 0;
+        for( int d = 0 ; d < dim ; d++ )
+            norm += out[d] * out[d];
+        norm = sqrt(norm);
+        float scale = norm > DBL_EPSILON ? 1.0 / norm : 0;
+        for( int d = 0 ; d < dim ; d++ )
+            out[d] *= scale;
     }
     
+    return pooled;
+}
+
+std::vector<cv::Mat> Hier_Pooler::PoolLayer_L1(const MulInfoT &data, const std::vector<cv::Mat> code_L0, std::vector<size_t> idxs, bool max_pool)
+{
+    NeighborGraph lab_graph, xyz_graph;
+    buildNeighborGraphs(data, idxs, pool_radius_L1, lab_graph, xyz_graph);
+    
+    return PoolLayer_L1(lab_graph, xyz_graph, code_L0, max_pool);
+}
+
+std::vector<cv::Mat> Hier_Pooler::PoolLayer_L1(const NeighborGraph &lab_graph, const NeighborGraph &xyz_graph, const std::vector<cv::Mat> &code_L0, bool max_pool)
+{
     std::vector<cv::Mat> raw_fea_L1(pool_type_num);
     for( int j = 0 ; j < pool_type_num ; j++ )
     {
-        cv::Mat feas;
-        std::vector< std::vector<int> > *neighs;
         if( pool_flag[j] == true)
         {
             switch(j)
             {
                 case 0:
-                    feas = code_L0[1];  //color_fea -> lab
-                    neighs = &lab_neighs;
+                    raw_fea_L1[j] = PoolGraph(lab_graph, code_L0[1], max_pool);     //color_fea -> lab
                     break;
                 case 1:
-                    feas = code_L0[0];  //depth_fea -> lab
-                    neighs = &lab_neighs;
+                    raw_fea_L1[j] = PoolGraph(lab_graph, code_L0[0], max_pool);     //depth_fea -> lab
                     break;
                 case 2:
-                    feas = code_L0[1];  //color_fea -> xyz
-                    neighs = &xyz_neighs;
+                    raw_fea_L1[j] = PoolGraph(xyz_graph, code_L0[1], max_pool);     //color_fea -> xyz
                     break;
                 case 3:
-                    feas = code_L0[0];  //depth_fea -> xyz
-                    neighs = &xyz_neighs;
+                    raw_fea_L1[j] = PoolGraph(xyz_graph, code_L0[0], max_pool);     //depth_fea -> xyz
                     break;
                 default:break;
             }
-            
-            // Pool L0 Features
-            std::vector<cv::Mat> raw_fea_L1_vec(num);
-            for( int i = 0 ; i < num ; i++ )
-            {
-                cv::Mat temp_fea = cv::Mat::zeros(1, feas.cols, CV_32FC1);
-               
-                for(std::vector<int>::iterator it_n = neighs->at(i).begin(); it_n < neighs->at(i).end() ; it_n++ )
-                {
-                    if( max_pool == false )
-                        temp_fea += feas.row(*it_n);
-                    else 
-                        MaxOP(temp_fea, feas.row(*it_n));
-                }  
-                // Normalize Pool Raw Vector
-                cv::normalize(temp_fea, temp_fea);
-                raw_fea_L1_vec[i] = temp_fea;
-            }
-            
-            cv::vconcat(raw_fea_L1_vec, raw_fea_L1[j]);
         }
     }
     
@@ -253,93 +311,35 @@ std::vector<cv::Mat> Hier_Pooler::PoolLayer_L1(const MulInfoT &data, const std::
 
 std::vector<cv::Mat> Hier_Pooler::PoolLayer_L2(const MulInfoT &data, const std::vector<cv::Mat> code_L1, std::vector<size_t> idxs, bool max_pool)
 {
-    int num;
-    bool subsampling = false;
-    if( idxs.empty() == true )
-        num = data.cloud->size();
-    else
-    {
-        subsampling = true;
-        num = idxs.size();
-    }
-    pcl::PointCloud<PointT>::ConstPtr temp_ptr = data.xyz_tree->getInputCloud();
-    int total_num = temp_ptr->size();
-    
-    // Build Neighborhood Index
-    std::vector< std::vector<int> > lab_neighs(num);
-    std::vector< std::vector<int> > xyz_neighs(num);
-    
-    cv::Mat lab_ptr = data.rgb;
-    for( int i = 0 ; i < num ; i++ )
-    {
-        int cur_idx = subsampling == true ? idxs[i] : i;
-        
-        myPointXYZ cur_lab_elem;
-        cur_lab_elem.x = lab_ptr.at<float>(cur_idx, 0);
-        cur_lab_elem.y = lab_ptr.at<float>(cur_idx, 1);
-        cur_lab_elem.z = lab_ptr.at<float>(cur_idx, 2);
-        
-        std::vector<float> cur_lab_dists;
-        std::vector<int> cur_lab_neighs;
-        data.lab_tree->radiusSearch(cur_lab_elem, pool_radius_L2[0], cur_lab_neighs, cur_lab_dists, total_num);
-        lab_neighs[i] = cur_lab_neighs;    
-        
-        std::vector<float> cur_xyz_dists;
-        std::vector<int> cur_xyz_neighs;
-        data.xyz_tree->radiusSearch(data.cloud->at(cur_idx), pool_radius_L2[1], cur_xyz_neighs, cur_xyz_dists, total_num);
-        xyz_neighs[i] = cur_xyz_neighs;
-        
-        //std::cerr << cur_lab_neighs.size() << " " << cur_xyz_neighs.size() << " " << total_num << std::endl;
-        //std::cin.get();
-    }
+    NeighborGraph lab_graph, xyz_graph;
+    buildNeighborGraphs(data, idxs, pool_radius_L2, lab_graph, xyz_graph);
     
+    return PoolLayer_L2(lab_graph, xyz_graph, code_L1, max_pool);
+}
+
+std::vector<cv::Mat> Hier_Pooler::PoolLayer_L2(const NeighborGraph &lab_graph, const NeighborGraph &xyz_graph, const std::vector<cv::Mat> &code_L1, bool max_pool)
+{
     std::vector<cv::Mat> raw_fea_L2(pool_type_num);
     for( int j = 0 ; j < pool_type_num ; j++ )
     {
-        cv::Mat feas;
-        std::vector< std::vector<int> > *neighs;
         if( pool_flag[j] == true)
         {
             switch(j)
             {
                 case 0:
-                    feas = code_L1[0];  //color_fea
-                    neighs = &lab_neighs;
+                    raw_fea_L2[j] = PoolGraph(lab_graph, code_L1[0], max_pool);     //color_fea
                     break;
                 case 1:
-                    feas = code_L1[1];  //depth_fea
-                    neighs = &lab_neighs;
+                    raw_fea_L2[j] = PoolGraph(lab_graph, code_L1[1], max_pool);     //depth_fea
                     break;
                 case 2:
-                    feas = code_L1[2];  //color_fea
-                    neighs = &xyz_neighs;
+                    raw_fea_L2[j] = PoolGraph(xyz_graph, code_L1[2], max_pool);     //color_fea
                     break;
                 case 3:
-                    feas = code_L1[3];  //depth_fea
-                    neighs = &xyz_neighs;
+                    raw_fea_L2[j] = PoolGraph(xyz_graph, code_L1[3], max_pool);     //depth_fea
                     break;
                 default:break;
             }
-            
-            // Pool L0 Features
-            std::vector<cv::Mat> raw_fea_L2_vec(num);
-            for( int i = 0 ; i < num ; i++ )
-            {
-                cv::Mat temp_fea = cv::Mat::zeros(1, feas.cols, CV_32FC1);
-               
-                for(std::vector<int>::iterator it_n = neighs->at(i).begin(); it_n < neighs->at(i).end() ; it_n++ )
-                {
-                    if( max_pool == false )
-                        temp_fea += feas.row(*it_n);
-                    else 
-                        MaxOP(temp_fea, feas.row(*it_n));
-                }  
-                // Normalize Pool Raw Vector
-                cv::normalize(temp_fea, temp_fea);
-                raw_fea_L2_vec[i] = temp_fea;
-            }
-            
-            cv::vconcat(raw_fea_L2_vec, raw_fea_L2[j]);
         }
     }
     
@@ -481,8 +481,10 @@ std::vector<cv::Mat> Hier_Pooler::getHierFea( MulInfoT &data, int layer)
     if( layer >= 1 )
     {    
         //buildIndex(data);
-        std::vector<size_t> void_idx_L1;
-        std::vector<cv::Mat> raw_fea_L1 = PoolLayer_L1(data, fea_L0, void_idx_L1);
+        std::vector<size_t> void_idx;
+        NeighborGraph lab_graph, xyz_graph;
+        buildNeighborGraphs(data, void_idx, pool_radius_L1, lab_graph, xyz_graph);
+        std::vector<cv::Mat> raw_fea_L1 = PoolLayer_L1(lab_graph, xyz_graph, fea_L0);
         std::vector<cv::Mat> fea_L1 = EncodeLayer_L1(raw_fea_L1);
     
         for( size_t i = 0 ; i < fea_L1.size() ; i++ )
@@ -490,8 +492,10 @@ std::vector<cv::Mat> Hier_Pooler::getHierFea( MulInfoT &data, int layer)
         
         if( layer >= 2 )
         {
-            std::vector<size_t> void_idx_L2;
-            std::vector<cv::Mat> raw_fea_L2 = PoolLayer_L2(data, fea_L1, void_idx_L2);
+            // both layers pool over all points, the L1 graphs are reused unless the radii differ
+            if( pool_radius_L2[0] != pool_radius_L1[0] || pool_radius_L2[1] != pool_radius_L1[1] )
+                buildNeighborGraphs(data, void_idx, pool_radius_L2, lab_graph, xyz_graph);
+            std::vector<cv::Mat> raw_fea_L2 = PoolLayer_L2(lab_graph, xyz_graph, fea_L1);
             std::vector<cv::Mat> fea_L2 = EncodeLayer_L2(raw_fea_L2);
 
             for( size_t i = 0 ; i < fea_L2.size() ; i++ )
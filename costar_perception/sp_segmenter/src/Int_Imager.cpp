@@ -1,5 +1,8 @@
 #include "sp_segmenter/features.h"
 
+// cells with a smaller squared norm are scored from the individual channels
+#define SCORE_MAP_MIN_SQR_NORM 1e-4
+
 IntImager::IntImager(float ap)
 {
     ap_ratio = ap;
@@ -29,6 +32,9 @@ IntImager::IntImager(float ap)
     target_flags.assign(1000, false);
     
     cur_down_cloud = pcl::PointCloud<PointT>::Ptr (new pcl::PointCloud<PointT>());
+    
+    score_model = NULL;
+    score_nr_w = 0;
 }
 
 void IntImager::setCameraParams(float fx_, float fy_, float center_x_, float center_y_)
@@ -88,6 +94,7 @@ void IntImager::Reset()
         memset(int_imgs[idx].data, 0, img_h*img_w*sizeof(float));
     }
     dim_per_cell.clear();
+    score_model = NULL;
 }
 
 void IntImager::ComputeInt(const MulInfoT &data, const std::vector<cv::Mat> &local_fea)
@@ -251,59 +258,186 @@ void IntImager::Pooling(const cv::Rect &reg, sparseVec &pooled_fea)
 }
 
 
+void IntImager::buildScoreMaps(const model* obj_model)
+{
+    int n = obj_model->bias >= 0 ? obj_model->nr_feature + 1 : obj_model->nr_feature;
+    int nr_class = obj_model->nr_class;
+    score_nr_w = (nr_class == 2 && obj_model->param.solver_type != MCSVM_CS) ? 1 : nr_class;
+    
+    score_bias.assign(score_nr_w, 0);
+    if( fea_dim + 1 <= n )
+        for( int i = 0 ; i < score_nr_w ; i++ )
+            score_bias[i] = obj_model->w[fea_dim*score_nr_w+i] * obj_model->bias;
+    
+    // group the valid dims by cell the same way Pooling() normalizes them
+    int len = dim_per_cell[0];
+    int last_cell = -1;
+    cell_s_idx.clear();
+    valid_int_ptr.resize(valid_dim);
+    valid_w.assign(valid_dim*score_nr_w, 0);
+    for( int i = 0 ; i < valid_dim ; i++ )
+    {
+        int idx = valid_idx->at(i);
+        valid_int_ptr[i] = (const float *)int_imgs[idx].data;
+        if( idx + 1 <= n )
+            for( int j = 0 ; j < score_nr_w ; j++ )
+                valid_w[i*score_nr_w+j] = obj_model->w[idx*score_nr_w+j];
+        int cur_cell = idx / len;
+        if( cur_cell != last_cell )
+        {
+            cell_s_idx.push_back(i);
+            last_cell = cur_cell;
+        }
+    }
+    cell_s_idx.push_back(valid_dim);
+    
+    // integral images are linear, so the integral of w*feature of a cell is the weighted sum of its integral images
+    int cell_num = cell_s_idx.size() - 1;
+    int map_num = cell_num * score_nr_w;
+    int pixel_num = img_h * img_w;
+    score_imgs.resize(map_num);
+    #pragma omp parallel for schedule(dynamic)
+    for( int m = 0 ; m < map_num ; m++ )
+    {
+        int k = m / score_nr_w;
+        int i = m % score_nr_w;
+        score_imgs[m] = cv::Mat::zeros(img_h, img_w, CV_32FC1);
+        float *dst = (float *)score_imgs[m].data;
+        for( int d = cell_s_idx[k] ; d < cell_s_idx[k+1] ; d++ )
+        {
+            float cur_w = valid_w[d*score_nr_w+i];
+            if( cur_w == 0 )
+                continue;
+            const float *src = valid_int_ptr[d];
+            for( int p = 0 ; p < pixel_num ; p++ )
+                dst[p] += cur_w * src[p];
+        }
+    }
+    score_model = obj_model;
+}
+
+bool IntImager::scoreWindow(const cv::Rect &reg, double *dec_values)
+{
+    int tl_y = reg.tl().y;
+    int tl_x = reg.tl().x;
+    int br_y = reg.br().y;
+    int br_x = reg.br().x;
+    
+    if( tl_y < 0 || tl_x < 0 || br_y >= img_h || br_x >= img_w )
+        return false;
+    
+    int off_br = br_y * img_w + br_x;
+    int off_tl = tl_y * img_w + tl_x;
+    int off_bl = br_y * img_w + tl_x;
+    int off_tr = tl_y * img_w + br_x;
+    
+    for( int i = 0 ; i < score_nr_w ; i++ )
+        dec_values[i] = score_bias[i];
+    
+    // only the cell norms need the individual channels, the model response of a cell is one lookup per row
+    bool empty = true;
+    int cell_num = cell_s_idx.size() - 1;
+    for( int k = 0 ; k < cell_num ; k++ )
+    {
+        float sum = 0;
+        for( int d = cell_s_idx[k] ; d < cell_s_idx[k+1] ; d++ )
+        {
+            const float *ptr = valid_int_ptr[d];
+            float val = ptr[off_br] + ptr[off_tl] - ptr[off_bl] - ptr[off_tr];
+            if( val > 1e-6 )
+                sum += val * val;
+            else if( val < 0 )
+            {
+                std::cerr << "Bug!!!" << std::endl;
+                exit(0);
+            }
+        }
+        if( sum <= 0 )
+            continue;
+        empty = false;
+        
+        float inv_norm = 1.0 / sqrt(sum);
+        if( sum < SCORE_MAP_MIN_SQR_NORM )
+        {
+            // the normalization would amplify the rounding error of the score map, use the channels
+            for( int d = cell_s_idx[k] ; d < cell_s_idx[k+1] ; d++ )
+            {
+                const float *ptr = valid_int_ptr[d];
+                float val = ptr[off_br] + ptr[off_tl] - ptr[off_bl] - ptr[off_tr];
+                if( val > 1e-6 )
+                    for( int i = 0 ; i < score_nr_w ; i++ )
+                        dec_values[i] += inv_norm * val * valid_w[d*score_nr_w+i];
+            }
+            continue;
+        }
+        const cv::Mat *cur_imgs = &score_imgs[k*score_nr_w];
+        for( int i = 0 ; i < score_nr_w ; i++ )
+        {
+            const float *ptr = (const float *)cur_imgs[i].data;
+            dec_values[i] += inv_norm * (ptr[off_br] + ptr[off_tl] - ptr[off_bl] - ptr[off_tr]);
+        }
+    }
+    return !empty;
+}
+
 std::vector<Hypo> IntImager::DetectObjects(const model* obj_model, const std::pair<float, float> &cur_box, int step)
 {   
-    float bias = obj_model->bias;
-    
     std::vector< std::pair<float, float> > all_boxes;
     all_boxes.push_back(cur_box);
     std::vector<cv::Rect> regs = UniformCubing(cur_down_cloud, int_map2d, all_boxes, step, ap_ratio, fx, fy, center_x, center_y);
     // make sure the integral images are already prepared    
     
-    feature_node bias_term;
-    bias_term.index = fea_dim +1;
-    bias_term.value = bias;
-    feature_node end_node;
-    end_node.index = -1;
-    end_node.value = 0;
-    
     std::vector<Hypo> hypo_set;
+    if( regs.empty() == true )
+        return hypo_set;
+    // the score maps are shared by all box sizes of the same model
+    if( score_model != obj_model )
+        buildScoreMaps(obj_model);
+    
+    // windows come row by row from UniformCubing, score consecutive chunks in parallel and merge them in order
+    const int chunk_size = 64;
     int regs_num = regs.size();
-    #pragma omp parallel for
-    for( int i = 0 ; i < regs_num ; i++ )
+    int chunk_num = (regs_num + chunk_size - 1) / chunk_size;
+    std::vector< std::vector<Hypo> > chunk_hypo_set(chunk_num);
+    #pragma omp parallel for schedule(dynamic)
+    for( int b = 0 ; b < chunk_num ; b++ )
     {
-        sparseVec tmp_fea;
-        Pooling(regs[i], tmp_fea);
-        if( tmp_fea.empty() == true )
-            continue;
-        
-        tmp_fea.push_back(bias_term);
-        tmp_fea.push_back(end_node);
-        
-        feature_node *cur_fea = new feature_node[tmp_fea.size()];
-        std::copy(tmp_fea.begin(), tmp_fea.end(), cur_fea);
-        double *dec_values = new double[obj_model->nr_class];
-	double cur_label = predict_values(obj_model, cur_fea, dec_values);
-        
-        int pred_label = round(cur_label);
-        if( target_flags[pred_label] == true )//&& dec_values[pred_label-1] > 0 )  //hit the target
+        std::vector<double> dec_values(score_nr_w);
+        int e_idx = std::min(regs_num, (b + 1) * chunk_size);
+        for( int i = b * chunk_size ; i < e_idx ; i++ )
         {
-            Hypo cur_hypo;
-            cur_hypo.box = regs[i];
-            if(obj_model->nr_class > 2 )
-                cur_hypo.score = dec_values[pred_label-1];
+            if( scoreWindow(regs[i], &dec_values[0]) == false )
+                continue;
+            
+            int pred_label;
+            if( obj_model->nr_class == 2 )
+                pred_label = dec_values[0] > 0 ? obj_model->label[0] : obj_model->label[1];
             else
-                cur_hypo.score = dec_values[0] >= 0 ? dec_values[0] : -dec_values[0];
-            cur_hypo.label = pred_label - 1 ;
-            cur_hypo.ap_ratio = ap_ratio;
+            {
+                int dec_max_idx = 0;
+                for( int j = 1 ; j < obj_model->nr_class ; j++ )
+                    if( dec_values[j] > dec_values[dec_max_idx] )
+                        dec_max_idx = j;
+                pred_label = obj_model->label[dec_max_idx];
+            }
             
-            #pragma omp critical
-            {hypo_set.push_back(cur_hypo);}
+            if( target_flags[pred_label] == true )//&& dec_values[pred_label-1] > 0 )  //hit the target
+            {
+                Hypo cur_hypo;
+                cur_hypo.box = regs[i];
+                if(obj_model->nr_class > 2 )
+                    cur_hypo.score = dec_values[pred_label-1];
+                else
+                    cur_hypo.score = dec_values[0] >= 0 ? dec_values[0] : -dec_values[0];
+                cur_hypo.label = pred_label - 1 ;
+                cur_hypo.ap_ratio = ap_ratio;
+                
+                chunk_hypo_set[b].push_back(cur_hypo);
+            }
         }
-        
-        delete[] cur_fea;
-        delete[] dec_values;
     }
+    for( int b = 0 ; b < chunk_num ; b++ )
+        hypo_set.insert(hypo_set.end(), chunk_hypo_set[b].begin(), chunk_hypo_set[b].end());
     
     std::vector<Hypo> final_hypo_set = hypo_set;
     //std::vector<Hypo> final_hypo_set = nonmax_suppress(hypo_set);
@@ -322,13 +456,29 @@ std::vector<Hypo> IntImager::nonmax_suppress(std::vector<Hypo> &hypo_set)
 {
     std::sort(hypo_set.begin(), hypo_set.end(), Hypo_comp);
     
+    // boxes as flat arrays so that the overlap test stays in cache
     int hypo_num = hypo_set.size();
+    std::vector<float> x1(hypo_num), y1(hypo_num), x2(hypo_num), y2(hypo_num), area(hypo_num);
+    for(int i = 0 ; i < hypo_num ; i++ )
+    {
+        const cv::Rect &box = hypo_set[i].box;
+        x1[i] = box.x;
+        y1[i] = box.y;
+        x2[i] = box.x + box.width;
+        y2[i] = box.y + box.height;
+        area[i] = box.area();
+    }
+    
     std::vector<Hypo> final_hypo_set;
     for(int i = 0 ; i < hypo_num ; i++ )
     {
+        // same test as overlap(): intersection / union > IN_OVERLAP_RATIO
         bool non_overlap = true;
         for(int j = i+1 ; j < hypo_num ; j++ ){
-            if( overlap(hypo_set[i], hypo_set[j]) == true )
+            float iw = std::max(0.0f, std::min(x2[i], x2[j]) - std::max(x1[i], x1[j]));
+            float ih = std::max(0.0f, std::min(y2[i], y2[j]) - std::max(y1[i], y1[j]));
+            float isect = iw * ih;
+            if( isect > IN_OVERLAP_RATIO * (area[i] + area[j] - isect) )
             {
                 non_overlap = false;
                 break;
@@ -353,4 +503,3 @@ std::vector<Hypo> IntImager::nonmax_suppress(std::vector<Hypo> &hypo_set)
     return final_hypo_set;
 }
 
-
@@ -243,6 +243,24 @@ void sparseK::AddData(cv::Mat data)
     }
 }
 
+void sparseK::AddProtos(std::vector<protoT> &protos)
+{
+    if( protos.empty() == true )
+        return;
+    if( proto_set.empty() == true )
+        fea_len = protos[0].elems[protos[0].elems.size()-1].index;
+
+    proto_set.reserve(proto_set.size() + protos.size());
+    for( std::vector<protoT>::iterator it = protos.begin() ; it < protos.end() ; it++ )
+    {
+        proto_set.push_back(protoT());
+        proto_set.back().elems.swap(it->elems);
+        proto_set.back().count = it->count;
+    }
+    total_count += protos.size();
+    protos.clear();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void sparseK::Initialize(std::vector< sparseVec > &centers, int K) //initialize the centers, should be deallocated outside the function after clustering
@@ -489,4 +507,608 @@ void HierKmeans(const std::vector<protoT> &proto_set, cv::Mat &centers, int K)
 
     std::cerr<<"Final Center Number: "<<centers.rows<<std::endl;
 
-}
\ No newline at end of file
+}
+
+void MiniBatchKmeans(const std::vector<protoT> &proto_set, cv::Mat &centers, int K)
+{
+    if( K <= 1 || proto_set.empty() == true )
+        return;
+    
+    flatKmeans temp_Kmeans;
+    temp_Kmeans.LoadProtos(proto_set);
+    temp_Kmeans.W_Cluster(centers, K);
+    
+    std::cerr<<"Final Center Number: "<<centers.rows<<std::endl;
+}
+
+void CompareKmeans(const std::vector<protoT> &proto_set, cv::Mat &centers, int K)
+{
+    if( K <= 1 || proto_set.empty() == true )
+        return;
+    
+    flatKmeans temp_Kmeans;
+    temp_Kmeans.LoadProtos(proto_set);
+    
+    double t1, t2;
+    cv::Mat hier_centers;
+    t1 = get_wall_time();
+    HierKmeans(proto_set, hier_centers, K);
+    t2 = get_wall_time();
+    double hier_time = t2 - t1;
+    float hier_energy = temp_Kmeans.Energy(hier_centers);
+    
+    t1 = get_wall_time();
+    temp_Kmeans.W_Cluster(centers, K);
+    t2 = get_wall_time();
+    double flat_time = t2 - t1;
+    float flat_energy = temp_Kmeans.Energy(centers);
+    
+    std::cerr << "HierKmeans      K=" << hier_centers.rows << " Time: " << hier_time << "s Energy: " << hier_energy << std::endl;
+    std::cerr << "MiniBatchKmeans K=" << centers.rows << " Time: " << flat_time << "s Energy: " << flat_energy << std::endl;
+}
+
+//Flat Kmeans
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+flatKmeans::flatKmeans()
+{
+    fea_len = -1;
+    proto_num = 0;
+    
+    batch_size = 1024;
+    batch_iter = 100;
+    max_iter = 100;
+    
+    thread_num = omp_get_max_threads();
+}
+
+flatKmeans::~flatKmeans(){}
+
+void flatKmeans::LoadProtos(const std::vector<protoT> &proto_set)
+{
+    proto_num = proto_set.size();
+    row_s.clear();
+    col_idx.clear();
+    vals.clear();
+    sq_norm.clear();
+    labels.clear();
+    if( proto_num == 0 )
+        return;
+    //the last element of each sparse vector only stores the feature length
+    fea_len = proto_set[0].elems[proto_set[0].elems.size()-1].index;
+    
+    size_t total = 0;
+    for( int i = 0 ; i < proto_num ; i++ )
+        total += proto_set[i].elems.size() - 1;
+    
+    row_s.resize(proto_num+1);
+    col_idx.resize(total);
+    vals.resize(total);
+    sq_norm.resize(proto_num);
+    
+    size_t cur = 0;
+    for( int i = 0 ; i < proto_num ; i++ )
+    {
+        row_s[i] = cur;
+        float sum = 0;
+        sparseVec::const_iterator e_it = proto_set[i].elems.end() - 1;
+        for( sparseVec::const_iterator it = proto_set[i].elems.begin() ; it < e_it ; it++, cur++ )
+        {
+            col_idx[cur] = it->index;
+            vals[cur] = it->value;
+            sum += it->value * it->value;
+        }
+        sq_norm[i] = sum;
+    }
+    row_s[proto_num] = cur;
+}
+
+float flatKmeans::distFunc2(int i, const float *center, float center_sq) const
+{
+    double dot = 0;
+    for( size_t j = row_s[i] ; j < row_s[i+1] ; j++ )
+        dot += vals[j] * center[col_idx[j]];
+    double dist2 = sq_norm[i] + center_sq - 2 * dot;
+    return dist2 > 0 ? dist2 : 0;
+}
+
+int flatKmeans::nearestCenter(int i, const cv::Mat &centers, const std::vector<float> &center_sq, float &min_dist2, float &second_dist2) const
+{
+    int min_idx = -1;
+    min_dist2 = INF_;
+    second_dist2 = INF_;
+    for( int k = 0 ; k < centers.rows ; k++ )
+    {
+        float buf = distFunc2(i, centers.ptr<float>(k), center_sq[k]);
+        if( buf < min_dist2 )
+        {
+            second_dist2 = min_dist2;
+            min_dist2 = buf;
+            min_idx = k;
+        }
+        else if( buf < second_dist2 )
+            second_dist2 = buf;
+    }
+    return min_idx;
+}
+
+void flatKmeans::Initialize(cv::Mat &centers, int K)
+{
+    //k-means++ seeding on a random sample of the protos
+    std::vector<size_t> rand_idx;
+    GenRandSeq(rand_idx, proto_num);
+    int sample_num = std::min(proto_num, 50*K);
+    
+    centers = cv::Mat::zeros(K, fea_len, CV_32FC1);
+    std::vector<float> min_dist2(sample_num, INF_);
+    for( int k = 0 ; k < K ; k++ )
+    {
+        int pick = 0;
+        if( k > 0 )
+        {
+            double sum = 0;
+            for( int s = 0 ; s < sample_num ; s++ )
+                sum += min_dist2[s];
+            double r = (rand() / (RAND_MAX + 1.0)) * sum;
+            for( pick = 0 ; pick < sample_num - 1 ; pick++ )
+            {
+                r -= min_dist2[pick];
+                if( r < 0 )
+                    break;
+            }
+        }
+        
+        int i = rand_idx[pick];
+        float *ptr = centers.ptr<float>(k);
+        for( size_t j = row_s[i] ; j < row_s[i+1] ; j++ )
+            ptr[col_idx[j]] = vals[j];
+        
+        #pragma omp parallel for
+        for( int s = 0 ; s < sample_num ; s++ )
+        {
+            float buf = distFunc2(rand_idx[s], ptr, sq_norm[i]);
+            if( buf < min_dist2[s] )
+                min_dist2[s] = buf;
+        }
+    }
+}
+
+void flatKmeans::MiniBatch(cv::Mat &centers, int K)
+{
+    if( proto_num <= batch_size )
+        return;
+    
+    std::vector<float> counts(K, 0);
+    std::vector<float> center_sq(K);
+    std::vector<int> batch_idx(batch_size), batch_label(batch_size);
+    for( int t = 0 ; t < batch_iter ; t++ )
+    {
+        for( int k = 0 ; k < K ; k++ )
+            center_sq[k] = centers.row(k).dot(centers.row(k));
+        for( int b = 0 ; b < batch_size ; b++ )
+            batch_idx[b] = rand() % proto_num;
+        
+        #pragma omp parallel for
+        for( int b = 0 ; b < batch_size ; b++ )
+        {
+            float min_dist2, second_dist2;
+            batch_label[b] = nearestCenter(batch_idx[b], centers, center_sq, min_dist2, second_dist2);
+        }
+        
+        //each center becomes the running mean of all the protos assigned to it so far
+        #pragma omp parallel for schedule(dynamic, 1)
+        for( int k = 0 ; k < K ; k++ )
+        {
+            int new_num = 0;
+            for( int b = 0 ; b < batch_size ; b++ )
+                new_num += batch_label[b] == k;
+            if( new_num == 0 )
+                continue;
+            
+            float pre_count = counts[k];
+            counts[k] += new_num;
+            float *ptr = centers.ptr<float>(k);
+            float eta = 1.0 / counts[k];
+            float decay = pre_count * eta;
+            for( int d = 0 ; d < fea_len ; d++ )
+                ptr[d] *= decay;
+            for( int b = 0 ; b < batch_size ; b++ )
+            {
+                if( batch_label[b] != k )
+                    continue;
+                int i = batch_idx[b];
+                for( size_t j = row_s[i] ; j < row_s[i+1] ; j++ )
+                    ptr[col_idx[j]] += eta * vals[j];
+            }
+        }
+    }
+}
+
+void flatKmeans::GroupCenters(const cv::Mat &centers, int G)
+{
+    //a few Lloyd iterations on the centers themselves, close centers share one lower bound
+    int K = centers.rows;
+    center_group.assign(K, 0);
+    cv::Mat group_centers = cv::Mat::zeros(G, fea_len, CV_32FC1);
+    for( int g = 0 ; g < G ; g++ )
+        centers.row(g * K / G).copyTo(group_centers.row(g));
+    for( int iter = 0 ; iter < 5 ; iter++ )
+    {
+        for( int k = 0 ; k < K ; k++ )
+        {
+            float min_dist = INF_;
+            for( int g = 0 ; g < G ; g++ )
+            {
+                float buf = cv::norm(centers.row(k), group_centers.row(g), cv::NORM_L2);
+                if( buf < min_dist )
+                {
+                    min_dist = buf;
+                    center_group[k] = g;
+                }
+            }
+        }
+        std::vector<int> group_num(G, 0);
+        group_centers = cv::Mat::zeros(G, fea_len, CV_32FC1);
+        for( int k = 0 ; k < K ; k++ )
+        {
+            cv::Mat cur_group = group_centers.row(center_group[k]);
+            cur_group += centers.row(k);
+            group_num[center_group[k]]++;
+        }
+        for( int g = 0 ; g < G ; g++ )
+        {
+            if( group_num[g] > 0 )
+                group_centers.row(g) /= group_num[g];
+            else
+                centers.row(rand() % K).copyTo(group_centers.row(g));
+        }
+    }
+    group_members.clear();
+    group_members.resize(G);
+    for( int k = 0 ; k < K ; k++ )
+        group_members[center_group[k]].push_back(k);
+}
+
+void flatKmeans::Refine(cv::Mat &centers, int K)
+{
+    //Lloyd iterations with one upper bound to the assigned center and one lower bound per group of centers
+    int G = std::max(1, std::min(K / 10, 32));
+    GroupCenters(centers, G);
+    
+    std::vector<float> center_sq(K);
+    for( int k = 0 ; k < K ; k++ )
+        center_sq[k] = centers.row(k).dot(centers.row(k));
+    
+    std::vector<float> upper(proto_num), lower((size_t)proto_num*G);
+    labels.resize(proto_num);
+    #pragma omp parallel
+    {
+        std::vector<float> dists(K);
+        #pragma omp for
+        for( int i = 0 ; i < proto_num ; i++ )
+        {
+            int min_idx = 0;
+            for( int k = 0 ; k < K ; k++ )
+            {
+                dists[k] = sqrt(distFunc2(i, centers.ptr<float>(k), center_sq[k]));
+                if( dists[k] < dists[min_idx] )
+                    min_idx = k;
+            }
+            float *cur_lower = &lower[(size_t)i*G];
+            std::fill(cur_lower, cur_lower + G, (float)INF_);
+            for( int k = 0 ; k < K ; k++ )
+                if( k != min_idx && dists[k] < cur_lower[center_group[k]] )
+                    cur_lower[center_group[k]] = dists[k];
+            labels[i] = min_idx;
+            upper[i] = dists[min_idx];
+        }
+    }
+    
+    std::vector<float> half_sep(K), shift(K), group_shift(G);
+    for( int iter = 0 ; iter < max_iter ; iter++ )
+    {
+        //move the centers to the means of their protos
+        cv::Mat new_centers = cv::Mat::zeros(K, fea_len, CV_32FC1);
+        std::vector<int> cluster_num(K, 0);
+        for( int i = 0 ; i < proto_num ; i++ )
+        {
+            int k = labels[i];
+            float *ptr = new_centers.ptr<float>(k);
+            for( size_t j = row_s[i] ; j < row_s[i+1] ; j++ )
+                ptr[col_idx[j]] += vals[j];
+            cluster_num[k]++;
+        }
+        float max_shift = 0;
+        std::fill(group_shift.begin(), group_shift.end(), 0);
+        for( int k = 0 ; k < K ; k++ )
+        {
+            if( cluster_num[k] == 0 )
+                centers.row(k).copyTo(new_centers.row(k));  //keep empty clusters in place
+            else
+                new_centers.row(k) /= cluster_num[k];
+            shift[k] = cv::norm(new_centers.row(k), centers.row(k), cv::NORM_L2);
+            max_shift = std::max(max_shift, shift[k]);
+            group_shift[center_group[k]] = std::max(group_shift[center_group[k]], shift[k]);
+            center_sq[k] = new_centers.row(k).dot(new_centers.row(k));
+        }
+        centers = new_centers;
+        if( max_shift <= 0 )
+            break;
+        
+        //half of the distance to the closest other center
+        #pragma omp parallel for
+        for( int k = 0 ; k < K ; k++ )
+        {
+            float min_sep = INF_;
+            for( int j = 0 ; j < K ; j++ )
+                if( j != k )
+                    min_sep = std::min(min_sep, (float)cv::norm(centers.row(k), centers.row(j), cv::NORM_L2));
+            half_sep[k] = 0.5 * min_sep;
+        }
+        
+        int changed = 0;
+        #pragma omp parallel reduction(+:changed)
+        {
+            std::vector<float> dists(K);
+            std::vector<bool> group_scan(G);
+            #pragma omp for
+            for( int i = 0 ; i < proto_num ; i++ )
+            {
+                int a = labels[i];
+                float *cur_lower = &lower[(size_t)i*G];
+                float min_lower = INF_;
+                for( int g = 0 ; g < G ; g++ )
+                {
+                    cur_lower[g] -= group_shift[g];
+                    min_lower = std::min(min_lower, cur_lower[g]);
+                }
+                upper[i] += shift[a];
+
+                float bound = std::max(half_sep[a], min_lower);
+                if( upper[i] <= bound )
+                    continue;
+                upper[i] = sqrt(distFunc2(i, centers.ptr<float>(a), center_sq[a]));
+                if( upper[i] <= bound )
+                    continue;
+
+                //only the groups whose lower bound is below the upper bound can hold a closer center
+                int best = a;
+                dists[a] = upper[i];
+                for( int g = 0 ; g < G ; g++ )
+                {
+                    group_scan[g] = cur_lower[g] < upper[i];
+                    if( group_scan[g] == false )
+                        continue;
+                    for( std::vector<int>::iterator it = group_members[g].begin() ; it < group_members[g].end() ; it++ )
+                    {
+                        if( *it == a )
+                            continue;
+                        dists[*it] = sqrt(distFunc2(i, centers.ptr<float>(*it), center_sq[*it]));
+                        if( dists[*it] < dists[best] )
+                            best = *it;
+                    }
+                }
+
+                //the rescanned groups get the distance to their closest center other than the new best
+                for( int g = 0 ; g < G ; g++ )
+                {
+                    if( group_scan[g] == false )
+                        continue;
+                    float min_dist = INF_;
+                    for( std::vector<int>::iterator it = group_members[g].begin() ; it < group_members[g].end() ; it++ )
+                        if( *it != best )
+                            min_dist = std::min(min_dist, dists[*it]);
+                    cur_lower[g] = min_dist;
+                }
+                if( best != a )
+                {
+                    float &pre_lower = cur_lower[center_group[a]];
+                    pre_lower = std::min(pre_lower, upper[i]);
+                    labels[i] = best;
+                    upper[i] = dists[best];
+                    changed++;
+                }
+            }
+        }
+        std::cerr << "Iter-" << iter << " Changed: " << changed << std::endl;
+        if( changed == 0 )
+            break;
+    }
+}
+
+std::vector<float> flatKmeans::W_Cluster(cv::Mat &centers, int K)
+{
+    if( K > proto_num )
+        K = proto_num;
+    
+    Initialize(centers, K);
+    MiniBatch(centers, K);
+    Refine(centers, K);
+    
+    std::vector<float> center_sq(K);
+    for( int k = 0 ; k < K ; k++ )
+        center_sq[k] = centers.row(k).dot(centers.row(k));
+    std::vector<float> energy_set(K, 0);
+    for( int i = 0 ; i < proto_num ; i++ )
+        energy_set[labels[i]] += sqrt(distFunc2(i, centers.ptr<float>(labels[i]), center_sq[labels[i]]));
+    
+    return energy_set;
+}
+
+float flatKmeans::Energy(const cv::Mat &centers)
+{
+    int K = centers.rows;
+    std::vector<float> center_sq(K);
+    for( int k = 0 ; k < K ; k++ )
+        center_sq[k] = centers.row(k).dot(centers.row(k));
+    
+    double energy = 0;
+    #pragma omp parallel for reduction(+:energy)
+    for( int i = 0 ; i < proto_num ; i++ )
+    {
+        float min_dist2, second_dist2;
+        nearestCenter(i, centers, center_sq, min_dist2, second_dist2);
+        energy += sqrt(min_dist2);
+    }
+    return energy;
+}
+
+//Sharded Proto Accumulator
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void rowToProto(const cv::Mat &row, protoT &proto)
+{
+    proto.elems.clear();
+    proto.count = 1;
+    const float *ptr = row.ptr<float>(0);
+    for( int i = 0 ; i < row.cols ; i++ )
+    {
+        if( ptr[i] != 0 )
+        {
+            feature_node buf;
+            buf.index = i;
+            buf.value = ptr[i];
+            proto.elems.push_back(buf);
+        }
+    }
+    feature_node buf;
+    buf.index = row.cols;
+    buf.value = 0;
+    proto.elems.push_back(buf);
+}
+
+// slack over the expected number of keys below the bound, so that at least max_num rows survive w.h.p.
+#define RESERVOIR_SLACK 1.2
+
+protoAccumulator::protoAccumulator(size_t max_num_, int shard_num)
+{
+    if( shard_num < 1 )
+        shard_num = 1;
+    max_num = max_num_;
+    total_seen = 0;
+    
+    shards.resize(shard_num);
+    for( int t = 0 ; t < shard_num ; t++ )
+    {
+        shards[t].seed = rand() + t;
+        shards[t].prune_size = std::max((size_t)1024, 2 * max_num / shard_num);
+    }
+    if( max_num > 0 )
+        reserve(shards[0].prune_size);
+}
+
+protoAccumulator::~protoAccumulator(){}
+
+void protoAccumulator::reserve(size_t num_per_shard)
+{
+    for( size_t t = 0 ; t < shards.size() ; t++ )
+    {
+        shards[t].protos.reserve(num_per_shard);
+        if( max_num > 0 )
+            shards[t].keys.reserve(num_per_shard);
+    }
+}
+
+double protoAccumulator::keyBound(size_t seen) const
+{
+    //the bound only shrinks while rows come in, so a row rejected earlier would be rejected at the end as well
+    if( seen <= max_num )
+        return 1.0;
+    return std::min(1.0, RESERVOIR_SLACK * max_num / seen);
+}
+
+void protoAccumulator::AddData(const cv::Mat &data)
+{
+    size_t thread_id = omp_get_thread_num();
+    if( thread_id >= shards.size() )
+    {
+        std::cerr << "protoAccumulator: thread " << thread_id << " has no shard!" << std::endl;
+        exit(0);
+    }
+    shardT &shard = shards[thread_id];
+    
+    size_t seen;
+    #pragma omp atomic capture
+    seen = total_seen += data.rows;
+    
+    if( max_num == 0 )
+    {
+        for( int i = 0 ; i < data.rows ; i++ )
+        {
+            shard.protos.push_back(protoT());
+            rowToProto(data.row(i), shard.protos.back());
+        }
+        return;
+    }
+    
+    double bound = keyBound(seen);
+    for( int i = 0 ; i < data.rows ; i++ )
+    {
+        double key = rand_r(&shard.seed) / (RAND_MAX + 1.0);
+        if( key >= bound )
+            continue;
+        shard.protos.push_back(protoT());
+        shard.keys.push_back(key);
+        rowToProto(data.row(i), shard.protos.back());
+    }
+    
+    if( shard.protos.size() > shard.prune_size )
+    {
+        //drop the rows whose keys are above the current bound
+        size_t kept = 0;
+        for( size_t j = 0 ; j < shard.protos.size() ; j++ )
+        {
+            if( shard.keys[j] >= bound )
+                continue;
+            if( kept != j )
+            {
+                shard.protos[kept].elems.swap(shard.protos[j].elems);
+                shard.protos[kept].count = shard.protos[j].count;
+                shard.keys[kept] = shard.keys[j];
+            }
+            kept++;
+        }
+        shard.protos.resize(kept);
+        shard.keys.resize(kept);
+        shard.prune_size = std::max(shard.prune_size, 2 * kept);
+    }
+}
+
+void protoAccumulator::MergeInto(sparseK &cluster)
+{
+    if( max_num > 0 )
+    {
+        //keep the max_num rows with the smallest keys over all the shards
+        std::vector<double> all_keys;
+        for( size_t t = 0 ; t < shards.size() ; t++ )
+            all_keys.insert(all_keys.end(), shards[t].keys.begin(), shards[t].keys.end());
+        double bound = keyBound(total_seen);
+        if( all_keys.size() > max_num )
+        {
+            std::nth_element(all_keys.begin(), all_keys.begin() + max_num - 1, all_keys.end());
+            bound = std::min(bound, all_keys[max_num - 1]);
+        }
+        
+        size_t kept = 0;
+        for( size_t t = 0 ; t < shards.size() ; t++ )
+        {
+            shardT &shard = shards[t];
+            std::vector<protoT> sample;
+            for( size_t j = 0 ; j < shard.protos.size() && kept < max_num ; j++ )
+            {
+                if( shard.keys[j] > bound )
+                    continue;
+                sample.push_back(protoT());
+                sample.back().elems.swap(shard.protos[j].elems);
+                sample.back().count = shard.protos[j].count;
+                kept++;
+            }
+            shard.protos.swap(sample);
+        }
+    }
+    
+    for( size_t t = 0 ; t < shards.size() ; t++ )
+    {
+        cluster.AddProtos(shards[t].protos);
+        std::vector<protoT>().swap(shards[t].protos);
+        std::vector<double>().swap(shards[t].keys);
+    }
+}
@@ -0,0 +1,243 @@
+#include "sp_segmenter/featureCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+
+uint64_t hashBytes(const void *ptr, size_t len, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *)ptr;
+    uint64_t hash = seed;
+    for( size_t i = 0 ; i < len ; i++ )
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t hashCloud(const pcl::PointCloud<PointT>::Ptr cloud, uint64_t seed)
+{
+    uint32_t dims[2] = {cloud->width, cloud->height};
+    uint64_t hash = hashBytes(dims, sizeof(dims), seed);
+    for( pcl::PointCloud<PointT>::const_iterator it = cloud->begin() ; it < cloud->end() ; it++ )
+    {
+        float buf[4] = {it->x, it->y, it->z, 0};
+        memcpy(&buf[3], &it->rgba, sizeof(uint32_t));
+        hash = hashBytes(buf, sizeof(buf), hash);
+    }
+    return hash;
+}
+
+uint64_t hashNormals(const pcl::PointCloud<NormalT>::Ptr normals, uint64_t seed)
+{
+    uint64_t num = normals->size();
+    uint64_t hash = hashBytes(&num, sizeof(num), seed);
+    for( pcl::PointCloud<NormalT>::const_iterator it = normals->begin() ; it < normals->end() ; it++ )
+    {
+        float buf[4] = {it->normal_x, it->normal_y, it->normal_z, it->curvature};
+        hash = hashBytes(buf, sizeof(buf), hash);
+    }
+    return hash;
+}
+
+std::string hashToString(uint64_t hash)
+{
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash);
+    return std::string(buf);
+}
+
+/************************************************************************************************************************************/
+
+featureCache::featureCache(std::string cache_path_)
+{
+    cache_path = cache_path_;
+    if( cache_path.empty() == false && cache_path[cache_path.size()-1] != '/' )
+        cache_path += "/";
+}
+
+std::string featureCache::stagePath(uint64_t hash, std::string name)
+{
+    return cache_path + hashToString(hash) + "/" + name;
+}
+
+std::string featureCache::tmpName(std::string name)
+{
+    std::stringstream ss;
+    ss << name << ".tmp" << getpid() << "_" << omp_get_thread_num();
+    return ss.str();
+}
+
+bool featureCache::commitFile(std::string tmp_name, std::string name)
+{
+    if( std::rename(tmp_name.c_str(), name.c_str()) != 0 )
+    {
+        std::remove(tmp_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool featureCache::loadNormals(uint64_t cloud_hash, float radius, pcl::PointCloud<NormalT>::Ptr normals)
+{
+    std::stringstream ss;
+    ss << "normals_r" << radius << ".pcd";
+    std::string name = stagePath(cloud_hash, ss.str());
+    if( exists_test(name) == false )
+        return false;
+    return pcl::io::loadPCDFile<NormalT>(name, *normals) == 0;
+}
+
+void featureCache::saveNormals(uint64_t cloud_hash, float radius, const pcl::PointCloud<NormalT>::Ptr normals)
+{
+    if( normals->empty() == true )
+        return;
+    std::stringstream ss;
+    ss << "normals_r" << radius << ".pcd";
+    std::string name = stagePath(cloud_hash, ss.str());
+    boost::filesystem::create_directories(cache_path + hashToString(cloud_hash));
+
+    std::string tmp_name = tmpName(name);
+    if( pcl::io::savePCDFileBinary(tmp_name, *normals) == 0 )
+        commitFile(tmp_name, name);
+}
+
+bool featureCache::loadSuperpixels(uint64_t cloud_hash, std::string param_key, pcl::PointCloud<PointT>::Ptr down_cloud,
+        pcl::PointCloud<PointLT>::Ptr label_cloud, IDXSET &segs_to_cloud, std::multimap<uint32_t, uint32_t> &graph)
+{
+    std::string name = stagePath(cloud_hash, "sp_" + param_key);
+    // the .idx file is committed last
+    std::ifstream in((name + ".idx").c_str(), std::ios::in|std::ios::binary);
+    if( in.is_open() == false )
+        return false;
+    if( pcl::io::loadPCDFile<PointT>(name + ".pcd", *down_cloud) != 0 || pcl::io::loadPCDFile<PointLT>(name + ".lbl.pcd", *label_cloud) != 0 )
+        return false;
+
+    size_t seg_num, edge_num;
+    in.read((char*)&seg_num, sizeof(size_t));
+    segs_to_cloud.clear();
+    segs_to_cloud.resize(seg_num);
+    for( size_t i = 0 ; i < seg_num && in.good() ; i++ )
+    {
+        size_t len;
+        in.read((char*)&len, sizeof(size_t));
+        segs_to_cloud[i].resize(len);
+        if( len > 0 )
+            in.read((char*)&segs_to_cloud[i][0], len * sizeof(int));
+    }
+    in.read((char*)&edge_num, sizeof(size_t));
+    graph.clear();
+    for( size_t i = 0 ; i < edge_num && in.good() ; i++ )
+    {
+        uint32_t edge[2];
+        in.read((char*)edge, sizeof(edge));
+        graph.insert(std::pair<uint32_t, uint32_t>(edge[0], edge[1]));
+    }
+    if( in.good() == false )
+    {
+        std::cerr << "Corrupted cache: " << name << ".idx" << std::endl;
+        return false;
+    }
+
+    for( size_t i = 0 ; i < seg_num ; i++ )
+        for( std::vector<int>::const_iterator it = segs_to_cloud[i].begin() ; it < segs_to_cloud[i].end() ; it++ )
+            if( *it < 0 || *it >= (int)down_cloud->size() )
+                return false;
+    return true;
+}
+
+void featureCache::saveSuperpixels(uint64_t cloud_hash, std::string param_key, const pcl::PointCloud<PointT>::Ptr down_cloud,
+        const pcl::PointCloud<PointLT>::Ptr label_cloud, const IDXSET &segs_to_cloud, const std::multimap<uint32_t, uint32_t> &graph)
+{
+    if( down_cloud->empty() == true || label_cloud->empty() == true )
+        return;
+    std::string name = stagePath(cloud_hash, "sp_" + param_key);
+    boost::filesystem::create_directories(cache_path + hashToString(cloud_hash));
+
+    std::string tmp_down = tmpName(name + ".pcd"), tmp_label = tmpName(name + ".lbl.pcd"), tmp_idx = tmpName(name + ".idx");
+    if( pcl::io::savePCDFileBinary(tmp_down, *down_cloud) != 0 || pcl::io::savePCDFileBinary(tmp_label, *label_cloud) != 0 )
+    {
+        std::remove(tmp_down.c_str());
+        std::remove(tmp_label.c_str());
+        return;
+    }
+
+    std::ofstream out(tmp_idx.c_str(), std::ios::out|std::ios::binary);
+    size_t seg_num = segs_to_cloud.size();
+    out.write((char*)&seg_num, sizeof(size_t));
+    for( size_t i = 0 ; i < seg_num ; i++ )
+    {
+        size_t len = segs_to_cloud[i].size();
+        out.write((char*)&len, sizeof(size_t));
+        if( len > 0 )
+            out.write((char*)&segs_to_cloud[i][0], len * sizeof(int));
+    }
+    size_t edge_num = graph.size();
+    out.write((char*)&edge_num, sizeof(size_t));
+    for( std::multimap<uint32_t, uint32_t>::const_iterator it = graph.begin() ; it != graph.end() ; it++ )
+    {
+        uint32_t edge[2] = {it->first, it->second};
+        out.write((char*)edge, sizeof(edge));
+    }
+    out.close();
+
+    if( commitFile(tmp_down, name + ".pcd") && commitFile(tmp_label, name + ".lbl.pcd") )
+        commitFile(tmp_idx, name + ".idx");
+    else
+        std::remove(tmp_idx.c_str());
+}
+
+std::vector<cv::Mat> featureCache::getHierFea(Hier_Pooler &producer, MulInfoT &data)
+{
+    uint64_t data_hash = hashCloud(data.cloud);
+    if( data.cloud_normals )
+        data_hash = hashNormals(data.cloud_normals, data_hash);
+    data_hash = hashCloud(data.down_cloud, data_hash);
+    std::string name = stagePath(data_hash, "hier_" + producer.getParamKey() + ".fea");
+
+    std::vector<cv::Mat> fea_set;
+    std::ifstream in(name.c_str(), std::ios::in|std::ios::binary);
+    if( in.is_open() == true )
+    {
+        // every feature matrix has one row per point of down_cloud
+        size_t num = 0;
+        in.read((char*)&num, sizeof(size_t));
+        for( size_t i = 0 ; i < num && in.good() ; i++ )
+        {
+            int header[3];
+            in.read((char*)header, sizeof(header));
+            if( in.good() == false || header[0] != (int)data.down_cloud->size() || header[1] < 0 )
+                break;
+            cv::Mat cur_fea(header[0], header[1], header[2]);
+            in.read((char*)cur_fea.data, cur_fea.total() * cur_fea.elemSize());
+            fea_set.push_back(cur_fea);
+        }
+        if( in.good() == true && num > 0 && fea_set.size() == num )
+            return fea_set;
+        std::cerr << "Corrupted cache: " << name << std::endl;
+        fea_set.clear();
+    }
+
+    fea_set = producer.getHierFea(data, 0);
+
+    boost::filesystem::create_directories(cache_path + hashToString(data_hash));
+    std::string tmp_name = tmpName(name);
+    std::ofstream out(tmp_name.c_str(), std::ios::out|std::ios::binary);
+    size_t num = fea_set.size();
+    out.write((char*)&num, sizeof(size_t));
+    for( size_t i = 0 ; i < num ; i++ )
+    {
+        cv::Mat cur_fea = fea_set[i].isContinuous() ? fea_set[i] : fea_set[i].clone();
+        int header[3] = {cur_fea.rows, cur_fea.cols, cur_fea.type()};
+        out.write((char*)header, sizeof(header));
+        out.write((char*)cur_fea.data, cur_fea.total() * cur_fea.elemSize());
+    }
+    out.close();
+    if( out.good() == true )
+        commitFile(tmp_name, name);
+    else
+        std::remove(tmp_name.c_str());
+    return fea_set;
+}
@@ -346,6 +346,13 @@ int main(int argc, char** argv)
     pcl::console::parse_argument(argc, argv, "--c1", c1);
     pcl::console::parse_argument(argc, argv, "--c2", c2);
     
+    // -fast: mini-batch flat kmeans instead of HierKmeans, -cmp: run both and report time and energy
+    bool fast_flag = pcl::console::find_switch(argc, argv, "-fast");
+    bool cmp_flag = pcl::console::find_switch(argc, argv, "-cmp");
+    // keep a uniform sample of at most maxp descriptors, 0 keeps all of them
+    int max_proto = 0;
+    pcl::console::parse_argument(argc, argv, "--maxp", max_proto);
+    
     boost::filesystem::create_directories(out_path);
     
     std::vector<cv::SiftFeatureDetector*> sift_det_vec;
@@ -369,6 +376,7 @@ int main(int argc, char** argv)
     }
     
     sparseK cluster_sift;
+    protoAccumulator sift_acc(max_proto);
     int count = 0;
 //    std::vector<cv::Mat> sift_set;
     for( int b1 = 0 ; b1 < UW_INST_MAX ; b1++ )
@@ -416,19 +424,18 @@ int main(int argc, char** argv)
             for(int k = 0 ; k < sift_descr.rows ; k++ )
                 cv::normalize(sift_descr.row(k), sift_descr.row(k));          
             
-            #pragma omp critical
-            {
-//                sift_set.push_back(sift_descr);
-                count++;
-                if( count % 100 == 0 )
-                    std::cerr << count << " ";
-                
-                int len = sift_descr.rows;
-                for( int p = 0 ; p < len ; p++)
-                    cluster_sift.AddData(sift_descr.row(p));
-            }
+            sift_acc.AddData(sift_descr);
+            
+            int cur_count;
+            #pragma omp atomic capture
+            cur_count = ++count;
+            if( cur_count % 100 == 0 )
+                std::cerr << cur_count << " ";
         }
     }
+    size_t seen_num = sift_acc.getSeenNum();
+    sift_acc.MergeInto(cluster_sift);
+    std::cerr << std::endl << "Descriptors: " << cluster_sift.proto_set.size() << "/" << seen_num << std::endl;
     
 //    std::cerr << "Start Kmeans...";
 //    cv::Mat final_sift;
@@ -444,7 +451,12 @@ int main(int argc, char** argv)
 //        cv::kmeans(final_sift, KK[i], labels, cv::TermCriteria(CV_TERMCRIT_ITER|CV_TERMCRIT_EPS, 500, 1e-6), 1, cv::KMEANS_PP_CENTERS, center_sift);
         std::cerr << "Clustering "<< KK[i] << std::endl;
         cv::Mat center_sift;
-        HierKmeans(cluster_sift.proto_set, center_sift, KK[i]);
+        if( cmp_flag == true )
+            CompareKmeans(cluster_sift.proto_set, center_sift, KK[i]);
+        else if( fast_flag == true )
+            MiniBatchKmeans(cluster_sift.proto_set, center_sift, KK[i]);
+        else
+            HierKmeans(cluster_sift.proto_set, center_sift, KK[i]);
         
         std::stringstream ss, ll;
         ss << KK[i];
@@ -1,6 +1,7 @@
 #include <opencv2/core/core.hpp>
 
 #include "sp_segmenter/features.h"
+#include "sp_segmenter/featureCache.h"
 #include "sp_segmenter/BBDataParser.h"
 #include "sp_segmenter/UWDataParser.h"
 #include "sp_segmenter/JHUDataParser.h"
@@ -29,8 +30,20 @@ int main(int argc, char** argv)
     pcl::console::parse_argument(argc, argv, "--rt", ratio);
     pcl::console::parse_argument(argc, argv, "--ss", down_ss);
     
+    // -stream: score level 0 first, skip the higher level superpixels rejected with margin >= rej
+    // and append the hard negatives to the .smat files while mining
+    bool stream_flag = pcl::console::find_switch(argc, argv, "-stream");
+    float reject_margin = 1.0;
+    pcl::console::parse_argument(argc, argv, "--rej", reject_margin);
+    // --cache: reuse the normals, superpixels and CSHOT features of each scene across runs
+    std::string cache_path;
+    pcl::console::parse_argument(argc, argv, "--cache", cache_path);
+    featureCache feature_cache(cache_path);
+    
     std::cerr << "Ratio: " << ratio << std::endl;
     std::cerr << "Downsample: " << down_ss << std::endl;
+    if( stream_flag )
+        std::cerr << "Streaming with Reject Margin: " << reject_margin << std::endl;
 /***************************************************************************************************************/
     Hier_Pooler hie_producer(radius);
     hie_producer.LoadDict_L0(shot_path, "200", "200");
@@ -53,7 +66,61 @@ int main(int argc, char** argv)
         binary_models[ll] = load_model((svm_path+"binary_L"+ss.str()+".model").c_str());
     }
     
-    if( true )
+    if( stream_flag )
+    {
+        std::vector< boost::shared_ptr<smatWriter> > writers(binary_models.size());
+        for( size_t ll = 0 ; ll < writers.size() ; ll++ )
+        {
+            std::stringstream mm;
+            mm << ll;
+            writers[ll] = boost::shared_ptr<smatWriter>(new smatWriter);
+            if( writers[ll]->open(svm_path + "hard/train_0_L" + mm.str() + ".smat") == false )
+            {
+                std::cerr << "Failed to open " << svm_path + "hard/train_0_L" + mm.str() + ".smat" << std::endl;
+                exit(0);
+            }
+        }
+        
+        size_t skip_num = 0;
+        for( size_t k = 0 ; k < background_name.size() ; k++ )
+        {
+            #pragma omp parallel for schedule(dynamic, 1) reduction(+:skip_num)
+            for( int j = 0 ; j < 200 ; j++ )
+            {
+                std::stringstream ss;
+                ss << j;
+
+                std::string filename(in_path + background_name[k] +"/" + background_name[k] + "_" + ss.str() + ".pcd");
+                if( exists_test(filename) == false )
+                {
+                    pcl::console::print_warn("Failed to Read: %s\n", filename.c_str());
+                    continue;
+                }
+                std::cerr << "Loading " << filename << std::endl;
+                pcl::PointCloud<PointT>::Ptr full_cloud(new pcl::PointCloud<PointT>());
+                pcl::io::loadPCDFile(filename, *full_cloud);
+
+                spPooler triple_pooler;
+                triple_pooler.setCache(&feature_cache);
+                triple_pooler.init(full_cloud, hie_producer, radius, down_ss);
+                triple_pooler.build_SP_LAB(lab_pooler_set, false);
+                
+                std::vector< std::vector<cv::Mat> > hard_set = triple_pooler.gethardNegtiveCascade(binary_models, reject_margin, false, &skip_num);
+                #pragma omp critical (hard_writer)
+                {
+                    for( size_t ll = 0 ; ll < hard_set.size() ; ll++ )
+                        for( std::vector<cv::Mat>::iterator it = hard_set[ll].begin(); it < hard_set[ll].end() ; it++ )
+                            writers[ll]->append(*it);
+                }
+                triple_pooler.reset();
+            }
+        }
+        
+        std::cerr << "Skipped Superpixels: " << skip_num << std::endl;
+        for( size_t ll = 0 ; ll < writers.size() ; ll++ )
+            std::cerr << "Hard Negatives L" << ll << ": " << writers[ll]->close() << std::endl;
+    }
+    else
     {
         int test_dim = -1;
         std::vector< std::vector< sparseVec> > final_test(MAX_LAYER);
@@ -79,6 +146,7 @@ int main(int argc, char** argv)
                 pcl::io::loadPCDFile(filename, *full_cloud);
 
                 spPooler triple_pooler;
+                triple_pooler.setCache(&feature_cache);
                 triple_pooler.init(full_cloud, hie_producer, radius, down_ss);
                 triple_pooler.build_SP_LAB(lab_pooler_set, false);
                 
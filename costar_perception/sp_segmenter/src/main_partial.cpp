@@ -1,4 +1,5 @@
 #include "sp_segmenter/features.h"
+#include "sp_segmenter/featureCache.h"
 #include "sp_segmenter/BBDataParser.h"
 #include "sp_segmenter/UWDataParser.h"
 #include "sp_segmenter/JHUDataParser.h"
@@ -30,6 +31,10 @@ int main(int argc, char** argv)
     pcl::console::parse_argument(argc, argv, "--rd", radius);
     pcl::console::parse_argument(argc, argv, "--rt", ratio);
     pcl::console::parse_argument(argc, argv, "--ss", down_ss);
+    // --cache: reuse the CSHOT features of each instance across runs
+    std::string cache_path;
+    pcl::console::parse_argument(argc, argv, "--cache", cache_path);
+    featureCache feature_cache(cache_path);
     
     if( pcl::console::find_switch(argc, argv, "-uw") == true )
         dataset_id = 0;
@@ -127,7 +132,7 @@ int main(int argc, char** argv)
             //double cur_t1, cur_t2;
             //cur_t1 = get_wall_time();
             
-            local_fea = hie_producer_3.getHierFea(*inst_ptr, 0);
+            local_fea = feature_cache.enabled() ? feature_cache.getHierFea(hie_producer_3, *inst_ptr) : hie_producer_3.getHierFea(*inst_ptr, 0);
             
             // RGB pool depth
             poolRGBLayer(shot_pooler_L1, *inst_ptr, local_fea[0], pool_fea_vec);
@@ -199,7 +204,7 @@ int main(int argc, char** argv)
             MulInfoT *inst_ptr = &test_objects[0][j];
             PreCloud(*inst_ptr, down_ss, false);
             
-            local_fea = hie_producer_3.getHierFea(*inst_ptr, 0);
+            local_fea = feature_cache.enabled() ? feature_cache.getHierFea(hie_producer_3, *inst_ptr) : hie_producer_3.getHierFea(*inst_ptr, 0);
             
             // RGB pool depth
             poolRGBLayer(shot_pooler_L1, *inst_ptr, local_fea[0], pool_fea_vec);
@@ -23,13 +23,13 @@
 #include <eigen3/Eigen/src/Geometry/Quaternion.h>
 
 // contains function for spatial data structure that also normalize the orientation of pose
-#include "sp_segmenter/spatial_pose.h"
+#include "sp_segmenter/object_persistence.h"
 
 #define OBJECT_MAX 100
 
 
 bool hasTF;
-objectRtree sp_segmenter_poses;
+objectPersistenceStore sp_segmenter_poses;
 
 // for orientation normalization
 std::map<std::string, objectSymmetry> objectDict;
@@ -185,12 +185,12 @@ void callback(const sensor_msgs::PointCloud2 &pc) {
 			std::cout << "# Poses found: " << all_poses.size() << std::endl;
             
             // normalize symmetric object Orientation
-            if (!hasTF) createTree(sp_segmenter_poses, objectDict, all_poses, ros::Time::now().toSec(), objectTFIndex);
-            else updateTree(sp_segmenter_poses, objectDict, all_poses, ros::Time::now().toSec(), objectTFIndex);
+            if (!hasTF) sp_segmenter_poses.create(objectDict, all_poses, ros::Time::now().toSec(), objectTFIndex);
+            else sp_segmenter_poses.update(objectDict, all_poses, ros::Time::now().toSec(), objectTFIndex);
             hasTF = true;
             
             all_poses.clear();
-            all_poses = getAllPoses(sp_segmenter_poses);
+            all_poses = sp_segmenter_poses.getAllPoses();
 
 			for (poseT &p: all_poses) {
 				geometry_msgs::Pose pmsg;
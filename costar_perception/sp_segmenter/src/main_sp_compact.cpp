@@ -1,5 +1,6 @@
 #include <opencv2/core/core.hpp>
 #include "sp_segmenter/features.h"
+#include "sp_segmenter/featureCache.h"
 #include "sp_segmenter/stringVectorArgsReader.h"
 
 // ros header for roslaunch capability
@@ -59,11 +60,14 @@ public:
     
     // modify order paramter
     void setOrder(int order_){order = order_;}
+    // cache the per-cloud normals, superpixels and CSHOT features under cache_path
+    void setCachePath(std::string cache_path){feature_cache = boost::shared_ptr<featureCache> (new featureCache(cache_path));}
 
 private:
     void readData(std::string path, ObjectSet &scene_set);
     std::vector<std::string> readData(std::string path);
     boost::shared_ptr<Hier_Pooler> hie_producer;
+    boost::shared_ptr<featureCache> feature_cache;
     
     std::vector< boost::shared_ptr<Pooler_L0> > sift_pooler_set;
     std::vector< boost::shared_ptr<Pooler_L0> > fpfh_pooler_set;
@@ -190,9 +194,13 @@ int main(int argc, char** argv)
 
     bool skip_fea;
     nh.param("skip_fea",skip_fea,false);
+    std::string feature_cache_path;
+    nh.param("feature_cache_path",feature_cache_path,std::string(""));
     
     feaExtractor object_ext(shot_path, sift_path, fpfh_path);
     feaExtractor background_ext(shot_path, sift_path, fpfh_path);
+    object_ext.setCachePath(feature_cache_path);
+    background_ext.setCachePath(feature_cache_path);
     
     // extracting features for object classes
     if (!skip_fea) extractFea(root_path,out_fea_path,obj_names,bg_names,object_ext,background_ext);
@@ -429,6 +437,7 @@ int feaExtractor::computeFeature(std::string in_path, std::vector< std::vector<s
 	        
 	        // disable sift and fpfh pooling for now
 	        spPooler triple_pooler;
+	        triple_pooler.setCache(feature_cache.get());
 	        triple_pooler.lightInit(full_cloud, *hie_producer, radius, down_ss);
 	        triple_pooler.build_SP_LAB(lab_pooler_set, false);
 	//        triple_pooler.build_SP_FPFH(fpfh_pooler_set, radius, false);
@@ -1,8 +1,19 @@
 #include "sp_segmenter/features.h"
+#include "sp_segmenter/utility/packedSmat.h"
 
 model* TrainMultiSVM(std::string fea_path, int l1, int l2, float CC, bool tacc_flag);
 //model* TrainBinarySVM(std::string fea_path, int l1, int l2, float CC, bool tacc_flag);
 model* TrainBinarySVM(std::string fea_path, std::vector<std::string> background_path, int l1, int l2, float CC, bool tacc_flag);
+void ReportQuantizedBinary(const model *cur_model, std::string fea_path, std::vector<std::string> background_path, int ll);
+
+struct smatFile{
+    std::string name;
+    int label;
+    std::vector< std::pair<int, int> > piece_inds;
+};
+std::vector<smatFile> BinaryFiles(std::string fea_path, std::vector<std::string> background_path, int l1, int l2, std::string prefix);
+std::vector<smatFile> MultiFiles(std::string fea_path, int l1, int l2, std::string prefix);
+model* TrainSVMDriver(const std::vector<smatFile> &files, const std::vector<float> &CC_set, bool packed_flag = false);
 
 #define HARD
 #ifndef HARD
@@ -81,6 +92,17 @@ int main(int argc, char** argv)
     float CCB = 0.01, CCM = 0.01;
     pcl::console::parse_argument(argc, argv, "--CCB", CCB);
     pcl::console::parse_argument(argc, argv, "--CCM", CCM);
+    // compare the int8 quantized model against the float model on the test_*.smat files
+    bool quant_flag = pcl::console::find_switch(argc, argv, "-q");
+    // -par: parallel training driver, --CCBs/--CCMs give C candidates (e.g. 0.1,0.01,0.001) chosen on held-out samples
+    // -multi: train the multi-class models as well
+    bool par_flag = pcl::console::find_switch(argc, argv, "-par");
+    bool multi_flag = pcl::console::find_switch(argc, argv, "-multi");
+    // -packed: with -par, convert the .smat files to memory-mapped .psmat files and train on them without copying rows
+    bool packed_flag = pcl::console::find_switch(argc, argv, "-packed");
+    std::vector<float> CCB_set, CCM_set;
+    pcl::console::parse_x_arguments(argc, argv, "--CCBs", CCB_set);
+    pcl::console::parse_x_arguments(argc, argv, "--CCMs", CCM_set);
     
     for( int ll = 0 ; ll <= 2 ; ll++ )
     {
@@ -94,8 +116,33 @@ int main(int argc, char** argv)
         else
             CCB = 0.001;
 
-        model *cur_model = TrainBinarySVM(in_path, background_path, ll, ll, CCB, true);
+        model *cur_model;
+        if( par_flag )
+        {
+            std::vector<float> cur_CC_set = CCB_set.empty() ? std::vector<float>(1, CCB) : CCB_set;
+            cur_model = TrainSVMDriver(BinaryFiles(in_path, background_path, ll, ll, "train"), cur_CC_set, packed_flag);
+        }
+        else
+            cur_model = TrainBinarySVM(in_path, background_path, ll, ll, CCB, true);
         save_model((out_path + "binary_L"+ss.str()+"_f.model").c_str(), cur_model);
+        if( quant_flag )
+            ReportQuantizedBinary(cur_model, in_path, background_path, ll);
+    }
+    
+    for( int ll = 0 ; multi_flag && ll <= 4 ; ll++ )
+    {
+        std::stringstream ss;
+        ss << ll;
+        
+        model *cur_model;
+        if( par_flag )
+        {
+            std::vector<float> cur_CC_set = CCM_set.empty() ? std::vector<float>(1, CCM) : CCM_set;
+            cur_model = TrainSVMDriver(MultiFiles(in_path, ll, ll, "train"), cur_CC_set, packed_flag);
+        }
+        else
+            cur_model = TrainMultiSVM(in_path, ll, ll, CCM, true);
+        save_model((out_path + "multi_L"+ss.str()+".model").c_str(), cur_model);
     }
    
     return 1;
@@ -271,7 +318,62 @@ model* TrainBinarySVM(std::string fea_path, std::vector<std::string> background_
     return cur_model;
 }
 
-
+void ReportQuantizedBinary(const model *cur_model, std::string fea_path, std::vector<std::string> background_path, int ll)
+{
+    std::vector< std::pair<int, int> > piece_inds1;
+    std::vector< std::pair<int, int> > piece_inds2;
+    piece_inds2.push_back(std::pair<int, int> (0, 90000));
+    std::vector<problem> test_prob_set;
+    std::stringstream mm;
+    mm << ll;
+    
+    for( int i = 0 ; i <= 10  ; i++ )
+    {
+        std::stringstream ss;
+        ss << i;
+        std::vector<std::string> test_names;
+        if( i == 0 )
+        {
+            for( size_t k = 0 ; k < background_path.size() ; k++ )
+                test_names.push_back(background_path[k] + "test_0_L"+mm.str()+".smat");
+        }
+        else
+            test_names.push_back(fea_path + "test_"+ss.str()+"_L"+mm.str()+".smat");
+        
+        for( size_t k = 0 ; k < test_names.size() ; k++ )
+        {
+            if( exists_test(test_names[k]) == false )
+                continue;
+            
+            std::cerr << "Reading: " << test_names[k] << std::endl;
+            std::vector<SparseDataOneClass> cur_data(1);
+            int fea_dim = i == 0 ? readSoluSparse_piecewise(test_names[k], cur_data[0].fea_vec, piece_inds1) 
+                                 : readSoluSparse_piecewise(test_names[k], cur_data[0].fea_vec, piece_inds2);
+            cur_data[0].label = i == 0 ? 1 : 2;
+            
+            problem tmp;
+            FormFeaSparseMat(cur_data, tmp, cur_data[0].fea_vec.size(), fea_dim);
+            test_prob_set.push_back(tmp);
+        }
+    }
+    if( test_prob_set.empty() == true )
+    {
+        std::cerr << "No held-out test_*_L" << ll << ".smat files for the quantized model!" << std::endl;
+        return;
+    }
+    problem test_prob;
+    test_prob.l = 0;
+    mergeProbs(test_prob_set, test_prob);
+    
+    std::cerr << "Binary L" << ll << " Quantized Evaluation:" << std::endl;
+    quantizedModel qmodel(cur_model);
+    evalQuantizedModel(cur_model, qmodel, test_prob);
+    
+    free(test_prob.y);
+    for( int i = 0 ; i < test_prob.l ; i++ )
+        free(test_prob.x[i]);
+    free(test_prob.x);
+}
 
 /*model* TrainLinearSVM(std::string fea_path, int c1, int c2, float CC, bool tacc_flag)
 {
@@ -433,3 +535,302 @@ model* TrainBinarySVM(std::string fea_path, std::vector<std::string> background_
         }
         train_objects.clear();
     }*/
+
+// Training driver: the feature files are read in parallel, the one-vs-rest classes and
+// the C candidates are trained concurrently and assembled into liblinear models
+std::vector<smatFile> BinaryFiles(std::string fea_path, std::vector<std::string> background_path, int l1, int l2, std::string prefix)
+{
+    std::vector<smatFile> files;
+    std::vector< std::pair<int, int> > piece_inds2;
+    piece_inds2.push_back(std::pair<int, int> (0, 90000));
+    for( int ll = l1 ; ll <= l2 ; ll++ )
+    {
+        std::stringstream mm;
+        mm << ll;
+        for( size_t i = 0 ; i < background_path.size() ; i++ )
+        {
+            smatFile cur_file;
+            cur_file.name = background_path[i] + prefix + "_0_L"+mm.str()+".smat";
+            cur_file.label = 1;
+            files.push_back(cur_file);
+        }
+        for( int i = 1 ; i <= 10 ; i++ )
+        {
+            std::stringstream ss;
+            ss << i;
+            smatFile cur_file;
+            cur_file.name = fea_path + prefix + "_"+ss.str()+"_L"+mm.str()+".smat";
+            cur_file.label = 2;
+            cur_file.piece_inds = piece_inds2;
+            files.push_back(cur_file);
+        }
+    }
+    return files;
+}
+
+std::vector<smatFile> MultiFiles(std::string fea_path, int l1, int l2, std::string prefix)
+{
+    std::vector<smatFile> files;
+    for( int i = 1 ; i <= 10 ; i++ )
+    {
+        std::stringstream ss;
+        ss << i;
+        for( int ll = l1 ; ll <= l2 ; ll++ )
+        {
+            std::stringstream mm;
+            mm << ll;
+            smatFile cur_file;
+            cur_file.name = fea_path + prefix + "_"+ss.str()+"_L"+mm.str()+".smat";
+            cur_file.label = i;
+            files.push_back(cur_file);
+        }
+    }
+    return files;
+}
+
+bool ReadSmatFiles(const std::vector<smatFile> &files, problem &prob)
+{
+    int file_num = files.size();
+    std::vector<problem> prob_set(file_num);
+    std::vector<char> valid(file_num, 0);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for( int i = 0 ; i < file_num ; i++ )
+    {
+        if( exists_test(files[i].name) == false )
+            continue;
+        std::vector<SparseDataOneClass> cur_data(1);
+        int fea_dim = readSoluSparse_piecewise(files[i].name, cur_data[0].fea_vec, files[i].piece_inds);
+        cur_data[0].label = files[i].label;
+        
+        FormFeaSparseMat(cur_data, prob_set[i], cur_data[0].fea_vec.size(), fea_dim);
+        valid[i] = 1;
+        #pragma omp critical
+        {std::cerr << "Read: " << files[i].name << std::endl;}
+    }
+    
+    std::vector<problem> valid_prob_set;
+    for( int i = 0 ; i < file_num ; i++ )
+        if( valid[i] == 1 )
+            valid_prob_set.push_back(prob_set[i]);
+    if( valid_prob_set.empty() == true )
+        return false;
+    
+    prob.l = 0;
+    mergeProbs(valid_prob_set, prob);
+    return true;
+}
+
+// packed copy next to the .smat file, the column pieces are part of the name
+std::string PackedName(const smatFile &file)
+{
+    std::stringstream ss;
+    ss << file.name.substr(0, file.name.size() - 5);
+    for( size_t k = 0 ; k < file.piece_inds.size() ; k++ )
+        ss << "_c" << file.piece_inds[k].first << "-" << file.piece_inds[k].second;
+    ss << ".psmat";
+    return ss.str();
+}
+
+// the packed files are rebuilt when missing or older than their .smat file
+bool ReadPackedFiles(const std::vector<smatFile> &files, problem &prob, std::vector< boost::shared_ptr<packedSmat> > &mats)
+{
+    int file_num = files.size();
+    std::vector< boost::shared_ptr<packedSmat> > cur_mats(file_num);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for( int i = 0 ; i < file_num ; i++ )
+    {
+        if( exists_test(files[i].name) == false )
+            continue;
+        std::string packed_name = PackedName(files[i]);
+        if( exists_test(packed_name) == false
+                || boost::filesystem::last_write_time(packed_name) < boost::filesystem::last_write_time(files[i].name) )
+        {
+            if( packSmat(files[i].name, packed_name, files[i].piece_inds) < 0 )
+            {
+                std::cerr << "Failed to pack " << files[i].name << std::endl;
+                exit(0);
+            }
+        }
+        boost::shared_ptr<packedSmat> cur_mat(new packedSmat);
+        if( cur_mat->open(packed_name) == false )
+        {
+            std::cerr << "Failed to map " << packed_name << std::endl;
+            exit(0);
+        }
+        cur_mats[i] = cur_mat;
+        #pragma omp critical
+        {std::cerr << "Mapped: " << packed_name << std::endl;}
+    }
+    
+    std::vector<packedSmat*> valid_mats;
+    std::vector<int> labels;
+    for( int i = 0 ; i < file_num ; i++ )
+    {
+        if( cur_mats[i] )
+        {
+            mats.push_back(cur_mats[i]);
+            valid_mats.push_back(cur_mats[i].get());
+            labels.push_back(files[i].label);
+        }
+    }
+    if( valid_mats.empty() == true )
+        return false;
+    
+    FormPackedProblem(valid_mats, labels, prob);
+    return true;
+}
+
+double SVMAccuracy(const model *cur_model, const problem &prob)
+{
+    int corr = 0;
+    #pragma omp parallel for reduction(+:corr)
+    for( int j = 0 ; j < prob.l ; j++ )
+    {
+        int true_label = floor(prob.y[j]+0.0001);
+        int pred_label = floor(predict(cur_model, prob.x[j])+0.0001);
+        corr += pred_label == true_label;
+    }
+    return prob.l > 0 ? (corr+0.0)/prob.l : 0;
+}
+
+std::vector<model*> TrainOneVsRest(const problem &prob, const std::vector<int> &labels, const std::vector<float> &CC_set)
+{
+    // a binary problem is a single task, otherwise one task per class and C
+    int nr_class = labels.size();
+    int class_task = nr_class == 2 ? 1 : nr_class;
+    int task_num = CC_set.size() * class_task;
+    std::vector<model*> task_models(task_num);
+    
+    #pragma omp parallel for schedule(dynamic, 1)
+    for( int t = 0 ; t < task_num ; t++ )
+    {
+        parameter param;
+        GenSVMParamter(param, CC_set[t / class_task]);
+        param.nr_thread = 1;
+        
+        problem sub_prob = prob;
+        std::vector<double> sub_y;
+        if( nr_class > 2 )
+        {
+            int pos_label = labels[t % class_task];
+            sub_y.resize(prob.l);
+            for( int j = 0 ; j < prob.l ; j++ )
+                sub_y[j] = floor(prob.y[j]+0.0001) == pos_label ? 1 : -1;
+            sub_prob.y = &sub_y[0];
+        }
+        task_models[t] = train(&sub_prob, &param);
+        destroy_param(&param);
+    }
+    
+    std::vector<model*> models(CC_set.size());
+    for( size_t c = 0 ; c < CC_set.size() ; c++ )
+    {
+        if( nr_class == 2 )
+        {
+            models[c] = task_models[c];
+            continue;
+        }
+        // same layout as the one-vs-rest model of train(): w[j*nr_class+i], labels in order of appearance
+        model *first = task_models[c*class_task];
+        int w_size = first->bias >= 0 ? first->nr_feature + 1 : first->nr_feature;
+        model *cur_model = (model *)malloc(sizeof(model));
+        cur_model->param = first->param;
+        cur_model->nr_class = nr_class;
+        cur_model->nr_feature = first->nr_feature;
+        cur_model->bias = first->bias;
+        cur_model->label = (int *)malloc(sizeof(int)*nr_class);
+        cur_model->w = (double *)malloc(sizeof(double)*w_size*nr_class);
+        for( int i = 0 ; i < nr_class ; i++ )
+        {
+            model *bin_model = task_models[c*class_task+i];
+            double sign = bin_model->label[0] == 1 ? 1 : -1;
+            cur_model->label[i] = labels[i];
+            for( int j = 0 ; j < w_size ; j++ )
+                cur_model->w[j*nr_class+i] = sign * bin_model->w[j];
+            free_and_destroy_model(&bin_model);
+        }
+        models[c] = cur_model;
+    }
+    return models;
+}
+
+model* TrainSVMSweep(const problem &prob, const std::vector<float> &CC_set, float &best_CC)
+{
+    std::vector<int> labels;
+    for( int j = 0 ; j < prob.l ; j++ )
+    {
+        int cur_label = floor(prob.y[j]+0.0001);
+        if( std::find(labels.begin(), labels.end(), cur_label) == labels.end() )
+            labels.push_back(cur_label);
+    }
+    
+    best_CC = CC_set[0];
+    if( CC_set.size() > 1 )
+    {
+        // every fifth sample is held out to select C
+        std::vector<feature_node*> train_x, val_x;
+        std::vector<double> train_y, val_y;
+        for( int j = 0 ; j < prob.l ; j++ )
+        {
+            if( j % 5 == 4 )
+            {
+                val_x.push_back(prob.x[j]);
+                val_y.push_back(prob.y[j]);
+            }
+            else
+            {
+                train_x.push_back(prob.x[j]);
+                train_y.push_back(prob.y[j]);
+            }
+        }
+        problem train_prob = prob, val_prob = prob;
+        train_prob.l = train_x.size();
+        train_prob.x = &train_x[0];
+        train_prob.y = &train_y[0];
+        val_prob.l = val_x.size();
+        val_prob.x = &val_x[0];
+        val_prob.y = &val_y[0];
+        
+        std::vector<model*> models = TrainOneVsRest(train_prob, labels, CC_set);
+        double best_acc = -1;
+        for( size_t c = 0 ; c < CC_set.size() ; c++ )
+        {
+            double acc = SVMAccuracy(models[c], val_prob);
+            std::cerr << "C = " << CC_set[c] << " Validation Accuracy: " << acc << std::endl;
+            if( acc > best_acc )
+            {
+                best_acc = acc;
+                best_CC = CC_set[c];
+            }
+            free_and_destroy_model(&models[c]);
+        }
+        std::cerr << "Selected C = " << best_CC << std::endl;
+    }
+    
+    std::vector<float> final_CC(1, best_CC);
+    model *cur_model = TrainOneVsRest(prob, labels, final_CC)[0];
+    std::cerr << "Training Accuracy: " << SVMAccuracy(cur_model, prob) << std::endl;
+    return cur_model;
+}
+
+model* TrainSVMDriver(const std::vector<smatFile> &files, const std::vector<float> &CC_set, bool packed_flag)
+{
+    problem train_prob;
+    std::vector< boost::shared_ptr<packedSmat> > mats;
+    bool read_flag = packed_flag ? ReadPackedFiles(files, train_prob, mats) : ReadSmatFiles(files, train_prob);
+    if( read_flag == false )
+    {
+        std::cerr << "No training files found!" << std::endl;
+        exit(0);
+    }
+    
+    float best_CC;
+    model *cur_model = TrainSVMSweep(train_prob, CC_set, best_CC);
+    
+    free(train_prob.y);
+    // packed rows belong to the mappings
+    for( int i = 0 ; packed_flag == false && i < train_prob.l ; i++ )
+        free(train_prob.x[i]);
+    free(train_prob.x);
+    return cur_model;
+}
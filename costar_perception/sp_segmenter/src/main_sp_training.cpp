@@ -1,6 +1,7 @@
 #include <opencv2/core/core.hpp>
 
 #include "sp_segmenter/features.h"
+#include "sp_segmenter/featureCache.h"
 #include "sp_segmenter/BBDataParser.h"
 #include "sp_segmenter/UWDataParser.h"
 #include "sp_segmenter/JHUDataParser.h"
@@ -48,6 +49,10 @@ int main(int argc, char** argv)
     pcl::console::parse_argument(argc, argv, "--rt", ratio);
     pcl::console::parse_argument(argc, argv, "--ss", down_ss);
 //    pcl::console::parse_argument(argc, argv, "--sigma", sigma);
+    // --cache: reuse the normals, superpixels and CSHOT features of each scene across runs
+    std::string cache_path;
+    pcl::console::parse_argument(argc, argv, "--cache", cache_path);
+    featureCache feature_cache(cache_path);
     
     std::cerr << "Ratio: " << ratio << std::endl;
     std::cerr << "Downsample: " << down_ss << std::endl;
@@ -149,6 +154,7 @@ int main(int argc, char** argv)
                     full_cloud->is_dense = false;
 
                     spPooler triple_pooler;
+                    triple_pooler.setCache(&feature_cache);
                     triple_pooler.init(full_cloud, hie_producer, radius, down_ss);
                     triple_pooler.build_SP_LAB(lab_pooler_set, false);
                     triple_pooler.build_SP_FPFH(fpfh_pooler_set, radius, false);
@@ -236,6 +242,7 @@ int main(int argc, char** argv)
                 pcl::io::loadPCDFile(filename, *full_cloud);
 
                 spPooler triple_pooler;
+                triple_pooler.setCache(&feature_cache);
                 triple_pooler.init(full_cloud, hie_producer, radius, down_ss);
                 triple_pooler.build_SP_LAB(lab_pooler_set, false);
 
@@ -0,0 +1,186 @@
+#include "sp_segmenter/quantizedSVM.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+static inline int8_t quantizeValue(float val, float inv_scale)
+{
+    float q = std::floor(val * inv_scale + 0.5f);
+    if( q > 127.0f )
+        q = 127.0f;
+    else if( q < -127.0f )
+        q = -127.0f;
+    return (int8_t)q;
+}
+
+// quantize a block of at most QUANT_BLOCK values, return its scale
+static float quantizeBlock(const float *src, int len, int8_t *dst)
+{
+    float max_abs = 0;
+    for( int i = 0 ; i < len ; i++ )
+        if( std::fabs(src[i]) > max_abs && src[i] == src[i] )
+            max_abs = std::fabs(src[i]);
+
+    if( max_abs <= 0 )
+    {
+        std::fill(dst, dst + QUANT_BLOCK, 0);
+        return 0;
+    }
+    float scale = max_abs / 127.0f;
+    float inv_scale = 1.0f / scale;
+    for( int i = 0 ; i < len ; i++ )
+        dst[i] = src[i] == src[i] ? quantizeValue(src[i], inv_scale) : 0;
+    std::fill(dst + len, dst + QUANT_BLOCK, 0);
+    return scale;
+}
+
+void quantizeFea(const float *fea, int dim, quantizedFea &qfea)
+{
+    int block_num = (dim + QUANT_BLOCK - 1) / QUANT_BLOCK;
+    qfea.data.resize(block_num * QUANT_BLOCK);
+    qfea.scale.resize(block_num);
+    for( int b = 0 ; b < block_num ; b++ )
+    {
+        int len = std::min(QUANT_BLOCK, dim - b * QUANT_BLOCK);
+        qfea.scale[b] = quantizeBlock(fea + b * QUANT_BLOCK, len, &qfea.data[b * QUANT_BLOCK]);
+    }
+}
+
+void quantizeFea(const cv::Mat &fea, quantizedFea &qfea)
+{
+    cv::Mat cur_fea = fea.isContinuous() ? fea : fea.clone();
+    quantizeFea(cur_fea.ptr<float>(0), cur_fea.cols * cur_fea.rows, qfea);
+}
+
+int32_t dotInt8Block(const int8_t *a, const int8_t *b)
+{
+#if defined(__AVX2__)
+    __m256i a0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)a));
+    __m256i b0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)b));
+    __m256i a1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(a + 16)));
+    __m256i b1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b + 16)));
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    __m256i acc = _mm256_dpwssd_epi32(_mm256_setzero_si256(), a0, b0);
+    acc = _mm256_dpwssd_epi32(acc, a1, b1);
+#else
+    __m256i acc = _mm256_add_epi32(_mm256_madd_epi16(a0, b0), _mm256_madd_epi16(a1, b1));
+#endif
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_hadd_epi32(sum, sum);
+    sum = _mm_hadd_epi32(sum, sum);
+    return _mm_cvtsi128_si32(sum);
+#else
+    int32_t sum = 0;
+    for( int i = 0 ; i < QUANT_BLOCK ; i++ )
+        sum += (int32_t)a[i] * (int32_t)b[i];
+    return sum;
+#endif
+}
+
+quantizedModel::quantizedModel() : nr_class(0), nr_w(0), dim(-1), block_num(0)
+{
+}
+
+quantizedModel::quantizedModel(const model *cur_model) : nr_class(0), nr_w(0), dim(-1), block_num(0)
+{
+    build(cur_model);
+}
+
+void quantizedModel::build(const model *cur_model)
+{
+    nr_class = cur_model->nr_class;
+    nr_w = (nr_class == 2 && cur_model->param.solver_type != MCSVM_CS) ? 1 : nr_class;
+    // the last feature column is the bias term appended by FormFeaSparseMat
+    dim = cur_model->nr_feature - 1;
+    block_num = (dim + QUANT_BLOCK - 1) / QUANT_BLOCK;
+
+    label.assign(cur_model->label, cur_model->label + nr_class);
+    weights.assign(nr_w * block_num * QUANT_BLOCK, 0);
+    scales.assign(nr_w * block_num, 0);
+    bias.assign(nr_w, 0);
+
+    std::vector<float> row(dim);
+    for( int i = 0 ; i < nr_w ; i++ )
+    {
+        for( int j = 0 ; j < dim ; j++ )
+            row[j] = cur_model->w[j * nr_w + i];
+        for( int b = 0 ; b < block_num ; b++ )
+        {
+            int len = std::min(QUANT_BLOCK, dim - b * QUANT_BLOCK);
+            scales[i * block_num + b] = quantizeBlock(&row[b * QUANT_BLOCK], len, &weights[(i * block_num + b) * QUANT_BLOCK]);
+        }
+        bias[i] = cur_model->w[dim * nr_w + i] * cur_model->bias;
+    }
+}
+
+double quantizedModel::predictValues(const quantizedFea &qfea, double *dec_values) const
+{
+    if( (int)qfea.scale.size() != block_num )
+    {
+        std::cerr << "qfea.scale.size() != block_num" << std::endl;
+        exit(0);
+    }
+
+    for( int i = 0 ; i < nr_w ; i++ )
+    {
+        const int8_t *w_row = &weights[i * block_num * QUANT_BLOCK];
+        const float *s_row = &scales[i * block_num];
+        double sum = bias[i];
+        for( int b = 0 ; b < block_num ; b++ )
+        {
+            float cur_scale = qfea.scale[b] * s_row[b];
+            if( cur_scale == 0 )
+                continue;
+            sum += cur_scale * dotInt8Block(&qfea.data[b * QUANT_BLOCK], w_row + b * QUANT_BLOCK);
+        }
+        dec_values[i] = sum;
+    }
+
+    if( nr_class == 2 )
+        return dec_values[0] > 0 ? label[0] : label[1];
+
+    int dec_max_idx = 0;
+    for( int i = 1 ; i < nr_class ; i++ )
+        if( dec_values[i] > dec_values[dec_max_idx] )
+            dec_max_idx = i;
+    return label[dec_max_idx];
+}
+
+double evalQuantizedModel(const model *cur_model, const quantizedModel &qmodel, const problem &prob)
+{
+    int dim = qmodel.getDim();
+    int corr_f = 0, corr_q = 0, agree = 0;
+    std::vector<double> dec_values(cur_model->nr_class);
+
+    #pragma omp parallel for schedule(dynamic, 64) firstprivate(dec_values) reduction(+:corr_f,corr_q,agree)
+    for( int j = 0 ; j < prob.l ; j++ )
+    {
+        std::vector<float> dense(dim, 0);
+        for( const feature_node *it = prob.x[j] ; it->index != -1 ; it++ )
+            if( it->index <= dim )
+                dense[it->index - 1] = it->value;
+        quantizedFea qfea;
+        quantizeFea(&dense[0], dim, qfea);
+
+        int true_label = floor(prob.y[j] + 0.0001);
+        int pred_f = floor(predict(cur_model, prob.x[j]) + 0.0001);
+        int pred_q = floor(qmodel.predictValues(qfea, &dec_values[0]) + 0.0001);
+        corr_f += pred_f == true_label;
+        corr_q += pred_q == true_label;
+        agree += pred_f == pred_q;
+    }
+
+    double acc_f = prob.l > 0 ? (corr_f + 0.0) / prob.l : 0;
+    double acc_q = prob.l > 0 ? (corr_q + 0.0) / prob.l : 0;
+    std::cerr << "Float Accuracy: " << acc_f << std::endl;
+    std::cerr << "Quantized Accuracy: " << acc_q << std::endl;
+    std::cerr << "Accuracy Delta: " << acc_q - acc_f << std::endl;
+    std::cerr << "Prediction Agreement: " << (prob.l > 0 ? (agree + 0.0) / prob.l : 0) << std::endl;
+    return acc_q - acc_f;
+}
@@ -23,7 +23,6 @@ void semanticSegmentation::setNodeHandle(const ros::NodeHandle &nh)
     this->nh = nh;
     initializeSemanticSegmentation(); // initialize all variables before doing semantic segmentation
     this->classReady = true;
-    this->doingGripperSegmentation = false;
     this->number_of_segmentation_done = 0;
 }
 
@@ -107,10 +106,19 @@ void semanticSegmentation::initializeSemanticSegmentation()
     this->nh.param("preferredOrientation",targetNormalObjectTF,std::string("/world"));
     this->nh.param("useBinarySVM",useBinarySVM,false);
     this->nh.param("useMultiClassSVM",useMultiClassSVM,true);
+    this->nh.param("useQuantizedSVM",useQuantizedSVM,false);
     this->nh.param("useMedianFilter",use_median_filter,true);
     this->nh.param("enableTracking",enableTracking,false);
     
     this->nh.param("useObjectPersistence",useObjectPersistence,false);
+    double objectMatchDistance;
+    int objectMaxMissedUpdates;
+    this->nh.param("objectMatchDistance",objectMatchDistance,0.025);
+    this->nh.param("objectMaxMissedUpdates",objectMaxMissedUpdates,0);
+    segmentedObjectTree.setMatchDistance(objectMatchDistance);
+    segmentedObjectTree.setMaxMissedUpdates(std::max(objectMaxMissedUpdates,0));
+    // remove the object parameters left from a previous run
+    tfPublisher.clearParams("/instructor_landmark/objects");
 
     crop_box_size = Eigen::Vector3f(cropBoxX, cropBoxY, cropBoxZ);
     tableConvexHull = pcl::PointCloud<PointT>::Ptr(new pcl::PointCloud<PointT>);
@@ -200,7 +208,13 @@ void semanticSegmentation::initializeSemanticSegmentation()
         combinedObjRec->setParams(objectVisibility,sceneVisibility);
         combinedObjRec->setUseCUDA(use_cuda);
     }
-    else objrec.resize(cur_name.size());
+    else
+    {
+        objrec.resize(cur_name.size());
+        objrecMutex.resize(cur_name.size());
+        for (std::size_t i = 0; i < objrecMutex.size(); i++)
+            objrecMutex[i] = boost::shared_ptr<boost::mutex>(new boost::mutex);
+    }
 
     for (int model_id = 0; model_id < cur_name.size(); model_id++)
     {
@@ -272,6 +286,19 @@ void semanticSegmentation::initializeSemanticSegmentation()
         if (cur_name.size() > 1) // doing more than one object classisfication
             multi_models[ll] = load_model((svm_path+"multi_L"+ss.str()+"_f.model").c_str());
     }
+
+    if (useQuantizedSVM)
+    {
+        std::cerr << "Using int8 quantized SVM models\n";
+        binary_qmodels.resize(binary_models.size());
+        multi_qmodels.resize(multi_models.size());
+        for( int ll = 0 ; ll < 3 ; ll++ )
+        {
+            binary_qmodels[ll].build(binary_models[ll]);
+            if (cur_name.size() > 1)
+                multi_qmodels[ll].build(multi_models[ll]);
+        }
+    }
     
     if( view_flag )
     {
@@ -294,6 +321,8 @@ void semanticSegmentation::initializeSemanticSegmentation()
           std::cout << "Warning: tried to add duplicate model name to tracker" << std::endl;
        }
       }
+      // the tracker seeds itself from the published poses
+      tracker->setPoseSnapshot(&poseSnapshot);
     }
 }
 
@@ -321,36 +350,28 @@ void semanticSegmentation::cropPointCloud(pcl::PointCloud<PointT>::Ptr &cloud_in
   cloud_input = cropped_cloud;
 }
 
-void semanticSegmentation::callbackPoses(const sensor_msgs::PointCloud2 &inputCloud)
+void semanticSegmentation::callbackPoses(const sensor_msgs::PointCloud2ConstPtr &inputCloud)
 {
     if (!classReady) return;
-    if (useTableSegmentation && !table_corner_published)
-    {
-        if (!haveTable) haveTable = getAndSaveTable(inputCloud);
-        
-        if (haveTable) { // publish the table corner
-            table_corner_published = true;
-            sensor_msgs::PointCloud2 output_msg;
-            toROSMsg(*tableConvexHull,output_msg);
-            output_msg.header.frame_id = inputCloud.header.frame_id;
-            std::cerr << "Published table corner point cloud\n";
-            table_corner_pub.publish(output_msg);
-        }
-        else return; // still does not have table
-    }
+    if (useTableSegmentation && !updateTable(*inputCloud))
+        return; // still does not have table
+    
+    pcl::PointCloud<PointT>::Ptr table_hull;
+    tf::Transform table_tf;
+    getTable(table_hull, table_tf);
     
     // Service call will run SPSegmenter
     pcl::PointCloud<PointT>::Ptr full_cloud(new pcl::PointCloud<PointT>());
     pcl::PointCloud<PointLT>::Ptr final_cloud(new pcl::PointCloud<PointLT>());
     
-    fromROSMsg(inputCloud,*full_cloud); // convert to PCL format
+    fromROSMsg(*inputCloud,*full_cloud); // convert to PCL format
     if (full_cloud->size() < 1){
         std::cerr << "No cloud available!\n";
         return;
     }
     
     if (useTableSegmentation) {
-      segmentCloudAboveTable(full_cloud, tableConvexHull, aboveTableMin, aboveTableMax);
+      segmentCloudAboveTable(full_cloud, table_hull, aboveTableMin, aboveTableMax);
     }
 
     if (full_cloud->size() < 1){
@@ -360,7 +381,7 @@ void semanticSegmentation::callbackPoses(const sensor_msgs::PointCloud2 &inputCl
 
     if(useCropBox) {
       Eigen::Affine3d cam_tf_in_table;
-      tf::transformTFToEigen(table_transform.inverse(), cam_tf_in_table);
+      tf::transformTFToEigen(table_tf.inverse(), cam_tf_in_table);
       cropPointCloud(full_cloud, cam_tf_in_table.cast<float>(), crop_box_size);
     }
     
@@ -370,12 +391,15 @@ void semanticSegmentation::callbackPoses(const sensor_msgs::PointCloud2 &inputCl
     }
     
     // get all poses from spSegmenterCallback
-    std::vector<poseT> all_poses = spSegmenterCallback(full_cloud,*final_cloud);
+    segmentationContext context;
+    context.inputCloud = inputCloud;
+    context.objRecRANSACdetector = objRecRANSACdetector;
+    std::vector<poseT> all_poses = spSegmenterCallback(context,full_cloud,*final_cloud);
     
     //publishing the segmented point cloud
     sensor_msgs::PointCloud2 output_msg;
     toROSMsg(*final_cloud,output_msg);
-    output_msg.header.frame_id = inputCloud.header.frame_id;
+    output_msg.header.frame_id = inputCloud->header.frame_id;
     pc_pub.publish(output_msg);
     
     if (all_poses.size() < 1) {
@@ -385,7 +409,7 @@ void semanticSegmentation::callbackPoses(const sensor_msgs::PointCloud2 &inputCl
     else
     {
         geometry_msgs::PoseArray msg;
-        msg.header.frame_id = inputCloud.header.frame_id;
+        msg.header.frame_id = inputCloud->header.frame_id;
         for (poseT &p: all_poses) {
             geometry_msgs::Pose pmsg;
             std::cout <<"pose = ("<<p.shift.x()<<","<<p.shift.y()<<","<<p.shift.z()<<")"<<std::endl;
@@ -403,7 +427,7 @@ void semanticSegmentation::callbackPoses(const sensor_msgs::PointCloud2 &inputCl
     }
 }
 
-std::vector<poseT> semanticSegmentation::spSegmenterCallback(const pcl::PointCloud<PointT>::Ptr full_cloud, pcl::PointCloud<PointLT> & final_cloud)
+std::vector<poseT> semanticSegmentation::spSegmenterCallback(const segmentationContext &context, const pcl::PointCloud<PointT>::Ptr full_cloud, pcl::PointCloud<PointLT> & final_cloud)
 {
     pcl::PointCloud<PointT>::Ptr scene_f(new pcl::PointCloud<PointT>());
     *scene_f = *full_cloud;
@@ -436,7 +460,10 @@ std::vector<poseT> semanticSegmentation::spSegmenterCallback(const pcl::PointClo
             bool reset_flag = ll == 0 ? true : false;
             if( ll >= 0 )
                 triple_pooler.extractForeground(false);
-            triple_pooler.InputSemantics(binary_models[ll], ll, reset_flag, false);
+            if (useQuantizedSVM)
+                triple_pooler.InputSemantics(binary_qmodels[ll], ll, reset_flag, false);
+            else
+                triple_pooler.InputSemantics(binary_models[ll], ll, reset_flag, false);
         }
 
         triple_pooler.extractForeground(true);
@@ -457,7 +484,10 @@ std::vector<poseT> semanticSegmentation::spSegmenterCallback(const pcl::PointClo
         for( int ll = sll ; ll <= ell ; ll++ )
         {
            bool reset_flag = ll == sll ? true : false;
-           triple_pooler.InputSemantics(multi_models[ll], ll, reset_flag, false);
+           if (useQuantizedSVM)
+               triple_pooler.InputSemantics(multi_qmodels[ll], ll, reset_flag, false);
+           else
+               triple_pooler.InputSemantics(multi_models[ll], ll, reset_flag, false);
         }
         pcl::PointCloud<PointLT>::Ptr label_cloud(new pcl::PointCloud<PointLT>());
         label_cloud = triple_pooler.getSemanticLabels();
@@ -481,10 +511,13 @@ std::vector<poseT> semanticSegmentation::spSegmenterCallback(const pcl::PointClo
             if( cloud_set[j]->empty() == false )
             {
                 std::vector<poseT> tmp_poses;
-                if      (objRecRANSACdetector == "StandardBest")      objrec[j-1]->StandardBest(cloud_set[j], tmp_poses);
-                else if (objRecRANSACdetector == "GreedyRecognize")   objrec[j-1]->GreedyRecognize(cloud_set[j], tmp_poses);
-                else if (objRecRANSACdetector == "StandardRecognize") objrec[j-1]->StandardRecognize(cloud_set[j], tmp_poses, minConfidence);
-                else ROS_ERROR("Unsupported objRecRANSACdetector!");
+                {
+                    boost::mutex::scoped_lock lock(*objrecMutex[j-1]);
+                    if      (context.objRecRANSACdetector == "StandardBest")      objrec[j-1]->StandardBest(cloud_set[j], tmp_poses);
+                    else if (context.objRecRANSACdetector == "GreedyRecognize")   objrec[j-1]->GreedyRecognize(cloud_set[j], tmp_poses);
+                    else if (context.objRecRANSACdetector == "StandardRecognize") objrec[j-1]->StandardRecognize(cloud_set[j], tmp_poses, minConfidence);
+                    else ROS_ERROR("Unsupported objRecRANSACdetector!");
+                }
 
 
                 #pragma omp critical
@@ -499,24 +532,23 @@ std::vector<poseT> semanticSegmentation::spSegmenterCallback(const pcl::PointClo
         // just combine all the object together and do combined object ransac
         pcl::copyPointCloud(*scene_f,*scene_xyz);
         std::vector<poseT> tmp_poses;
-        if      (objRecRANSACdetector == "StandardBest")      combinedObjRec->StandardBest(scene_xyz, all_poses1);
-        else if (objRecRANSACdetector == "GreedyRecognize")   combinedObjRec->GreedyRecognize(scene_xyz, all_poses1);
-        else if (objRecRANSACdetector == "StandardRecognize") combinedObjRec->StandardRecognize(scene_xyz, all_poses1, minConfidence);
+        boost::mutex::scoped_lock lock(combinedObjRecMutex);
+        if      (context.objRecRANSACdetector == "StandardBest")      combinedObjRec->StandardBest(scene_xyz, all_poses1);
+        else if (context.objRecRANSACdetector == "GreedyRecognize")   combinedObjRec->GreedyRecognize(scene_xyz, all_poses1);
+        else if (context.objRecRANSACdetector == "StandardRecognize") combinedObjRec->StandardRecognize(scene_xyz, all_poses1, minConfidence);
         else ROS_ERROR("Unsupported objRecRANSACdetector!");
     }
 
     std::vector<poseT> all_poses = all_poses1;
     // RefinePoses(scene_xyz, mesh_set, all_poses1);
-    std::map<std::string, unsigned int> objectTFIndex_no_persistence = objectTFIndex;
-    std::map<std::string, unsigned int> &tmpTFIndex = objectTFIndex;
     
     // baseRotation sets the preferred orientation for initial pose detection for every object
     Eigen::Quaternion<double> baseRotation;
     if (setObjectOrientationTarget && 
-        listener->waitForTransform(inputCloud.header.frame_id,targetNormalObjectTF,ros::Time::now(),ros::Duration(1.5)) 
+        listener->waitForTransform(context.inputCloud->header.frame_id,targetNormalObjectTF,ros::Time::now(),ros::Duration(1.5)) 
        ){
           tf::StampedTransform transform;
-          listener->lookupTransform(inputCloud.header.frame_id,targetNormalObjectTF,ros::Time(0),transform);
+          listener->lookupTransform(context.inputCloud->header.frame_id,targetNormalObjectTF,ros::Time(0),transform);
           tf::quaternionTFToEigen(transform.getRotation(),baseRotation);
         }
     else
@@ -524,38 +556,42 @@ std::vector<poseT> semanticSegmentation::spSegmenterCallback(const pcl::PointClo
         // just use identity if no preferred orientation is being used
         baseRotation.setIdentity();
     }
+
+    boost::mutex::scoped_lock lock(objectMutex);
+    std::map<std::string, unsigned int> objectTFIndex_no_persistence = objectTFIndex;
+    std::map<std::string, unsigned int> &tmpTFIndex = objectTFIndex;
     
-    if (doingGripperSegmentation || !hasTF){
+    if (context.doingGripperSegmentation || !hasTF){
       // normalize symmetric object Orientation
-        if (!doingGripperSegmentation)
+        if (!context.doingGripperSegmentation)
         {
             std::cerr << "create tree\n";
             // this will create tree and normalize the orientation to the baseRotation
-            createTree(segmentedObjectTree, objectDict, all_poses, ros::Time::now().toSec(), tmpTFIndex, baseRotation);
+            segmentedObjectTree.create(objectDict, all_poses, ros::Time::now().toSec(), tmpTFIndex, baseRotation);
         }
         else
         {
             // for gripper segmentation, only one value will be updated while the other remains (assuming one gripper)
             std::cerr << "update one value on tree\n";
-            updateOneValue(segmentedObjectTree, targetTFtoUpdate, objectDict, all_poses, ros::Time::now().toSec(), tmpTFIndex, baseRotation);
+            segmentedObjectTree.updateOne(context.targetTFtoUpdate, objectDict, all_poses, ros::Time::now().toSec(), tmpTFIndex, baseRotation);
         }
     }
     else if (useObjectPersistence)
     {
         std::cerr << "update tree\n";
-        updateTree(segmentedObjectTree, objectDict, all_poses, ros::Time::now().toSec(), tmpTFIndex, baseRotation);
+        segmentedObjectTree.update(objectDict, all_poses, ros::Time::now().toSec(), tmpTFIndex, baseRotation);
         
     }
     else
     {
         // not using object persistance, recreate tree every service call.
-        createTree(segmentedObjectTree, objectDict, all_poses, ros::Time::now().toSec(), tmpTFIndex, baseRotation);
+        segmentedObjectTree.create(objectDict, all_poses, ros::Time::now().toSec(), tmpTFIndex, baseRotation);
     }
 
     // restore original index if not using object persistance
     if (!useObjectPersistence) tmpTFIndex = objectTFIndex_no_persistence;
 
-    return getAllPoses(segmentedObjectTree);
+    return segmentedObjectTree.getAllPoses();
 }
 
 bool semanticSegmentation::getAndSaveTable (const sensor_msgs::PointCloud2 &pc)
@@ -568,12 +604,13 @@ bool semanticSegmentation::getAndSaveTable (const sensor_msgs::PointCloud2 &pc)
     if (listener->waitForTransform(tableTFparent,tableTFname,ros::Time::now(),ros::Duration(1.5)))
     {
         std::cerr << "Table TF with name: '" << tableTFname << "' found with parent frame: " << tableTFparent << std::endl;
-        listener->lookupTransform(tableTFparent,tableTFname,ros::Time(0),table_transform);
+        tf::StampedTransform transform;
+        listener->lookupTransform(tableTFparent,tableTFname,ros::Time(0),transform);
         pcl::PointCloud<PointT>::Ptr full_cloud(new pcl::PointCloud<PointT>());
         
-        fromROSMsg(inputCloud,*full_cloud);
+        fromROSMsg(pc,*full_cloud);
         std::cerr << "PCL organized: " << full_cloud->isOrganized() << std::endl;
-        volumeSegmentation(full_cloud,table_transform,crop_box_size);
+        volumeSegmentation(full_cloud,transform,crop_box_size);
         
         if( viewer )
         {
@@ -584,8 +621,8 @@ bool semanticSegmentation::getAndSaveTable (const sensor_msgs::PointCloud2 &pc)
             viewer->removeAllPointClouds();
         }
 
-        tableConvexHull = getTableConvexHull(full_cloud, viewer, tableDistanceThreshold, tableAngularThreshold,tableMinimalInliers);
-        if (tableConvexHull->size() < 3) {
+        pcl::PointCloud<PointT>::Ptr hull = getTableConvexHull(full_cloud, viewer, tableDistanceThreshold, tableAngularThreshold,tableMinimalInliers);
+        if (hull->size() < 3) {
             std::cerr << "Retrying table segmentation...\n";
             return false;
         }
@@ -596,9 +633,14 @@ bool semanticSegmentation::getAndSaveTable (const sensor_msgs::PointCloud2 &pc)
             std::string saveTable_directory;
             nh.param("saveTable_directory",saveTable_directory,std::string("./data"));
             pcl::PCDWriter writer;
-            writer.write<PointT> (saveTable_directory+"/table.pcd", *tableConvexHull, true);
+            writer.write<PointT> (saveTable_directory+"/table.pcd", *hull, true);
             std::cerr << "Saved table point cloud in : " << saveTable_directory <<"/table.pcd"<<std::endl;
         }
+        
+        boost::mutex::scoped_lock lock(tableMutex);
+        tableConvexHull = hull;
+        table_transform = transform;
+        haveTable = true;
         return true;
     }
     else {
@@ -608,32 +650,61 @@ bool semanticSegmentation::getAndSaveTable (const sensor_msgs::PointCloud2 &pc)
     }
 }
 
-void semanticSegmentation::updateCloudData (const sensor_msgs::PointCloud2 &pc)
+bool semanticSegmentation::updateTable (const sensor_msgs::PointCloud2 &pc)
+{
+    bool found;
+    {
+        boost::mutex::scoped_lock lock(tableMutex);
+        if (table_corner_published) return true;
+        found = haveTable;
+    }
+    // waits for the table TF, so it runs without holding the lock
+    if (!found && !getAndSaveTable(pc))
+        return false;
+
+    pcl::PointCloud<PointT>::Ptr hull;
+    {
+        boost::mutex::scoped_lock lock(tableMutex);
+        if (table_corner_published) return true;
+        table_corner_published = true;
+        hull = tableConvexHull;
+    }
+
+    // publish the table corner
+    sensor_msgs::PointCloud2 output_msg;
+    toROSMsg(*hull,output_msg);
+    output_msg.header.frame_id = pc.header.frame_id;
+    std::cerr << "Published table corner point cloud\n";
+    table_corner_pub.publish(output_msg);
+    return true;
+}
+
+bool semanticSegmentation::getTable (pcl::PointCloud<PointT>::Ptr &hull, tf::Transform &transform)
+{
+    boost::mutex::scoped_lock lock(tableMutex);
+    hull = tableConvexHull;
+    transform = table_transform;
+    return haveTable;
+}
+
+void semanticSegmentation::updateCloudData (const sensor_msgs::PointCloud2ConstPtr &pc)
 {
     if (!classReady) return;
-    // The callback from main only update the cloud data
-    inputCloud = pc;
     
-    if (useTableSegmentation && !table_corner_published)
+    bool tableReady = !useTableSegmentation || updateTable(*pc);
+
+    pcl::PointCloud<PointT>::Ptr full_cloud;
+    if (use_median_filter)
     {
-        if (!haveTable) haveTable = getAndSaveTable(inputCloud);
-        
-        if (haveTable) { // publish the table corner
-            table_corner_published = true;
-            sensor_msgs::PointCloud2 output_msg;
-            toROSMsg(*tableConvexHull,output_msg);
-            output_msg.header.frame_id = inputCloud.header.frame_id;
-            std::cerr << "Published table corner point cloud\n";
-            table_corner_pub.publish(output_msg);
-        }
-        else return; // still does not have table
+        full_cloud = pcl::PointCloud<PointT>::Ptr(new pcl::PointCloud<PointT>());
+        fromROSMsg(*pc,*full_cloud); // convert to PCL format
     }
 
-    if (use_median_filter)
+    // The callback from main only update the cloud data
+    boost::mutex::scoped_lock lock(cloudMutex);
+    inputCloud = pc;
+    if (use_median_filter && tableReady)
     {
-        pcl::PointCloud<PointT>::Ptr full_cloud(new pcl::PointCloud<PointT>());
-    
-        fromROSMsg(inputCloud,*full_cloud); // convert to PCL format
         cloud_vec[cur_frame_idx] = full_cloud;
         cur_frame_idx++;
         // std::cerr << "PointCloud --- " << cur_frame_idx << "----" << full_cloud->size() << std::endl;
@@ -646,34 +717,41 @@ void semanticSegmentation::updateCloudData (const sensor_msgs::PointCloud2 &pc)
     
 }
 
-void semanticSegmentation::populateTFMapFromTree()
+void semanticSegmentation::populateTFMapFromTree(const std::string &frame_id, const ros::Time &stamp, const bool &seedTracker)
 {
-  ros::param::del("/instructor_landmark/objects");
-  
-  std::vector<value> sp_segmenter_detectedPoses = getAllNodes(segmentedObjectTree);
+  boost::mutex::scoped_lock lock(objectMutex);
+  const std::vector<persistentObject> &sp_segmenter_detectedPoses = segmentedObjectTree.getAllObjects();
 //  segmentedObjectTFMap.clear();
   segmentedObjectTFV.clear();
+  std::map<std::string, std::string> objectParams;
   costar_objrec_msgs::DetectedObjectList object_list;
   object_list.header.seq = ++(this->number_of_segmentation_done);
   object_list.header.stamp = ros::Time::now();
-  object_list.header.frame_id =  inputCloud.header.frame_id;
+  object_list.header.frame_id =  frame_id;
+
+  objectPoseSnapshot snapshot;
+  snapshot.stamp = stamp;
+  snapshot.frame_id = frame_id;
+  snapshot.seedTracker = seedTracker;
 
   std::cerr << "detected poses: " << sp_segmenter_detectedPoses.size() << "\n";
   for (std::size_t i = 0; i < sp_segmenter_detectedPoses.size(); i++)
   {
-    const value &v = sp_segmenter_detectedPoses.at(i);
-    const poseT &p = std::get<1>(v).pose;
-    const std::string objectTFname = std::get<1>(v).tfName;
+    const objectPose &v = sp_segmenter_detectedPoses.at(i).object;
+    const poseT &p = v.pose;
+    const std::string objectTFname = v.tfName;
     segmentedObjectTF objectTmp(p,objectTFname);
     segmentedObjectTFV.push_back(objectTmp);
+    snapshot.poses.push_back(p);
+    snapshot.tfNames.push_back(objectTFname);
 //    segmentedObjectTFMap[objectTmp.TFname] = objectTmp;
     std::stringstream ss;
-    ss << "/instructor_landmark/objects/" << p.model_name << "/" << std::get<1>(v).index;
+    ss << "/instructor_landmark/objects/" << p.model_name << "/" << v.index;
     // std::cerr << "frame " << i << " name = " << objectTmp.TFname << "\n";
     
-    ros::param::set(ss.str(), objectTmp.TFname);
+    objectParams[ss.str()] = objectTmp.TFname;
     std::stringstream ss2;
-    ss2 << std::get<1>(v).tfName;
+    ss2 << v.tfName;
     costar_objrec_msgs::DetectedObject object_tmp;
   	object_tmp.id = ss2.str();
 
@@ -689,6 +767,12 @@ void semanticSegmentation::populateTFMapFromTree()
   	object_list.objects.push_back(object_tmp);
   }
 
+  // only objects whose TF name changed are written to the parameter server
+  tfPublisher.updateParams(objectParams);
+  // publishTF and the tracker pick up the new poses without locking objectMutex
+  poseSnapshot.publish(snapshot);
+  hasTF = true;
+
   detected_object_pub.publish(object_list);
 }
 
@@ -752,21 +836,38 @@ bool semanticSegmentation::serviceCallback (std_srvs::Empty::Request& request, s
     pcl::PointCloud<PointT>::Ptr full_cloud(new pcl::PointCloud<PointT>());
     pcl::PointCloud<PointLT>::Ptr final_cloud(new pcl::PointCloud<PointLT>());
     
-    if (!haveTable && useTableSegmentation)
+    pcl::PointCloud<PointT>::Ptr table_hull;
+    tf::Transform table_tf;
+    if (!getTable(table_hull, table_tf) && useTableSegmentation)
     {
         ROS_ERROR("Class does not have table data yet!");
         return false; // still does not have table
     }
     
-    // fromROSMsg(inputCloud,*full_cloud); // convert to PCL format
-    // fromROSMsg(inputCloud,*full_cloud); // convert to PCL format
+    // take a snapshot of the clouds, the subscriber only replaces the pointers
+    segmentationContext context;
+    context.objRecRANSACdetector = objRecRANSACdetector;
+    std::vector<pcl::PointCloud<PointT>::Ptr, Eigen::aligned_allocator<pcl::PointCloud<PointT>::Ptr> > median_clouds;
+    bool median_ready;
+    {
+        boost::mutex::scoped_lock lock(cloudMutex);
+        context.inputCloud = inputCloud;
+        median_clouds = cloud_vec;
+        median_ready = cloud_ready;
+    }
+    if (!context.inputCloud)
+    {
+        ROS_ERROR("No cloud available!");
+        return false;
+    }
+
     if (!use_median_filter)  // not using median filter
-        fromROSMsg(inputCloud,*full_cloud);
-    else if(cloud_ready == true )
+        fromROSMsg(*context.inputCloud,*full_cloud);
+    else if(median_ready == true )
     {
         std::cerr << "Averaging point clouds" << std::endl;
         // full_cloud = AveragePointCloud(cloud_vec);
-        full_cloud = MedianPointCloud(cloud_vec);
+        full_cloud = MedianPointCloud(median_clouds);
         // cloud_ready = false;
         std::cerr << "Averaging point clouds Done" << std::endl;
     }
@@ -782,7 +883,7 @@ bool semanticSegmentation::serviceCallback (std_srvs::Empty::Request& request, s
     }
     
     if (useTableSegmentation) {
-      segmentCloudAboveTable(full_cloud, tableConvexHull, aboveTableMin, aboveTableMax);
+      segmentCloudAboveTable(full_cloud, table_hull, aboveTableMin, aboveTableMax);
     }
     
     if (full_cloud->size() < 1){
@@ -792,7 +893,7 @@ bool semanticSegmentation::serviceCallback (std_srvs::Empty::Request& request, s
 
     if(useCropBox) {
       Eigen::Affine3d cam_tf_in_table;
-      tf::transformTFToEigen(table_transform.inverse(), cam_tf_in_table);
+      tf::transformTFToEigen(table_tf.inverse(), cam_tf_in_table);
       cropPointCloud(full_cloud, cam_tf_in_table.cast<float>(), crop_box_size);
     }
 
@@ -802,106 +903,95 @@ bool semanticSegmentation::serviceCallback (std_srvs::Empty::Request& request, s
     }
     
     // get all poses from spSegmenterCallback
-    std::vector<poseT> all_poses = spSegmenterCallback(full_cloud,*final_cloud);
+    std::vector<poseT> all_poses = spSegmenterCallback(context,full_cloud,*final_cloud);
     ROS_INFO("Found %u objects",all_poses.size());
     // std::cerr << "found: " << all_poses.size() << "\n";
-
-    if(enableTracking)
-    {
-      tracker->generateTrackingPoints(inputCloud.header.stamp, all_poses);
-    }
     
     //publishing the segmented point cloud
     sensor_msgs::PointCloud2 output_msg;
     toROSMsg(*final_cloud,output_msg);
-    output_msg.header.frame_id = inputCloud.header.frame_id;
+    output_msg.header.frame_id = context.inputCloud->header.frame_id;
     pc_pub.publish(output_msg);
     
-    fromROSMsg(inputCloud,*full_cloud); // convert to PCL format
     if (all_poses.size() < 1) {
         ROS_ERROR("Failed to find any objects on the table.");
         return false;
     }
   
-    this->populateTFMapFromTree();
+    // also seeds the tracker through the pose snapshot
+    this->populateTFMapFromTree(context.inputCloud->header.frame_id, context.inputCloud->header.stamp, true);
   
     std::cerr << "Segmentation done.\n";
     ROS_INFO("Segmentation done.");
     
-    hasTF = true;
     return true;
 }
 
 bool semanticSegmentation::serviceCallbackGripper (sp_segmenter::segmentInGripper::Request & request, sp_segmenter::segmentInGripper::Response& response)
 {
     std::cerr << "Segmenting object on gripper...\n";
-    std::string bestPoseOriginal = objRecRANSACdetector;
+    segmentationContext context;
 
      // Use the detector for objects in the gripper
-    nh.param("objRecRANSACdetectorInGripper",objRecRANSACdetector,std::string("StandardBest"));
+    nh.param("objRecRANSACdetectorInGripper",context.objRecRANSACdetector,std::string("StandardBest"));
     
-    targetTFtoUpdate = request.tfToUpdate;
-    this->doingGripperSegmentation = true;
+    context.targetTFtoUpdate = request.tfToUpdate;
+    context.doingGripperSegmentation = true;
   
     pcl::PointCloud<PointT>::Ptr full_cloud(new pcl::PointCloud<PointT>());
     pcl::PointCloud<PointLT>::Ptr final_cloud(new pcl::PointCloud<PointLT>());
     std::string segmentFail("Object in gripper segmentation fails.");
     
-    fromROSMsg(inputCloud,*full_cloud); // convert to PCL format
+    {
+        boost::mutex::scoped_lock lock(cloudMutex);
+        context.inputCloud = inputCloud;
+    }
+    if (context.inputCloud)
+        fromROSMsg(*context.inputCloud,*full_cloud); // convert to PCL format
     if (full_cloud->size() < 1){
         std::cerr << "No cloud available";
         response.result = segmentFail;
-        objRecRANSACdetector = bestPoseOriginal;
-        this->doingGripperSegmentation = false;
         return false;
     }
     
-    if (listener->waitForTransform(inputCloud.header.frame_id,gripperTF,ros::Time::now(),ros::Duration(1.5)))
+    if (listener->waitForTransform(context.inputCloud->header.frame_id,gripperTF,ros::Time::now(),ros::Duration(1.5)))
     {
         tf::StampedTransform transform;
-        listener->lookupTransform(inputCloud.header.frame_id,gripperTF,ros::Time(0),transform);
+        listener->lookupTransform(context.inputCloud->header.frame_id,gripperTF,ros::Time(0),transform);
         // do a box segmentation around the gripper (50x50x50 cm)
         volumeSegmentation(full_cloud,transform,crop_box_size,false);
         std::cerr << "Volume Segmentation done.\n";
     }
     else
     {
-        std::cerr << "Fail to get transform between: "<< gripperTF << " and "<< inputCloud.header.frame_id << std::endl;
+        std::cerr << "Fail to get transform between: "<< gripperTF << " and "<< context.inputCloud->header.frame_id << std::endl;
         response.result = segmentFail;
-        objRecRANSACdetector = bestPoseOriginal;
-        this->doingGripperSegmentation = false;
         return false;
     }
     
     if (full_cloud->size() < 1){
         std::cerr << "No cloud available around gripper. Make sure the object can be seen by the camera.\n";
-        objRecRANSACdetector = bestPoseOriginal;
-        this->doingGripperSegmentation = false;
         return false;
     }
     // get best poses from spSegmenterCallback
-    std::vector<poseT> all_poses = spSegmenterCallback(full_cloud,*final_cloud);
+    std::vector<poseT> all_poses = spSegmenterCallback(context,full_cloud,*final_cloud);
     
     if (all_poses.size() < 1) {
         std::cerr << "Fail to segment the object around gripper.\n";
         response.result = segmentFail;
-        objRecRANSACdetector = bestPoseOriginal;
-        this->doingGripperSegmentation = false;
         return false;
     }
     
     //publishing the segmented point cloud
     sensor_msgs::PointCloud2 output_msg;
     toROSMsg(*final_cloud,output_msg);
-    output_msg.header.frame_id = inputCloud.header.frame_id;
+    output_msg.header.frame_id = context.inputCloud->header.frame_id;
     pc_pub.publish(output_msg);
   
-    this->populateTFMapFromTree();
+    // the object in the gripper is not tracked
+    this->populateTFMapFromTree(context.inputCloud->header.frame_id, context.inputCloud->header.stamp, false);
   
     std::cerr << "Object In gripper segmentation done.\n";
-    objRecRANSACdetector = bestPoseOriginal;
-    this->doingGripperSegmentation = false;
-    hasTF = true;
     response.result = "Object In gripper segmentation done.\n";
     return true;
 }
@@ -909,17 +999,20 @@ bool semanticSegmentation::serviceCallbackGripper (sp_segmenter::segmentInGrippe
 void semanticSegmentation::publishTF()
 {
     if (!useTFinsteadOfPoses) return; // do nothing
-    if (hasTF)
-    {
-        // broadcast all transform
-        std::string parent = inputCloud.header.frame_id;
-        // int index = 0;
-        for (std::size_t i = 0; i < segmentedObjectTFV.size(); i++){
-            // std::cerr << "Publishing: " << segmentedObjectTFV.at(i).TFname << "\n";
-            br.sendTransform(
-                segmentedObjectTFV.at(i).generateStampedTransform(parent)
-                );
-        }
+
+    // rebuild the transforms only when the segmentation published new poses, no lock is needed
+    if (poseSnapshot.read(publishedTFSnapshot, publishedTFSnapshot.version))
+    {
+        std::vector<segmentedObjectTF> objects;
+        for (std::size_t i = 0; i < publishedTFSnapshot.poses.size(); i++)
+            objects.push_back(segmentedObjectTF(publishedTFSnapshot.poses.at(i), publishedTFSnapshot.tfNames.at(i)));
+        tfPublisher.setObjects(objects, publishedTFSnapshot.frame_id);
+    }
+
+    if (publishedTFSnapshot.version > 0)
+    {
+        // broadcast all transform in one message
+        tfPublisher.publish(br);
         // for (std::map<std::string, segmentedObjectTF>::iterator it=segmentedObjectTFMap.begin(); it!=segmentedObjectTFMap.end(); ++it)
         // {
         //     std::cerr << "Publishing: " << it->second.TFname << "\n";
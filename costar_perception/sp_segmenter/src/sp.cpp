@@ -2,6 +2,7 @@
 #include <opencv2/highgui/highgui.hpp>
 
 #include "sp_segmenter/features.h"
+#include "sp_segmenter/featureCache.h"
 
 /************************************************************************************************************************************/
 
@@ -46,6 +47,39 @@ IDXSET spExt::getSegsToCloud()
     return segs_to_cloud;
 }
 
+std::string spExt::getParamKey() const
+{
+    std::stringstream ss;
+    ss << "ss" << down_ss << "_v" << voxel_resol << "_s" << seed_resol << "_c" << color_w << "_p" << spatial_w << "_n" << normal_w;
+    return ss.str();
+}
+
+void spExt::setSPLevel0(const pcl::PointCloud<PointT>::Ptr down_cloud_, const pcl::PointCloud<PointLT>::Ptr label_cloud_, 
+                        const IDXSET &segs_to_cloud_, const std::multimap<uint32_t, uint32_t> &graph_)
+{
+    clear();
+    down_cloud = down_cloud_;
+    label_cloud = label_cloud_;
+    segs_to_cloud = segs_to_cloud_;
+    graph = graph_;
+    
+    // same as SPCloud(), segment j holds the points of down_cloud in segs_to_cloud[j]
+    IDXSET idx_0;
+    low_segs.resize(segs_to_cloud.size());
+    for( size_t j = 0 ; j < segs_to_cloud.size() ; j++ )
+    {
+        low_segs[j] = pcl::PointCloud<PointT>::Ptr (new pcl::PointCloud<PointT>());
+        for( std::vector<int>::const_iterator it = segs_to_cloud[j].begin() ; it < segs_to_cloud[j].end() ; it++ )
+            low_segs[j]->push_back(down_cloud->at(*it));
+        std::vector<int> tmp;
+        tmp.push_back(j);
+        idx_0.push_back(tmp);
+    }
+    low_seg_num = idx_0.size();
+    sp_level_idx.push_back(idx_0);
+    sp_flags.resize(low_seg_num, 1);
+}
+
 void spExt::clear()
 {
     down_cloud = pcl::PointCloud<PointT>::Ptr (new pcl::PointCloud<PointT>());
@@ -227,6 +261,7 @@ std::vector<pcl::PointCloud<PointT>::Ptr> spExt::getSPCloud(int level)
 
 spPooler::spPooler()
 {
+    cache = NULL;
     reset();
 }
 
@@ -265,18 +300,16 @@ void spPooler::lightInit(const pcl::PointCloud<PointT>::Ptr cloud, Hier_Pooler&
     // If not use SIFT pooling!!! Use this light version.
     reset();
     
-    pcl::PointCloud<NormalT>::Ptr cloud_normals(new pcl::PointCloud<NormalT>());
-    computeNormals(cloud, cloud_normals, radius);
+    uint64_t cloud_hash = cache != NULL && cache->enabled() ? hashCloud(cloud) : 0;
+    pcl::PointCloud<NormalT>::Ptr cloud_normals = getNormals(cloud, cloud_hash, radius);
     data = convertPCD(cloud, cloud_normals);
     
     // ext_sp is for superpixel extraction from the segmented point cloud
     ext_sp.setSS(down_ss);
     ext_sp.setParams(0.005, 0.05, 0.5, 0.5, 0.0);   //TODO, from ROS main
-    ext_sp.clear();
-    ext_sp.LoadPointCloud(cloud);
+    extractSuperpixels(cloud, cloud_hash);
     data.down_cloud  = ext_sp.getCloud();
     
-    std::vector< pcl::PointCloud<PointT>::Ptr > segs = ext_sp.getSPCloud(0);
     segs_to_cloud = ext_sp.getSegsToCloud();
     
     sp_num = segs_to_cloud.size();
@@ -285,7 +318,7 @@ void spPooler::lightInit(const pcl::PointCloud<PointT>::Ptr cloud, Hier_Pooler&
     class_responses.resize(sp_num);
     
     std::cerr << "CSHOT Extraction..." << std::endl;
-    std::vector<cv::Mat> main_fea = cshot_producer.getHierFea(data, 0);
+    std::vector<cv::Mat> main_fea = cache != NULL && cache->enabled() ? cache->getHierFea(cshot_producer, data) : cshot_producer.getHierFea(data, 0);
     int depth_len = main_fea[0].cols;
     int color_len = main_fea[1].cols;
     
@@ -329,18 +362,15 @@ void spPooler::init(const pcl::PointCloud<PointT>::Ptr full_cloud_, Hier_Pooler&
     }
     pcl::PointCloud<PointT>::Ptr cloud = refineScene(full_cloud);
     
-    pcl::PointCloud<NormalT>::Ptr cloud_normals(new pcl::PointCloud<NormalT>());
-    computeNormals(cloud, cloud_normals, radius);
+    uint64_t cloud_hash = cache != NULL && cache->enabled() ? hashCloud(cloud) : 0;
+    pcl::PointCloud<NormalT>::Ptr cloud_normals = getNormals(cloud, cloud_hash, radius);
     data = convertPCD(cloud, cloud_normals);
     data.img = getFullImage(full_cloud);
     
     ext_sp.setSS(down_ss);
-    ext_sp.clear();
-    ext_sp.LoadPointCloud(cloud);
+    extractSuperpixels(cloud, cloud_hash);
     data.down_cloud  = ext_sp.getCloud();
     
-    std::vector< pcl::PointCloud<PointT>::Ptr > segs = ext_sp.getSPCloud(0);
-    
 //    for(int i = 0 ; i < segs.size() ; i++ )
 //    {
 //        std::vector< pcl::PointCloud<PointT>::Ptr > big_segs = ext_sp.getSPCloud(i);
@@ -354,7 +384,7 @@ void spPooler::init(const pcl::PointCloud<PointT>::Ptr full_cloud_, Hier_Pooler&
     segs_max_score.resize(sp_num, -1000.0);
     class_responses.resize(sp_num);
     
-    std::vector<cv::Mat> main_fea = cshot_producer.getHierFea(data, 0);
+    std::vector<cv::Mat> main_fea = cache != NULL && cache->enabled() ? cache->getHierFea(cshot_producer, data) : cshot_producer.getHierFea(data, 0);
     int depth_len = main_fea[0].cols;
     int color_len = main_fea[1].cols;
     
@@ -400,6 +430,42 @@ void spPooler::init(const pcl::PointCloud<PointT>::Ptr full_cloud_, Hier_Pooler&
 }
 
 
+pcl::PointCloud<NormalT>::Ptr spPooler::getNormals(const pcl::PointCloud<PointT>::Ptr cloud, uint64_t cloud_hash, float radius)
+{
+    pcl::PointCloud<NormalT>::Ptr cloud_normals(new pcl::PointCloud<NormalT>());
+    bool cache_flag = cache != NULL && cache->enabled();
+    if( cache_flag == true && cache->loadNormals(cloud_hash, radius, cloud_normals) == true )
+        return cloud_normals;
+    
+    computeNormals(cloud, cloud_normals, radius);
+    if( cache_flag == true )
+        cache->saveNormals(cloud_hash, radius, cloud_normals);
+    return cloud_normals;
+}
+
+void spPooler::extractSuperpixels(const pcl::PointCloud<PointT>::Ptr cloud, uint64_t cloud_hash)
+{
+    ext_sp.clear();
+    bool cache_flag = cache != NULL && cache->enabled();
+    if( cache_flag == true )
+    {
+        pcl::PointCloud<PointT>::Ptr down_cloud(new pcl::PointCloud<PointT>());
+        pcl::PointCloud<PointLT>::Ptr label_cloud(new pcl::PointCloud<PointLT>());
+        IDXSET cur_segs_to_cloud;
+        std::multimap<uint32_t, uint32_t> graph;
+        if( cache->loadSuperpixels(cloud_hash, ext_sp.getParamKey(), down_cloud, label_cloud, cur_segs_to_cloud, graph) == true )
+        {
+            ext_sp.setSPLevel0(down_cloud, label_cloud, cur_segs_to_cloud, graph);
+            return;
+        }
+    }
+    
+    ext_sp.LoadPointCloud(cloud);
+    ext_sp.getSPIdx(0);
+    if( cache_flag == true )
+        cache->saveSuperpixels(cloud_hash, ext_sp.getParamKey(), ext_sp.getCloud(), ext_sp.getLabels(), ext_sp.getSegsToCloud(), ext_sp.getGraph());
+}
+
 void spPooler::build_SP_LAB(const std::vector<boost::shared_ptr<Pooler_L0> >& lab_pooler_set, bool max_pool_flag)
 {
     int pooler_num = lab_pooler_set.size();
@@ -730,9 +796,112 @@ std::vector<cv::Mat> spPooler::gethardNegtive(const model *cur_model, int level,
     return hard_negative_vec;
 }
 
-void spPooler::InputSemantics(const model *cur_model, int level, bool reset, bool max_pool)
+// returns the class index as in gethardNegtive() (>= 1 for foreground) and the margin of the decision
+static int predictHardLabel(const model *cur_model, const cv::Mat &fea, float &margin)
 {
     int model_num = cur_model->nr_class;
+    feature_node bias_term;
+    bias_term.index = cur_model->nr_feature;
+    bias_term.value = cur_model->bias;
+    feature_node end_node;
+    end_node.index = -1;
+    end_node.value = 0;
+    
+    sparseVec sparse_fea;
+    CvMatToFeatureNode(fea, sparse_fea);
+    sparse_fea.push_back(bias_term);
+    sparse_fea.push_back(end_node);
+    
+    std::vector<double> dec_values(model_num);
+    double tmp_label = predict_values(cur_model, &sparse_fea[0], &dec_values[0]);
+    int cur_label = model_num <= 2 ? floor(tmp_label+0.0001-1) : floor(tmp_label+0.0001);
+    
+    if( model_num <= 2 )
+        margin = fabs(dec_values[0]);
+    else
+    {
+        std::sort(dec_values.begin(), dec_values.end());
+        margin = dec_values[model_num-1] - dec_values[model_num-2];
+    }
+    return cur_label;
+}
+
+std::vector< std::vector<cv::Mat> > spPooler::gethardNegtiveCascade(const std::vector<model*> &model_set, float reject_margin, bool max_pool, size_t *skip_num)
+{
+    std::vector< std::vector<cv::Mat> > hard_negative_set(model_set.size());
+    if( model_set.empty() == true )
+        return hard_negative_set;
+    
+    // level 0, every segment is pooled and scored
+    IDXSET idx_0 = ext_sp.getSPIdx(0);
+    std::vector<bool> rejected(idx_0.size(), false);
+    for( size_t j = 0 ; j < idx_0.size() ; j++ )
+    {
+        IDXSET tmp;
+        tmp.push_back(idx_0[j]);
+        std::vector<cv::Mat> tmp_fea = getSPFea(tmp, max_pool); 
+        if( tmp_fea.empty() == true )
+            continue;
+        if( tmp_fea[0].cols != model_set[0]->nr_feature - 1)
+        {
+            std::cerr << "sp_fea[j].cols != cur_model->nr_feature - 1" << std::endl;
+            exit(0);
+        }
+        
+        float margin;
+        int cur_label = predictHardLabel(model_set[0], tmp_fea[0], margin);
+        if( cur_label >= 1 )
+            hard_negative_set[0].push_back(tmp_fea[0]);
+        else if( margin >= reject_margin )
+            rejected[idx_0[j][0]] = true;
+    }
+    
+    // higher levels, skip the superpixels whose segments were all rejected at level 0
+    size_t skipped = 0;
+    for( size_t level = 1 ; level < model_set.size() ; level++ )
+    {
+        IDXSET idx_set = ext_sp.getSPIdx(level);
+        for( size_t j = 0 ; j < idx_set.size() ; j++ )
+        {
+            bool all_rejected = true;
+            for( std::vector<int>::const_iterator it = idx_set[j].begin() ; it < idx_set[j].end() ; it++ )
+            {
+                if( rejected[*it] == false )
+                {
+                    all_rejected = false;
+                    break;
+                }
+            }
+            if( all_rejected == true )
+            {
+                skipped++;
+                continue;
+            }
+            
+            IDXSET tmp;
+            tmp.push_back(idx_set[j]);
+            std::vector<cv::Mat> tmp_fea = getSPFea(tmp, max_pool); 
+            if( tmp_fea.empty() == true )
+                continue;
+            if( tmp_fea[0].cols != model_set[level]->nr_feature - 1)
+            {
+                std::cerr << "sp_fea[j].cols != cur_model->nr_feature - 1" << std::endl;
+                exit(0);
+            }
+            
+            float margin;
+            if( predictHardLabel(model_set[level], tmp_fea[0], margin) >= 1 )
+                hard_negative_set[level].push_back(tmp_fea[0]);
+        }
+    }
+    if( skip_num != NULL )
+        *skip_num += skipped;
+    
+    return hard_negative_set;
+}
+
+void spPooler::resetResponses(int model_num, bool reset)
+{
     if( class_responses.empty() == true )
     {
         std::cerr << "class_responses.empty() == true" << std::endl;
@@ -753,6 +922,27 @@ void spPooler::InputSemantics(const model *cur_model, int level, bool reset, boo
             segs_max_score.resize(sp_num, -1000.0);
         }
     }
+}
+
+void spPooler::updateResponses(const std::vector<int> &idxs, int cur_label, float cur_score)
+{
+    for( std::vector<int>::const_iterator it = idxs.begin() ; it < idxs.end() ; it++ ){
+        if( class_responses[*it][cur_label] < cur_score )
+        {
+            class_responses[*it][cur_label] = cur_score;
+            if( segs_max_score[*it] < cur_score )
+            {
+                segs_max_score[*it] = cur_score;
+                segs_label[*it] = cur_label;
+            }
+        }
+    }
+}
+
+void spPooler::InputSemantics(const model *cur_model, int level, bool reset, bool max_pool)
+{
+    int model_num = cur_model->nr_class;
+    resetResponses(model_num, reset);
     
     IDXSET idx_set = ext_sp.getSPIdx(level);
 //    std::vector<cv::Mat> sp_fea = getSPFea(idx_set, max_pool);
@@ -792,23 +982,46 @@ void spPooler::InputSemantics(const model *cur_model, int level, bool reset, boo
         int cur_label = model_num <= 2 ? floor(tmp_label+0.0001-1) : floor(tmp_label+0.0001-1);
         float cur_score = model_num <= 2 ? fabs(dec_values[0]) : dec_values[cur_label-1];
         
-        for( std::vector<int>::iterator it = idx_set[j].begin() ; it < idx_set[j].end() ; it++ ){
-            if( class_responses[*it][cur_label] < cur_score )
-            {
-                class_responses[*it][cur_label] = cur_score;
-                if( segs_max_score[*it] < cur_score )
-                {
-                    segs_max_score[*it] = cur_score;
-                    segs_label[*it] = cur_label;
-                }
-            }
-        }
+        updateResponses(idx_set[j], cur_label, cur_score);
         delete[] cur_fea;
         delete[] dec_values;
     }
     
 }
 
+void spPooler::InputSemantics(const quantizedModel &qmodel, int level, bool reset, bool max_pool)
+{
+    int model_num = qmodel.getNrClass();
+    resetResponses(model_num, reset);
+    
+    IDXSET idx_set = ext_sp.getSPIdx(level);
+    
+    int num = idx_set.size();
+    std::vector<double> dec_values(model_num);
+    quantizedFea qfea;
+    for( int j = 0 ; j < num ; j++ )
+    {
+        IDXSET tmp;
+        tmp.push_back(idx_set[j]);
+        std::vector<cv::Mat> tmp_fea = getSPFea(tmp, max_pool); 
+        if( tmp_fea.empty() == true )
+            continue;
+        
+        if( tmp_fea[0].cols != qmodel.getDim() )
+        {
+            std::cerr << "sp_fea[j].cols != qmodel.getDim()" << std::endl;
+            exit(0);
+        }
+        quantizeFea(tmp_fea[0], qfea);
+        
+        double tmp_label = qmodel.predictValues(qfea, &dec_values[0]);
+        int cur_label = floor(tmp_label+0.0001-1);
+        float cur_score = model_num <= 2 ? fabs(dec_values[0]) : dec_values[cur_label-1];
+        
+        updateResponses(idx_set[j], cur_label, cur_score);
+    }
+}
+
 pcl::PointCloud<PointLT>::Ptr spPooler::getSemanticLabels()
 {
     pcl::PointCloud<PointLT>::Ptr label_cloud(new pcl::PointCloud<PointLT>());
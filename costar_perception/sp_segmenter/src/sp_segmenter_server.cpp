@@ -9,12 +9,18 @@ int main(int argc, char** argv)
     ros::Rate r(10); //10Hz
     semanticSegmentation segmenter(argc, argv, nh);
     
+    // service calls and point cloud callbacks run concurrently, 0 uses one thread per core
+    int spinnerThreads;
+    nh.param("spinnerThreads", spinnerThreads, 0);
+    ros::AsyncSpinner spinner(spinnerThreads);
+    spinner.start();
+
     while (ros::ok())
     {
         segmenter.publishTF();
         r.sleep();
-        ros::spinOnce();
     }
     
+    spinner.stop();
     return 1;
 }
@@ -6,7 +6,7 @@
 
 using namespace cv;
 
-Tracker::Tracker(): nh("~"), has_cam_info(false)
+Tracker::Tracker(): nh("~"), pose_snapshot(NULL), has_cam_info(false)
 {
   nh.param("CAMERA_INFO_IN", CAMERA_INFO_IN,std::string("/camera/camera_info"));
   nh.param("IMAGE_IN", IMAGE_IN,std::string("/camera/image_raw"));
@@ -24,6 +24,8 @@ Tracker::Tracker(): nh("~"), has_cam_info(false)
   nh.setCallbackQueue(&callback_queue);
 
   callback_thread = boost::thread(&Tracker::monitorQueue, this);
+  // seeding projects the meshes and fast-forwards over the image history, keep it off the image callback
+  seed_thread = boost::thread(&Tracker::monitorSnapshot, this);
 }
 
 void Tracker::monitorQueue()
@@ -35,6 +37,24 @@ void Tracker::monitorQueue()
   }
 }
 
+void Tracker::monitorSnapshot()
+{
+  while (ros::ok())
+  {
+    const objectPoseSnapshotBuffer* snapshot = pose_snapshot.load();
+    if(snapshot && snapshot->read(seed_snapshot, seed_snapshot.version))
+    {
+      // only poses from a full segmentation seed new tracking points
+      if(seed_snapshot.seedTracker)
+        generateTrackingPoints(seed_snapshot.stamp, seed_snapshot.poses);
+    }
+    else
+    {
+      ros::WallDuration(0.01).sleep();
+    }
+  }
+}
+
 bool Tracker::addTracker(const ModelT& model)
 {
   TrackingInfo ti(model, max_kps);
@@ -43,6 +63,11 @@ bool Tracker::addTracker(const ModelT& model)
   return res.second;
 }
 
+void Tracker::setPoseSnapshot(const objectPoseSnapshotBuffer* snapshot)
+{
+  pose_snapshot.store(snapshot);
+}
+
 // poses should be pose of object in frame of camera
 void Tracker::generateTrackingPoints(ros::Time stamp,  const std::vector<poseT>& poses)
 {
@@ -0,0 +1,223 @@
+#include "sp_segmenter/utility/bitClique.h"
+
+#include <algorithm>
+#include <omp.h>
+
+// the time budget is checked every TIME_CHECK_NODES expanded nodes of a thread
+static const long TIME_CHECK_NODES = 1024;
+
+static inline int popCount(uint64_t w)
+{
+    return __builtin_popcountll(w);
+}
+
+static inline int lowBit(uint64_t w)
+{
+    return __builtin_ctzll(w);
+}
+
+bitClique::bitClique(int num_) : num(num_), word_num((num_ + 63) / 64), best_size(0), abort_flag(false), deadline(-1)
+{
+    adj.assign((size_t)num * word_num, 0);
+}
+
+void bitClique::addEdge(int i, int j)
+{
+    if( i == j || i < 0 || j < 0 || i >= num || j >= num )
+        return;
+    adj[(size_t)i * word_num + (j >> 6)] |= 1ULL << (j & 63);
+    adj[(size_t)j * word_num + (i >> 6)] |= 1ULL << (i & 63);
+}
+
+// greedy sequential coloring of P, order[] lists the vertices by non-decreasing color
+// and colors[k] bounds the clique size that can be built from order[0..k]
+void bitClique::colorSort(const std::vector<uint64_t> &P, std::vector<int> &order, std::vector<int> &colors, searchState &st) const
+{
+    order.clear();
+    colors.clear();
+    std::vector<uint64_t> &U = st.uncolored;
+    std::vector<uint64_t> &Q = st.color_class;
+    U = P;
+
+    int color = 0;
+    int left = 0;
+    for( int w = 0 ; w < word_num ; w++ )
+        left += popCount(U[w]);
+    while( left > 0 )
+    {
+        color++;
+        Q = U;
+        for( int w = 0 ; w < word_num ; w++ )
+        {
+            while( Q[w] != 0 )
+            {
+                int v = (w << 6) + lowBit(Q[w]);
+                Q[w] &= Q[w] - 1;
+                U[w] &= ~(1ULL << (v & 63));
+                left--;
+                // remove the neighbors of v from the current color class
+                const uint64_t *nv = &radj[(size_t)v * word_num];
+                for( int k = w ; k < word_num ; k++ )
+                    Q[k] &= ~nv[k];
+                order.push_back(v);
+                colors.push_back(color);
+            }
+        }
+    }
+}
+
+bool bitClique::timeUp(searchState &st)
+{
+    bool flag;
+    #pragma omp atomic read
+    flag = abort_flag;
+    if( flag == true )
+        return true;
+    if( deadline > 0 && ++st.nodes % TIME_CHECK_NODES == 0 && omp_get_wtime() > deadline )
+    {
+        #pragma omp atomic write
+        abort_flag = true;
+        return true;
+    }
+    return false;
+}
+
+void bitClique::updateBest(const std::vector<int> &cur)
+{
+    #pragma omp critical (bit_clique)
+    {
+        if( (int)cur.size() > best_size )
+        {
+            best = cur;
+            #pragma omp atomic write
+            best_size = cur.size();
+        }
+    }
+}
+
+void bitClique::expand(int depth, searchState &st)
+{
+    std::vector<uint64_t> &P = st.cand[depth];
+    std::vector<int> &order = st.order[depth];
+    std::vector<int> &colors = st.colors[depth];
+    colorSort(P, order, colors, st);
+
+    for( int k = order.size() - 1 ; k >= 0 ; k-- )
+    {
+        int cur_best;
+        #pragma omp atomic read
+        cur_best = best_size;
+        if( (int)st.cur.size() + colors[k] <= cur_best || timeUp(st) == true )
+            return;
+
+        int v = order[k];
+        st.cur.push_back(v);
+        std::vector<uint64_t> &newP = st.cand[depth+1];
+        const uint64_t *nv = &radj[(size_t)v * word_num];
+        bool empty = true;
+        for( int w = 0 ; w < word_num ; w++ )
+        {
+            newP[w] = P[w] & nv[w];
+            empty = empty && newP[w] == 0;
+        }
+        if( empty == true )
+        {
+            if( (int)st.cur.size() > cur_best )
+                updateBest(st.cur);
+        }
+        else
+            expand(depth + 1, st);
+        st.cur.pop_back();
+        P[v >> 6] &= ~(1ULL << (v & 63));
+    }
+}
+
+std::vector<int> bitClique::solve(double time_budget, bool *complete)
+{
+    best.clear();
+    best_size = 0;
+    abort_flag = false;
+    deadline = time_budget > 0 ? omp_get_wtime() + time_budget : -1;
+    if( complete )
+        *complete = true;
+    if( num == 0 )
+        return best;
+
+    // renumber the vertices by non-increasing degree
+    std::vector< std::pair<int, int> > degree(num);
+    for( int i = 0 ; i < num ; i++ )
+    {
+        int count = 0;
+        for( int w = 0 ; w < word_num ; w++ )
+            count += popCount(adj[(size_t)i * word_num + w]);
+        degree[i] = std::pair<int, int>(-count, i);
+    }
+    std::sort(degree.begin(), degree.end());
+    perm.resize(num);
+    for( int i = 0 ; i < num ; i++ )
+        perm[i] = degree[i].second;
+    radj.assign((size_t)num * word_num, 0);
+    for( int i = 0 ; i < num ; i++ )
+        for( int j = 0 ; j < num ; j++ )
+            if( connected(perm[i], perm[j]) == true )
+                radj[(size_t)i * word_num + (j >> 6)] |= 1ULL << (j & 63);
+
+    // greedy incumbent, also what is returned if the budget runs out right away
+    std::vector<int> greedy;
+    for( int i = 0 ; i < num ; i++ )
+    {
+        bool flag = true;
+        for( size_t k = 0 ; k < greedy.size() && flag ; k++ )
+            flag = (radj[(size_t)i * word_num + (greedy[k] >> 6)] >> (greedy[k] & 63)) & 1;
+        if( flag == true )
+            greedy.push_back(i);
+    }
+    best = greedy;
+    best_size = greedy.size();
+
+    // branch i holds the cliques whose last vertex in the new order is i,
+    // the large branches come last in the order and are started first
+    #pragma omp parallel
+    {
+        searchState st;
+        st.nodes = 0;
+        st.cand.assign(num + 1, std::vector<uint64_t>(word_num, 0));
+        st.order.resize(num + 1);
+        st.colors.resize(num + 1);
+
+        #pragma omp for schedule(dynamic, 1)
+        for( int i = num - 1 ; i >= 0 ; i-- )
+        {
+            if( timeUp(st) == true )
+                continue;
+            std::vector<uint64_t> &P = st.cand[0];
+            const uint64_t *ni = &radj[(size_t)i * word_num];
+            int cand_num = 0;
+            for( int w = 0 ; w < word_num ; w++ )
+            {
+                uint64_t mask = w < (i >> 6) ? ~0ULL : (w == (i >> 6) ? (1ULL << (i & 63)) - 1 : 0);
+                P[w] = ni[w] & mask;
+                cand_num += popCount(P[w]);
+            }
+            int cur_best;
+            #pragma omp atomic read
+            cur_best = best_size;
+            if( cand_num + 1 <= cur_best )
+                continue;
+
+            st.cur.assign(1, i);
+            if( cand_num == 0 )
+                updateBest(st.cur);
+            else
+                expand(0, st);
+        }
+    }
+
+    if( complete )
+        *complete = !abort_flag;
+    std::vector<int> clique(best.size());
+    for( size_t k = 0 ; k < best.size() ; k++ )
+        clique[k] = perm[best[k]];
+    std::sort(clique.begin(), clique.end());
+    return clique;
+}
@@ -0,0 +1,251 @@
+#include "sp_segmenter/utility/packedSmat.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char PACKED_MAGIC[8] = {'P', 'S', 'M', 'A', 'T', '0', '1', '\0'};
+static const size_t PACKED_HEADER_LEN = 8 + 4 * sizeof(uint64_t);
+static const size_t PACKED_BUF_NUM = 1 << 16;
+
+static void finishRow(std::vector<feature_node> &buf, uint64_t &node_num, std::vector<uint64_t> &row_ptr, size_t cols)
+{
+    feature_node bias_term;
+    bias_term.index = cols + 1;
+    bias_term.value = -1.0;
+    feature_node end_node;
+    end_node.index = -1;
+    end_node.value = 0;
+    buf.push_back(bias_term);
+    buf.push_back(end_node);
+    node_num += 2;
+    row_ptr.push_back(node_num);
+}
+
+static void flushNodes(std::ofstream &out, std::vector<feature_node> &buf)
+{
+    if( buf.empty() == false )
+        out.write((char*)&buf[0], buf.size() * sizeof(feature_node));
+    buf.clear();
+}
+
+long packSmat(std::string smat_name, std::string packed_name, const std::vector< std::pair<int, int> > &inds)
+{
+    std::ifstream in(smat_name.c_str(), std::ios::in|std::ios::binary);
+    if( in.is_open() == false )
+        return -1;
+
+    size_t size_t_len = sizeof(size_t);
+    size_t float_len = sizeof(float);
+    size_t cols, rows, num;
+    in.read((char*)&cols, size_t_len);
+    in.read((char*)&rows, size_t_len);
+    in.read((char*)&num, size_t_len);
+    if( in.good() == false || cols == 0 )
+        return -1;
+
+    // column shift of each piece, same checks as readSoluSparse_piecewise()
+    std::vector<size_t> piece_len;
+    size_t new_cols = cols;
+    if( inds.empty() == false )
+    {
+        new_cols = 0;
+        for( size_t k = 0 ; k < inds.size() ; k++ )
+        {
+            if( inds[k].second <= inds[k].first || inds[k].first < 0 || (k > 0 && inds[k].first < inds[k-1].second) )
+            {
+                std::cerr << "Invalid column pieces for " << smat_name << std::endl;
+                exit(0);
+            }
+            piece_len.push_back(k == 0 ? inds[k].first : inds[k].first - inds[k-1].second + piece_len[k-1]);
+            new_cols += inds[k].second - inds[k].first;
+        }
+    }
+
+    std::ofstream out(packed_name.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+    if( out.is_open() == false )
+        return -1;
+    // header and row offsets are written once the nodes are known
+    std::vector<char> zeros(PACKED_HEADER_LEN + (rows + 1) * sizeof(uint64_t), 0);
+    out.write(&zeros[0], zeros.size());
+
+    std::vector<uint64_t> row_ptr;
+    row_ptr.reserve(rows + 1);
+    row_ptr.push_back(0);
+    uint64_t node_num = 0;
+
+    std::vector<feature_node> buf;
+    buf.reserve(PACKED_BUF_NUM + 2);
+    std::vector<char> in_buf(PACKED_BUF_NUM * (size_t_len + float_len));
+    size_t cur_row = 0;
+    for( size_t i = 0 ; i < num ; )
+    {
+        size_t chunk = std::min(PACKED_BUF_NUM, num - i);
+        in.read(&in_buf[0], chunk * (size_t_len + float_len));
+        if( in.good() == false )
+        {
+            std::cerr << "Truncated smat file: " << smat_name << std::endl;
+            exit(0);
+        }
+        for( size_t j = 0 ; j < chunk ; j++, i++ )
+        {
+            size_t idx;
+            float val;
+            memcpy(&idx, &in_buf[j * (size_t_len + float_len)], size_t_len);
+            memcpy(&val, &in_buf[j * (size_t_len + float_len) + size_t_len], float_len);
+            size_t r = idx / cols;
+            size_t c = idx % cols;
+            if( r < cur_row || r >= rows )
+            {
+                std::cerr << "smat entries are not in row order: " << smat_name << std::endl;
+                exit(0);
+            }
+            for( ; cur_row < r ; cur_row++ )
+                finishRow(buf, node_num, row_ptr, new_cols);
+
+            if( inds.empty() == false )
+            {
+                size_t k;
+                for( k = 0 ; k < inds.size() ; k++ )
+                    if( c >= (size_t)inds[k].first && c < (size_t)inds[k].second )
+                        break;
+                if( k == inds.size() )
+                    continue;
+                c -= piece_len[k];
+            }
+            feature_node cur_node;
+            cur_node.index = c + 1;
+            cur_node.value = val;
+            buf.push_back(cur_node);
+            node_num++;
+            if( buf.size() >= PACKED_BUF_NUM )
+                flushNodes(out, buf);
+        }
+    }
+    for( ; cur_row < rows ; cur_row++ )
+    {
+        finishRow(buf, node_num, row_ptr, new_cols);
+        if( buf.size() >= PACKED_BUF_NUM )
+            flushNodes(out, buf);
+    }
+    flushNodes(out, buf);
+
+    uint64_t header[4] = {sizeof(feature_node), rows, new_cols, node_num};
+    out.seekp(0, std::ios::beg);
+    out.write(PACKED_MAGIC, 8);
+    out.write((char*)header, sizeof(header));
+    out.write((char*)&row_ptr[0], row_ptr.size() * sizeof(uint64_t));
+    out.close();
+    return out.good() ? (long)rows : -1;
+}
+
+/************************************************************************************************************************************/
+
+packedSmat::packedSmat() : map_ptr(NULL), map_len(0), rows(0), cols(0), row_ptr(NULL), nodes(NULL)
+{
+}
+
+packedSmat::~packedSmat()
+{
+    close();
+}
+
+bool packedSmat::open(std::string filename)
+{
+    close();
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if( fd < 0 )
+        return false;
+    struct stat st;
+    if( fstat(fd, &st) != 0 || (size_t)st.st_size < PACKED_HEADER_LEN )
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // private writable mapping, liblinear only reads the rows so no page is ever copied
+    void *ptr = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if( ptr == MAP_FAILED )
+        return false;
+
+    const char *base = (const char *)ptr;
+    uint64_t header[4];
+    memcpy(header, base + 8, sizeof(header));
+    size_t nodes_offset = PACKED_HEADER_LEN + (header[1] + 1) * sizeof(uint64_t);
+    if( memcmp(base, PACKED_MAGIC, 8) != 0 || header[0] != sizeof(feature_node)
+            || nodes_offset + header[3] * sizeof(feature_node) != (size_t)st.st_size )
+    {
+        std::cerr << "Not a valid packed smat file: " << filename << std::endl;
+        munmap(ptr, st.st_size);
+        return false;
+    }
+
+    map_ptr = ptr;
+    map_len = st.st_size;
+    rows = header[1];
+    cols = header[2];
+    row_ptr = (const uint64_t *)(base + PACKED_HEADER_LEN);
+    nodes = (feature_node *)(base + nodes_offset);
+    // the solver visits every row in each iteration, start reading the whole file
+    madvise(map_ptr, map_len, MADV_WILLNEED);
+    return true;
+}
+
+void packedSmat::close()
+{
+    if( map_ptr != NULL )
+        munmap(map_ptr, map_len);
+    map_ptr = NULL;
+    map_len = 0;
+    rows = 0;
+    cols = 0;
+    row_ptr = NULL;
+    nodes = NULL;
+}
+
+void FormPackedProblem(const std::vector<packedSmat*> &mats, const std::vector<int> &labels, problem &prob, long r1, long r2)
+{
+    if( mats.empty() == true || mats.size() != labels.size() )
+    {
+        std::cerr << "Error in FormPackedProblem()!" << std::endl;
+        exit(0);
+    }
+
+    size_t total = 0;
+    size_t fea_dim = mats[0]->getCols();
+    for( size_t i = 0 ; i < mats.size() ; i++ )
+    {
+        if( mats[i]->getCols() != fea_dim )
+        {
+            std::cerr << mats[i]->getCols() << " " << fea_dim << std::endl;
+            std::cerr << "Merging Dimensions Mismatched!" << std::endl;
+            exit(0);
+        }
+        size_t e = r2 < 0 ? mats[i]->getRows() : std::min((size_t)r2, mats[i]->getRows());
+        total += e > (size_t)r1 ? e - r1 : 0;
+    }
+
+    prob.l = total;
+    prob.n = fea_dim + 1;	//include bias term
+    prob.bias = -1.0;
+    prob.y = (double *)malloc(sizeof(double) * total);
+    prob.x = (feature_node **)malloc(sizeof(feature_node *) * total);
+
+    size_t base = 0;
+    for( size_t i = 0 ; i < mats.size() ; i++ )
+    {
+        size_t e = r2 < 0 ? mats[i]->getRows() : std::min((size_t)r2, mats[i]->getRows());
+        for( size_t r = r1 ; r < e ; r++, base++ )
+        {
+            prob.x[base] = mats[i]->getRow(r);
+            prob.y[base] = labels[i];
+        }
+    }
+}
@@ -1,5 +1,9 @@
 #include "sp_segmenter/utility/utility.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 double get_wall_time(){
     struct timeval time;
     if (gettimeofday(&time,NULL)){
@@ -1201,45 +1205,36 @@ pcl::PointCloud<myPointXYZ>::Ptr uniformSampleCloud(const pcl::PointCloud<myPoin
     return down_cloud;
 }
 
-std::vector<int> getOneClique(const Eigen::MatrixXi &adj_mat, const std::vector<int> &active_idx)
+std::vector<int> getOneClique(const Eigen::MatrixXi &adj_mat, const std::vector<int> &active_idx, double time_budget)
 {
     int num = active_idx.size();
-    bool **adj = new bool*[num];
-    for(int i = 0 ; i < num ; i++ )
+    bitClique solver(num);
+    for( int i = 0 ; i < num ; i++ )
     {
-        adj[i] = new bool[num];
         int r = active_idx[i];
-        for( int j = 0 ; j < num ; j++ )
+        for( int j = i + 1 ; j < num ; j++ )
         {
             int c = active_idx[j];
-            adj[i][j] = adj_mat(r, c) == 1 ? true : false; 
+            if( adj_mat(r, c) == 1 && adj_mat(c, r) == 1 )
+                solver.addEdge(i, j);
         }
-        //memset(adj[i], 0, sizeof(bool)*num);
-    } 
-    Maxclique md(adj, num); 
-    int *qmax;
-    int qsize;
-    md.mcqdyn(qmax, qsize);  // run max clique with improved coloring and dynamic sorting of vertices 
-    
-    std::vector<int> clique_idx(qsize);
-    for (int i = 0; i < qsize; i++)
-    {
-        int cur_idx = active_idx[qmax[i]];
-        clique_idx[i] = cur_idx;
-        //std::cout << cur_idx << " ";
-    }
-    //std::cout << endl;
-    //cout << "Size = " << qsize << endl;
-    delete []qmax;
-    for(int i = 0 ; i < num ; i++ )
-        delete[] (adj[i]);
-    
-    delete []adj;
+    }
+    std::vector<int> qmax = solver.solve(time_budget);
+    
+    std::vector<int> clique_idx(qmax.size());
+    for (size_t i = 0; i < qmax.size(); i++)
+        clique_idx[i] = active_idx[qmax[i]];
     return clique_idx;
 }
 
 std::vector< std::vector<int> > maximalClique(const Eigen::MatrixXi &adj_mat)
 {
+    return maximalClique(adj_mat, -1);
+}
+
+std::vector< std::vector<int> > maximalClique(const Eigen::MatrixXi &adj_mat, double time_budget)
+{
+    double deadline = omp_get_wtime() + time_budget;
     // in-degree sorting
     int num = adj_mat.rows();
     /*
@@ -1273,7 +1268,9 @@ std::vector< std::vector<int> > maximalClique(const Eigen::MatrixXi &adj_mat)
                     active_idx.push_back(j);
             }
             //std::cerr << "pivot idx: " << pivot_idx << std::endl;
-            std::vector<int> new_cluster = getOneClique(adj_mat, active_idx);
+            // the budget is shared by all pivots, a spent budget still yields the greedy clique
+            double remaining = time_budget > 0 ? std::max(deadline - omp_get_wtime(), 1e-6) : -1;
+            std::vector<int> new_cluster = getOneClique(adj_mat, active_idx, remaining);
             //std::cerr<<"Cluster "<<final_clusters.size()<<": "<<new_cluster.size()<<std::endl;
             final_clusters.push_back(new_cluster);                   
             //for(int j = 0 ; j < new_cluster.size() ; j++ )
@@ -1593,6 +1590,7 @@ void GenSVMParamter(parameter &param, float CC)
     param.weight_label = NULL;
     param.weight = NULL;
     param.init_sol = NULL;
+    param.nr_thread = omp_get_max_threads();
 
 #ifdef LIBLINEAR_WEIGHT
     param.nr_weight = 2;
@@ -1874,6 +1872,81 @@ void saveCvMatSparse(std::string filename, const std::vector< sparseVec > &data,
     out.close();  
 }
 
+smatWriter::smatWriter() : cols(0), rows(0), num(0)
+{
+}
+
+smatWriter::~smatWriter()
+{
+    close();
+}
+
+bool smatWriter::open(std::string filename_)
+{
+    close();
+    filename = filename_;
+    cols = 0;
+    rows = 0;
+    num = 0;
+    out.open(filename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+    if( out.is_open() == false )
+        return false;
+    
+    // placeholder header, patched in close()
+    size_t size_t_len = sizeof(size_t);
+    out.write((char*)&cols, size_t_len);
+    out.write((char*)&rows, size_t_len);
+    out.write((char*)&num, size_t_len);
+    return true;
+}
+
+void smatWriter::append(const cv::Mat &row)
+{
+    if( out.is_open() == false )
+        return;
+    if( rows == 0 )
+        cols = row.cols * row.rows;
+    else if( (size_t)(row.cols * row.rows) != cols )
+    {
+        std::cerr << "Error: smatWriter row dim " << row.cols * row.rows << " != " << cols << std::endl;
+        exit(0);
+    }
+    
+    cv::Mat cur_row = row.isContinuous() ? row : row.clone();
+    const float *ptr = (const float *)cur_row.data;
+    size_t s_idx = rows * cols;
+    size_t size_t_len = sizeof(size_t);
+    size_t float_len = sizeof(float);
+    for( size_t i = 0 ; i < cols ; i++, ptr++ )
+    {
+        if( fabs(*ptr) >= 1e-6 && *ptr == *ptr )
+        {
+            size_t idx = s_idx + i;
+            out.write((char*)&idx, size_t_len);
+            out.write((char*)ptr, float_len);
+            num++;
+        }
+    }
+    rows++;
+}
+
+size_t smatWriter::close()
+{
+    if( out.is_open() == false )
+        return 0;
+    
+    size_t size_t_len = sizeof(size_t);
+    out.seekp(0, std::ios::beg);
+    out.write((char*)&cols, size_t_len);
+    out.write((char*)&rows, size_t_len);
+    out.write((char*)&num, size_t_len);
+    out.close();
+    
+    if( rows == 0 )
+        std::remove(filename.c_str());
+    return rows;
+}
+
 void getNonNormalPCDFiles(std::string path, std::vector<std::string> &files)
 {
     boost::filesystem::path p(path);
@@ -1,7 +1,179 @@
 #include "predicate.h"
 
+#include <fcl/collision.h>
+#include <fcl/distance.h>
+
+#include <set>
+
 namespace predicator {
 
+  /*
+   * hashBytes()
+   * FNV-1a, used to recognize shapes we have already built
+   */
+  static unsigned long hashBytes(const void *data, size_t len, unsigned long hash = 14695981039346656037UL) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < len; ++i) {
+      hash ^= bytes[i];
+      hash *= 1099511628211UL;
+    }
+    return hash;
+  }
+
+  template<typename T>
+  static unsigned long hashVector(const std::vector<T> &vec, unsigned long hash = 14695981039346656037UL) {
+    return vec.empty() ? hash : hashBytes(&vec[0], vec.size() * sizeof(T), hash);
+  }
+
+  static fcl::Transform3f toTransform(const geometry_msgs::Pose &pose) {
+    fcl::Quaternion3f q(pose.orientation.w, pose.orientation.x, pose.orientation.y, pose.orientation.z);
+    fcl::Vec3f t(pose.position.x, pose.position.y, pose.position.z);
+    return fcl::Transform3f(q, t);
+  }
+
+  static bool sameTransform(const fcl::Transform3f &a, const fcl::Transform3f &b) {
+    const fcl::Vec3f &ta = a.getTranslation();
+    const fcl::Vec3f &tb = b.getTranslation();
+    const fcl::Quaternion3f &qa = a.getQuatRotation();
+    const fcl::Quaternion3f &qb = b.getQuatRotation();
+    return ta[0] == tb[0] && ta[1] == tb[1] && ta[2] == tb[2]
+      && qa.getW() == qb.getW() && qa.getX() == qb.getX() && qa.getY() == qb.getY() && qa.getZ() == qb.getZ();
+  }
+
+  /**
+   * addMesh()
+   * Build the BVH of link i of an entity unless it already has this mesh
+   */
+  void GeometryParser::addMesh(CollisionEntity &entity, unsigned int i, const shape_msgs::Mesh &mesh) {
+    unsigned long signature = hashVector(mesh.vertices);
+    signature = hashVector(mesh.triangles, signature);
+
+    if (entity.hasShape(i, signature)) {
+      return;
+    }
+
+    // generate a BVH model from the shapes
+    // generate a mesh from triangles and points
+
+    std::vector<fcl::Triangle> triangles;
+    std::vector<fcl::Vec3f> vertices;
+    triangles.reserve(mesh.triangles.size());
+    vertices.reserve(mesh.vertices.size());
+
+    // ------------------------------------------------------
+    // Triangle mesh
+    // ------------------------------------------------------
+    for(std::vector<shape_msgs::MeshTriangle>::const_iterator tr = mesh.triangles.begin();
+        tr != mesh.triangles.end();
+        ++tr)
+    {
+      fcl::Triangle fcl_tr(tr->vertex_indices[0],
+                           tr->vertex_indices[1],
+                           tr->vertex_indices[2]);
+      triangles.push_back(fcl_tr);
+    }
+
+    // ------------------------------------------------------
+    // Actual vertex coordinates
+    // ------------------------------------------------------
+    for(std::vector<geometry_msgs::Point>::const_iterator pt = mesh.vertices.begin();
+        pt != mesh.vertices.end();
+        ++pt)
+    {
+      vertices.push_back(fcl::Vec3f(pt->x, pt->y, pt->z));
+    }
+
+    boost::shared_ptr<Model> model(new Model());
+    model->beginModel(triangles.size(), vertices.size());
+    model->addSubModel(vertices, triangles);
+    model->endModel();
+    model->computeLocalAABB();
+
+    ObjectPtr old = entity.setShape(i, signature, model);
+    if (old && old->getUserData() != NULL) {
+      // only objects with a pose are in the broadphase
+      manager_.unregisterObject(old.get());
+    }
+    ++num_built_;
+  }
+
+  /**
+   * addPrimitive()
+   * Create the shape of link i of an entity unless it already has this primitive
+   */
+  void GeometryParser::addPrimitive(CollisionEntity &entity, unsigned int i, const shape_msgs::SolidPrimitive &primitive) {
+    unsigned long signature = hashBytes(&primitive.type, sizeof(primitive.type));
+    signature = hashVector(primitive.dimensions, signature);
+
+    if (entity.hasShape(i, signature)) {
+      return;
+    }
+
+    GeometryPtr geometry;
+    const std::vector<double> &dim = primitive.dimensions;
+    if (primitive.type == shape_msgs::SolidPrimitive::BOX && dim.size() >= 3) {
+      geometry.reset(new fcl::Box(dim[shape_msgs::SolidPrimitive::BOX_X],
+                                  dim[shape_msgs::SolidPrimitive::BOX_Y],
+                                  dim[shape_msgs::SolidPrimitive::BOX_Z]));
+    } else if (primitive.type == shape_msgs::SolidPrimitive::SPHERE && dim.size() >= 1) {
+      geometry.reset(new fcl::Sphere(dim[shape_msgs::SolidPrimitive::SPHERE_RADIUS]));
+    } else if (primitive.type == shape_msgs::SolidPrimitive::CYLINDER && dim.size() >= 2) {
+      geometry.reset(new fcl::Cylinder(dim[shape_msgs::SolidPrimitive::CYLINDER_RADIUS],
+                                       dim[shape_msgs::SolidPrimitive::CYLINDER_HEIGHT]));
+    } else if (primitive.type == shape_msgs::SolidPrimitive::CONE && dim.size() >= 2) {
+      geometry.reset(new fcl::Cone(dim[shape_msgs::SolidPrimitive::CONE_RADIUS],
+                                   dim[shape_msgs::SolidPrimitive::CONE_HEIGHT]));
+    } else {
+      ROS_WARN("unsupported primitive type %u for collision object \"%s\"", primitive.type, entity.getId().c_str());
+      return;
+    }
+    geometry->computeLocalAABB();
+
+    ObjectPtr old = entity.setShape(i, signature, geometry);
+    if (old && old->getUserData() != NULL) {
+      // only objects with a pose are in the broadphase
+      manager_.unregisterObject(old.get());
+    }
+    ++num_built_;
+  }
+
+  /**
+   * setLinkPose()
+   * Move a link and refit the broadphase
+   */
+  void GeometryParser::setLinkPose(CollisionEntity &entity, unsigned int i, const geometry_msgs::Pose &pose) {
+    fcl::CollisionObject *obj = entity.getLink(i);
+    if (obj == NULL) {
+      return;
+    }
+
+    bool registered = obj->getUserData() != NULL;
+    if (entity.setPose(i, pose) || !registered) {
+      if (registered) {
+        manager_.update(obj);
+      } else {
+        obj->setUserData(&entity);
+        manager_.registerObject(obj);
+      }
+      ++num_moved_;
+    }
+  }
+
+  /**
+   * disable()
+   * Take all links of an entity out of the broadphase
+   */
+  void GeometryParser::disable(CollisionEntity &entity) {
+    for (unsigned int i = 0; i < entity.numLinks(); ++i) {
+      fcl::CollisionObject *obj = entity.getLink(i);
+      if (obj != NULL && obj->getUserData() != NULL) {
+        manager_.unregisterObject(obj);
+        obj->setUserData(NULL);
+      }
+    }
+    entity.setEnabled(false);
+  }
+
   /**
    * updateCollisionObject()
    * Called once for each CollisionObject method.
@@ -9,120 +181,133 @@ namespace predicator {
    * Else, it can move the pose associated with that object.
    */
   void GeometryParser::updateCollisionObject(const moveit_msgs::CollisionObject &co) {
-    ROS_INFO("updating collision object \"%s\", command=%u", co.id.c_str(), co.operation);
+    if (verbosity_ > 1) {
+      ROS_INFO("updating collision object \"%s\", command=%u", co.id.c_str(), co.operation);
+    }
+
+    std::map<std::string, CollisionEntity>::iterator it = entities_.find(co.id);
+    if (it == entities_.end()) {
+      it = entities_.insert(std::make_pair(co.id, CollisionEntity(co.id))).first;
+    }
+    CollisionEntity &entity = it->second;
 
     // check to see if we should be adding it or what
-    if(co.operation == moveit_msgs::CollisionObject::ADD) {
-      entities_[co.id] = CollisionEntity(co.id);
-    } else if(co.operation == moveit_msgs::CollisionObject::REMOVE) {
-      entities_[co.id].setEnabled(false);
-      entities_[co.id].purge(); // delete the unused model
+    if(co.operation == moveit_msgs::CollisionObject::REMOVE) {
+      disable(entity);
       return;
-    } else if (entities_.find(co.id) == entities_.end()) {
-      entities_[co.id] = CollisionEntity(co.id);
     }
 
-    entities_[co.id].setEnabled(true);
-    entities_[co.id].setId(co.id);
-
-
-    // create a bunch of entities!
-    if (entities_[co.id].isEnabled()) {
+    entity.setEnabled(true);
+    entity.setId(co.id);
 
-      if (!entities_[co.id].isOpen()) {
-        entities_[co.id].open();
-      }
+    // links are numbered meshes first, then primitives
+    const unsigned int num_meshes = co.meshes.size();
+    const unsigned int first = (co.operation == moveit_msgs::CollisionObject::APPEND) ? entity.numLinks() : 0;
 
+    if (co.operation != moveit_msgs::CollisionObject::MOVE) {
       // ------------------------------------------------------
-      // add the mesh or update it
+      // add the meshes or reuse the ones we have
       // ------------------------------------------------------
       for (unsigned int i = 0; i < co.meshes.size(); ++i) {
-        // generate a BVH model from the shapes
-        // generate a mesh from triangles and points
-
-        std::vector<fcl::Triangle> triangles;
-        std::vector<fcl::Vec3f> vertices;
-
-        // ------------------------------------------------------
-        // Triangle mesh
-        // ------------------------------------------------------
-        for(std::vector<shape_msgs::MeshTriangle>::const_iterator tr = co.meshes[i].triangles.begin();
-            tr != co.meshes[i].triangles.end();
-            ++tr)
-        {
-          fcl::Triangle fcl_tr(tr->vertex_indices[0],
-                               tr->vertex_indices[1],
-                               tr->vertex_indices[2]);
-          triangles.push_back(fcl_tr);
-        }
+        addMesh(entity, first + i, co.meshes[i]);
+      }
+      for (unsigned int i = 0; i < co.primitives.size(); ++i) {
+        addPrimitive(entity, first + num_meshes + i, co.primitives[i]);
+      }
 
-        // ------------------------------------------------------
-        // Actual vertex coordinates
-        // ------------------------------------------------------
-        for(std::vector<geometry_msgs::Point>::const_iterator pt = co.meshes[i].vertices.begin();
-            pt != co.meshes[i].vertices.end();
-            ++pt)
-        {
-          fcl::Vec3f vec;
-          vec[0] = pt->x;
-          vec[1] = pt->y;
-          vec[2] = pt->z;
-
-          vertices.push_back(vec);
+      // an ADD replaces the whole object
+      if (co.operation == moveit_msgs::CollisionObject::ADD) {
+        std::vector<ObjectPtr> removed;
+        entity.truncate(num_meshes + co.primitives.size(), removed);
+        for (unsigned int i = 0; i < removed.size(); ++i) {
+          if (removed[i]->getUserData() != NULL) {
+            manager_.unregisterObject(removed[i].get());
+          }
         }
-
-        // add link to an object
-        entities_[co.id].addLink(vertices, triangles);
       }
     }
+
+    // ------------------------------------------------------
+    // update the poses
+    // ------------------------------------------------------
+    for (unsigned int i = 0; i < co.mesh_poses.size(); ++i) {
+      setLinkPose(entity, first + i, co.mesh_poses[i]);
+    }
+    for (unsigned int i = 0; i < co.primitive_poses.size(); ++i) {
+      setLinkPose(entity, first + num_meshes + i, co.primitive_poses[i]);
+    }
   }
 
-  CollisionEntity::CollisionEntity(const std::string &id) : id_(id) {
+  CollisionEntity::CollisionEntity(const std::string &id) : id_(id), enabled_(false) {
     // do whatever to create this thing
   }
 
-  /**
-   * isOpen()
-   * Is this open to add more links to it?
-   */
-  const bool CollisionEntity::isOpen() const { return open_; }
+  unsigned int CollisionEntity::numLinks() const { return links_.size(); }
 
-  /**
-   * open()
-   * Set this object to accept new links
-   */
-  void CollisionEntity::open() {
-    if (model == NULL) {
-      model = new Model(); // create the model
-    }
-    model->beginModel();
+  fcl::CollisionObject *CollisionEntity::getLink(unsigned int i) const {
+    return i < links_.size() ? links_[i].get() : NULL;
+  }
+
+  bool CollisionEntity::hasShape(unsigned int i, unsigned long signature) const {
+    return i < links_.size() && links_[i] && signatures_[i] == signature;
   }
 
   /**
-   * purge()
-   * Delete the underlying structure(s) 
+   * setShape()
+   * Replace the geometry of link i, adding links as needed.
    */
-  void CollisionEntity::purge() {
-    if(model != NULL) {
-      delete model;
+  ObjectPtr CollisionEntity::setShape(unsigned int i, unsigned long signature, const GeometryPtr &geometry) {
+    if (i >= links_.size()) {
+      links_.resize(i + 1);
+      signatures_.resize(i + 1, 0);
+    }
+
+    ObjectPtr old = links_[i];
+    fcl::Transform3f tf;
+    if (old) {
+      tf = old->getTransform();
     }
-    model = NULL;
+
+    links_[i].reset(new fcl::CollisionObject(geometry, tf));
+    links_[i]->setUserData(NULL); // not in the broadphase yet
+    signatures_[i] = signature;
+
+    return old;
   }
 
   /**
-   * addLink()
-   * Append a single sub model to the object.
+   * setPose()
+   * Move link i, returns true if the pose changed
    */
-  void CollisionEntity::addLink(const std::vector<fcl::Vec3f> &vertices, const std::vector<fcl::Triangle> &triangles) {
-    model->addSubModel(vertices, triangles);
+  bool CollisionEntity::setPose(unsigned int i, const geometry_msgs::Pose &pose) {
+    if (i >= links_.size() || !links_[i]) {
+      return false;
+    }
+
+    fcl::Transform3f tf = toTransform(pose);
+    if (sameTransform(links_[i]->getTransform(), tf)) {
+      return false;
+    }
+
+    links_[i]->setTransform(tf);
+    links_[i]->computeAABB();
+    return true;
   }
 
   /**
-   * close()
-   * Stop adding new links
+   * truncate()
+   * Drop the links from n on
    */
-  void CollisionEntity::close() {
-    model->endModel();
+  void CollisionEntity::truncate(unsigned int n, std::vector<ObjectPtr> &removed) {
+    for (unsigned int i = n; i < links_.size(); ++i) {
+      if (links_[i]) {
+        removed.push_back(links_[i]);
+      }
+    }
+    if (n < links_.size()) {
+      links_.resize(n);
+      signatures_.resize(n);
+    }
   }
 
   // -------------------------------------------------------------------------
@@ -134,21 +319,163 @@ namespace predicator {
   const std::string &CollisionEntity::getId() const { return id_; }
   // -------------------------------------------------------------------------
 
+  typedef std::map<std::pair<std::string, std::string>, double> pair_map_t;
+
+  struct ContactData {
+    fcl::CollisionRequest request;
+    std::set<std::pair<std::string, std::string> > pairs;
+  };
+
+  struct DistanceData {
+    fcl::DistanceRequest request;
+    double threshold;
+    pair_map_t pairs; // smallest distance between links of two entities
+  };
+
+  static inline std::pair<std::string, std::string> entityPair(fcl::CollisionObject *o1, fcl::CollisionObject *o2) {
+    const std::string &id1 = ((CollisionEntity *)o1->getUserData())->getId();
+    const std::string &id2 = ((CollisionEntity *)o2->getUserData())->getId();
+    return id1 < id2 ? std::make_pair(id1, id2) : std::make_pair(id2, id1);
+  }
+
+  // called by the broadphase for every pair of links with overlapping AABBs
+  static bool contactCallback(fcl::CollisionObject *o1, fcl::CollisionObject *o2, void *cdata) {
+    ContactData *data = (ContactData *)cdata;
+    if (o1->getUserData() == o2->getUserData()) {
+      return false;
+    }
+
+    std::pair<std::string, std::string> ids = entityPair(o1, o2);
+    if (data->pairs.find(ids) != data->pairs.end()) {
+      return false;
+    }
+
+    fcl::CollisionResult result;
+    fcl::collide(o1, o2, data->request, result);
+    if (result.isCollision()) {
+      data->pairs.insert(ids);
+    }
+    return false;
+  }
+
+  // called by the broadphase for every pair of links closer than dist
+  static bool distanceCallback(fcl::CollisionObject *o1, fcl::CollisionObject *o2, void *cdata, fcl::FCL_REAL &dist) {
+    DistanceData *data = (DistanceData *)cdata;
+
+    // keep the search radius at the threshold so every near pair is visited
+    dist = data->threshold;
+
+    if (o1->getUserData() == o2->getUserData()) {
+      return false;
+    }
+
+    fcl::DistanceResult result;
+    fcl::distance(o1, o2, data->request, result);
+    if (result.min_distance < data->threshold) {
+      std::pair<std::string, std::string> ids = entityPair(o1, o2);
+      pair_map_t::iterator it = data->pairs.find(ids);
+      if (it == data->pairs.end() || result.min_distance < it->second) {
+        data->pairs[ids] = result.min_distance;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * computePredicates()
+   * All pairs contact and distance queries over the broadphase
+   */
+  void GeometryParser::computePredicates(predicator_msgs::PredicateList &list) {
+    // rebalances the tree only if objects were added since the last call
+    manager_.setup();
+
+    ContactData contacts;
+    manager_.collide(&contacts, contactCallback);
+
+    DistanceData distances;
+    distances.threshold = near_threshold_;
+    manager_.distance(&distances, distanceCallback);
+
+    for (std::set<std::pair<std::string, std::string> >::const_iterator it = contacts.pairs.begin();
+         it != contacts.pairs.end();
+         ++it)
+    {
+      predicator_msgs::PredicateStatement ps;
+      ps.predicate = "touching";
+      ps.num_params = 2;
+      ps.params[0] = it->first;
+      ps.params[1] = it->second;
+      list.statements.push_back(ps);
+
+      ps.params[0] = it->second;
+      ps.params[1] = it->first;
+      list.statements.push_back(ps);
+    }
+
+    for (pair_map_t::const_iterator it = distances.pairs.begin();
+         it != distances.pairs.end();
+         ++it)
+    {
+      predicator_msgs::PredicateStatement ps;
+      ps.predicate = "near_mesh";
+      ps.value = near_threshold_ - it->second;
+      ps.num_params = 2;
+      ps.params[0] = it->first.first;
+      ps.params[1] = it->first.second;
+      list.statements.push_back(ps);
+
+      ps.params[0] = it->first.second;
+      ps.params[1] = it->first.first;
+      list.statements.push_back(ps);
+    }
+  }
+
   /**
   */
   void GeometryParser::planningSceneCallback(const moveit_msgs::PlanningScene::ConstPtr &msg) {
+    num_built_ = 0;
+    num_moved_ = 0;
+
+    // a full scene removes everything it does not mention
+    if (!msg->is_diff) {
+      std::set<std::string> ids;
+      for (unsigned int i = 0; i < msg->world.collision_objects.size(); ++i) {
+        ids.insert(msg->world.collision_objects[i].id);
+      }
+      for (std::map<std::string, CollisionEntity>::iterator it = entities_.begin();
+           it != entities_.end();
+           ++it)
+      {
+        if (it->second.isEnabled() && ids.find(it->first) == ids.end()) {
+          disable(it->second);
+        }
+      }
+    }
+
     for(std::vector<moveit_msgs::CollisionObject>::const_iterator it = msg->world.collision_objects.begin();
         it != msg->world.collision_objects.end();
         ++it) {
       updateCollisionObject(*it);
     }
+
+    predicator_msgs::PredicateList list;
+    list.pheader.source = ros::this_node::getName();
+    computePredicates(list);
+    pub_.publish(list);
+
+    if (verbosity_ > 0) {
+      ROS_INFO("planning scene: %u geometries built, %u links moved, %lu statements",
+               num_built_, num_moved_, list.statements.size());
+    }
   }
 
   /**
   */
   GeometryParser::GeometryParser(const std::string &planning_topic,
-                                 const std::string &predicate_topic)
-    : nh_()
+                                 const std::string &predicate_topic,
+                                 double near_threshold,
+                                 int verbosity)
+    : nh_(), near_threshold_(near_threshold), verbosity_(verbosity), num_built_(0), num_moved_(0)
   {
     // advertize a topic with predicate information
     pub_ = nh_.advertise<predicator_msgs::PredicateList>(predicate_topic, 1000);
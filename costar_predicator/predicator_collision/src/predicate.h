@@ -6,6 +6,8 @@
 #include <fcl/data_types.h> // Triangles, other simple data types
 #include <fcl/shape/geometric_shapes.h> // spheres, cylinders, etc.
 #include <fcl/BVH/BVH_model.h>
+#include <fcl/collision_object.h>
+#include <fcl/broadphase/broadphase_dynamic_AABB_tree.h>
 
 // --------------------------------------
 // MoveIt types and functions
@@ -30,121 +32,170 @@
 
 #include <map>
 #include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
 
 namespace predicator {
 
   typedef fcl::BVHModel<fcl::OBBRSS> Model;
+  typedef boost::shared_ptr<fcl::CollisionGeometry> GeometryPtr;
+  typedef boost::shared_ptr<fcl::CollisionObject> ObjectPtr;
 
   class CollisionEntity;
 
   /**
-   * GeometryParser
-   * Listens for PlanningScene updates and deals with them.
-   * 
-   * NOTE: this should also connect to MoveIt, for convenience functions describing robot/world interactions.
-   * Right now, there are no names sent for individual links in world objects on the PlanningScene topic.
-   * This could cause trouble if we want to identify specific parts of the objects by name.
+   * Entity
+   * Defines an unknown object in the world.
+   * Consists of Collision Links, which are smaller objects.
+   * Every link keeps its geometry (and the BVH of a mesh) for as long as its shape does not change,
+   * new poses only move the link.
    */
-  class GeometryParser {
+  class CollisionEntity {
   private:
-    ros::Subscriber sub_; // listen to incoming planning scenes
-    ros::Publisher pub_; // publish predicate information
+    std::string id_; // what identifies this object?
+    bool enabled_; // are we tracking predicates?
 
-    ros::NodeHandle nh_; // node handle for extra stuff
+    std::vector<ObjectPtr> links_; // one per mesh or primitive, in message order
+    std::vector<unsigned long> signatures_; // hash of the shape of each link
 
-  protected:
+  public:
+    const std::string &getId() const;
 
-    // set of all collision entities
-    std::map<std::string, CollisionEntity> entities_;
+    CollisionEntity(const std::string &id = "");
+
+    void setId(const std::string &new_id);
 
-    void addMesh(const std::string &id, const shape_msgs::Mesh &mesh);
+    /**
+     * setEnabled()
+     * Set the object to be enabled in the world.
+     * Is the object enabled? AKA, should we report predicates?
+     */
+    void setEnabled(bool enabled);
 
-    void addPrimitive(const std::string &id, const shape_msgs::SolidPrimitive &primitive);
+    /**
+     * isEnabled()
+     * Is the object enabled? AKA, should we report predicates?
+     */
+    bool isEnabled() const;
 
     /**
-     * updateCollisionObject()
-     * Called once for each CollisionObject method.
-     * If operation == add or append, it will add these entities to that object.
-     * Else, 
+     * numLinks()
      */
-    void updateCollisionObject(const moveit_msgs::CollisionObject &co);
+    unsigned int numLinks() const;
 
-  public:
-    void planningSceneCallback(const moveit_msgs::PlanningScene::ConstPtr &msg);
+    /**
+     * getLink()
+     * Collision object of one link, NULL if it has no geometry yet
+     */
+    fcl::CollisionObject *getLink(unsigned int i) const;
 
     /**
-     * GeometryParser()
-     * Constructor, creates a subscriber and a publisher among other things
+     * hasShape()
+     * True if link i was built from a shape with this signature
+     */
+    bool hasShape(unsigned int i, unsigned long signature) const;
+
+    /**
+     * setShape()
+     * Replace the geometry of link i, adding links as needed.
+     * Returns the collision object that was replaced (or NULL) so it can be removed from the broadphase.
+     */
+    ObjectPtr setShape(unsigned int i, unsigned long signature, const GeometryPtr &geometry);
+
+    /**
+     * setPose()
+     * Move link i, returns true if the pose changed
      */
-    GeometryParser(const std::string &planning_topic, const std::string &predicate_topic);
+    bool setPose(unsigned int i, const geometry_msgs::Pose &pose);
 
+    /**
+     * truncate()
+     * Drop the links from n on, appending them to removed
+     */
+    void truncate(unsigned int n, std::vector<ObjectPtr> &removed);
   };
 
   /**
-   * Entity
-   * Defines an unknown object in the world.
-   * Consists of Collision Links, which are smaller objects.
+   * GeometryParser
+   * Listens for PlanningScene updates and deals with them.
+   * Keeps a persistent collision world: the BVH of a mesh is built once per object id and shape,
+   * later scenes only move the objects in a dynamic AABB tree broadphase that answers all pairs queries.
+   * 
+   * NOTE: this should also connect to MoveIt, for convenience functions describing robot/world interactions.
+   * Right now, there are no names sent for individual links in world objects on the PlanningScene topic.
+   * This could cause trouble if we want to identify specific parts of the objects by name.
    */
-  class CollisionEntity {
+  class GeometryParser {
   private:
-    std::string id_; // what identifies this object?
-    bool enabled_; // are we tracking predicates?
-    bool open_; // are we still reading links?
+    ros::Subscriber sub_; // listen to incoming planning scenes
+    ros::Publisher pub_; // publish predicate information
 
-    geometry_msgs::Pose pose_;
+    ros::NodeHandle nh_; // node handle for extra stuff
 
-  protected:
-    Model * model;
+    double near_threshold_; // report near_mesh for objects closer than this
+    int verbosity_;
 
-  public:
-    const std::string &getId() const;
+    // counters, for debugging
+    unsigned int num_built_; // geometries built
+    unsigned int num_moved_; // links moved
 
-    CollisionEntity(const std::string &id = "");
+  protected:
 
-    void setId(const std::string &new_id);
+    // set of all collision entities
+    std::map<std::string, CollisionEntity> entities_;
+
+    // all enabled links of all entities
+    fcl::DynamicAABBTreeCollisionManager manager_;
 
     /**
-     * setEnabled()
-     * Set the object to be enabled in the world.
-     * Is the object enabled? AKA, should we report predicates?
+     * addMesh()
+     * Build the BVH of link i of an entity unless it already has this mesh
      */
-    void setEnabled(bool enabled);
+    void addMesh(CollisionEntity &entity, unsigned int i, const shape_msgs::Mesh &mesh);
 
     /**
-     * isEnabled()
-     * Is the object enabled? AKA, should we report predicates?
+     * addPrimitive()
+     * Create the shape of link i of an entity unless it already has this primitive
      */
-    bool isEnabled() const;
+    void addPrimitive(CollisionEntity &entity, unsigned int i, const shape_msgs::SolidPrimitive &primitive);
 
     /**
-     * isOpen()
-     * Is this open to add more links to it?
+     * setLinkPose()
+     * Move a link and refit the broadphase
      */
-    const bool isOpen() const;
+    void setLinkPose(CollisionEntity &entity, unsigned int i, const geometry_msgs::Pose &pose);
 
     /**
-     * open()
-     * Set this object to accept new links
+     * disable()
+     * Take all links of an entity out of the broadphase
      */
-    void open();
+    void disable(CollisionEntity &entity);
 
     /**
-     * close()
-     * Stop adding new links
+     * updateCollisionObject()
+     * Called once for each CollisionObject method.
+     * If operation == add or append, it will add these entities to that object.
+     * Else, it can move the pose associated with that object.
      */
-    void close();
+    void updateCollisionObject(const moveit_msgs::CollisionObject &co);
 
     /**
-     * purge()
-     * Delete the underlying structure(s) 
+     * computePredicates()
+     * All pairs contact and distance queries over the broadphase
      */
-    void purge();
+    void computePredicates(predicator_msgs::PredicateList &list);
+
+  public:
+    void planningSceneCallback(const moveit_msgs::PlanningScene::ConstPtr &msg);
 
     /**
-     * addLink()
-     * Append a single sub model to the object.
+     * GeometryParser()
+     * Constructor, creates a subscriber and a publisher among other things
      */
-    void addLink(const std::vector<fcl::Vec3f> &vertices, const std::vector<fcl::Triangle> &triangles);
+    GeometryParser(const std::string &planning_topic, const std::string &predicate_topic,
+                   double near_threshold = 0.1, int verbosity = 0);
+
   };
 
 
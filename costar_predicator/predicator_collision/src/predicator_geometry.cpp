@@ -37,5 +37,12 @@ int main(int argc, char **argv) {
   nh_tilde.param("predicate_output_topic", output_topic, std::string("/predicator/input"));
   nh_tilde.param("planning_scene_topic", input_topic, std::string("/planning_scene"));
 
-  GeometryParser gp(input_topic, output_topic);
+  double near_threshold;
+  int verbosity;
+  nh_tilde.param("near_mesh_threshold", near_threshold, 0.1);
+  nh_tilde.param("verbosity", verbosity, 0);
+
+  GeometryParser gp(input_topic, output_topic, near_threshold, verbosity);
+
+  ros::spin();
 }
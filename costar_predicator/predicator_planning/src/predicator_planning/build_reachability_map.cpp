@@ -0,0 +1,126 @@
+// ROS
+#include <ros/ros.h>
+
+// for debugging
+#include <iostream>
+
+// MoveIt!
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <moveit/robot_state/robot_state.h>
+
+#include <random_numbers/random_numbers.h>
+
+#include <algorithm>
+
+#include "reachability_map.h"
+
+/**
+ * build_reachability_map
+ * Offline tool for the reachability predicates of predicator_planning.
+ * Samples random positions of a joint group, records where the tip link ends up
+ * in the root link frame together with its manipulability, and writes the voxel grid to a file.
+ */
+int main(int argc, char **argv) {
+
+  ros::init(argc, argv, "build_reachability_map");
+
+  ros::NodeHandle nh("~");
+
+  std::string description;
+  std::string group_name;
+  std::string tip_name;
+  std::string filename;
+  double resolution;
+  double padding;
+  int samples;
+  int seed;
+
+  nh.param("robot_description", description, std::string("robot_description"));
+  nh.param("group", group_name, std::string("arm"));
+  nh.param("tip", tip_name, std::string(""));
+  nh.param("output", filename, std::string("reachability.map"));
+  nh.param("resolution", resolution, double(0.05));
+  nh.param("padding", padding, double(0.1));
+  nh.param("samples", samples, int(1000000));
+  nh.param("seed", seed, int(0));
+
+  robot_model_loader::RobotModelLoader loader(description);
+  robot_model::RobotModelPtr model = loader.getModel();
+  if (!model) {
+    ROS_ERROR("Could not load robot description \"%s\"!", description.c_str());
+    return -1;
+  }
+
+  if (!model->hasJointModelGroup(group_name)) {
+    ROS_ERROR("Unable to get group \"%s\" for robot \"%s\"!", group_name.c_str(), model->getName().c_str());
+    return -1;
+  }
+  const moveit::core::JointModelGroup *group = model->getJointModelGroup(group_name);
+
+  // default to the last link of the group
+  if (tip_name.size() == 0) {
+    tip_name = group->getLinkModelNames().back();
+  }
+  if (!model->hasLinkModel(tip_name)) {
+    ROS_ERROR("Unable to get tip link \"%s\" for robot \"%s\"!", tip_name.c_str(), model->getName().c_str());
+    return -1;
+  }
+  const moveit::core::LinkModel *tip = model->getLinkModel(tip_name);
+  const moveit::core::LinkModel *base = model->getRootLink();
+
+  robot_state::RobotState state(model);
+  state.setToDefaultValues();
+  random_numbers::RandomNumberGenerator rng((boost::uint32_t)seed);
+  std::vector<double> values;
+
+  // bounds from a first batch of samples
+  const int bound_samples = std::min(samples, 10000);
+  double min[3] = {1e9, 1e9, 1e9};
+  double max[3] = {-1e9, -1e9, -1e9};
+  for (int i = 0; i < bound_samples; ++i) {
+    group->getVariableRandomPositions(rng, values);
+    state.setJointGroupPositions(group, values);
+    state.update();
+
+    Eigen::Vector3d p = state.getGlobalLinkTransform(base).inverse() * state.getGlobalLinkTransform(tip).translation();
+    for (unsigned int k = 0; k < 3; ++k) {
+      min[k] = std::min(min[k], p[k] - padding);
+      max[k] = std::max(max[k], p[k] + padding);
+    }
+  }
+
+  predicator_planning::ReachabilityMap map;
+  map.robot = model->getName();
+  map.group = group_name;
+  map.tip = tip_name;
+  map.base = base->getName();
+  map.resize(min, max, resolution);
+
+  std::cout << "Sampling " << samples << " positions of " << map.robot << "/" << map.group
+    << " into " << map.size[0] << "x" << map.size[1] << "x" << map.size[2] << " voxels" << std::endl;
+
+  ros::WallTime start = ros::WallTime::now();
+  for (int i = 0; i < samples && ros::ok(); ++i) {
+    group->getVariableRandomPositions(rng, values);
+    state.setJointGroupPositions(group, values);
+    state.update();
+
+    Eigen::Vector3d p = state.getGlobalLinkTransform(base).inverse() * state.getGlobalLinkTransform(tip).translation();
+    map.add(p, predicator_planning::manipulability(state, group, tip));
+
+    if ((i + 1) % 100000 == 0) {
+      std::cout << (i + 1) << " samples, " << map.countReachable() << " reachable voxels" << std::endl;
+    }
+  }
+
+  std::cout << "Done after " << (ros::WallTime::now() - start).toSec() << " seconds, "
+    << map.countReachable() << " of " << map.scores.size() << " voxels reachable" << std::endl;
+
+  if (!map.save(filename)) {
+    ROS_ERROR("Could not write reachability map \"%s\"!", filename.c_str());
+    return -1;
+  }
+  std::cout << "Wrote " << filename << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,215 @@
+#include "collision_engine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace predicator_planning {
+
+  CollisionEngine::PairResult::PairResult() :
+    dist(std::numeric_limits<double>::max()), checked(false), has_geometry(false), version1(0), version2(0), valid(false) {}
+
+  CollisionEngine::SceneCache::SceneCache() : has_box(false), version(0) {
+    for (unsigned int k = 0; k < 6; ++k) {
+      box[k] = 0;
+    }
+  }
+
+  CollisionEngine::CollisionEngine(double _near_threshold, double _padding, int _verbosity) :
+    near_threshold(_near_threshold), padding(_padding), verbosity(_verbosity),
+    num_contact_queries(0), num_distance_queries(0), num_cached(0), num_far(0) {}
+
+  /**
+   * updateState()
+   * Returns true if the state changed since the last call
+   */
+  bool CollisionEngine::updateState(unsigned int i, RobotState *state) {
+    SceneCache &sc = cache[i];
+    const double *positions = state->getVariablePositions();
+    const size_t count = state->getVariableCount();
+
+    if (sc.version > 0 && sc.positions.size() == count && std::equal(positions, positions + count, sc.positions.begin())) {
+      // still make sure the transforms are there, this does nothing if the state is clean
+      state->update();
+      return false;
+    }
+
+    sc.positions.assign(positions, positions + count);
+    ++sc.version;
+
+    // force an update
+    // source: https://groups.google.com/forum/#!topic/moveit-users/O9CEef6sxbE
+    state->update(true);
+
+    std::vector<double> aabb;
+    state->computeAABB(aabb);
+    sc.has_box = aabb.size() == 6 && aabb[0] <= aabb[1] && aabb[2] <= aabb[3] && aabb[4] <= aabb[5];
+    if (sc.has_box) {
+      for (unsigned int k = 0; k < 6; ++k) {
+        sc.box[k] = aabb[k] + ((k % 2 == 0) ? -padding : padding);
+      }
+    }
+
+    return true;
+  }
+
+  /**
+   * boxGap()
+   * Euclidean distance between the padded boxes of two scenes, 0 if they overlap
+   */
+  double CollisionEngine::boxGap(unsigned int i, unsigned int j) const {
+    const SceneCache &a = cache[i];
+    const SceneCache &b = cache[j];
+    if (!a.has_box || !b.has_box) {
+      return std::numeric_limits<double>::max();
+    }
+
+    double sum = 0;
+    for (unsigned int k = 0; k < 3; ++k) {
+      double gap = std::max(b.box[2*k] - a.box[2*k+1], a.box[2*k] - b.box[2*k+1]);
+      if (gap > 0) {
+        sum += gap * gap;
+      }
+    }
+    return sqrt(sum);
+  }
+
+  /**
+   * broadphase()
+   * Sweep and prune along x, marks the pairs within near_threshold
+   */
+  void CollisionEngine::broadphase(std::vector<bool> &near) const {
+    const unsigned int n = cache.size();
+    near.assign(n * n, false);
+
+    std::vector<std::pair<double, unsigned int> > order;
+    for (unsigned int i = 0; i < n; ++i) {
+      if (cache[i].has_box) {
+        order.push_back(std::make_pair(cache[i].box[0], i));
+      }
+    }
+    std::sort(order.begin(), order.end());
+
+    for (unsigned int a = 0; a < order.size(); ++a) {
+      const unsigned int i = order[a].second;
+      const double max_x = cache[i].box[1] + near_threshold;
+      for (unsigned int b = a + 1; b < order.size() && order[b].first <= max_x; ++b) {
+        const unsigned int j = order[b].second;
+        if (boxGap(i, j) <= near_threshold) {
+          near[i * n + j] = true;
+          near[j * n + i] = true;
+        }
+      }
+    }
+  }
+
+  void CollisionEngine::computePair(const std::vector<PlanningScene *> &scenes, const std::vector<RobotState *> &states,
+                                    unsigned int i, unsigned int j, bool near)
+  {
+    PairResult &res = pairs[std::make_pair(i, j)];
+
+    if (res.valid && res.version1 == cache[i].version && res.version2 == cache[j].version) {
+      ++num_cached;
+      return;
+    }
+
+    res.valid = true;
+    res.version1 = cache[i].version;
+    res.version2 = cache[j].version;
+    res.contacts.clear();
+
+    res.has_geometry = cache[i].has_box && cache[j].has_box;
+    if (!res.has_geometry) {
+      // nothing to measure, there is no predicate for this pair
+      res.dist = std::numeric_limits<double>::max();
+      res.checked = false;
+      return;
+    }
+
+    if (!near) {
+      // too far apart to be interesting, the box gap is a lower bound of the mesh distance
+      res.dist = boxGap(i, j);
+      res.checked = false;
+      ++num_far;
+      return;
+    }
+
+    collision_detection::CollisionRobotConstPtr robot1 = scenes[i]->getCollisionRobot();
+    collision_detection::CollisionRobotConstPtr robot2 = scenes[j]->getCollisionRobot();
+
+    // padded boxes that do not overlap cannot contain touching links
+    if (boxGap(i, j) <= 0) {
+      collision_detection::CollisionRequest req;
+      collision_detection::CollisionResult cres;
+      req.contacts = true;
+      req.max_contacts = 1000;
+
+      robot1->checkOtherCollision(req, cres, *states[i], *robot2, *states[j]);
+      ++num_contact_queries;
+
+      if (verbosity > 4) {
+        std::cout << cres.contacts.size() << " contacts found" << std::endl;
+      }
+
+      for(collision_detection::CollisionResult::ContactMap::const_iterator cit = cres.contacts.begin();
+          cit != cres.contacts.end();
+          ++cit)
+      {
+        res.contacts.push_back(cit->first);
+      }
+    }
+
+    res.dist = robot1->distanceOther(*states[i], *robot2, *states[j]);
+    res.checked = true;
+    ++num_distance_queries;
+  }
+
+  /**
+   * update()
+   * Refresh the changed states and their boxes, then recompute the pairs of states that changed.
+   */
+  void CollisionEngine::update(const std::vector<PlanningScene *> &scenes, const std::vector<RobotState *> &states, unsigned int idx) {
+    const unsigned int n = scenes.size();
+    if (cache.size() != n) {
+      cache.assign(n, SceneCache());
+      pairs.clear();
+    }
+
+    num_contact_queries = 0;
+    num_distance_queries = 0;
+    num_cached = 0;
+    num_far = 0;
+
+    for (unsigned int i = 0; i < n; ++i) {
+      updateState(i, states[i]);
+    }
+
+    std::vector<bool> near;
+    broadphase(near);
+
+    for (unsigned int i = 0; i < n; ++i) {
+      for (unsigned int j = i + 1; j < n; ++j) {
+        if (idx < n && i != idx && j != idx) {
+          continue;
+        }
+        computePair(scenes, states, i, j, near[i * n + j]);
+      }
+    }
+
+    if (verbosity > 1) {
+      std::cout << "collision pairs: " << num_contact_queries << " contact queries, "
+        << num_distance_queries << " distance queries, "
+        << num_cached << " cached, "
+        << num_far << " skipped by broadphase" << std::endl;
+    }
+  }
+
+  /**
+   * getPair()
+   * Result for scenes i and j (in either order), as computed by the last update()
+   */
+  const CollisionEngine::PairResult &CollisionEngine::getPair(unsigned int i, unsigned int j) const {
+    return pairs.at(i < j ? std::make_pair(i, j) : std::make_pair(j, i));
+  }
+}
@@ -0,0 +1,115 @@
+#ifndef _PP_COLLISION_ENGINE
+#define _PP_COLLISION_ENGINE
+
+// stl
+#include <vector>
+#include <map>
+#include <string>
+
+// MoveIt!
+#include <moveit/collision_detection/collision_robot.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/planning_scene/planning_scene.h>
+
+using planning_scene::PlanningScene;
+using robot_state::RobotState;
+
+namespace predicator_planning {
+
+  /**
+   * CollisionEngine
+   * Caches the collision results between pairs of planning scenes.
+   * - a state is only updated and boxed again when its variable values changed since the last call
+   * - a sweep and prune over the padded AABBs finds the pairs that are within near_threshold,
+   *   all other pairs skip both narrowphase queries and report the gap between their boxes,
+   *   a lower bound of the mesh distance that is used as is for their distance heuristics
+   * - pairs with a robot without collision geometry have no result (has_geometry is false)
+   * - near pairs whose boxes do not overlap cannot touch, so they skip the contact query
+   * - the result of a pair is reused while neither of its states changed
+   */
+  struct CollisionEngine {
+
+    /**
+     * PairResult
+     * Collision information for one pair of scenes
+     */
+    struct PairResult {
+      double dist; // mesh distance, or the box gap (a lower bound) if checked is false
+      std::vector<std::pair<std::string, std::string> > contacts; // pairs of touching links
+      bool checked; // true if the distance comes from a narrowphase query
+      bool has_geometry; // false if one of the robots has no collision geometry, dist is meaningless then
+      unsigned long version1; // versions of the two states this was computed for
+      unsigned long version2;
+      bool valid;
+
+      PairResult();
+    };
+
+    /**
+     * SceneCache
+     * Last seen variable values and the padded AABB of one state
+     */
+    struct SceneCache {
+      std::vector<double> positions;
+      double box[6]; // (minx, maxx, miny, maxy, minz, maxz)
+      bool has_box; // false if the robot has no collision geometry
+      unsigned long version; // incremented every time the state changes
+
+      SceneCache();
+    };
+
+    double near_threshold; // pairs further apart than this skip the distance query
+    double padding; // link padding, added to every box
+    int verbosity;
+
+    std::vector<SceneCache> cache;
+    std::map<std::pair<unsigned int, unsigned int>, PairResult> pairs;
+
+    // counters of the last call to update(), for debugging
+    unsigned int num_contact_queries;
+    unsigned int num_distance_queries;
+    unsigned int num_cached;
+    unsigned int num_far;
+
+    CollisionEngine(double near_threshold = 0.1, double padding = 0.0, int verbosity = 0);
+
+    /**
+     * update()
+     * Refresh the changed states and their boxes, then recompute the pairs of states that changed.
+     * If idx is a valid scene index only the pairs including idx are computed.
+     * Afterwards getPair() returns the result for every computed pair.
+     */
+    void update(const std::vector<PlanningScene *> &scenes, const std::vector<RobotState *> &states, unsigned int idx = ~0);
+
+    /**
+     * getPair()
+     * Result for scenes i and j (in either order), as computed by the last update()
+     */
+    const PairResult &getPair(unsigned int i, unsigned int j) const;
+
+    /**
+     * boxGap()
+     * Euclidean distance between the padded boxes of two scenes, 0 if they overlap
+     */
+    double boxGap(unsigned int i, unsigned int j) const;
+
+  private:
+
+    /**
+     * updateState()
+     * Returns true if the state changed since the last call
+     */
+    bool updateState(unsigned int i, RobotState *state);
+
+    /**
+     * broadphase()
+     * Sweep and prune along x, marks the pairs within near_threshold
+     */
+    void broadphase(std::vector<bool> &near) const;
+
+    void computePair(const std::vector<PlanningScene *> &scenes, const std::vector<RobotState *> &states,
+                     unsigned int i, unsigned int j, bool near);
+  };
+}
+
+#endif
@@ -0,0 +1,180 @@
+#include "predicator.h"
+#include "geometry_engine.h"
+
+#include <cmath>
+
+namespace predicator_planning {
+
+  static const char *RELATION_NAMES[GeometryEngine::NUM_RELATIONS] = {
+    "left_of", "right_of", "in_front_of", "behind", "above", "below", "near", "near_xy"
+  };
+
+  // the directional relations are seen from the world frame
+  static inline bool hasWorldFrame(unsigned int rel) {
+    return rel < GeometryEngine::NEAR;
+  }
+
+  GeometryEngine::GeometryEngine() :
+    rel_x_threshold(0.1), rel_y_threshold(0.1), rel_z_threshold(0.1),
+    near_2d_threshold(0.2), near_3d_threshold(0.2), verbosity(0),
+    num_true(0), num_changed(0) {}
+
+  /**
+   * init()
+   * Collect the links of the robots and look up their heuristic slots
+   */
+  void GeometryEngine::init(const std::vector<RobotState *> &states, SymbolTable &symbols, const heuristic_map_t &heuristic_indices) {
+    links.clear();
+    link_robot.clear();
+
+    for (unsigned int i = 0; i < states.size(); ++i) {
+      const std::vector<const moveit::core::LinkModel *> &models = states[i]->getRobotModel()->getLinkModels();
+      for (std::vector<const moveit::core::LinkModel *>::const_iterator it = models.begin();
+           it != models.end();
+           ++it)
+      {
+        if ((*it)->getName().compare(std::string("world")) == 0) {
+          continue;
+        }
+        links.push_back(*it);
+        link_robot.push_back(i);
+      }
+    }
+
+    const unsigned int n = links.size();
+    xs.assign(n, 0);
+    ys.assign(n, 0);
+    zs.assign(n, 0);
+    indices.assign(n * n * NUM_RELATIONS, -1);
+    values.assign(n * n * NUM_RELATIONS, 0);
+    truth.assign(n * n * NUM_RELATIONS, 0);
+    last_truth.assign(n * n * NUM_RELATIONS, 0);
+    statements.assign(n * n * NUM_RELATIONS, PredicateStatement());
+    keys.assign(n * n * NUM_RELATIONS, PredicateKey());
+
+    // string lookups happen here once instead of on every tick
+    unsigned int missing = 0;
+    for (unsigned int a = 0; a < n; ++a) {
+      for (unsigned int b = 0; b < n; ++b) {
+        if (link_robot[a] == link_robot[b]) {
+          continue;
+        }
+        for (unsigned int rel = 0; rel < NUM_RELATIONS; ++rel) {
+          const unsigned int k = (a * n + b) * NUM_RELATIONS + rel;
+          statements[k] = createStatement(RELATION_NAMES[rel], 0,
+                                          links[a]->getName(),
+                                          links[b]->getName(),
+                                          hasWorldFrame(rel) ? "world" : "");
+          keys[k] = symbols.intern(statements[k]);
+          heuristic_map_t::const_iterator it = heuristic_indices.find(keys[k]);
+          if (it == heuristic_indices.end()) {
+            ++missing;
+          } else {
+            indices[k] = it->second;
+          }
+        }
+      }
+    }
+
+    if (missing > 0) {
+      ROS_ERROR("(INIT) %u geometry predicates have no heuristic index", missing);
+    }
+  }
+
+  /**
+   * evaluate()
+   * Compute all relations for these states and store their heuristic values.
+   */
+  void GeometryEngine::evaluate(const std::vector<RobotState *> &states, std::vector<double> &heuristics, bool track_changes) {
+    const unsigned int n = links.size();
+
+    // snapshot: one transform lookup per link
+    for (unsigned int a = 0; a < n; ++a) {
+      const Eigen::Affine3d &tf = states[link_robot[a]]->getGlobalLinkTransform(links[a]);
+      xs[a] = tf.translation()[0];
+      ys[a] = tf.translation()[1];
+      zs[a] = tf.translation()[2];
+    }
+
+    num_true = 0;
+    for (unsigned int a = 0; a < n; ++a) {
+      for (unsigned int b = 0; b < n; ++b) {
+        const unsigned int k = (a * n + b) * NUM_RELATIONS;
+        if (link_robot[a] == link_robot[b]) {
+          continue;
+        }
+
+        double xdiff = ys[a] - ys[b]; // x = red = front/back from stage
+        double ydiff = xs[a] - xs[b]; // y = green = left/right?
+        double zdiff = zs[a] - zs[b]; // z = blue = up/down
+        double dist_xy = sqrt((xdiff*xdiff) + (ydiff*ydiff)); // compute xy distance only
+        double dist = sqrt((xdiff*xdiff) + (ydiff*ydiff) + (zdiff*zdiff)); // compute xyz distance
+
+        double *v = &values[k];
+        v[LEFT_OF] = xdiff - rel_x_threshold;
+        v[RIGHT_OF] = -1.0 * xdiff - rel_x_threshold;
+        v[IN_FRONT_OF] = ydiff - rel_y_threshold;
+        v[BEHIND] = -1.0 * ydiff - rel_y_threshold;
+        v[ABOVE] = zdiff - rel_z_threshold;
+        v[BELOW] = -1.0 * zdiff - rel_z_threshold;
+        v[NEAR] = -1.0 * dist + near_3d_threshold;
+        v[NEAR_XY] = -1.0 * dist_xy + near_2d_threshold;
+
+        // every relation holds when its value is positive
+        for (unsigned int rel = 0; rel < NUM_RELATIONS; ++rel) {
+          truth[k + rel] = v[rel] > 0;
+          num_true += truth[k + rel];
+        }
+      }
+    }
+
+    for (unsigned int k = 0; k < indices.size(); ++k) {
+      if (indices[k] >= 0 && (unsigned int)indices[k] < heuristics.size()) {
+        heuristics[indices[k]] = values[k];
+      }
+    }
+
+    if (track_changes) {
+      num_changed = 0;
+      for (unsigned int k = 0; k < truth.size(); ++k) {
+        num_changed += truth[k] != last_truth[k];
+      }
+      last_truth = truth;
+
+      if (verbosity > 1) {
+        std::cout << "geometry predicates: " << num_true << " true, " << num_changed << " changed" << std::endl;
+      }
+    }
+  }
+
+  /**
+   * appendStatements()
+   * Append the relations that hold after the last evaluate() to list if given
+   * and insert their keys into true_keys if given
+   */
+  void GeometryEngine::appendStatements(PredicateList *list, key_set_t *true_keys) {
+    const unsigned int n = links.size();
+    if (list) {
+      list->statements.reserve(list->statements.size() + num_true);
+    }
+
+    for (unsigned int a = 0; a < n; ++a) {
+      for (unsigned int b = 0; b < n; ++b) {
+        const unsigned int k = (a * n + b) * NUM_RELATIONS;
+        for (unsigned int rel = 0; rel < NUM_RELATIONS; ++rel) {
+          if (!truth[k + rel]) {
+            continue;
+          }
+          if (list) {
+            PredicateStatement &ps = statements[k + rel];
+            ps.value = values[k + rel];
+            list->statements.push_back(ps);
+          }
+          if (true_keys) {
+            true_keys->insert(keys[k + rel]);
+          }
+        }
+      }
+    }
+  }
+}
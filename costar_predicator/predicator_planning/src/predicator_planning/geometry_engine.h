@@ -0,0 +1,90 @@
+#ifndef _PP_GEOMETRY_ENGINE
+#define _PP_GEOMETRY_ENGINE
+
+// stl
+#include <vector>
+#include <string>
+
+// MoveIt!
+#include <moveit/robot_state/robot_state.h>
+
+#include "utility.hpp"
+
+using robot_state::RobotState;
+
+namespace predicator_planning {
+
+  /**
+   * GeometryEngine
+   * Evaluates the geometry predicates between the links of different robots.
+   * - every link position is read once per call into flat x/y/z arrays
+   * - all relations of all link pairs are computed in one batch over these arrays,
+   *   the heuristic slot of every relation is looked up once in init() instead of hashing
+   *   a PredicateStatement per relation
+   * - the statements are built once in init(), afterwards only their values are refreshed
+   * - with track_changes the relations that flipped since the previous call are counted
+   */
+  struct GeometryEngine {
+
+    enum Relation {
+      LEFT_OF = 0,
+      RIGHT_OF,
+      IN_FRONT_OF,
+      BEHIND,
+      ABOVE,
+      BELOW,
+      NEAR,
+      NEAR_XY,
+      NUM_RELATIONS
+    };
+
+    double rel_x_threshold;
+    double rel_y_threshold;
+    double rel_z_threshold;
+    double near_2d_threshold;
+    double near_3d_threshold;
+    int verbosity;
+
+    std::vector<const moveit::core::LinkModel *> links; // non-world links of all robots
+    std::vector<unsigned int> link_robot; // robot of each link
+    std::vector<double> xs; // link positions of the last call
+    std::vector<double> ys;
+    std::vector<double> zs;
+
+    // per (link1, link2, relation), in that order
+    std::vector<int> indices; // heuristic slot, -1 if none
+    std::vector<double> values; // heuristic value of the last call
+    std::vector<unsigned char> truth; // relation holds in the last call
+    std::vector<unsigned char> last_truth; // relation held in the last call with track_changes
+    std::vector<PredicateStatement> statements;
+    std::vector<PredicateKey> keys;
+
+    unsigned int num_true;
+    unsigned int num_changed;
+
+    GeometryEngine();
+
+    /**
+     * init()
+     * Collect the links of the robots and look up their heuristic slots
+     */
+    void init(const std::vector<RobotState *> &states, SymbolTable &symbols, const heuristic_map_t &heuristic_indices);
+
+    /**
+     * evaluate()
+     * Compute all relations for these states and store their heuristic values.
+     * The states must use the robot models given to init(), in the same order.
+     */
+    void evaluate(const std::vector<RobotState *> &states, std::vector<double> &heuristics, bool track_changes = false);
+
+    /**
+     * appendStatements()
+     * Append the relations that hold after the last evaluate() to list if given
+     * and insert their keys into true_keys if given
+     */
+    void appendStatements(PredicateList *list, key_set_t *true_keys = NULL);
+
+  };
+}
+
+#endif
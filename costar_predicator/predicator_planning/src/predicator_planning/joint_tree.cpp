@@ -0,0 +1,96 @@
+#include "joint_tree.h"
+
+#include <limits>
+
+namespace predicator_planning {
+
+  JointTree::JointTree(unsigned int _dim) : dim(_dim) {}
+
+  void JointTree::clear(unsigned int _dim) {
+    dim = _dim;
+    points.clear();
+    nodes.clear();
+  }
+
+  unsigned int JointTree::size() const {
+    return nodes.size();
+  }
+
+  /**
+   * insert()
+   * Walk down to a leaf and split on the next axis
+   */
+  void JointTree::insert(const std::vector<double> &point, unsigned int id) {
+    Node node;
+    node.id = id;
+    node.axis = 0;
+    node.left = -1;
+    node.right = -1;
+
+    const int idx = nodes.size();
+    points.insert(points.end(), point.begin(), point.begin() + dim);
+
+    if (nodes.empty()) {
+      nodes.push_back(node);
+      return;
+    }
+
+    int cur = 0;
+    while (true) {
+      const Node &n = nodes[cur];
+      int &child = (point[n.axis] < points[cur * dim + n.axis]) ? nodes[cur].left : nodes[cur].right;
+      if (child < 0) {
+        node.axis = dim > 0 ? (n.axis + 1) % dim : 0;
+        child = idx;
+        break;
+      }
+      cur = child;
+    }
+    nodes.push_back(node);
+  }
+
+  void JointTree::search(int cur, const double *point, int &best, double &best_dist) const {
+    while (cur >= 0) {
+      const Node &n = nodes[cur];
+      const double *p = &points[cur * dim];
+
+      double dist = 0;
+      for (unsigned int k = 0; k < dim && dist < best_dist; ++k) {
+        double d = point[k] - p[k];
+        dist += d * d;
+      }
+      if (dist < best_dist) {
+        best_dist = dist;
+        best = cur;
+      }
+
+      // descend into the near side first, visit the far side only if the splitting plane is closer than the best
+      double diff = point[n.axis] - p[n.axis];
+      int near = diff < 0 ? n.left : n.right;
+      int far = diff < 0 ? n.right : n.left;
+      if (far >= 0 && diff * diff < best_dist) {
+        search(near, point, best, best_dist);
+        if (diff * diff < best_dist) {
+          search(far, point, best, best_dist);
+        }
+        return;
+      }
+      cur = near;
+    }
+  }
+
+  int JointTree::nearest(const std::vector<double> &point, double *dist_sq) const {
+    if (nodes.empty() || point.size() < dim) {
+      return -1;
+    }
+
+    int best = -1;
+    double best_dist = std::numeric_limits<double>::max();
+    search(0, &point[0], best, best_dist);
+
+    if (dist_sq) {
+      *dist_sq = best_dist;
+    }
+    return nodes[best].id;
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef _PP_JOINT_TREE
+#define _PP_JOINT_TREE
+
+// stl
+#include <vector>
+
+namespace predicator_planning {
+
+  /**
+   * JointTree
+   * Incremental k-d tree over joint vectors, used by the planner to find the nearest search node.
+   * Points are only ever added. The tree is not rebalanced, the planner inserts random samples
+   * so the expected depth stays logarithmic.
+   */
+  struct JointTree {
+
+    struct Node {
+      unsigned int id; // id given to insert()
+      unsigned int axis; // split dimension
+      int left; // children, -1 if none
+      int right;
+    };
+
+    unsigned int dim;
+    std::vector<double> points; // dim values per node
+    std::vector<Node> nodes;
+
+    JointTree(unsigned int dim = 0);
+
+    /**
+     * clear()
+     * Remove all points and use vectors of size dim from now on
+     */
+    void clear(unsigned int dim);
+
+    /**
+     * insert()
+     * Add a joint vector with the given id
+     */
+    void insert(const std::vector<double> &point, unsigned int id);
+
+    /**
+     * nearest()
+     * Id of the point closest to point (euclidean), -1 if the tree is empty
+     */
+    int nearest(const std::vector<double> &point, double *dist_sq = 0) const;
+
+    unsigned int size() const;
+
+  private:
+
+    void search(int node, const double *point, int &best, double &best_dist) const;
+  };
+}
+
+#endif
@@ -4,87 +4,192 @@
 #include <trajectory_msgs/JointTrajectory.h>
 #include <trajectory_msgs/JointTrajectoryPoint.h>
 
-// joint model group -- which joints are we solving for?
-#include <moveit/robot_model/joint_model_group.h>
-
 // standard libraries for random
 #include <cstdlib>
-#include <unordered_set>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace predicator_planning {
 
-  Planner::Planner(PredicateContext *_context, unsigned int _max_iter, double _step, double _chance, double _skip, double _search_volume) :
-    context(_context), max_iter(_max_iter), step(_step), chance(_chance), skip_distance(_skip), search_volume(_search_volume)
+  Planner::Planner(PredicateContext *_context, unsigned int _max_iter, double _step, double _chance, double _skip, double _search_volume,
+                   double _max_time, unsigned int _batch_size, int _num_threads, int _seed) :
+    context(_context), max_iter(_max_iter), step(_step), chance(_chance), skip_distance(_skip), search_volume(_search_volume),
+    max_time(_max_time), batch_size(_batch_size > 0 ? _batch_size : 1), num_threads(_num_threads), seed(_seed)
   {
     ros::NodeHandle nh;
     planServer = nh.advertiseService("predicator/plan", &Planner::plan, this);
     nh.param("verbosity", verbosity, 0);
+
+#ifdef _OPENMP
+    if (num_threads <= 0) {
+      num_threads = omp_get_max_threads();
+    }
+#else
+    num_threads = 1;
+#endif
+    if (batch_size == 1) {
+      num_threads = 1;
+    }
+
+    for (int i = 0; i < num_threads; ++i) {
+      workers.push_back(new Worker(context));
+    }
+  }
+
+  Planner::~Planner() {
+    for (unsigned int i = 0; i < workers.size(); ++i) {
+      delete workers[i];
+    }
+  }
+
+  Planner::Worker::Worker(const PredicateContext *context) :
+    collisions(context->collisions), geometry(context->geometry)
+  {
+    for (unsigned int i = 0; i < context->states.size(); ++i) {
+      states.push_back(new RobotState(*context->states[i]));
+    }
+  }
+
+  Planner::Worker::~Worker() {
+    for (unsigned int i = 0; i < states.size(); ++i) {
+      delete states[i];
+    }
+  }
+
+  void Planner::Worker::sync(const PredicateContext *context) {
+    for (unsigned int i = 0; i < states.size(); ++i) {
+      states[i]->setVariablePositions(context->states[i]->getVariablePositions());
+    }
   }
 
   // default constructor
-  Planner::SearchPose::SearchPose() : state(NULL), count_best(0), parent(NULL), child(NULL), cost(0), count_met(0), hsum(0.) {}
+  Planner::SearchPose::SearchPose() : state(NULL), count_best(0), parent(NULL), child(NULL), id(0), cost(0), count_met(0), hsum(0.) {}
 
   // initialize parents, variables
-  Planner::SearchPose::SearchPose(std::deque<SearchPose *> &search, RobotState *_state) :
-    count_best(0), parent(NULL), child(NULL), state(_state), cost(0), count_met(0), hsum(0.)
-  {
-    double shortest_dist = 999999.;
-    for(unsigned int i = 0; i < search.size(); ++i) {
-      // compare distance
-      double dist = search[i]->state->distance(*state);
-      if (parent == NULL || dist < shortest_dist) {
-        parent = search[i];
-        cost = parent->cost + dist;
+  Planner::SearchPose::SearchPose(RobotState *_state, SearchPose *_parent, double _cost) :
+    count_best(0), parent(_parent), child(NULL), id(0), state(_state), cost(_cost), count_met(0), hsum(0.) {}
+
+  Planner::Score::Score(const SearchPose &pose) : count_met(pose.count_met), hsum(pose.hsum), id(pose.id) {}
+
+  bool Planner::Score::operator<(const Score &other) const {
+    if (count_met != other.count_met) {
+      return count_met < other.count_met;
+    } else if (hsum != other.hsum) {
+      return hsum < other.hsum;
+    }
+    return id > other.id;
+  }
+
+  Planner::SearchTree::SearchTree(const moveit::core::JointModelGroup *_group) :
+    group(_group), index(_group->getVariableCount()), num_rejected(0) {}
+
+  Planner::SearchTree::~SearchTree() {
+    for (unsigned int i = 0; i < poses.size(); ++i) {
+      delete poses[i].state;
+    }
+    for (unsigned int i = 0; i < spares.size(); ++i) {
+      delete spares[i];
+    }
+  }
+
+  RobotState *Planner::SearchTree::newState(const RobotModelPtr &model) {
+    if (!spares.empty()) {
+      RobotState *rs = spares.back();
+      spares.pop_back();
+      return rs;
+    }
+    return new RobotState(model);
+  }
+
+  Planner::SearchPose *Planner::SearchTree::add(const SearchPose &pose) {
+    poses.push_back(pose);
+    SearchPose *sp = &poses.back();
+    sp->id = poses.size() - 1;
+
+    sp->state->copyJointGroupPositions(group, joints);
+    index.insert(joints, sp->id);
+    queue.push(Score(*sp));
+
+    return sp;
+  }
+
+  void Planner::SearchTree::reject(RobotState *state) {
+    ++num_rejected;
+    spares.push_back(state);
+  }
+
+  Planner::SearchPose *Planner::SearchTree::nearest(const RobotState &state) {
+    state.copyJointGroupPositions(group, joints);
+    int id = index.nearest(joints);
+    return id < 0 ? NULL : &poses[id];
+  }
+
+  Planner::SearchPose *Planner::SearchTree::best() {
+    return queue.empty() ? NULL : &poses[queue.top().id];
+  }
+
+  // look up the keys of a list of statements
+  static void lookupKeys(const std::vector<PredicateStatement> &statements, const PredicateContext *context, std::vector<PredicateKey> &keys) {
+    keys.clear();
+    for (const PredicateStatement &ps: statements) {
+      PredicateKey key = context->getKey(ps);
+      if (!key.valid()) {
+        ROS_WARN("predicate %s(%s,%s,%s) uses unknown names and never holds",ps.predicate.c_str(),
+                 ps.params[0].c_str(),
+                 ps.params[1].c_str(),
+                 ps.params[2].c_str());
       }
+      keys.push_back(key);
     }
   }
 
+  Planner::GoalKeys::GoalKeys(const PredicatePlan::Request &req, const PredicateContext *context) {
+    lookupKeys(req.required_true, context, required_true);
+    lookupKeys(req.required_false, context, required_false);
+    lookupKeys(req.goal_true, context, goal_true);
+    lookupKeys(req.goal_false, context, goal_false);
+  }
+
   // update with information from the context
-  bool Planner::SearchPose::checkPredicates(PredicatePlan::Request &req, PredicateContext *context, unsigned int idx, bool &goals) {
+  bool Planner::SearchPose::checkPredicates(PredicatePlan::Request &req, const GoalKeys &keys, PredicateContext *context, Worker &worker, unsigned int idx, bool &goals) {
 
     // get starting states
-    // these are the states as recorded in the context
-    // they will be updated as we go on if this takes a while -- might be bad
-    std::vector<RobotState *> states = context->states;
+    // these are the worker copies of the states recorded in the context
+    // plan() refreshes them before every batch
+    std::vector<RobotState *> states = worker.states;
     states[idx] = state; // set to this state
 
     std::vector<double> all_heuristics(context->numHeuristics());
-    PredicateList list;
-
-    context->updateRobotStates();
 
     //if (!state->satisfiesBounds()) {
     //  return false;
     //}
 
-    context->addCollisionPredicates(list, all_heuristics, states);
-    context->addGeometryPredicates(list, all_heuristics, states);
-    context->addReachabilityPredicates(list, all_heuristics, states);
-
+    // keys of every statement that holds, so the checks below compare integers instead of strings
+    // no statement strings are built here, the NULL lists only collect the keys
+    key_set_t lookup;
 
-    std::unordered_set<PredicateStatement, Hash, Equals> lookup;
-
-    for (PredicateStatement &ps: list.statements) {
-      //ROS_INFO("%s(%s,%s,%s)",ps.predicate.c_str(),
-      //         ps.params[0].c_str(),
-      //         ps.params[1].c_str(),
-      //         ps.params[2].c_str());
-      lookup.insert(ps);
-    }
+    context->addCollisionPredicates(worker.collisions, NULL, all_heuristics, states, ~0, &lookup);
+    context->addGeometryPredicates(worker.geometry, NULL, all_heuristics, states, false, &lookup);
+    context->addReachabilityPredicates(NULL, all_heuristics, states, &lookup);
 
     // check requirements
-    for (PredicateStatement &ps: req.required_true) {
-      if (lookup.find(ps) == lookup.end()) {
+    for (unsigned int i = 0; i < keys.required_true.size(); ++i) {
+      if (lookup.find(keys.required_true[i]) == lookup.end()) {
         return false;
       } else {
+        const PredicateStatement &ps = req.required_true[i];
         ROS_INFO("found goal state for predicate %s(%s,%s,%s)",ps.predicate.c_str(),
                ps.params[0].c_str(),
                ps.params[1].c_str(),
                ps.params[2].c_str());
       }
     }
-    for (PredicateStatement &ps: req.required_false) {
-      if (lookup.find(ps) != lookup.end()) {
+    for (const PredicateKey &key: keys.required_false) {
+      if (lookup.find(key) != lookup.end()) {
         return false;
       }
     }
@@ -92,13 +197,13 @@ namespace predicator_planning {
     goals = true;
 
     // compute predicate stuff right here
-    for (PredicateStatement &ps: req.goal_true) {
+    for (const PredicateKey &key: keys.goal_true) {
       // look at the predicates
       // get a heuristic value from context
 
-      double val = context->getHeuristic(ps, all_heuristics);
+      double val = context->getHeuristic(key, all_heuristics);
 
-      if(lookup.find(ps) == lookup.end()) {
+      if(lookup.find(key) == lookup.end()) {
         goals = false;
       } else if (val < 0) {
         val = 0;
@@ -107,12 +212,12 @@ namespace predicator_planning {
       // update this pose based on that
       heuristics.push_back(val);
     }
-    for (PredicateStatement &ps: req.goal_false) {
+    for (const PredicateKey &key: keys.goal_false) {
       // look at the predicates
       // get a heuristic value from context
-      double val = -1 * context->getHeuristic(ps, all_heuristics);
+      double val = -1 * context->getHeuristic(key, all_heuristics);
 
-      if(lookup.find(ps) != lookup.end()) {
+      if(lookup.find(key) != lookup.end()) {
         goals = false;
       } else if (val < 0) {
         val = 0;
@@ -122,20 +227,25 @@ namespace predicator_planning {
       heuristics.push_back(val);
     }
 
-    std::cout << "values = [";
     for (double &d: heuristics) {
-      std::cout << d << ", ";
       if (d >= 0) {
         ++count_met;
       } else {
         hsum += d;
       }
     }
-    std::cout << "]";
-    if (goals == true) {
-      std::cout << " (MEETS GOALS)";
+
+    if (context->verbosity > 1) {
+      std::cout << "values = [";
+      for (double &d: heuristics) {
+        std::cout << d << ", ";
+      }
+      std::cout << "]";
+      if (goals == true) {
+        std::cout << " (MEETS GOALS)";
+      }
+      std::cout << std::endl;
     }
-    std::cout << std::endl;
 
     return true;
   }
@@ -145,9 +255,8 @@ namespace predicator_planning {
   {
 
     ROS_INFO("Received planning request.");
-
-    // this is the list of states we are searching in
-    std::deque<SearchPose *> search;
+    ros::WallTime start = ros::WallTime::now();
+    ros::WallDuration check_time(0);
 
     // find the index of the current robot state
     unsigned int idx = 0;
@@ -174,155 +283,152 @@ namespace predicator_planning {
     }
     ROS_INFO("Found group \"%s\" for robot \"%s\".", req.group.c_str(), req.robot.c_str());
 
-    SearchPose *first = new SearchPose();
+    // intern the request once instead of hashing its strings for every sample
+    GoalKeys keys(req, context);
+
+    // this is the set of states we are searching in
+    SearchTree search(group);
+
+    // all samples are drawn on this thread from one generator,
+    // so for a given seed the tree does not depend on the number of threads
+    random_numbers::RandomNumberGenerator *rng = seed >= 0 ?
+      new random_numbers::RandomNumberGenerator((boost::uint32_t)seed) :
+      new random_numbers::RandomNumberGenerator();
+    std::vector<double> values;
+    std::vector<double> near;
+
+    context->updateRobotStates();
+    for (unsigned int w = 0; w < workers.size(); ++w) {
+      workers[w]->sync(context);
+    }
+
+    SearchPose first(new RobotState(*context->states[idx]), NULL, 0);
     bool goals_found = false;
-    first->state = new RobotState(*context->states[idx]);
-    first->checkPredicates(req, context, idx, goals_found);
-    search.push_back(first);
+    first.checkPredicates(req, keys, context, *workers[0], idx, goals_found);
+    SearchPose *last = search.add(first);
 
     ROS_INFO("Added first state.");
 
+    std::vector<SearchPose> batch;
+    std::vector<unsigned char> valid;
+    std::vector<unsigned char> goals;
+
     // loop over 
-    for (unsigned int iter = 0; iter < max_iter && !res.found; ++iter) {
+    for (unsigned int iter = 0; iter < max_iter && !res.found; iter += batch.size()) {
       // either generate a starting position at random or...
       // step in a direction from a "good" position (as determined by high heuristics)
 
-      double choose_op = (double)rand() / (double)RAND_MAX;
-      std::cout << "Iteration " << iter << "(" << (choose_op > chance) << ") :";
-      if(choose_op > chance) {
-        // spawn children from the thing with the highest heuristic
-        // first, iterate over all poses
-        // track the best number of goals met and best values for unmet goals
-        SearchPose *best = NULL;
-        unsigned int best_met = 0;
-        double best_hsum = 99999.9;
-        for (std::deque<SearchPose *>::iterator it = search.begin();
-             it != search.end();
-             ++it) {
-          if (((*it)->count_met > best_met) ||
-               (((*it)->count_met == best_met) && (*it)->hsum > best_hsum) ||
-              best == NULL)
-          {
-            best = *it;
-            best_hsum = best->hsum;
-            best_met = best->count_met;
-            //ROS_INFO("expanding from sum=%f, count=%u", best_hsum, best_met);
-          }
+      if (max_time > 0 && (ros::WallTime::now() - start).toSec() > max_time) {
+        ROS_WARN("Planning time limit of %f seconds reached after %u iterations.", max_time, iter);
+        break;
+      }
+
+      // the other objects may have moved
+      context->updateRobotStates();
+      for (unsigned int w = 0; w < workers.size(); ++w) {
+        workers[w]->sync(context);
+      }
+
+      // draw the samples of this batch, all of them expand the tree as it was before the batch
+      unsigned int count = std::min(batch_size, max_iter - iter);
+      batch.clear();
+      for (unsigned int k = 0; k < count; ++k) {
+        double choose_op = rng->uniform01();
+        if (verbosity > 1) {
+          std::cout << "Iteration " << (iter + k) << "(" << (choose_op > chance) << ")" << std::endl;
         }
 
-        // find the BEST state and step from there
-        // best being defined as "the most matching predicates and highest heuristics"
-        RobotState *rs = new RobotState(context->robots[idx]);
-        rs->setToRandomPositionsNearBy(group, *best->state, search_volume);
-        SearchPose *new_sp = new SearchPose(search, rs);
-        new_sp->parent->state->interpolate(*rs, step, *rs, group);
-
-        // check and add or delete
-        if (new_sp->checkPredicates(req, context, idx, goals_found)) {
-          search.push_back(new_sp);
-          res.found = goals_found;
+        if(choose_op > chance) {
+          // find the BEST state and step from there
+          // best being defined as "the most matching predicates and highest heuristics"
+          search.best()->state->copyJointGroupPositions(group, near);
+          group->getVariableRandomPositionsNearBy(*rng, values, near, search_volume);
         } else {
-          ROS_INFO("Deleting illegal state.");
-          delete new_sp->state;
-          delete new_sp;
+          // case 2: choose a random position
+          group->getVariableRandomPositions(*rng, values);
         }
 
+        RobotState *rs = search.newState(context->robots[idx]);
+        rs->setJointGroupPositions(group, values);
 
-      } else {
-        // case 2: choose a random position
-        RobotState *rs = new RobotState(context->robots[idx]);
-        rs->setToRandomPositions(group);
-
-        // find the nearest state to this step
+        // find the nearest state to this sample
         // then step in the direction of this state rs
-        // NOTE: should be interpolating from some other state, not the initial one here
-        SearchPose *new_sp = new SearchPose(search, rs);
+        SearchPose *parent = search.nearest(*rs);
+        parent->state->interpolate(*rs, step, *rs, group);
 
-        new_sp->parent->state->interpolate(*rs, step, *rs, group);
-
-        goals_found = false;
+        batch.push_back(SearchPose(rs, parent, parent->cost + parent->state->distance(*rs, group)));
+      }
 
-        if (new_sp->checkPredicates(req, context, idx, goals_found)) {
-          search.push_back(new_sp);
-          res.found = goals_found;
+      // check the samples in parallel, every thread with its own worker
+      valid.assign(count, 0);
+      goals.assign(count, 0);
+      ros::WallTime check_start = ros::WallTime::now();
+#ifdef _OPENMP
+      #pragma omp parallel for schedule(dynamic, 1) num_threads(workers.size())
+#endif
+      for (int k = 0; k < (int)count; ++k) {
+#ifdef _OPENMP
+        Worker &worker = *workers[omp_get_thread_num()];
+#else
+        Worker &worker = *workers[0];
+#endif
+        bool sample_goals = false;
+        valid[k] = batch[k].checkPredicates(req, keys, context, worker, idx, sample_goals);
+        goals[k] = sample_goals;
+      }
+      check_time += ros::WallTime::now() - check_start;
+
+      // add or delete in sample order, stop at the first sample that meets the goals
+      for (unsigned int k = 0; k < count; ++k) {
+        if (res.found) {
+          // drawn after the goal, not checked against the final tree
+          search.spares.push_back(batch[k].state);
+        } else if (valid[k]) {
+          last = search.add(batch[k]);
+          res.found = goals[k];
+          res.iter = iter + k;
         } else {
-          ROS_INFO("Deleting illegal state.");
-          delete new_sp->state;
-          delete new_sp;
+          if (verbosity > 0) {
+            ROS_INFO("Deleting illegal state.");
+          }
+          search.reject(batch[k].state);
+          res.iter = iter + k;
         }
       }
-
-      res.iter = iter;
-
-      if (res.found == true) {
-        break;
-      }
     }
 
-    SearchPose *cur = *search.rbegin();
+    delete rng;
+
+    SearchPose *cur = last;
     if(res.found != true) {
       ROS_INFO("selecting final node based on goal performance");
-      SearchPose *best = NULL;
-      unsigned int best_met = 0;
-      double best_hsum = 99999.9;
-      for (std::deque<SearchPose *>::iterator it = search.begin();
-           it != search.end();
-           ++it) {
-        if (((*it)->count_met > best_met) ||
-            (((*it)->count_met == best_met) && (*it)->hsum > best_hsum) ||
-            best == NULL)
-        {
-          best = *it;
-          best_hsum = best->hsum;
-          best_met = best->count_met;
-        }
-      }
-
       // take the best pose
-      cur = best;
+      cur = search.best();
     }
 
     ROS_INFO("selected final node");
 
-    // get a path from the last thing we added
+    // get a path from the selected node
     // by going backwards to the start
-    std::deque<RobotState *> path;
-    //path.push_front(cur->state);
-    //cur = cur->parent;
-    int i = 0; 
-    while (cur != NULL) {
-      ++i;
-      // instead of finding parents we may want to find the closest node
-      // or the node with the least distance (COST) within some threshold
-      path.push_front(cur->state);
-
-      int j = i;
-      SearchPose *parent = cur;
-      SearchPose *next = parent;
-      while (parent->parent != NULL) {
-        ++j;
-        parent = parent->parent;
-
-        double dist = cur->state->distance(*parent->state, group);
-
-        std::cout << "(" << i << ", " << j << ") ";
-        std::cout << cur->hsum;
-
-        //if(cur->parent != NULL) {
-        std::cout << ", dist = ";
-        std::cout << dist;
-        //}
-        std::cout << std::endl; 
-
-        if (dist < skip_distance) {
-          cur->parent = parent->parent;
-        }
+    std::vector<RobotState *> chain;
+    for (SearchPose *sp = cur; sp != NULL; sp = sp->parent) {
+      chain.push_back(sp->state);
+    }
+    std::reverse(chain.begin(), chain.end());
+
+    // shortcut in one pass: a node is skipped if the node after it is still
+    // within skip_distance of the last node we kept
+    std::vector<RobotState *> path;
+    path.push_back(chain[0]);
+    for (unsigned int i = 1; i < chain.size(); ++i) {
+      if (i + 1 < chain.size() && path.back()->distance(*chain[i + 1], group) < skip_distance) {
+        continue;
       }
-      cur = cur->parent;
+      path.push_back(chain[i]);
     }
 
     // now go forward over the list
-    for(std::deque<RobotState *>::const_iterator it = path.begin();
+    for(std::vector<RobotState *>::const_iterator it = path.begin();
         it != path.end();
         ++it)
     {
@@ -333,14 +439,15 @@ namespace predicator_planning {
     }
     res.path.joint_names = path[0]->getVariableNames();
 
+    res.planning_time = (ros::WallTime::now() - start).toSec();
+    res.nodes = search.poses.size();
 
-    // clean up
-    for (unsigned int i = 0; i < search.size(); ++i) {
-      delete search[i]->state;
-      delete search[i];
-    }
+    ROS_INFO("Planning took %f seconds (%f checking predicates), %u nodes, %u rejected, path of %lu from %lu nodes.",
+             res.planning_time, check_time.toSec(),
+             (unsigned int)search.poses.size(), search.num_rejected,
+             path.size(), chain.size());
 
-    std::cout << "returning" << std::endl;
+    // the states are freed with the search tree
     return true;
   }
 }
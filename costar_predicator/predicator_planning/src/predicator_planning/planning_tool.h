@@ -8,15 +8,58 @@
 #include <predicator_planning/PredicatePlan.h>
 
 #include "predicator.h"
+#include "joint_tree.h"
 
 // deque more efficient for long arrays
 #include <deque>
+#include <queue>
+
+// joint model group -- which joints are we solving for?
+#include <moveit/robot_model/joint_model_group.h>
+
+// seeded sampling
+#include <random_numbers/random_numbers.h>
 
 namespace predicator_planning {
 
 
   struct Planner {
 
+    /**
+     * GoalKeys
+     * Interned keys of the statements of a request, looked up once per call to plan()
+     */
+    struct GoalKeys {
+      std::vector<PredicateKey> required_true;
+      std::vector<PredicateKey> required_false;
+      std::vector<PredicateKey> goal_true;
+      std::vector<PredicateKey> goal_false;
+
+      GoalKeys(const PredicatePlan::Request &req, const PredicateContext *context);
+    };
+
+    /**
+     * Worker
+     * What one thread needs to check samples independently of the others:
+     * copies of the context robot states and its own collision and geometry engines.
+     * The planning scenes are only read and stay shared.
+     */
+    struct Worker {
+      std::vector<RobotState *> states;
+      CollisionEngine collisions;
+      GeometryEngine geometry;
+
+      Worker(const PredicateContext *context);
+      ~Worker();
+
+      // copy the current joint values of the context states
+      void sync(const PredicateContext *context);
+
+    private:
+      Worker(const Worker &);
+      Worker &operator=(const Worker &);
+    };
+
     /**
      * SearchPose
      * Struct holding information on how good this RobotState is.
@@ -33,16 +76,70 @@ namespace predicator_planning {
 
       SearchPose *parent; // which one comes before this in the path
       SearchPose *child; // which one comes next
+      unsigned int id; // position in the SearchTree
 
       // default constructor
       SearchPose();
 
       // initialize parents, variables
-      SearchPose(std::deque<SearchPose *> &search,
-                 RobotState *state);
+      SearchPose(RobotState *state, SearchPose *parent, double cost);
 
       // update with information from the context
-      bool checkPredicates(PredicatePlan::Request &req, PredicateContext *context, unsigned int idx, bool &goals_reached);
+      // the other robots are taken from worker, which must have been synced with the context
+      bool checkPredicates(PredicatePlan::Request &req, const GoalKeys &keys, PredicateContext *context, Worker &worker, unsigned int idx, bool &goals_reached);
+    };
+
+    /**
+     * Score
+     * Orders search poses by most goal conditions met, then highest sum of negative heuristics,
+     * then the earliest added.
+     */
+    struct Score {
+      unsigned int count_met;
+      double hsum;
+      unsigned int id;
+
+      Score(const SearchPose &pose);
+
+      // true if this is worse than other
+      bool operator<(const Score &other) const;
+    };
+
+    /**
+     * SearchTree
+     * All poses of one call to plan().
+     * - the poses live in a deque arena and are freed together with their states
+     * - a k-d tree over the group joint values finds the nearest pose to a new sample
+     * - a priority queue keeps the best pose to expand from on top
+     * - the states of rejected samples are kept and reused for the next ones
+     */
+    struct SearchTree {
+      const moveit::core::JointModelGroup *group;
+      std::deque<SearchPose> poses;
+      JointTree index;
+      std::priority_queue<Score> queue;
+      std::vector<RobotState *> spares;
+      std::vector<double> joints; // scratch
+
+      unsigned int num_rejected;
+
+      SearchTree(const moveit::core::JointModelGroup *group);
+      ~SearchTree();
+
+      // a state to sample into, either new or one of a rejected sample
+      RobotState *newState(const RobotModelPtr &model);
+
+      // add a checked pose, takes ownership of its state
+      SearchPose *add(const SearchPose &pose);
+
+      // drop a pose that failed its checks, its state is kept for reuse
+      void reject(RobotState *state);
+
+      // closest pose in group joint space, NULL if there are none
+      SearchPose *nearest(const RobotState &state);
+
+      // pose with the best score, NULL if there are none
+      SearchPose *best();
     };
 
     // context contains information about the world and will produce new predicates
@@ -55,12 +152,24 @@ namespace predicator_planning {
     double step; // distance to move
     double chance; // percent of the time to move at random
     double skip_distance; // used to smooth trajectories
+    double max_time; // seconds a request may take, 0 for no limit
+    unsigned int batch_size; // samples drawn per iteration and checked in parallel
+    int num_threads; // threads checking a batch, 0 for the OpenMP default
+    int seed; // seed of the sampler, negative for a random seed
+
+    std::vector<Worker *> workers;
 
     Planner(PredicateContext *context, unsigned int max_iter = 10000,
             double step = 0.05,
             double chance = 0.2,
             double skip_distance = 0.5,
-            double search_volume = 0.5);
+            double search_volume = 0.5,
+            double max_time = 0.0,
+            unsigned int batch_size = 1,
+            int num_threads = 0,
+            int seed = -1);
+
+    ~Planner();
 
     bool plan(predicator_planning::PredicatePlan::Request &req,
               predicator_planning::PredicatePlan::Response &res);
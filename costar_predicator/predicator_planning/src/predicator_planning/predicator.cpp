@@ -45,6 +45,7 @@ namespace predicator_planning {
     XmlRpc::XmlRpcValue descriptions;
     XmlRpc::XmlRpcValue topics;
     XmlRpc::XmlRpcValue floating; // set of floating root joints that need to be updated
+    XmlRpc::XmlRpcValue reachability_maps; // files written by build_reachability_map
 
 
     nh_tilde.param("verbosity", verbosity, 0);
@@ -63,6 +64,23 @@ namespace predicator_planning {
     nh_tilde.param("rel_z_threshold", rel_z_threshold, 0.1);
     nh_tilde.param("near_2D_threshold", near_2d_threshold, 0.2);
     nh_tilde.param("near_3D_threshold", near_3d_threshold, 0.2);
+    nh_tilde.param("near_mesh_threshold", near_mesh_threshold, 0.1);
+
+    collisions.near_threshold = near_mesh_threshold;
+    collisions.padding = padding;
+    collisions.verbosity = verbosity;
+
+    geometry.rel_x_threshold = rel_x_threshold;
+    geometry.rel_y_threshold = rel_y_threshold;
+    geometry.rel_z_threshold = rel_z_threshold;
+    geometry.near_2d_threshold = near_2d_threshold;
+    geometry.near_3d_threshold = near_3d_threshold;
+    geometry.verbosity = verbosity;
+
+    nh_tilde.param("reachability_threshold", reachability.threshold, 0.0);
+    nh_tilde.param("reachability_ik", reachability.refine_ik, false);
+    nh_tilde.param("reachability_ik_timeout", reachability.ik_timeout, 0.05);
+    reachability.verbosity = verbosity;
 
     if(nh_tilde.hasParam("description_list")) {
       nh_tilde.param("description_list", descriptions, descriptions);
@@ -100,6 +118,7 @@ namespace predicator_planning {
     // define valid predicates topic
     pval.predicates.push_back("touching");
     pval.value_predicates.push_back("mesh_distance");
+    pval.predicates.push_back("near_mesh");
     pval.pheader.source = ros::this_node::getName();
 
     pval.predicates.push_back("near_xy");
@@ -110,6 +129,7 @@ namespace predicator_planning {
     pval.predicates.push_back("behind");
     pval.predicates.push_back("above");
     pval.predicates.push_back("below");
+    pval.predicates.push_back("reachable");
 
     // read in topics and descriptions
     for(unsigned int i = 0; i < descriptions.size(); ++i) {
@@ -193,6 +213,17 @@ namespace predicator_planning {
       }
     }
 
+    if(nh_tilde.hasParam("reachability_maps")) {
+      nh_tilde.param("reachability_maps", reachability_maps, reachability_maps);
+      for(unsigned int i = 0; i < reachability_maps.size(); ++i) {
+        if(reachability_maps[i].getType() == XmlRpc::XmlRpcValue::TypeString) {
+          reachability.load(static_cast<std::string>(reachability_maps[i]), states);
+        } else {
+          ROS_WARN("Reachability map entry %u was not of type \"string\"!", i);
+        }
+      }
+    }
+
     // print out information on all the different joints
     unsigned int i = 0;
     for (typename std::vector<PlanningScene *>::iterator it1 = scenes.begin();
@@ -218,6 +249,8 @@ namespace predicator_planning {
       ROS_INFO("creating list of heuristic indices for possible values");
     }
     updateIndices();
+    geometry.init(states, symbols, heuristic_indices);
+    reachability.init(states, symbols, heuristic_indices);
   }
 
   /**
@@ -225,11 +258,13 @@ namespace predicator_planning {
    * helper function
    */
   static inline void checkAndUpdate(const PredicateStatement &pred,
+                                    SymbolTable &symbols,
                                     heuristic_map_t &indices,
                                     unsigned int &next_idx)
   {
-    if (indices.find(pred) == indices.end()) {
-      indices[pred] = next_idx++;
+    PredicateKey key = symbols.intern(pred);
+    if (indices.find(key) == indices.end()) {
+      indices[key] = next_idx++;
       //std::cout << next_idx << " ";
     }
   }
@@ -242,6 +277,15 @@ namespace predicator_planning {
   void PredicateContext::updateIndices() {
     unsigned int idx = 0;
     unsigned int i = 0;
+
+    // names used by addCollisionPredicates()
+    touching_id = symbols.intern("touching");
+    near_mesh_id = symbols.intern("near_mesh");
+    robot_ids.clear();
+    for (unsigned int r = 0; r < robots.size(); ++r) {
+      robot_ids.push_back(symbols.intern(robots[r]->getName()));
+    }
+
     for(typename std::vector<RobotState *>::const_iterator it = states.begin();
         it != states.end();
         ++it, ++i)
@@ -276,8 +320,8 @@ namespace predicator_planning {
 
           //std::cout << heuristic_indices.size() << ", idx = " << idx << std::endl;
 
-          checkAndUpdate(near_mesh, heuristic_indices, idx);
-          checkAndUpdate(touching_robot, heuristic_indices, idx);
+          checkAndUpdate(near_mesh, symbols, heuristic_indices, idx);
+          checkAndUpdate(touching_robot, symbols, heuristic_indices, idx);
 
           //std::cout << (*it)->getRobotModel()->getName() << ", " << (*it2)->getRobotModel()->getName() << std::endl;
 
@@ -302,21 +346,39 @@ namespace predicator_planning {
             PredicateStatement near = createStatement("near",0,*link1,*link2);
             PredicateStatement near_xy = createStatement("near_xy",0,*link1,*link2);
 
-            checkAndUpdate(left, heuristic_indices, idx);
-            checkAndUpdate(right, heuristic_indices, idx);
-            checkAndUpdate(front, heuristic_indices, idx);
-            checkAndUpdate(back, heuristic_indices, idx);
-            checkAndUpdate(up, heuristic_indices, idx);
-            checkAndUpdate(down, heuristic_indices, idx);
-            checkAndUpdate(touching, heuristic_indices, idx);
-            checkAndUpdate(near, heuristic_indices, idx);
-            checkAndUpdate(near_xy, heuristic_indices, idx);
+            checkAndUpdate(left, symbols, heuristic_indices, idx);
+            checkAndUpdate(right, symbols, heuristic_indices, idx);
+            checkAndUpdate(front, symbols, heuristic_indices, idx);
+            checkAndUpdate(back, symbols, heuristic_indices, idx);
+            checkAndUpdate(up, symbols, heuristic_indices, idx);
+            checkAndUpdate(down, symbols, heuristic_indices, idx);
+            checkAndUpdate(touching, symbols, heuristic_indices, idx);
+            checkAndUpdate(near, symbols, heuristic_indices, idx);
+            checkAndUpdate(near_xy, symbols, heuristic_indices, idx);
 
             //std::cout << *link1 << ", " << *link2 << std::endl;
           }
         }
       }
     }
+
+    // reachable(robot, link) for the links of all other objects
+    for (unsigned int m = 0; m < reachability.maps.size(); ++m) {
+      const unsigned int robot = reachability.map_robots[m];
+      for (unsigned int j = 0; j < states.size(); ++j) {
+        if (j == robot) {
+          continue;
+        }
+        const std::vector<std::string> &names = states[j]->getRobotModel()->getLinkModelNames();
+        for (unsigned int l = 0; l < names.size(); ++l) {
+          if (names[l].compare(std::string("world")) == 0) {
+            continue;
+          }
+          PredicateStatement reachable = createStatement("reachable",0,robots[robot]->getName(),names[l]);
+          checkAndUpdate(reachable, symbols, heuristic_indices, idx);
+        }
+      }
+    }
   }
 
   /**
@@ -393,20 +455,23 @@ namespace predicator_planning {
    * updateHeuristics
    * helper function to store heuristic values
    */
-  static inline void updateHeuristics(const PredicateStatement &pred, const heuristic_map_t &indices, std::vector<double> &heuristics) {
-    if (indices.find(pred) == indices.end()) {
-      ROS_ERROR("(UPDATE) Failed to look up predicate \"%s\" with arguments (%s, %s, %s)", pred.predicate.c_str(),
-                pred.params[0].c_str(),
-                pred.params[1].c_str(),
-                pred.params[2].c_str());
-    } else if (indices.at(pred) > heuristics.size()) {
-      ROS_ERROR("(UPDATE) Indexing error from predicate \"%s\" with arguments (%s, %s, %s)", pred.predicate.c_str(),
-                pred.params[0].c_str(),
-                pred.params[1].c_str(),
-                pred.params[2].c_str());
-      ROS_ERROR("index = %u, length=%lu", indices.at(pred), heuristics.size());
+  static inline void updateHeuristics(const PredicateKey &key, double value, const SymbolTable &symbols, const heuristic_map_t &indices, std::vector<double> &heuristics) {
+    heuristic_map_t::const_iterator it = indices.find(key);
+    if (it == indices.end()) {
+      ROS_ERROR("(UPDATE) Failed to look up predicate \"%s\" with arguments (%s, %s, %s)", symbols.name(key.predicate).c_str(),
+                symbols.name(key.params[0]).c_str(),
+                symbols.name(key.params[1]).c_str(),
+                symbols.name(key.params[2]).c_str());
+      return;
+    } else if (it->second >= heuristics.size()) {
+      ROS_ERROR("(UPDATE) Indexing error from predicate \"%s\" with arguments (%s, %s, %s)", symbols.name(key.predicate).c_str(),
+                symbols.name(key.params[0]).c_str(),
+                symbols.name(key.params[1]).c_str(),
+                symbols.name(key.params[2]).c_str());
+      ROS_ERROR("index = %u, length=%lu", it->second, heuristics.size());
+      return;
     }
-    heuristics[indices.at(pred)] = pred.value;
+    heuristics[it->second] = value;
   }
 
   /**
@@ -415,96 +480,101 @@ namespace predicator_planning {
    * checks for all pairs of objects, determines collisions and distances
    * publishes the relationships between all of these objects
    */
-  void PredicateContext::addCollisionPredicates(PredicateList &output, std::vector<double> &heuristics, const std::vector<RobotState *> &states, unsigned int idx) {
-
-    unsigned i = 0;
-    for(typename std::vector<PlanningScene *>::iterator it1 = scenes.begin();
-        it1 != scenes.end();
-        ++it1, ++i)
-    {
-
-      collision_detection::CollisionRobotConstPtr robot1 = (*it1)->getCollisionRobot();
-
-      typename std::vector<PlanningScene *>::iterator it2 = it1;
-      unsigned int j = i+1;
-
-      // skip if we are only computing predicates for a single planning scene
-      if (idx < scenes.size() && i != idx) {
-        continue;
-      } else if (idx < scenes.size() && i == idx){
-        j = 0;
-        it2 = scenes.begin();
-      }
+  void PredicateContext::addCollisionPredicates(PredicateList *output, std::vector<double> &heuristics, const std::vector<RobotState *> &states, unsigned int idx, key_set_t *true_keys) {
+    addCollisionPredicates(collisions, output, heuristics, states, idx, true_keys);
+  }
 
-      for(++it2; it2 != scenes.end(); ++it2, ++j) {
+  void PredicateContext::addCollisionPredicates(CollisionEngine &engine, PredicateList *output, std::vector<double> &heuristics, const std::vector<RobotState *> &states, unsigned int idx, key_set_t *true_keys) const {
 
-        if (i == j) continue;
+    // only pairs whose states changed get new narrowphase queries
+    engine.update(scenes, states, idx);
 
-        collision_detection::CollisionRobotConstPtr robot2 = (*it2)->getCollisionRobot();
+    for (unsigned int i = 0; i < scenes.size(); ++i) {
+      for (unsigned int j = i + 1; j < scenes.size(); ++j) {
 
-        collision_detection::CollisionRequest req;
-        collision_detection::CollisionResult res;
-        req.contacts = true;
-        req.max_contacts = 1000;
+        // skip if we are only computing predicates for a single planning scene
+        if (idx < scenes.size() && i != idx && j != idx) {
+          continue;
+        }
 
-        // force an update
-        // source: https://groups.google.com/forum/#!topic/moveit-users/O9CEef6sxbE
-        states[i]->update(true);
-        states[j]->update(true);
+        const std::string &name1 = robots[i]->getName();
+        const std::string &name2 = robots[j]->getName();
+        const CollisionEngine::PairResult &pair = engine.getPair(i, j);
+        if (!pair.has_geometry) {
+          continue;
+        }
 
-        robot1->checkOtherCollision(req, res, *states[i], *robot2, *states[j]);
-        double dist = robot1->distanceOther(*states[i], *robot2, *states[j]);
+        // for pairs beyond the broadphase threshold this is the gap between their boxes, a lower bound
+        // of the mesh distance, so their touching and near_mesh heuristics are slightly optimistic
+        double dist = pair.dist;
 
-        PredicateStatement ps = createStatement("touching", -1.0 * dist,
-                                                robot1->getRobotModel()->getName(),
-                                                robot2->getRobotModel()->getName());
-        PredicateStatement ps2 = createStatement("touching", -1.0 * dist,
-                                                 robot2->getRobotModel()->getName(),
-                                                 robot1->getRobotModel()->getName());
+        // statements are only built for the predicates that hold
+        PredicateKey ps(touching_id, robot_ids[i], robot_ids[j]);
+        PredicateKey ps2(touching_id, robot_ids[j], robot_ids[i]);
 
-        updateHeuristics(ps, heuristic_indices, heuristics);
-        updateHeuristics(ps2, heuristic_indices, heuristics);
+        updateHeuristics(ps, -1.0 * dist, symbols, heuristic_indices, heuristics);
+        updateHeuristics(ps2, -1.0 * dist, symbols, heuristic_indices, heuristics);
 
         if (dist <= 0) {
-          output.statements.push_back(ps);
-          output.statements.push_back(ps2);
+          if (output) {
+            output->statements.push_back(createStatement("touching", -1.0 * dist, name1, name2));
+            output->statements.push_back(createStatement("touching", -1.0 * dist, name2, name1));
+          }
+          if (true_keys) {
+            true_keys->insert(ps);
+            true_keys->insert(ps2);
+          }
         }
 
-        if (verbosity > 4) {
-          std::cout << res.contacts.size() << " contacts found" << std::endl;
+        PredicateKey near(near_mesh_id, robot_ids[i], robot_ids[j]);
+        PredicateKey near2(near_mesh_id, robot_ids[j], robot_ids[i]);
+
+        updateHeuristics(near, near_mesh_threshold - dist, symbols, heuristic_indices, heuristics);
+        updateHeuristics(near2, near_mesh_threshold - dist, symbols, heuristic_indices, heuristics);
+
+        if (pair.checked && dist < near_mesh_threshold) {
+          if (output) {
+            output->statements.push_back(createStatement("near_mesh", near_mesh_threshold - dist, name1, name2));
+            output->statements.push_back(createStatement("near_mesh", near_mesh_threshold - dist, name2, name1));
+          }
+          if (true_keys) {
+            true_keys->insert(near);
+            true_keys->insert(near2);
+          }
         }
 
         // iterate over all collisions
-        for(collision_detection::CollisionResult::ContactMap::const_iterator cit = res.contacts.begin(); 
-            cit != res.contacts.end(); 
+        for(std::vector<std::pair<std::string, std::string> >::const_iterator cit = pair.contacts.begin();
+            cit != pair.contacts.end();
             ++cit)
         {
-          // write the correct predicate
-          predicator_msgs::PredicateStatement ps;
-          ps.predicate = "touching";
-          ps.value = -1.0 * dist;
-          ps.num_params = 2;
-          ps.params[0] = cit->first.first;
-          ps.params[1] = cit->first.second;
-          output.statements.push_back(ps);
-
-          // the reverse is also true, so update it
-          predicator_msgs::PredicateStatement ps2;
-          ps2.predicate = "touching";
-          ps2.value = -1.0 * dist;
-          ps2.num_params = 2;
-          ps2.params[0] = cit->first.second;
-          ps2.params[1] = cit->first.first;
-          output.statements.push_back(ps2);
-
-          updateHeuristics(ps, heuristic_indices, heuristics);
-          updateHeuristics(ps2, heuristic_indices, heuristics);
+          if (output) {
+            // write the correct predicate
+            output->statements.push_back(createStatement("touching", -1.0 * dist, cit->first, cit->second));
+
+            // the reverse is also true, so update it
+            output->statements.push_back(createStatement("touching", -1.0 * dist, cit->second, cit->first));
+          }
+
+          // link names are known from updateIndices()
+          unsigned int link1 = symbols.find(cit->first);
+          unsigned int link2 = symbols.find(cit->second);
+          PredicateKey key(touching_id, link1, link2);
+          PredicateKey key2(touching_id, link2, link1);
+
+          updateHeuristics(key, -1.0 * dist, symbols, heuristic_indices, heuristics);
+          updateHeuristics(key2, -1.0 * dist, symbols, heuristic_indices, heuristics);
+          if (true_keys) {
+            true_keys->insert(key);
+            true_keys->insert(key2);
+          }
         }
 
         if (verbosity > 1) {
-          std::cout << "(" << robot1->getRobotModel()->getName()
-            << ", " << robot2->getRobotModel()->getName()
-            << ") : Distance to collision: " << dist << std::endl;
+          std::cout << "(" << name1
+            << ", " << name2
+            << ") : Distance to collision: " << dist
+            << (pair.checked ? "" : " (box gap)") << std::endl;
         }
       }
     }
@@ -518,26 +588,43 @@ namespace predicator_planning {
     return heuristic_indices.size();
   }
 
+  /**
+   * getKey
+   * Interned key of a statement, not valid() if it uses a name the context does not know
+   */
+  PredicateKey PredicateContext::getKey(const PredicateStatement &pred) const {
+    return symbols.find(pred);
+  }
+
   /**
    * getHeuristic
    * Looks up a score from a vector of possible values
    */
   double PredicateContext::getHeuristic(const PredicateStatement &pred, const std::vector<double> &heuristics) const {
-    if (heuristic_indices.find(pred) == heuristic_indices.end()) {
+    PredicateKey key = getKey(pred);
+    if (heuristic_indices.find(key) == heuristic_indices.end()) {
       ROS_ERROR("(GET) Failed to lookup predicate \"%s\" with arguments (%s, %s, %s)", pred.predicate.c_str(),
                 pred.params[0].c_str(),
                 pred.params[1].c_str(),
                 pred.params[2].c_str());
       return 0;
-    } else if (heuristic_indices.at(pred) > heuristics.size()) {
-      ROS_ERROR("(GET) Indexing error from predicate \"%s\" with arguments (%s, %s, %s)", pred.predicate.c_str(),
-                pred.params[0].c_str(),
-                pred.params[1].c_str(),
-                pred.params[2].c_str());
-      ROS_ERROR("index = %u, length=%lu", heuristic_indices.at(pred), heuristics.size());
+    }
+    return getHeuristic(key, heuristics);
+  }
+
+  double PredicateContext::getHeuristic(const PredicateKey &key, const std::vector<double> &heuristics) const {
+    heuristic_map_t::const_iterator it = heuristic_indices.find(key);
+    if (it == heuristic_indices.end()) {
+      return 0;
+    } else if (it->second >= heuristics.size()) {
+      ROS_ERROR("(GET) Indexing error from predicate \"%s\" with arguments (%s, %s, %s)", symbols.name(key.predicate).c_str(),
+                symbols.name(key.params[0]).c_str(),
+                symbols.name(key.params[1]).c_str(),
+                symbols.name(key.params[2]).c_str());
+      ROS_ERROR("index = %u, length=%lu", it->second, heuristics.size());
       return 0;
     }
-    return heuristics.at(heuristic_indices.at(pred));
+    return heuristics[it->second];
   }
 
   /**
@@ -552,9 +639,9 @@ namespace predicator_planning {
     heuristics.resize(heuristic_indices.size());
 
     updateRobotStates();
-    addCollisionPredicates(output, heuristics, states);
-    addGeometryPredicates(output, heuristics, states);
-    addReachabilityPredicates(output, heuristics, states);
+    addCollisionPredicates(&output, heuristics, states);
+    addGeometryPredicates(&output, heuristics, states, true);
+    addReachabilityPredicates(&output, heuristics, states, NULL, reachability.refine_ik);
 
     pub.publish(output);
     vpub.publish(pval);
@@ -564,11 +651,12 @@ namespace predicator_planning {
    * addReachabilityPredicates()
    * compute whether or not we can reach certain points or waypoints
    */
-  void PredicateContext::addReachabilityPredicates(PredicateList &list, std::vector<double> &heuristics, const std::vector<RobotState *> &states) {
-    // update list of reachable waypoints
+  void PredicateContext::addReachabilityPredicates(PredicateList *list, std::vector<double> &heuristics, const std::vector<RobotState *> &states, key_set_t *true_keys, bool refine) const {
+    // waypoints are not handled yet, the targets are the links of the other objects
     // use a service call to predicator to get the relevant waypoints
 
     // compute whether or not that point can be reached
+    reachability.evaluate(states, heuristics, list, true_keys, refine);
   }
 
   /**
@@ -597,117 +685,21 @@ namespace predicator_planning {
    ring1/ring_link 
    world stage_link 
    */
-  void PredicateContext::addGeometryPredicates(PredicateList &list, std::vector<double> &heuristics, const std::vector<RobotState *> &states) {
-
-    unsigned int i = 0;
-    for(typename std::vector<RobotState *>::const_iterator it = states.begin();
-        it != states.end();
-        ++it, ++i)
-    {
-
-      // get the list of joints for the robot state
-      for (typename std::vector<std::string>::const_iterator link1 = (*it)->getRobotModel()->getLinkModelNames().begin();
-           link1 != (*it)->getRobotModel()->getLinkModelNames().end();
-           ++link1)
-      {
-        if (link1->compare(std::string("world")) == 0) {
-          continue;
-        }
-
-        // access world coordinates
-        // NOTE: does not work for the ring yet!
-        Eigen::Affine3d tf1 = getLinkTransform(*it, *link1);
-
-        // loop over the other objects in the world
-        // this does NOT include waypoints or anything like that -- we need a separate loop
-        // the second loop can handle abstract entities like these
-        unsigned int j = 0;
-        for(typename std::vector<RobotState *>::const_iterator it2 = states.begin();
-            it2 != states.end();
-            ++it2, ++j)
-        {
-          if (i == j) {
-            continue;
-          }
-
-          // loop over the non-world links of this object
-          // get the list of joints for the robot state
-          for (typename std::vector<std::string>::const_iterator link2 = (*it2)->getRobotModel()->getLinkModelNames().begin();
-               link2 != (*it2)->getRobotModel()->getLinkModelNames().end();
-               ++link2)
-          {
-            if (link2->compare(std::string("world")) == 0) {
-              continue;
-            }
-
-            Eigen::Affine3d tf2 = getLinkTransform(*it2, *link2);
-
-            if (verbosity > 2) {
-              std::cout << *link1 << ", " << *link2 << std::endl;
-            }
-
-            if (verbosity > 3) {
-              std::cout << tf1.translation()[0] << "," << tf1.translation()[1] << "," << tf1.translation()[2] << " --> ";
-              std::cout << tf2.translation()[0] << "," << tf2.translation()[1] << "," << tf2.translation()[2] << std::endl;
-            }
-
-            double xdiff = tf1.translation()[1] - tf2.translation()[1]; // x = red = front/back from stage
-            double ydiff = tf1.translation()[0] - tf2.translation()[0]; // y = green = left/right?
-            double zdiff = tf1.translation()[2] - tf2.translation()[2]; // z = blue = up/down
-            double dist_xy = sqrt((xdiff*xdiff) + (ydiff*ydiff)); // compute xy distance only
-            double dist = sqrt((xdiff*xdiff) + (ydiff*ydiff) + (zdiff*zdiff)); // compute xyz distance
-
-            PredicateStatement left = createStatement("left_of",xdiff - rel_x_threshold,*link1,*link2,"world");
-            PredicateStatement right = createStatement("right_of",-1.0 * xdiff - rel_x_threshold,*link1,*link2,"world");
-            PredicateStatement front = createStatement("in_front_of",ydiff - rel_y_threshold,*link1,*link2,"world");
-            PredicateStatement back = createStatement("behind",-1.0 * ydiff - rel_y_threshold,*link1,*link2,"world");
-            PredicateStatement up = createStatement("above",zdiff - rel_z_threshold,*link1,*link2,"world");
-            PredicateStatement down = createStatement("below",-1.0 * zdiff - rel_z_threshold,*link1,*link2,"world");
-            PredicateStatement near = createStatement("near",-1.0 * dist + near_3d_threshold,*link1,*link2);
-            PredicateStatement near_xy = createStatement("near_xy",-1.0 * dist_xy + near_2d_threshold,*link1,*link2);
-
-            updateHeuristics(left, heuristic_indices, heuristics);
-            updateHeuristics(right, heuristic_indices, heuristics);
-            updateHeuristics(front, heuristic_indices, heuristics);
-            updateHeuristics(back, heuristic_indices, heuristics);
-            updateHeuristics(up, heuristic_indices, heuristics);
-            updateHeuristics(down, heuristic_indices, heuristics);
-            updateHeuristics(near, heuristic_indices, heuristics);
-            updateHeuristics(near_xy, heuristic_indices, heuristics);
-
-            // x is left/right
-            if (xdiff < -1.0 * rel_x_threshold){
-              list.statements.push_back(right);
-            } else if (xdiff > rel_x_threshold) {
-              list.statements.push_back(left);
-            }
-
-            // y is front/back
-            if (ydiff < -1.0 * rel_y_threshold) {
-              list.statements.push_back(back);
-            } else if (ydiff > rel_y_threshold) {
-              list.statements.push_back(front);
-            }
-
-            // z is front/back
-            if (zdiff < -1.0 * rel_z_threshold) {
-              list.statements.push_back(down);
-            } else if (zdiff > rel_z_threshold) {
-              list.statements.push_back(up);
-            }
+  void PredicateContext::addGeometryPredicates(PredicateList *list, std::vector<double> &heuristics, const std::vector<RobotState *> &states, bool track_changes, key_set_t *true_keys) {
+    addGeometryPredicates(geometry, list, heuristics, states, track_changes, true_keys);
+  }
 
-            if (dist < near_3d_threshold) {
-              list.statements.push_back(near);
-            }
+  void PredicateContext::addGeometryPredicates(GeometryEngine &engine, PredicateList *list, std::vector<double> &heuristics, const std::vector<RobotState *> &states, bool track_changes, key_set_t *true_keys) const {
 
-            if (dist_xy < near_2d_threshold) {
-              list.statements.push_back(near_xy);
-            }
+    engine.evaluate(states, heuristics, track_changes);
 
-            // somehow we need to do this from other points of view as well... but maybe not for now
-          }
-        }
+    if (verbosity > 3) {
+      for (unsigned int a = 0; a < engine.links.size(); ++a) {
+        std::cout << engine.links[a]->getName() << ": " << engine.xs[a] << "," << engine.ys[a] << "," << engine.zs[a] << std::endl;
       }
     }
+
+    // somehow we need to do this from other points of view as well... but maybe not for now
+    engine.appendStatements(list, true_keys);
   }
 }
@@ -32,6 +32,9 @@
 #include <boost/bind/bind.hpp>
 
 #include "utility.hpp"
+#include "collision_engine.h"
+#include "geometry_engine.h"
+#include "reachability_engine.h"
 
 using planning_scene::PlanningScene;
 using robot_model_loader::RobotModelLoader;
@@ -41,11 +44,6 @@ using collision_detection::CollisionRobot;
 
 namespace predicator_planning {
 
-  typedef std::unordered_map<predicator_msgs::PredicateStatement,
-          unsigned int,
-          predicator_planning::Hash,
-          predicator_planning::Equals> heuristic_map_t;
-
   /*
    * joint_state_callback()
    * Update the robot state variable values
@@ -88,18 +86,46 @@ namespace predicator_planning {
     double rel_z_threshold;
     double near_2d_threshold;
     double near_3d_threshold;
+    double near_mesh_threshold; // pairs of objects further apart than this skip the mesh distance query
 
     tf::TransformListener listener;
 
     double padding; // how much padding do we give robot links?
     int verbosity; // how much should get printed for debugging purposes
 
+    /*
+     * symbols
+     * Interned predicate names and parameters, filled by updateIndices()
+     */
+    SymbolTable symbols;
+    std::vector<unsigned int> robot_ids; // symbol of each robot name
+    unsigned int touching_id;
+    unsigned int near_mesh_id;
+
     /*
      * heuristic_indices
      * Stores the locations in a double array of the indices for different features (heuristics)
      */
     heuristic_map_t heuristic_indices;
 
+    /*
+     * collisions
+     * Broadphase and cached pair results for addCollisionPredicates()
+     */
+    CollisionEngine collisions;
+
+    /*
+     * geometry
+     * Link snapshot and precomputed heuristic slots for addGeometryPredicates()
+     */
+    GeometryEngine geometry;
+
+    /*
+     * reachability
+     * Reachability maps and their targets for addReachabilityPredicates()
+     */
+    ReachabilityEngine reachability;
+
     std::map<std::string, std::string> floating_frames;
     std::string world_frame;
 
@@ -157,20 +183,44 @@ namespace predicator_planning {
      *
      * @param idx is the index of a particular PlanningScene.
      * When doing planning, we don't really need to recompute all of the world collisions, just the ones that might be changing.
+     * @param list receives the statements that hold, NULL to only fill true_keys
+     * @param true_keys if given, receives the keys of all statements that hold
      */
-    void addCollisionPredicates(PredicateList &list, std::vector<double> &heuristics, const std::vector<RobotState *> &states, unsigned int idx=~0);
+    void addCollisionPredicates(PredicateList *list, std::vector<double> &heuristics, const std::vector<RobotState *> &states, unsigned int idx=~0, key_set_t *true_keys = NULL);
+
+    /**
+     * addCollisionPredicates()
+     * Same as above with the caller's own engine instead of collisions.
+     * Only reads the context, so threads with separate engines and states may call it at the same time.
+     */
+    void addCollisionPredicates(CollisionEngine &engine, PredicateList *list, std::vector<double> &heuristics, const std::vector<RobotState *> &states, unsigned int idx=~0, key_set_t *true_keys = NULL) const;
 
     /**
      * addGeometryPredicates()
      * compute the set of geometry predicates
+     *
+     * @param track_changes counts the relations that changed since the last call with track_changes set
+     * @param list receives the statements that hold, NULL to only fill true_keys
+     * @param true_keys if given, receives the keys of all statements that hold
      */
-    void addGeometryPredicates(PredicateList &list, std::vector<double> &heuristic, const std::vector<RobotState *> &states);
+    void addGeometryPredicates(PredicateList *list, std::vector<double> &heuristic, const std::vector<RobotState *> &states, bool track_changes = false, key_set_t *true_keys = NULL);
+
+    /**
+     * addGeometryPredicates()
+     * Same as above with the caller's own engine instead of geometry.
+     * Only reads the context, so threads with separate engines and states may call it at the same time.
+     */
+    void addGeometryPredicates(GeometryEngine &engine, PredicateList *list, std::vector<double> &heuristic, const std::vector<RobotState *> &states, bool track_changes = false, key_set_t *true_keys = NULL) const;
 
     /**
      * addReachabilityPredicates()
      * compute whether or not we can reach certain points or waypoints
+     *
+     * @param list receives the statements that hold, NULL to only fill true_keys
+     * @param true_keys if given, receives the keys of all statements that hold
+     * @param refine confirms every reachable voxel with an IK solve
      */
-    void addReachabilityPredicates(PredicateList &list, std::vector<double> &heuristics, const std::vector<RobotState *> &states);
+    void addReachabilityPredicates(PredicateList *list, std::vector<double> &heuristics, const std::vector<RobotState *> &states, key_set_t *true_keys = NULL, bool refine = false) const;
 
     /**
      * getLinkTransform
@@ -192,6 +242,13 @@ namespace predicator_planning {
      * Looks up a score from a vector of possible values
      */
     double getHeuristic(const PredicateStatement &pred, const std::vector<double> &heuristics) const;
+    double getHeuristic(const PredicateKey &key, const std::vector<double> &heuristics) const;
+
+    /**
+     * getKey
+     * Interned key of a statement, not valid() if it uses a name the context does not know
+     */
+    PredicateKey getKey(const PredicateStatement &pred) const;
   };
 }
 
@@ -19,6 +19,10 @@ int main(int argc, char **argv) {
   double chance = 0.30;
   double skip_distance = 0.75;
   double search_volume = 0.50;
+  double max_time = 0.0;
+  int batch_size = 1;
+  int num_threads = 0;
+  int seed = -1;
 
   ros::NodeHandle nh("~");
   nh.param("max_iter", max_iter, int(5000));
@@ -26,8 +30,13 @@ int main(int argc, char **argv) {
   nh.param("chance", chance, double(0.40));
   nh.param("skip_distance", skip_distance, double(0.75));
   nh.param("search_volume", search_volume, double(0.50));
+  nh.param("max_time", max_time, double(0.0));
+  nh.param("batch_size", batch_size, int(1));
+  nh.param("num_threads", num_threads, int(0));
+  nh.param("seed", seed, int(-1));
 
-  predicator_planning::Planner planner(&pc, (unsigned int)max_iter, step, chance, skip_distance, search_volume);
+  predicator_planning::Planner planner(&pc, (unsigned int)max_iter, step, chance, skip_distance, search_volume, max_time,
+                                        (unsigned int)batch_size, num_threads, seed);
 
   // define spin rate
   ros::Rate rate(30);
@@ -0,0 +1,127 @@
+#include "predicator.h"
+#include "reachability_engine.h"
+
+namespace predicator_planning {
+
+  ReachabilityEngine::ReachabilityEngine() : threshold(0), refine_ik(false), ik_timeout(0.05), verbosity(0) {}
+
+  bool ReachabilityEngine::load(const std::string &filename, const std::vector<RobotState *> &states) {
+    ReachabilityMap map;
+    if (!map.load(filename)) {
+      ROS_ERROR("Could not read reachability map \"%s\"!", filename.c_str());
+      return false;
+    }
+
+    unsigned int robot = 0;
+    for (; robot < states.size(); ++robot) {
+      if (states[robot]->getRobotModel()->getName().compare(map.robot) == 0) {
+        break;
+      }
+    }
+    if (robot >= states.size()) {
+      ROS_ERROR("Reachability map \"%s\" is for unknown robot \"%s\"!", filename.c_str(), map.robot.c_str());
+      return false;
+    }
+
+    // reachable(robot, link) has no room for the map, so a second map would produce the same keys
+    for (unsigned int m = 0; m < map_robots.size(); ++m) {
+      if (map_robots[m] == robot) {
+        ROS_ERROR("Reachability map \"%s\" is for robot \"%s\", which already has a map!", filename.c_str(), map.robot.c_str());
+        return false;
+      }
+    }
+
+    robot_model::RobotModelConstPtr model = states[robot]->getRobotModel();
+    if (!model->hasJointModelGroup(map.group) || !model->hasLinkModel(map.tip) || !model->hasLinkModel(map.base)) {
+      ROS_ERROR("Reachability map \"%s\" does not match robot \"%s\"!", filename.c_str(), map.robot.c_str());
+      return false;
+    }
+
+    maps.push_back(map);
+    map_robots.push_back(robot);
+    map_groups.push_back(model->getJointModelGroup(map.group));
+    map_bases.push_back(model->getLinkModel(map.base));
+    map_tips.push_back(model->getLinkModel(map.tip));
+
+    if (verbosity > 0) {
+      std::cout << "Loaded reachability map for " << map.robot << "/" << map.group << " with "
+        << map.countReachable() << " reachable voxels" << std::endl;
+    }
+    return true;
+  }
+
+  void ReachabilityEngine::init(const std::vector<RobotState *> &states, SymbolTable &symbols, const heuristic_map_t &heuristic_indices) {
+    targets.clear();
+
+    const unsigned int reachable = symbols.intern("reachable");
+    for (unsigned int m = 0; m < maps.size(); ++m) {
+      const unsigned int robot = symbols.intern(maps[m].robot);
+
+      for (unsigned int i = 0; i < states.size(); ++i) {
+        if (i == map_robots[m]) {
+          continue;
+        }
+
+        const std::vector<const moveit::core::LinkModel *> &links = states[i]->getRobotModel()->getLinkModels();
+        for (unsigned int l = 0; l < links.size(); ++l) {
+          if (links[l]->getName().compare(std::string("world")) == 0) {
+            continue;
+          }
+
+          Target t;
+          t.map = m;
+          t.robot = map_robots[m];
+          t.object = i;
+          t.link = links[l];
+          t.key = PredicateKey(reachable, robot, symbols.intern(links[l]->getName()));
+
+          heuristic_map_t::const_iterator it = heuristic_indices.find(t.key);
+          t.index = it == heuristic_indices.end() ? -1 : (int)it->second;
+          targets.push_back(t);
+        }
+      }
+    }
+  }
+
+  void ReachabilityEngine::evaluate(const std::vector<RobotState *> &states, std::vector<double> &heuristics,
+                                    PredicateList *list, key_set_t *true_keys, bool refine) const
+  {
+    // one inverse base transform per map
+    EigenSTL::vector_Affine3d to_base(maps.size());
+    for (unsigned int m = 0; m < maps.size(); ++m) {
+      to_base[m] = states[map_robots[m]]->getGlobalLinkTransform(map_bases[m]).inverse();
+    }
+
+    for (unsigned int k = 0; k < targets.size(); ++k) {
+      const Target &t = targets[k];
+      const ReachabilityMap &map = maps[t.map];
+
+      Eigen::Vector3d world = states[t.object]->getGlobalLinkTransform(t.link).translation();
+      double value = map.lookup(to_base[t.map] * world) - threshold;
+
+      if (t.index >= 0 && (unsigned int)t.index < heuristics.size()) {
+        heuristics[t.index] = value;
+      }
+
+      if (value <= 0) {
+        continue;
+      }
+
+      if (refine) {
+        RobotState state(*states[t.robot]);
+        Eigen::Affine3d pose = state.getGlobalLinkTransform(map_tips[t.map]);
+        pose.translation() = world;
+        if (!state.setFromIK(map_groups[t.map], pose, map.tip, 1, ik_timeout)) {
+          continue;
+        }
+      }
+
+      if (list) {
+        list->statements.push_back(createStatement("reachable", value, map.robot, t.link->getName()));
+      }
+      if (true_keys) {
+        true_keys->insert(t.key);
+      }
+    }
+  }
+}
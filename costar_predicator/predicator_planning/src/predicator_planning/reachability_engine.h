@@ -0,0 +1,78 @@
+#ifndef _PP_REACHABILITY_ENGINE
+#define _PP_REACHABILITY_ENGINE
+
+// stl
+#include <vector>
+#include <string>
+
+// MoveIt!
+#include <moveit/robot_state/robot_state.h>
+#include <eigen_stl_containers/eigen_stl_vector_container.h>
+
+#include "utility.hpp"
+#include "reachability_map.h"
+
+using robot_state::RobotState;
+
+namespace predicator_planning {
+
+  /**
+   * ReachabilityEngine
+   * Evaluates reachable(robot, link): the link of another object lies in a voxel of the
+   * reachability map of robot with a score above threshold.
+   * - the links, keys and heuristic slots of all (map, link) pairs are resolved once in init()
+   * - a lookup is one transform into the robot base frame and one voxel read
+   * - with refine_ik a reachable voxel is confirmed by an IK solve for the tip, keeping the
+   *   current tip orientation. This needs a kinematics solver for the group and is meant
+   *   for the published predicates, not for the planning loop.
+   */
+  struct ReachabilityEngine {
+
+    struct Target {
+      unsigned int map; // index into maps
+      unsigned int robot; // robot owning the map
+      unsigned int object; // robot owning the link
+      const moveit::core::LinkModel *link;
+      PredicateKey key;
+      int index; // heuristic slot, -1 if none
+    };
+
+    double threshold; // scores above this count as reachable
+    bool refine_ik;
+    double ik_timeout;
+    int verbosity;
+
+    std::vector<ReachabilityMap> maps;
+    std::vector<unsigned int> map_robots; // robot of each map
+    std::vector<const moveit::core::JointModelGroup *> map_groups;
+    std::vector<const moveit::core::LinkModel *> map_bases;
+    std::vector<const moveit::core::LinkModel *> map_tips;
+    std::vector<Target> targets;
+
+    ReachabilityEngine();
+
+    /**
+     * load()
+     * Read a map built by build_reachability_map and attach it to the state with the same robot,
+     * every robot can have one map
+     */
+    bool load(const std::string &filename, const std::vector<RobotState *> &states);
+
+    /**
+     * init()
+     * Look up the heuristic slots of all targets, after the indices were created
+     */
+    void init(const std::vector<RobotState *> &states, SymbolTable &symbols, const heuristic_map_t &heuristic_indices);
+
+    /**
+     * evaluate()
+     * Store the heuristic value (score - threshold) of every target,
+     * append the statements that hold to list and their keys to true_keys if given
+     * (list may be NULL when only the keys are needed)
+     */
+    void evaluate(const std::vector<RobotState *> &states, std::vector<double> &heuristics,
+                  PredicateList *list, key_set_t *true_keys, bool refine) const;
+  };
+}
+
+#endif
@@ -0,0 +1,155 @@
+#include "reachability_map.h"
+
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+
+namespace predicator_planning {
+
+  static const char MAP_MAGIC[8] = {'P', 'P', 'R', 'M', 'A', 'P', '0', '1'};
+
+  ReachabilityMap::ReachabilityMap() : resolution(0) {
+    for (unsigned int k = 0; k < 3; ++k) {
+      origin[k] = 0;
+      size[k] = 0;
+    }
+  }
+
+  void ReachabilityMap::resize(const double *min, const double *max, double _resolution) {
+    resolution = _resolution;
+    for (unsigned int k = 0; k < 3; ++k) {
+      origin[k] = min[k];
+      size[k] = (unsigned int)ceil((max[k] - min[k]) / resolution);
+      if (size[k] == 0) {
+        size[k] = 1;
+      }
+    }
+    scores.assign((size_t)size[0] * size[1] * size[2], 0.f);
+  }
+
+  bool ReachabilityMap::index(const Eigen::Vector3d &point, unsigned int &idx) const {
+    if (resolution <= 0) {
+      return false;
+    }
+
+    unsigned int cell[3];
+    for (unsigned int k = 0; k < 3; ++k) {
+      double c = floor((point[k] - origin[k]) / resolution);
+      if (c < 0 || c >= size[k]) {
+        return false;
+      }
+      cell[k] = (unsigned int)c;
+    }
+    idx = (cell[2] * size[1] + cell[1]) * size[0] + cell[0];
+    return true;
+  }
+
+  double ReachabilityMap::lookup(const Eigen::Vector3d &point) const {
+    unsigned int idx;
+    if (!index(point, idx)) {
+      return -1;
+    }
+    return scores[idx];
+  }
+
+  void ReachabilityMap::add(const Eigen::Vector3d &point, double score) {
+    // a voxel reached only in singular poses still counts as reached
+    score = std::max(score, 1e-6);
+
+    unsigned int idx;
+    if (index(point, idx) && score > scores[idx]) {
+      scores[idx] = score;
+    }
+  }
+
+  unsigned int ReachabilityMap::countReachable() const {
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < scores.size(); ++i) {
+      count += scores[i] > 0;
+    }
+    return count;
+  }
+
+  static void writeString(std::ofstream &out, const std::string &str) {
+    unsigned int len = str.size();
+    out.write((const char *)&len, sizeof(len));
+    out.write(str.data(), len);
+  }
+
+  static bool readString(std::ifstream &in, std::string &str) {
+    unsigned int len = 0;
+    in.read((char *)&len, sizeof(len));
+    if (!in || len > 4096) {
+      return false;
+    }
+    str.resize(len);
+    if (len > 0) {
+      in.read(&str[0], len);
+    }
+    return (bool)in;
+  }
+
+  /**
+   * save()
+   * Binary file: magic, the four names, resolution, origin, size, then the scores as floats
+   */
+  bool ReachabilityMap::save(const std::string &filename) const {
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out) {
+      return false;
+    }
+
+    out.write(MAP_MAGIC, sizeof(MAP_MAGIC));
+    writeString(out, robot);
+    writeString(out, group);
+    writeString(out, tip);
+    writeString(out, base);
+    out.write((const char *)&resolution, sizeof(resolution));
+    out.write((const char *)origin, sizeof(origin));
+    out.write((const char *)size, sizeof(size));
+    out.write((const char *)&scores[0], scores.size() * sizeof(float));
+
+    return (bool)out;
+  }
+
+  bool ReachabilityMap::load(const std::string &filename) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in) {
+      return false;
+    }
+
+    char magic[sizeof(MAP_MAGIC)];
+    in.read(magic, sizeof(magic));
+    if (!in || memcmp(magic, MAP_MAGIC, sizeof(MAP_MAGIC)) != 0) {
+      return false;
+    }
+
+    if (!readString(in, robot) || !readString(in, group) || !readString(in, tip) || !readString(in, base)) {
+      return false;
+    }
+    in.read((char *)&resolution, sizeof(resolution));
+    in.read((char *)origin, sizeof(origin));
+    in.read((char *)size, sizeof(size));
+    if (!in || resolution <= 0) {
+      return false;
+    }
+
+    scores.resize((size_t)size[0] * size[1] * size[2]);
+    in.read((char *)&scores[0], scores.size() * sizeof(float));
+
+    return (bool)in;
+  }
+
+  double manipulability(RobotState &state, const moveit::core::JointModelGroup *group, const moveit::core::LinkModel *tip) {
+    Eigen::MatrixXd jacobian;
+    if (!state.getJacobian(group, tip, Eigen::Vector3d::Zero(), jacobian)) {
+      return 0;
+    }
+
+    // only the translational rows, the map stores positions
+    Eigen::MatrixXd jv = jacobian.topRows(3);
+    double det = (jv * jv.transpose()).determinant();
+    return det > 0 ? sqrt(det) : 0;
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef _PP_REACHABILITY_MAP
+#define _PP_REACHABILITY_MAP
+
+// stl
+#include <vector>
+#include <string>
+
+// MoveIt!
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_model/joint_model_group.h>
+
+using robot_state::RobotState;
+
+namespace predicator_planning {
+
+  /**
+   * ReachabilityMap
+   * Voxel grid in the root link frame of a robot. Every voxel holds the best manipulability
+   * the tip link of a group reached inside it, 0 if it was never reached.
+   * Built offline by build_reachability_map and looked up in O(1).
+   */
+  struct ReachabilityMap {
+    std::string robot; // robot model name
+    std::string group; // joint model group that was sampled
+    std::string tip; // link whose position was recorded
+    std::string base; // root link, the frame of the grid
+
+    double resolution;
+    double origin[3]; // lower corner of the grid
+    unsigned int size[3]; // voxels per axis
+    std::vector<float> scores;
+
+    ReachabilityMap();
+
+    /**
+     * resize()
+     * Cover the box from min to max with empty voxels
+     */
+    void resize(const double *min, const double *max, double resolution);
+
+    /**
+     * index()
+     * Voxel of a point in the base frame, false if it is outside the grid
+     */
+    bool index(const Eigen::Vector3d &point, unsigned int &idx) const;
+
+    /**
+     * lookup()
+     * Score of the voxel of a point in the base frame, -1 if it is outside the grid
+     */
+    double lookup(const Eigen::Vector3d &point) const;
+
+    /**
+     * add()
+     * Record that the tip reached point with this score
+     */
+    void add(const Eigen::Vector3d &point, double score);
+
+    unsigned int countReachable() const;
+
+    bool save(const std::string &filename) const;
+    bool load(const std::string &filename);
+  };
+
+  /**
+   * manipulability()
+   * Yoshikawa manipulability of the translational part of the tip jacobian, sqrt(det(J J^T))
+   */
+  double manipulability(RobotState &state, const moveit::core::JointModelGroup *group, const moveit::core::LinkModel *tip);
+}
+
+#endif
@@ -2,6 +2,9 @@
 #define _PP_UTILITY
 
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <stdint.h>
 #include <predicator_msgs/PredicateStatement.h>
 #include <predicator_msgs/PredicateSet.h>
 #include <predicator_msgs/PredicateList.h>
@@ -25,8 +28,9 @@ namespace predicator_planning {
 
       size_t res = hash_str(msg.predicate);
 
+      // combine as in boost::hash_combine, shifted sums collide for permuted params
       for (unsigned int i = 0; i < msg.params.size(); ++i) {
-        res += hash_str(msg.params[i]) << (3*i);
+        res ^= hash_str(msg.params[i]) + 0x9e3779b9 + (res << 6) + (res >> 2);
       }
 
       return res;
@@ -44,6 +48,110 @@ namespace predicator_planning {
         msg1.params[2] == msg2.params[2];
     }
   };
+
+  // id of a string that was never interned
+  static const unsigned int NO_SYMBOL = ~0u;
+
+  /**
+   * PredicateKey
+   * Predicate name and parameters of a statement as interned ids.
+   * Keys are compared and hashed as four integers instead of four strings.
+   */
+  struct PredicateKey {
+    unsigned int predicate;
+    unsigned int params[3];
+
+    PredicateKey(unsigned int _predicate = NO_SYMBOL, unsigned int param1 = 0, unsigned int param2 = 0, unsigned int param3 = 0) :
+      predicate(_predicate)
+    {
+      params[0] = param1;
+      params[1] = param2;
+      params[2] = param3;
+    }
+
+    // false if one of the strings of the statement was never interned
+    bool valid() const {
+      return predicate != NO_SYMBOL &&
+        params[0] != NO_SYMBOL &&
+        params[1] != NO_SYMBOL &&
+        params[2] != NO_SYMBOL;
+    }
+
+    bool operator==(const PredicateKey &other) const {
+      return predicate == other.predicate &&
+        params[0] == other.params[0] &&
+        params[1] == other.params[1] &&
+        params[2] == other.params[2];
+    }
+  };
+
+  struct KeyHash {
+
+    // 64 bit finalizer from MurmurHash3
+    static inline uint64_t mix(uint64_t h) {
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      h ^= h >> 33;
+      return h;
+    }
+
+    size_t operator()(const PredicateKey &key) const {
+      uint64_t w1 = ((uint64_t)key.predicate << 32) | key.params[0];
+      uint64_t w2 = ((uint64_t)key.params[1] << 32) | key.params[2];
+      return (size_t)mix(w1 ^ mix(w2));
+    }
+  };
+
+  /**
+   * SymbolTable
+   * Maps predicate names and parameters to small integer ids and back.
+   * The empty string is always id 0.
+   */
+  struct SymbolTable {
+    unordered_map<string, unsigned int> ids;
+    std::vector<string> names;
+
+    SymbolTable() {
+      intern(string());
+    }
+
+    // id of name, adds it if it is new
+    unsigned int intern(const string &name) {
+      unordered_map<string, unsigned int>::const_iterator it = ids.find(name);
+      if (it != ids.end()) {
+        return it->second;
+      }
+      unsigned int id = names.size();
+      ids[name] = id;
+      names.push_back(name);
+      return id;
+    }
+
+    // id of name, NO_SYMBOL if it was never interned
+    unsigned int find(const string &name) const {
+      unordered_map<string, unsigned int>::const_iterator it = ids.find(name);
+      return it == ids.end() ? NO_SYMBOL : it->second;
+    }
+
+    const string &name(unsigned int id) const {
+      static const string unknown("?");
+      return id < names.size() ? names[id] : unknown;
+    }
+
+    PredicateKey intern(const PredicateStatement &msg) {
+      return PredicateKey(intern(msg.predicate), intern(msg.params[0]), intern(msg.params[1]), intern(msg.params[2]));
+    }
+
+    // does not add anything, the key is not valid() if a string is unknown
+    PredicateKey find(const PredicateStatement &msg) const {
+      return PredicateKey(find(msg.predicate), find(msg.params[0]), find(msg.params[1]), find(msg.params[2]));
+    }
+  };
+
+  typedef std::unordered_map<PredicateKey, unsigned int, KeyHash> heuristic_map_t;
+  typedef std::unordered_set<PredicateKey, KeyHash> key_set_t;
 }
 
 #endif
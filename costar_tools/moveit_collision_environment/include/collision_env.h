@@ -9,6 +9,8 @@
 #include <shape_msgs/Mesh.h>
 #include <moveit_msgs/CollisionObject.h>
 
+#include <map>
+
 // use detected object list instead of tf name convention
 #include <costar_objrec_msgs/DetectedObject.h>
 #include <costar_objrec_msgs/DetectedObjectList.h>
@@ -43,6 +45,28 @@ class collision_environment
         std::string definedParent;
         double tableSize, baseLinkWallDistance;
 
+        // decoded meshes keyed by object class, so every mesh file is only read once
+        std::map<std::string, shape_msgs::Mesh> meshCache;
+        double meshDecimationResolution; // vertex clustering cell size in meters, 0 keeps the full mesh
+        std::string collisionProxy; // preferred proxy generated by collision_proxy_generator: convex, hull or none
+        const shape_msgs::Mesh * getMesh(const std::string &objectClass);
+
+        // all object transforms share one deadline of tfTimeout seconds
+        double tfTimeout;
+        void resolveTransforms(const std::vector<std::string> &frames, const ros::Time &stamp,
+            std::vector<bool> &found, std::vector<geometry_msgs::Pose> &poses);
+
+        // shape and poses of the objects that are in the planning scene, to publish only what changed
+        struct publishedObject {
+            std::string shape, frame_id;
+            std::vector<geometry_msgs::Pose> poses;
+        };
+        std::map<std::string, publishedObject> publishedObjects;
+        // frame of every object id sent since the last resync, REMOVEs that may have been lost are sent again on resync
+        std::map<std::string, std::string> sentObjectFrames;
+        std::map<std::string, std::string> segmentedObjectShapes; // shape of each object in segmentedObjects
+        double poseChangeThreshold;
+
         bool getTable();
         void addSurroundingWalls(
         	moveit_msgs::CollisionObject &targetCollisionObject, const tf::Transform &centerOfObject,
@@ -62,7 +86,7 @@ class collision_environment
 		void updateCollisionObjects(const bool &updateFrame = true);
         std::vector<std::string> getListOfTF() const;
         const std::vector<moveit_msgs::CollisionObject> getCollisionObjects() const;
-        const std::vector<moveit_msgs::CollisionObject> generateOldObjectToRemove() const;
+        std::vector<moveit_msgs::CollisionObject> generateCollisionObjectDiff(const bool &fullResync = false);
 };
 
 std::vector<std::string> stringVectorSeparator (const std::string &input,
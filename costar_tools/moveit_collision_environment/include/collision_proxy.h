@@ -0,0 +1,34 @@
+#ifndef COLLISION_PROXY_H
+#define COLLISION_PROXY_H
+
+#include <string>
+#include <vector>
+
+// Simplified collision geometry that is generated offline from the object meshes.
+// Vertices are stored as (x,y,z,x,y,z,...) and triangles as (i,j,k,i,j,k,...), triangles are counter clockwise seen from outside.
+struct proxyMesh {
+    std::vector<double> vertices;
+    std::vector<unsigned int> triangles;
+
+    unsigned int vertexCount() const { return vertices.size() / 3; }
+    unsigned int triangleCount() const { return triangles.size() / 3; }
+    void append(const proxyMesh &other);
+};
+
+// Convex hull of a point set with at most maxTriangles triangles.
+// The farthest point outside the hull is always added first. When the budget stops the hull early,
+// its face planes are pushed out over the remaining points, so the result always contains every point.
+proxyMesh convexHull(const std::vector<double> &points, const unsigned int &maxTriangles);
+
+// Approximate convex decomposition of a mesh.
+// The most concave part is split in two along the longest axis of its bounding box until every part is within
+// concavityTolerance of its hull or there are maxParts parts. Returns the union of the part hulls,
+// which together have at most maxTriangles triangles.
+// Concavity is the largest distance from a triangle of the part to its hull along the triangle normal.
+proxyMesh convexDecomposition(const proxyMesh &mesh, const unsigned int &maxParts,
+    const double &concavityTolerance, const unsigned int &maxTriangles, unsigned int *numParts = NULL);
+
+// Writes the mesh as a binary STL file
+bool writeSTL(const std::string &fileName, const proxyMesh &mesh);
+
+#endif
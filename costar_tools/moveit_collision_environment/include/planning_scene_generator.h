@@ -29,6 +29,10 @@ private:
     ros::Subscriber getDetectedObject; 
     boost::mutex mtx; // for locking detectedObjectList
     costar_objrec_msgs::DetectedObjectList detectedObjectList;
+    // the diffs are not acknowledged, so every fullResyncInterval updates all objects are sent again (0 never)
+    int fullResyncInterval, updatesSinceResync;
+    void publishCollisionObjectDiff();
+    void sendSceneToNewSubscriber(const ros::SingleSubscriberPublisher &subscriber);
     ;
     
 public:
@@ -1,5 +1,6 @@
 #include "collision_env.h"
 #include <boost/filesystem.hpp>
+#include <cmath>
 
 std::vector<std::string> stringVectorSeparator (const std::string &input,
                                                 const std::string &charToFind, const bool &debug)
@@ -35,6 +36,89 @@ std::vector<std::string> stringVectorSeparator (const std::string &input,
     return result;
 }
 
+static void decimateMesh(shape_msgs::Mesh &mesh, const double &resolution)
+{
+    // Vertex clustering: all vertices inside the same grid cell are merged to their mean,
+    // triangles that collapse to a line or a point are dropped
+    typedef std::pair<long, std::pair<long, long> > cellKey;
+    std::map<cellKey, unsigned int> cells;
+    std::vector<unsigned int> remap(mesh.vertices.size());
+    std::vector<geometry_msgs::Point> vertices;
+    std::vector<unsigned int> count;
+
+    for (unsigned int i = 0; i < mesh.vertices.size(); i++) {
+        const geometry_msgs::Point &p = mesh.vertices.at(i);
+        cellKey key((long)floor(p.x / resolution), std::make_pair((long)floor(p.y / resolution), (long)floor(p.z / resolution)));
+        std::map<cellKey, unsigned int>::iterator it = cells.find(key);
+        if (it == cells.end()) {
+            it = cells.insert(std::make_pair(key, (unsigned int)vertices.size())).first;
+            vertices.push_back(geometry_msgs::Point());
+            count.push_back(0);
+        }
+        remap[i] = it->second;
+        vertices[it->second].x += p.x;
+        vertices[it->second].y += p.y;
+        vertices[it->second].z += p.z;
+        count[it->second]++;
+    }
+
+    for (unsigned int i = 0; i < vertices.size(); i++) {
+        vertices[i].x /= count[i];
+        vertices[i].y /= count[i];
+        vertices[i].z /= count[i];
+    }
+
+    std::vector<shape_msgs::MeshTriangle> triangles;
+    for (unsigned int i = 0; i < mesh.triangles.size(); i++) {
+        shape_msgs::MeshTriangle triangle;
+        for (unsigned int j = 0; j < 3; j++)
+            triangle.vertex_indices[j] = remap.at(mesh.triangles.at(i).vertex_indices[j]);
+
+        if (triangle.vertex_indices[0] == triangle.vertex_indices[1] ||
+            triangle.vertex_indices[1] == triangle.vertex_indices[2] ||
+            triangle.vertex_indices[0] == triangle.vertex_indices[2])
+            continue;
+        triangles.push_back(triangle);
+    }
+
+    mesh.vertices.swap(vertices);
+    mesh.triangles.swap(triangles);
+}
+
+static bool posesChanged(const std::vector<geometry_msgs::Pose> &oldPoses, const std::vector<geometry_msgs::Pose> &newPoses,
+    const double &threshold)
+{
+    // Returns true if any position or quaternion component moved more than threshold
+    if (oldPoses.size() != newPoses.size())
+        return true;
+
+    for (unsigned int i = 0; i < oldPoses.size(); i++) {
+        const geometry_msgs::Pose &a = oldPoses.at(i), &b = newPoses.at(i);
+        if (std::fabs(a.position.x - b.position.x) > threshold ||
+            std::fabs(a.position.y - b.position.y) > threshold ||
+            std::fabs(a.position.z - b.position.z) > threshold ||
+            std::fabs(a.orientation.x - b.orientation.x) > threshold ||
+            std::fabs(a.orientation.y - b.orientation.y) > threshold ||
+            std::fabs(a.orientation.z - b.orientation.z) > threshold ||
+            std::fabs(a.orientation.w - b.orientation.w) > threshold)
+            return true;
+    }
+    return false;
+}
+
+static std::string primitiveShape(const moveit_msgs::CollisionObject &co)
+{
+    // Text signature of the primitives of a collision object, used to tell whether its shape changed
+    std::stringstream ss;
+    for (unsigned int i = 0; i < co.primitives.size(); i++) {
+        ss << (int)co.primitives.at(i).type;
+        for (unsigned int j = 0; j < co.primitives.at(i).dimensions.size(); j++)
+            ss << " " << co.primitives.at(i).dimensions.at(j);
+        ss << ";";
+    }
+    return ss.str();
+}
+
 collision_environment::collision_environment()
 {
     // Basic collision environment constructor. Set the class as not ready if there is no node handle assigned to it
@@ -71,6 +155,11 @@ void collision_environment::setNodeHandle(const ros::NodeHandle &nh)
     nh.param("useBaseLinkWall",useBaseLinkWall,true);    
     nh.param("tableSize",tableSize,1.0);
     nh.param("baseLinkWallDistance",baseLinkWallDistance,1.0);
+
+    nh.param("meshDecimationResolution",meshDecimationResolution,0.0);
+    nh.param("collisionProxy",collisionProxy,std::string("convex"));
+    nh.param("tfTimeout",tfTimeout,1.0);
+    nh.param("poseChangeThreshold",poseChangeThreshold,0.001);
     
     if (defineParent) {
         nh.param("parentFrameName",definedParent,std::string("base_link"));
@@ -97,21 +186,26 @@ void collision_environment::updateCollisionObjects(const bool &updateFrame)
     
     // Remove all collision objects from cache
     segmentedObjects->clear();
+    segmentedObjectShapes.clear();
     
     bool updateTable;
     // Renew table param determine whether the table will be updated after it is detected for the first time
     nh.param("renewTable", updateTable, true);
     if (updateTable) {
         // update table and add it to list of collision objects
-        if (getTable())
+        if (getTable()) {
             segmentedObjects->push_back(this->tableObject);
+            segmentedObjectShapes[tableObject.id] = primitiveShape(tableObject);
+        }
     }
     else {
         // use previous table data if available. If it is not available, get new table
         if (!hasTableTF) getTable();
 
-        if (hasTableTF)
+        if (hasTableTF) {
             segmentedObjects->push_back(this->tableObject);
+            segmentedObjectShapes[tableObject.id] = primitiveShape(tableObject);
+        }
     }
         
     
@@ -135,27 +229,17 @@ void collision_environment::updateCollisionObjects(const bool &updateFrame)
         // name of collision object = TF name
         co.id = detectedObjectsTF.at(i).frame_id;
         co.header.frame_id = parentFrame;
-        std::stringstream file_location, ss;
-        // read the location of the mesh file
 
-        file_location << mesh_source << "/" << detectedObjectsTF.at(i).name << "." << file_extension;
-        if (!boost::filesystem::exists( file_location.str() ))
-        {
-            std::cerr << "Warning: Mesh file not found at: " << file_location.str() << std::endl;
+        // Get the moveit mesh of this object class
+        const shape_msgs::Mesh * co_mesh = getMesh(detectedObjectsTF.at(i).name);
+        if (co_mesh == NULL)
             continue;
-        }
-        ss << "file://" << file_location.str();
-        
-        // Generate moveit mesh from mesh file
-        shapes::Mesh * tmpMesh = shapes::createMeshFromResource(ss.str());
-        shape_msgs::Mesh co_mesh;
-        shapes::ShapeMsg co_mesh_msg;
-        shapes::constructMsgFromShape(tmpMesh,co_mesh_msg);
-        co_mesh = boost::get<shape_msgs::Mesh>(co_mesh_msg);
-        co.meshes.push_back(co_mesh);
+
+        co.meshes.push_back(*co_mesh);
         co.mesh_poses.push_back(detectedObjectsTF.at(i).pose);
         co.operation = co.ADD;
         segmentedObjects->push_back(co);
+        segmentedObjectShapes[co.id] = detectedObjectsTF.at(i).name;
     }
     
     if (debug) {
@@ -165,6 +249,102 @@ void collision_environment::updateCollisionObjects(const bool &updateFrame)
     }
 };
 
+const shape_msgs::Mesh * collision_environment::getMesh(const std::string &objectClass)
+{
+    // This function reads the mesh of an object class from mesh_source the first time it is needed,
+    // afterwards the decoded (and decimated) mesh comes from the cache
+    std::map<std::string, shape_msgs::Mesh>::const_iterator it = meshCache.find(objectClass);
+    if (it != meshCache.end())
+        return &it->second;
+
+    std::stringstream file_location, ss;
+    // prefer the simplified collision proxies stored next to the mesh
+    std::vector<std::string> proxies;
+    if (collisionProxy == "convex")
+        proxies.push_back("convex");
+    if (collisionProxy == "convex" || collisionProxy == "hull")
+        proxies.push_back("hull");
+    for (unsigned int i = 0; i < proxies.size() && file_location.str().empty(); i++) {
+        std::stringstream proxy_location;
+        proxy_location << mesh_source << "/" << objectClass << "." << proxies.at(i) << ".stl";
+        if (boost::filesystem::exists( proxy_location.str() ))
+            file_location << proxy_location.str();
+    }
+
+    // read the location of the mesh file
+    if (file_location.str().empty())
+        file_location << mesh_source << "/" << objectClass << "." << file_extension;
+    if (!boost::filesystem::exists( file_location.str() ))
+    {
+        std::cerr << "Warning: Mesh file not found at: " << file_location.str() << std::endl;
+        return NULL;
+    }
+    if (debug)
+        std::cerr << "Mesh of " << objectClass << ": " << file_location.str() << std::endl;
+    ss << "file://" << file_location.str();
+
+    // Generate moveit mesh from mesh file
+    shapes::Mesh * tmpMesh = shapes::createMeshFromResource(ss.str());
+    if (tmpMesh == NULL)
+    {
+        std::cerr << "Warning: Fail to load mesh file: " << file_location.str() << std::endl;
+        return NULL;
+    }
+    shapes::ShapeMsg co_mesh_msg;
+    shapes::constructMsgFromShape(tmpMesh,co_mesh_msg);
+    delete tmpMesh;
+
+    shape_msgs::Mesh &co_mesh = meshCache[objectClass];
+    co_mesh = boost::get<shape_msgs::Mesh>(co_mesh_msg);
+    if (meshDecimationResolution > 0)
+    {
+        std::size_t numTriangles = co_mesh.triangles.size();
+        decimateMesh(co_mesh, meshDecimationResolution);
+        if (debug)
+            std::cerr << "Decimated mesh of " << objectClass << " from " << numTriangles << " to " << co_mesh.triangles.size() << " triangles\n";
+    }
+    return &co_mesh;
+}
+
+void collision_environment::resolveTransforms(const std::vector<std::string> &frames, const ros::Time &stamp,
+    std::vector<bool> &found, std::vector<geometry_msgs::Pose> &poses)
+{
+    // This function gets the transforms of all frames to the parentFrame.
+    // All missing frames are polled together in rounds until one shared deadline, so a missing frame
+    // cannot use up the time of the others. Every frame is checked once more after the deadline.
+    found.assign(frames.size(), false);
+    poses.resize(frames.size());
+    ros::Time deadline = ros::Time::now() + ros::Duration(tfTimeout);
+
+    while (true) {
+        unsigned int missing = 0;
+        for (unsigned int i = 0; i < frames.size(); i++) {
+            if (found.at(i))
+                continue;
+
+            if (!listener.canTransform(frames.at(i),parentFrame,stamp)) {
+                missing++;
+                continue;
+            }
+
+            try {
+                tf::StampedTransform transform;
+                listener.lookupTransform(parentFrame,frames.at(i),ros::Time(0),transform);
+                tf::poseTFToMsg(transform,poses.at(i));
+                found.at(i) = true;
+            }
+            catch (tf::TransformException &ex) {
+                std::cerr << "Fail to look up: " << frames.at(i) << ": " << ex.what() << std::endl;
+            }
+        }
+
+        if (missing == 0 || ros::Time::now() >= deadline)
+            break;
+        // the listener fills its buffer on its own thread
+        ros::Duration(0.01).sleep();
+    }
+}
+
 void collision_environment::getAllObjectTFfromDetectedObjectMsgs(const costar_objrec_msgs::DetectedObjectList &detectedObjectList)
 {
     std::cerr << "Number of detected objects: " << detectedObjectList.objects.size() << std::endl;
@@ -186,21 +366,27 @@ void collision_environment::getAllObjectTFfromDetectedObjectMsgs(const costar_ob
         hasParent = true;
     }
 
-    // get and save the TF name and pose in the class variable
+    // get all object transforms at once
+    std::vector<std::string> frames;
+    for (unsigned int i = 0; i < detectedObjectList.objects.size(); i++)
+        frames.push_back(detectedObjectList.objects.at(i).id);
+
+    std::vector<bool> found;
+    std::vector<geometry_msgs::Pose> poses;
+    resolveTransforms(frames, now, found, poses);
+
+    // save the TF name and pose in the class variable
     for (unsigned int i = 0; i < detectedObjectList.objects.size(); i++) {
-        std::string currentObjectFrameId = detectedObjectList.objects.at(i).id;
-        if (listener.waitForTransform(currentObjectFrameId,parentFrame,now,ros::Duration(1.0)))
+        if (found.at(i))
         {
             objectTF detectedObject;
             detectedObject.name = detectedObjectList.objects.at(i).object_class;
-            detectedObject.frame_id = currentObjectFrameId;
+            detectedObject.frame_id = frames.at(i);
+            detectedObject.pose = poses.at(i);
             listOfTF.push_back(detectedObject.frame_id);
-            tf::StampedTransform transform;
-            listener.lookupTransform(parentFrame,currentObjectFrameId,ros::Time(0),transform);
-            tf::poseTFToMsg(transform,detectedObject.pose);
             detectedObjectsTF.push_back(detectedObject);
         }
-        else std::cerr << "Fail to get: " << currentObjectFrameId << " transform to " << parentFrame << std::endl;
+        else std::cerr << "Fail to get: " << frames.at(i) << " transform to " << parentFrame << std::endl;
     }
     
     // update the list of TF to contain only newest set of object TF frames
@@ -272,7 +458,8 @@ void collision_environment::getAllObjectTF()
         return;
     }
 
-    // get and save the TF name and pose in the class variable
+    // collect the object TF names
+    std::vector<std::string> frames, names;
     for (unsigned int i = 0; i < listOfTF.size(); i++) {
 
         // if the beginning character of TF is not the same character as object tf signature, skip it
@@ -285,19 +472,27 @@ void collision_environment::getAllObjectTF()
         std::vector<std::string> tmp = stringVectorSeparator(listOfTF.at(i), charToFind, debug);
         if (tmp.size() > objectNameFormatIndex)
         {
-            if (listener.waitForTransform(listOfTF.at(i),parentFrame,now,ros::Duration(0.5)))
-            {
-                objectTF detectedObject;
-                detectedObject.name = tmp.at(objectNameFormatIndex-1);
-                detectedObject.frame_id = listOfTF.at(i);
-                newestListOfTF.push_back(detectedObject.frame_id);
-                tf::StampedTransform transform;
-                listener.lookupTransform(parentFrame,listOfTF.at(i),ros::Time(0),transform);
-                tf::poseTFToMsg(transform,detectedObject.pose);
-                detectedObjectsTF.push_back(detectedObject);
-            }
+            frames.push_back(listOfTF.at(i));
+            names.push_back(tmp.at(objectNameFormatIndex-1));
         }
 	}
+
+    // get all object transforms at once and save the TF name and pose in the class variable
+    std::vector<bool> found;
+    std::vector<geometry_msgs::Pose> poses;
+    resolveTransforms(frames, now, found, poses);
+
+    for (unsigned int i = 0; i < frames.size(); i++) {
+        if (found.at(i))
+        {
+            objectTF detectedObject;
+            detectedObject.name = names.at(i);
+            detectedObject.frame_id = frames.at(i);
+            detectedObject.pose = poses.at(i);
+            newestListOfTF.push_back(detectedObject.frame_id);
+            detectedObjectsTF.push_back(detectedObject);
+        }
+    }
     
     // update the list of TF to contain only newest set of object TF frames
     listOfTF = newestListOfTF;
@@ -310,18 +505,74 @@ void collision_environment::getAllObjectTF()
     }
 };
 
-const std::vector<moveit_msgs::CollisionObject> collision_environment::generateOldObjectToRemove() const
+std::vector<moveit_msgs::CollisionObject> collision_environment::generateCollisionObjectDiff(const bool &fullResync)
 {
-    // This function will generate list of collision objects generated from prior iteration
-    std::vector<moveit_msgs::CollisionObject> objectsToRemove;
+    // This function compares the current collision objects with the ones already sent to the planning scene.
+    // New objects and objects with another shape are added, objects that only moved get a MOVE without their meshes,
+    // unchanged objects are skipped and objects that disappeared are removed.
+    // With fullResync every object is added again and every id sent since the last resync that is gone is removed again,
+    // which repairs the planning scene after a lost diff.
+    std::vector<moveit_msgs::CollisionObject> diff;
+    if (!classReady)
+        return diff;
+
+    std::map<std::string, publishedObject> current;
+    unsigned int numAdded = 0, numMoved = 0, numRemoved = 0;
+
     for (unsigned int i = 0; i < segmentedObjects->size(); i++) {
+        const moveit_msgs::CollisionObject &co = segmentedObjects->at(i);
+        publishedObject &object = current[co.id];
+        object.shape = segmentedObjectShapes[co.id];
+        object.frame_id = co.header.frame_id;
+        object.poses = co.mesh_poses;
+        object.poses.insert(object.poses.end(), co.primitive_poses.begin(), co.primitive_poses.end());
+
+        std::map<std::string, publishedObject>::const_iterator old = publishedObjects.find(co.id);
+        bool sameShape = old != publishedObjects.end() && old->second.shape == object.shape
+            && old->second.frame_id == object.frame_id && old->second.poses.size() == object.poses.size();
+
+        if (fullResync || !sameShape) {
+            diff.push_back(co);
+            numAdded++;
+        }
+        else if (posesChanged(old->second.poses, object.poses, poseChangeThreshold)) {
+            moveit_msgs::CollisionObject moved;
+            moved.id = co.id;
+            moved.header.frame_id = co.header.frame_id;
+            moved.mesh_poses = co.mesh_poses;
+            moved.primitive_poses = co.primitive_poses;
+            moved.operation = moved.MOVE;
+            diff.push_back(moved);
+            numMoved++;
+        }
+        else
+            // keep the published poses so small changes cannot add up without being sent
+            object.poses = old->second.poses;
+    }
+
+    for (std::map<std::string, std::string>::const_iterator it = sentObjectFrames.begin(); it != sentObjectFrames.end(); ++it) {
+        if (current.find(it->first) != current.end())
+            continue;
+        // without a resync only the objects of the last update are removed
+        if (!fullResync && publishedObjects.find(it->first) == publishedObjects.end())
+            continue;
         moveit_msgs::CollisionObject co;
-        co.id = segmentedObjects->at(i).id;
-        co.header.frame_id = segmentedObjects->at(i).header.frame_id;
+        co.id = it->first;
+        co.header.frame_id = it->second;
         co.operation = co.REMOVE;
-        objectsToRemove.push_back(co);
+        diff.push_back(co);
+        numRemoved++;
     }
-    return objectsToRemove;
+
+    if (fullResync)
+        sentObjectFrames.clear();
+    for (std::map<std::string, publishedObject>::const_iterator it = current.begin(); it != current.end(); ++it)
+        sentObjectFrames[it->first] = it->second.frame_id;
+    publishedObjects.swap(current);
+
+    if (debug)
+        std::cerr << (fullResync ? "Collision object resync: " : "Collision object diff: ") << numAdded << " added, " << numMoved << " moved, " << numRemoved << " removed\n";
+    return diff;
 }
 
 const std::vector<moveit_msgs::CollisionObject> collision_environment::getCollisionObjects() const
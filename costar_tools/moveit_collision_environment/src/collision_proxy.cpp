@@ -0,0 +1,498 @@
+#include "collision_proxy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <set>
+#include <stdint.h>
+
+namespace {
+    struct vec3 {
+        double x, y, z;
+        vec3() : x(0), y(0), z(0) {}
+        vec3(double _x, double _y, double _z) : x(_x), y(_y), z(_z) {}
+        vec3 operator-(const vec3 &o) const { return vec3(x - o.x, y - o.y, z - o.z); }
+        double dot(const vec3 &o) const { return x * o.x + y * o.y + z * o.z; }
+        vec3 cross(const vec3 &o) const { return vec3(y * o.z - z * o.y, z * o.x - x * o.z, x * o.y - y * o.x); }
+        double norm() const { return std::sqrt(dot(*this)); }
+    };
+
+    struct hullFace {
+        unsigned int v[3];
+        vec3 normal;
+        double offset; // plane is normal.p = offset
+        std::vector<unsigned int> outside; // points in front of this face
+        unsigned int farthest; // outside point with the largest distance
+        double farthestDistance;
+        bool alive;
+    };
+
+    inline vec3 pointAt(const std::vector<double> &points, const unsigned int &i)
+    {
+        return vec3(points[3 * i], points[3 * i + 1], points[3 * i + 2]);
+    }
+
+    hullFace makeFace(const std::vector<double> &points, const unsigned int &a, const unsigned int &b, const unsigned int &c)
+    {
+        hullFace face;
+        face.v[0] = a;
+        face.v[1] = b;
+        face.v[2] = c;
+        vec3 pa = pointAt(points, a);
+        vec3 n = (pointAt(points, b) - pa).cross(pointAt(points, c) - pa);
+        double length = n.norm();
+        if (length > 0)
+            n = vec3(n.x / length, n.y / length, n.z / length);
+        face.normal = n;
+        face.offset = n.dot(pa);
+        face.farthestDistance = 0;
+        face.alive = true;
+        return face;
+    }
+
+    inline double faceDistance(const hullFace &face, const vec3 &p)
+    {
+        return face.normal.dot(p) - face.offset;
+    }
+
+    void assignOutside(const std::vector<double> &points, std::vector<hullFace> &faces,
+        const std::vector<unsigned int> &candidates, const unsigned int &firstFace, const double &eps)
+    {
+        // every point goes to the face it is farthest in front of, points behind all faces are inside
+        for (unsigned int i = 0; i < candidates.size(); i++) {
+            vec3 p = pointAt(points, candidates[i]);
+            double best = eps;
+            int bestFace = -1;
+            for (unsigned int f = firstFace; f < faces.size(); f++) {
+                if (!faces[f].alive)
+                    continue;
+                double d = faceDistance(faces[f], p);
+                if (d > best) {
+                    best = d;
+                    bestFace = f;
+                }
+            }
+            if (bestFace < 0)
+                continue;
+            hullFace &face = faces[bestFace];
+            face.outside.push_back(candidates[i]);
+            if (best > face.farthestDistance) {
+                face.farthestDistance = best;
+                face.farthest = candidates[i];
+            }
+        }
+    }
+}
+
+void proxyMesh::append(const proxyMesh &other)
+{
+    unsigned int first = vertexCount();
+    vertices.insert(vertices.end(), other.vertices.begin(), other.vertices.end());
+    for (unsigned int i = 0; i < other.triangles.size(); i++)
+        triangles.push_back(first + other.triangles[i]);
+}
+
+namespace {
+    // quickhull that stops at maxTriangles, leaving the points beyond the last faces outside
+    proxyMesh budgetedHull(const std::vector<double> &points, const unsigned int &maxTriangles)
+    {
+        proxyMesh hull;
+        const unsigned int n = points.size() / 3;
+        if (n < 4 || maxTriangles < 4)
+            return hull;
+
+        // tolerance relative to the size of the point set
+        vec3 lo = pointAt(points, 0), hi = lo;
+        for (unsigned int i = 1; i < n; i++) {
+            vec3 p = pointAt(points, i);
+            lo = vec3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+            hi = vec3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+        }
+        const double eps = 1e-9 * std::max((hi - lo).norm(), 1e-12);
+
+        // initial simplex: two extreme points, the farthest point from their line, the farthest point from their plane
+        unsigned int extremes[6] = {0, 0, 0, 0, 0, 0};
+        for (unsigned int i = 1; i < n; i++) {
+            for (unsigned int k = 0; k < 3; k++) {
+                if (points[3 * i + k] < points[3 * extremes[2 * k] + k]) extremes[2 * k] = i;
+                if (points[3 * i + k] > points[3 * extremes[2 * k + 1] + k]) extremes[2 * k + 1] = i;
+            }
+        }
+        unsigned int i0 = extremes[0], i1 = extremes[1];
+        double best = -1;
+        for (unsigned int a = 0; a < 6; a++) {
+            for (unsigned int b = a + 1; b < 6; b++) {
+                double d = (pointAt(points, extremes[a]) - pointAt(points, extremes[b])).norm();
+                if (d > best) {
+                    best = d;
+                    i0 = extremes[a];
+                    i1 = extremes[b];
+                }
+            }
+        }
+        if (best <= eps)
+            return hull;
+
+        vec3 p0 = pointAt(points, i0), axis = pointAt(points, i1) - p0;
+        unsigned int i2 = i0;
+        best = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            double d = axis.cross(pointAt(points, i) - p0).norm();
+            if (d > best) {
+                best = d;
+                i2 = i;
+            }
+        }
+        if (best <= eps * axis.norm())
+            return hull;
+
+        vec3 planeNormal = axis.cross(pointAt(points, i2) - p0);
+        double planeLength = planeNormal.norm();
+        unsigned int i3 = i0;
+        best = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            double d = std::fabs(planeNormal.dot(pointAt(points, i) - p0)) / planeLength;
+            if (d > best) {
+                best = d;
+                i3 = i;
+            }
+        }
+        if (best <= eps)
+            return hull;
+
+        std::vector<hullFace> faces;
+        const unsigned int simplex[4][4] = {{i0, i1, i2, i3}, {i0, i3, i1, i2}, {i1, i3, i2, i0}, {i2, i3, i0, i1}};
+        for (unsigned int f = 0; f < 4; f++) {
+            hullFace face = makeFace(points, simplex[f][0], simplex[f][1], simplex[f][2]);
+            // the opposite corner has to be behind the face
+            if (faceDistance(face, pointAt(points, simplex[f][3])) > 0)
+                face = makeFace(points, simplex[f][0], simplex[f][2], simplex[f][1]);
+            faces.push_back(face);
+        }
+
+        std::vector<unsigned int> candidates;
+        for (unsigned int i = 0; i < n; i++)
+            if (i != i0 && i != i1 && i != i2 && i != i3)
+                candidates.push_back(i);
+        assignOutside(points, faces, candidates, 0, eps);
+
+        unsigned int numAlive = 4;
+        while (true) {
+            // the farthest outside point of all faces
+            int top = -1;
+            for (unsigned int f = 0; f < faces.size(); f++)
+                if (faces[f].alive && !faces[f].outside.empty() && (top < 0 || faces[f].farthestDistance > faces[top].farthestDistance))
+                    top = f;
+            if (top < 0)
+                break;
+
+            const unsigned int apex = faces[top].farthest;
+            const vec3 p = pointAt(points, apex);
+
+            // faces that see the point and the edges on the border of that region
+            std::vector<unsigned int> visible;
+            std::set<std::pair<unsigned int, unsigned int> > edges;
+            for (unsigned int f = 0; f < faces.size(); f++) {
+                if (faces[f].alive && faceDistance(faces[f], p) > eps) {
+                    visible.push_back(f);
+                    for (unsigned int k = 0; k < 3; k++)
+                        edges.insert(std::make_pair(faces[f].v[k], faces[f].v[(k + 1) % 3]));
+                }
+            }
+            std::vector<std::pair<unsigned int, unsigned int> > horizon;
+            for (std::set<std::pair<unsigned int, unsigned int> >::const_iterator it = edges.begin(); it != edges.end(); ++it)
+                if (edges.find(std::make_pair(it->second, it->first)) == edges.end())
+                    horizon.push_back(*it);
+
+            if (numAlive - visible.size() + horizon.size() > maxTriangles)
+                break;
+
+            candidates.clear();
+            for (unsigned int i = 0; i < visible.size(); i++) {
+                hullFace &face = faces[visible[i]];
+                face.alive = false;
+                for (unsigned int j = 0; j < face.outside.size(); j++)
+                    if (face.outside[j] != apex)
+                        candidates.push_back(face.outside[j]);
+                std::vector<unsigned int>().swap(face.outside);
+            }
+
+            const unsigned int firstFace = faces.size();
+            for (unsigned int i = 0; i < horizon.size(); i++)
+                faces.push_back(makeFace(points, horizon[i].first, horizon[i].second, apex));
+            numAlive = numAlive - visible.size() + horizon.size();
+
+            assignOutside(points, faces, candidates, firstFace, eps);
+        }
+
+        // compact the used vertices
+        std::map<unsigned int, unsigned int> used;
+        for (unsigned int f = 0; f < faces.size(); f++) {
+            if (!faces[f].alive)
+                continue;
+            for (unsigned int k = 0; k < 3; k++) {
+                std::map<unsigned int, unsigned int>::iterator it = used.find(faces[f].v[k]);
+                if (it == used.end()) {
+                    it = used.insert(std::make_pair(faces[f].v[k], hull.vertexCount())).first;
+                    hull.vertices.push_back(points[3 * faces[f].v[k]]);
+                    hull.vertices.push_back(points[3 * faces[f].v[k] + 1]);
+                    hull.vertices.push_back(points[3 * faces[f].v[k] + 2]);
+                }
+                hull.triangles.push_back(it->second);
+            }
+        }
+        return hull;
+    }
+
+    // Pushes every face plane of hull out to the farthest point in front of it and returns the polytope
+    // bounded by the moved planes, which contains all points. The vertices of that polytope are found
+    // through the polar dual around an interior point: each dual hull triangle is one primal vertex.
+    proxyMesh enclosingHull(const std::vector<double> &points, const proxyMesh &hull)
+    {
+        const unsigned int n = points.size() / 3;
+        const unsigned int numFaces = hull.triangleCount();
+
+        vec3 lo = pointAt(points, 0), hi = lo, center;
+        for (unsigned int i = 1; i < n; i++) {
+            vec3 p = pointAt(points, i);
+            lo = vec3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+            hi = vec3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+        }
+        const double eps = 1e-9 * std::max((hi - lo).norm(), 1e-12);
+
+        for (unsigned int i = 0; i < hull.vertexCount(); i++) {
+            vec3 p = pointAt(hull.vertices, i);
+            center = vec3(center.x + p.x, center.y + p.y, center.z + p.z);
+        }
+        center = vec3(center.x / hull.vertexCount(), center.y / hull.vertexCount(), center.z / hull.vertexCount());
+
+        std::vector<hullFace> faces(numFaces);
+        bool complete = true;
+        for (unsigned int f = 0; f < numFaces; f++) {
+            faces[f] = makeFace(hull.vertices, hull.triangles[3 * f], hull.triangles[3 * f + 1], hull.triangles[3 * f + 2]);
+            double residual = 0;
+            for (unsigned int i = 0; i < n; i++)
+                residual = std::max(residual, faceDistance(faces[f], pointAt(points, i)));
+            if (residual > eps) {
+                faces[f].offset += residual;
+                complete = false;
+            }
+        }
+        if (complete)
+            return hull;
+
+        // dual point of the plane n.x = offset is n / (offset - n.center)
+        std::vector<double> dual(3 * numFaces);
+        for (unsigned int f = 0; f < numFaces; f++) {
+            double h = faces[f].offset - faces[f].normal.dot(center);
+            if (h <= eps)
+                return proxyMesh();
+            dual[3 * f] = faces[f].normal.x / h;
+            dual[3 * f + 1] = faces[f].normal.y / h;
+            dual[3 * f + 2] = faces[f].normal.z / h;
+        }
+        proxyMesh dualHull = budgetedHull(dual, std::numeric_limits<unsigned int>::max());
+
+        // the dual triangle m.q = e is the primal vertex center + m / e
+        std::vector<double> corners;
+        for (unsigned int t = 0; t < dualHull.triangleCount(); t++) {
+            hullFace face = makeFace(dualHull.vertices, dualHull.triangles[3 * t], dualHull.triangles[3 * t + 1], dualHull.triangles[3 * t + 2]);
+            if (face.offset <= 0)
+                continue;
+            corners.push_back(center.x + face.normal.x / face.offset);
+            corners.push_back(center.y + face.normal.y / face.offset);
+            corners.push_back(center.z + face.normal.z / face.offset);
+        }
+        return budgetedHull(corners, std::numeric_limits<unsigned int>::max());
+    }
+}
+
+proxyMesh convexHull(const std::vector<double> &points, const unsigned int &maxTriangles)
+{
+    // pushing the planes out can add vertices, the budget of the inner hull shrinks until the result fits
+    unsigned int budget = maxTriangles;
+    while (true) {
+        proxyMesh hull = budgetedHull(points, budget);
+        if (hull.triangleCount() == 0)
+            return hull;
+        proxyMesh enclosing = enclosingHull(points, hull);
+        if (enclosing.triangleCount() <= maxTriangles || budget <= 4)
+            return enclosing;
+        budget = std::max(4u, std::min(budget - 1, (unsigned int)((double)budget * maxTriangles / enclosing.triangleCount())));
+    }
+}
+
+namespace {
+    struct meshPart {
+        std::vector<unsigned int> triangles; // triangles of the source mesh
+        std::vector<double> points; // their vertices
+        proxyMesh hull;
+        double concavity;
+        bool final;
+    };
+
+    void evaluatePart(const proxyMesh &mesh, meshPart &part)
+    {
+        std::set<unsigned int> indices;
+        for (unsigned int i = 0; i < part.triangles.size(); i++)
+            for (unsigned int k = 0; k < 3; k++)
+                indices.insert(mesh.triangles[3 * part.triangles[i] + k]);
+
+        part.points.clear();
+        for (std::set<unsigned int>::const_iterator it = indices.begin(); it != indices.end(); ++it)
+            part.points.insert(part.points.end(), mesh.vertices.begin() + 3 * (*it), mesh.vertices.begin() + 3 * (*it) + 3);
+
+        part.hull = convexHull(part.points, std::numeric_limits<unsigned int>::max());
+        part.concavity = 0;
+        part.final = part.hull.triangleCount() == 0;
+        if (part.final)
+            return;
+
+        std::vector<hullFace> faces;
+        for (unsigned int f = 0; f < part.hull.triangleCount(); f++)
+            faces.push_back(makeFace(part.hull.vertices, part.hull.triangles[3 * f], part.hull.triangles[3 * f + 1], part.hull.triangles[3 * f + 2]));
+
+        // distance from every triangle to the hull along its outward normal,
+        // triangles on the hull surface have 0 and triangles in a cavity face the opposite side
+        for (unsigned int i = 0; i < part.triangles.size(); i++) {
+            vec3 p[3];
+            for (unsigned int k = 0; k < 3; k++)
+                p[k] = pointAt(mesh.vertices, mesh.triangles[3 * part.triangles[i] + k]);
+            vec3 normal = (p[1] - p[0]).cross(p[2] - p[0]);
+            double length = normal.norm();
+            if (length <= 0)
+                continue;
+            normal = vec3(normal.x / length, normal.y / length, normal.z / length);
+            vec3 center((p[0].x + p[1].x + p[2].x) / 3, (p[0].y + p[1].y + p[2].y) / 3, (p[0].z + p[1].z + p[2].z) / 3);
+
+            double depth = std::numeric_limits<double>::max();
+            for (unsigned int f = 0; f < faces.size(); f++) {
+                double cosine = faces[f].normal.dot(normal);
+                if (cosine > 1e-9)
+                    depth = std::min(depth, std::max(0.0, -faceDistance(faces[f], center)) / cosine);
+            }
+            if (depth < std::numeric_limits<double>::max())
+                part.concavity = std::max(part.concavity, depth);
+        }
+    }
+
+    bool splitPart(const proxyMesh &mesh, const meshPart &part, meshPart &first, meshPart &second)
+    {
+        // split the triangles by their centroids at the mean along the longest axis
+        std::vector<vec3> centroids;
+        vec3 lo(std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max());
+        vec3 hi(-lo.x, -lo.y, -lo.z);
+        vec3 mean;
+        for (unsigned int i = 0; i < part.triangles.size(); i++) {
+            vec3 c;
+            for (unsigned int k = 0; k < 3; k++) {
+                vec3 p = pointAt(mesh.vertices, mesh.triangles[3 * part.triangles[i] + k]);
+                c = vec3(c.x + p.x / 3, c.y + p.y / 3, c.z + p.z / 3);
+            }
+            centroids.push_back(c);
+            lo = vec3(std::min(lo.x, c.x), std::min(lo.y, c.y), std::min(lo.z, c.z));
+            hi = vec3(std::max(hi.x, c.x), std::max(hi.y, c.y), std::max(hi.z, c.z));
+            mean = vec3(mean.x + c.x, mean.y + c.y, mean.z + c.z);
+        }
+        if (centroids.empty())
+            return false;
+        mean = vec3(mean.x / centroids.size(), mean.y / centroids.size(), mean.z / centroids.size());
+
+        vec3 extent = hi - lo;
+        unsigned int axis = 0;
+        if (extent.y > extent.x && extent.y >= extent.z) axis = 1;
+        else if (extent.z > extent.x && extent.z > extent.y) axis = 2;
+
+        const double split = axis == 0 ? mean.x : (axis == 1 ? mean.y : mean.z);
+        first.triangles.clear();
+        second.triangles.clear();
+        for (unsigned int i = 0; i < centroids.size(); i++) {
+            double value = axis == 0 ? centroids[i].x : (axis == 1 ? centroids[i].y : centroids[i].z);
+            if (value < split)
+                first.triangles.push_back(part.triangles[i]);
+            else
+                second.triangles.push_back(part.triangles[i]);
+        }
+        return !first.triangles.empty() && !second.triangles.empty();
+    }
+}
+
+proxyMesh convexDecomposition(const proxyMesh &mesh, const unsigned int &maxParts,
+    const double &concavityTolerance, const unsigned int &maxTriangles, unsigned int *numParts)
+{
+    std::vector<meshPart> parts(1);
+    for (unsigned int i = 0; i < mesh.triangleCount(); i++)
+        parts[0].triangles.push_back(i);
+    evaluatePart(mesh, parts[0]);
+
+    while (parts.size() < maxParts) {
+        // the most concave part that can still be split
+        int worst = -1;
+        for (unsigned int i = 0; i < parts.size(); i++)
+            if (!parts[i].final && parts[i].concavity > concavityTolerance && (worst < 0 || parts[i].concavity > parts[worst].concavity))
+                worst = i;
+        if (worst < 0)
+            break;
+
+        meshPart first, second;
+        if (!splitPart(mesh, parts[worst], first, second)) {
+            parts[worst].final = true;
+            continue;
+        }
+        evaluatePart(mesh, first);
+        evaluatePart(mesh, second);
+        parts[worst] = first;
+        parts.push_back(second);
+    }
+
+    // share the triangle budget between the parts
+    proxyMesh result;
+    const unsigned int budget = std::max(4u, maxTriangles / (unsigned int)parts.size());
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < parts.size(); i++) {
+        if (parts[i].hull.triangleCount() == 0)
+            continue;
+        if (parts[i].hull.triangleCount() > budget)
+            result.append(convexHull(parts[i].points, budget));
+        else
+            result.append(parts[i].hull);
+        count++;
+    }
+
+    if (numParts)
+        *numParts = count;
+    return result;
+}
+
+bool writeSTL(const std::string &fileName, const proxyMesh &mesh)
+{
+    std::ofstream out(fileName.c_str(), std::ios::binary);
+    if (!out)
+        return false;
+
+    char header[80] = "collision proxy";
+    out.write(header, 80);
+    uint32_t count = mesh.triangleCount();
+    out.write((const char *)&count, 4);
+
+    for (unsigned int f = 0; f < mesh.triangleCount(); f++) {
+        vec3 p[3];
+        for (unsigned int k = 0; k < 3; k++)
+            p[k] = pointAt(mesh.vertices, mesh.triangles[3 * f + k]);
+        vec3 n = (p[1] - p[0]).cross(p[2] - p[0]);
+        double length = n.norm();
+        if (length > 0)
+            n = vec3(n.x / length, n.y / length, n.z / length);
+
+        float values[12] = {(float)n.x, (float)n.y, (float)n.z,
+            (float)p[0].x, (float)p[0].y, (float)p[0].z,
+            (float)p[1].x, (float)p[1].y, (float)p[1].z,
+            (float)p[2].x, (float)p[2].y, (float)p[2].z};
+        out.write((const char *)values, sizeof(values));
+        uint16_t attributes = 0;
+        out.write((const char *)&attributes, 2);
+    }
+    return out.good();
+}
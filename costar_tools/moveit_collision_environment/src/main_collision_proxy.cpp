@@ -0,0 +1,78 @@
+#include <ros/ros.h>
+#include <geometric_shapes/mesh_operations.h>
+#include <boost/filesystem.hpp>
+
+#include "collision_proxy.h"
+
+// Offline tool: generates the simplified collision proxies for every mesh in mesh_source.
+// For an object mesh <name>.<file_extension> it writes
+//   <name>.hull.stl   : convex hull with at most hullTriangles triangles
+//   <name>.convex.stl : approximate convex decomposition with at most convexParts parts and convexTriangles triangles
+// collision_environment uses these files instead of the full mesh when they are present.
+int main(int argc, char** argv)
+{
+    ros::init(argc,argv, "collision_proxy_generator");
+    ros::NodeHandle nh ("~");
+
+    std::string mesh_source, file_extension;
+    int hullTriangles, convexParts, convexTriangles;
+    double concavityTolerance;
+    nh.param("mesh_source", mesh_source,std::string("data/mesh"));
+    nh.param("file_extension",file_extension,std::string("stl"));
+    nh.param("hullTriangles",hullTriangles,200);
+    nh.param("convexParts",convexParts,16);
+    nh.param("convexTriangles",convexTriangles,1000);
+    nh.param("concavityTolerance",concavityTolerance,0.005);
+
+    if (!boost::filesystem::is_directory(mesh_source))
+    {
+        std::cerr << "ERROR, mesh_source is not a directory: " << mesh_source << std::endl;
+        return 1;
+    }
+
+    boost::filesystem::directory_iterator end;
+    for (boost::filesystem::directory_iterator it(mesh_source); it != end; ++it)
+    {
+        boost::filesystem::path file = it->path();
+        if (!boost::filesystem::is_regular_file(file) || file.extension().string() != "." + file_extension)
+            continue;
+
+        // skip the proxies themselves
+        std::string name = file.stem().string();
+        if (boost::filesystem::path(name).extension().string() == ".hull" || boost::filesystem::path(name).extension().string() == ".convex")
+            continue;
+
+        shapes::Mesh * tmpMesh = shapes::createMeshFromResource("file://" + boost::filesystem::absolute(file).string());
+        if (tmpMesh == NULL)
+        {
+            std::cerr << "Warning: Fail to load mesh file: " << file.string() << std::endl;
+            continue;
+        }
+
+        proxyMesh mesh;
+        mesh.vertices.assign(tmpMesh->vertices, tmpMesh->vertices + 3 * tmpMesh->vertex_count);
+        mesh.triangles.assign(tmpMesh->triangles, tmpMesh->triangles + 3 * tmpMesh->triangle_count);
+        delete tmpMesh;
+
+        std::string hullFile = (file.parent_path() / (name + ".hull.stl")).string();
+        proxyMesh hull = convexHull(mesh.vertices, hullTriangles);
+        if (hull.triangleCount() == 0 || !writeSTL(hullFile, hull))
+        {
+            std::cerr << "Warning: Fail to generate hull of: " << file.string() << std::endl;
+            continue;
+        }
+
+        std::string convexFile = (file.parent_path() / (name + ".convex.stl")).string();
+        unsigned int numParts = 0;
+        proxyMesh convex = convexDecomposition(mesh, convexParts, concavityTolerance, convexTriangles, &numParts);
+        if (convex.triangleCount() == 0 || !writeSTL(convexFile, convex))
+        {
+            std::cerr << "Warning: Fail to generate convex decomposition of: " << file.string() << std::endl;
+            continue;
+        }
+
+        std::cerr << name << ": " << mesh.triangleCount() << " triangles, hull " << hull.triangleCount()
+            << " triangles, convex decomposition " << numParts << " parts with " << convex.triangleCount() << " triangles\n";
+    }
+    return 0;
+}
@@ -18,11 +18,9 @@ bool moveitPlanningSceneGenerator::updateCollisionObject (std_srvs::Empty::Reque
     // Keep the node from updating collision object with autoUpdate if the service call is running first
     mtx.lock();
 
-    // remove old collision objects
+    // the planning scene diff only carries the objects that changed
     planning_scene.world.collision_objects.clear();
-    std::cerr << "Number of old object to remove: ";
-    this->addCollisionObjects(collisionObjectGenerator.generateOldObjectToRemove());
-    
+
     // add new collision objects
     std::cerr << "Updating objects.\n";
     if(useDetectedObjectMsgs)
@@ -33,26 +31,17 @@ bool moveitPlanningSceneGenerator::updateCollisionObject (std_srvs::Empty::Reque
     else
         collisionObjectGenerator.updateCollisionObjects();
     
-    std::cerr << "Number of new object to add: ";
-    this->addCollisionObjects(collisionObjectGenerator.getCollisionObjects());
-    
+    publishCollisionObjectDiff();
     bool anyUpdate = planning_scene.world.collision_objects.size() > 0;
-    if (anyUpdate) {
-        planning_scene.is_diff = true;
-        planning_scene_diff_publisher.publish(planning_scene);
-        std::cerr << "Update done\n";
-    }
-    else
-        std::cerr << "No update done since there is no object TF detected\n";
-    std::cerr << std::endl;
     mtx.unlock();
-    return anyUpdate;
+    // an unchanged scene is still up to date
+    return anyUpdate || collisionObjectGenerator.getCollisionObjects().size() > 0;
 }
 
 void moveitPlanningSceneGenerator::autoUpdateScene(const costar_objrec_msgs::DetectedObjectList &detectedObject)
 {
     // this function will automatically update scene when it got detectedObject msgs
-    // remove old collision objects
+    // the planning scene diff only carries the objects that changed
 
     // Keep the node from updating collision object with service call if the autoupdate is running first
     mtx.lock();
@@ -60,8 +49,6 @@ void moveitPlanningSceneGenerator::autoUpdateScene(const costar_objrec_msgs::Det
     this->detectedObjectList = detectedObject;
 
     planning_scene.world.collision_objects.clear();
-    std::cerr << "Number of old object to remove: ";
-    this->addCollisionObjects(collisionObjectGenerator.generateOldObjectToRemove());
 
     // Get update of tf names from detected object msgs
     std::cerr << "Updating objects.\n";
@@ -70,8 +57,19 @@ void moveitPlanningSceneGenerator::autoUpdateScene(const costar_objrec_msgs::Det
     // Update collision objects without updating frame (because we already update it from the msgs)
     collisionObjectGenerator.updateCollisionObjects(false);
 
-    std::cerr << "Number of new object to add: ";
-    this->addCollisionObjects(collisionObjectGenerator.getCollisionObjects());
+    publishCollisionObjectDiff();
+    mtx.unlock();
+}
+
+void moveitPlanningSceneGenerator::publishCollisionObjectDiff()
+{
+    // only publish the objects that changed since the last update, or all of them on a resync
+    bool fullResync = fullResyncInterval > 0 && ++updatesSinceResync >= fullResyncInterval;
+    if (fullResync)
+        updatesSinceResync = 0;
+
+    std::cerr << (fullResync ? "Number of objects to resync: " : "Number of changed object to update: ");
+    this->addCollisionObjects(collisionObjectGenerator.generateCollisionObjectDiff(fullResync));
     
     bool anyUpdate = planning_scene.world.collision_objects.size() > 0;
     if (anyUpdate) {
@@ -80,17 +78,33 @@ void moveitPlanningSceneGenerator::autoUpdateScene(const costar_objrec_msgs::Det
         std::cerr << "Update done\n";
     }
     else
-        std::cerr << "No update done since there is no object TF detected\n";
+        std::cerr << "No update done since no object changed\n";
     std::cerr << std::endl;
+}
+
+void moveitPlanningSceneGenerator::sendSceneToNewSubscriber(const ros::SingleSubscriberPublisher &subscriber)
+{
+    // a new subscriber (e.g. a restarted move_group) missed all earlier diffs, so it gets every current object
+    mtx.lock();
+    moveit_msgs::PlanningScene scene;
+    scene.is_diff = true;
+    scene.world.collision_objects = collisionObjectGenerator.getCollisionObjects();
     mtx.unlock();
+
+    if (scene.world.collision_objects.size() > 0) {
+        std::cerr << "Sending " << scene.world.collision_objects.size() << " objects to new subscriber " << subscriber.getSubscriberName() << std::endl;
+        subscriber.publish(scene);
+    }
 }
 
-moveitPlanningSceneGenerator::moveitPlanningSceneGenerator(const ros::NodeHandle &nh)
+moveitPlanningSceneGenerator::moveitPlanningSceneGenerator(const ros::NodeHandle &nh) : updatesSinceResync(0)
 {
     // This will set the nodehandle and publisher of the class
     this->nh = nh;
-    planning_scene_diff_publisher = this->nh.advertise<moveit_msgs::PlanningScene>("/planning_scene", 1);
     collisionObjectGenerator.setNodeHandle(this->nh);
+    this->nh.param("fullResyncInterval", fullResyncInterval, 10);
+    planning_scene_diff_publisher = this->nh.advertise<moveit_msgs::PlanningScene>("/planning_scene", 1,
+        boost::bind(&moveitPlanningSceneGenerator::sendSceneToNewSubscriber, this, _1));
 
     this->nh.param("useDetectedObjectMsgs", useDetectedObjectMsgs, false);
     if(useDetectedObjectMsgs){
@@ -34,6 +34,9 @@
 #include <boost/filesystem.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/date_time/posix_time/posix_time_io.hpp>
+// for the capture pipeline
+#include <deque>
+#include <boost/thread.hpp>
 
 bool dist_viewer ,haveTable,update_table;
 std::string POINTS_IN;
@@ -53,7 +56,94 @@ int num_to_capture = 0;
 bool useTFsurface;
 bool useRosbag;
 bool doCluster;
-boost::posix_time::ptime time_to_save;
+bool compress_pcd;
+bool drop_frames;
+
+// One captured cloud with the time and index that name its files
+struct CaptureFrame
+{
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
+  boost::posix_time::ptime time;
+  int index;
+};
+
+// One cloud waiting to be written to disk
+struct WriteJob
+{
+  pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr cloud;
+  std::string filename;
+};
+
+// Fixed capacity queue between two pipeline stages.
+// tryPush() refuses an item when the queue is full, push() waits for room instead.
+// After close() the pushes fail and pop() returns false once the queue is drained.
+template <typename T>
+class BoundedQueue
+{
+public:
+  BoundedQueue(size_t capacity) : capacity_(capacity > 0 ? capacity : 1), closed_(false) {}
+
+  bool tryPush(const T &item)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (closed_ || items_.size() >= capacity_)
+      return false;
+    items_.push_back(item);
+    not_empty_.notify_one();
+    return true;
+  }
+
+  bool push(const T &item)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (!closed_ && items_.size() >= capacity_)
+      not_full_.wait(lock);
+    if (closed_)
+      return false;
+    items_.push_back(item);
+    not_empty_.notify_one();
+    return true;
+  }
+
+  bool pop(T &item)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (!closed_ && items_.empty())
+      not_empty_.wait(lock);
+    if (items_.empty())
+      return false;
+    item = items_.front();
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  bool closed_;
+  std::deque<T> items_;
+  boost::mutex mutex_;
+  boost::condition_variable not_empty_;
+  boost::condition_variable not_full_;
+};
+
+// Capture (subscriber callback) -> segmentation thread -> write thread.
+// A frame is accepted or dropped as a whole when it is captured, the files of an
+// accepted frame are always written.
+BoundedQueue<CaptureFrame> * segment_queue;
+BoundedQueue<WriteJob> * write_queue;
+int frames_captured = 0;
+int frames_dropped = 0;
+int files_written = 0;
+int files_failed = 0;
     
 // function getch is from http://answers.ros.org/question/63491/keyboard-key-pressed/
 int getch()
@@ -169,24 +259,44 @@ pcl::PointCloud<pcl::PointXYZRGBA>::Ptr getTableConvexHull(pcl::PointCloud<pcl::
   return convexHull;
 }
 
-void saveCloud(const pcl::PointCloud<pcl::PointXYZRGBA>& cloud_input, std::string dir, std::string additional_text = std::string(""))
+std::string cloudFilename(const CaptureFrame &frame, std::string dir, std::string additional_text = std::string(""))
 {
-    std::stringstream ss;
-    
-    try{
-      using namespace boost::posix_time;
-      using namespace std;
+  std::stringstream ss;
+  ss.imbue(std::locale(ss.getloc(), new boost::posix_time::time_facet("%Y_%m_%d_%H_%M_%S_")));
+  ss << dir << frame.time << object_name << "_" << frame.index << additional_text << ".pcd";
+  return ss.str();
+}
+
+// Hand the cloud to the write thread, waits while the write queue is full
+void saveCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr &cloud_input, const std::string &filename)
+{
+  WriteJob job;
+  job.cloud = cloud_input;
+  job.filename = filename;
+  if (!write_queue->push(job))
+    ROS_ERROR("could not queue %s, the writer is stopped!",filename.c_str());
+}
 
-      ss.imbue(std::locale(ss.getloc(), new boost::posix_time::time_facet("%Y_%m_%d_%H_%M_%S_")));
-      ss << dir << time_to_save << object_name << "_" << cloud_save_index << additional_text << ".pcd";
-      writer.write<pcl::PointXYZRGBA> (ss.str (), cloud_input, true);
-      std::cerr << "Saved: " << ss.str() << "\n";
+void writeLoop()
+{
+  WriteJob job;
+  while (write_queue->pop(job))
+  {
+    try{
+      if (compress_pcd)
+        writer.writeBinaryCompressed<pcl::PointXYZRGBA> (job.filename, *job.cloud);
+      else
+        writer.write<pcl::PointXYZRGBA> (job.filename, *job.cloud, true);
+      ++files_written;
+      std::cerr << "Saved: " << job.filename << "\n";
     } catch (pcl::IOException e) {
-      ROS_ERROR("could not write to %s!",ss.str().c_str());
+      ++files_failed;
+      ROS_ERROR("could not write to %s!",job.filename.c_str());
     }
+  }
 }
 
-void cloud_segmenter_and_save(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud_filtered)
+void cloud_segmenter_and_save(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud_filtered, const CaptureFrame &frame)
 {
   std::cerr << "Object Segmentation process begin \n";
   if (dist_viewer)
@@ -251,7 +361,7 @@ void cloud_segmenter_and_save(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud_fil
   pcl::OrganizedConnectedComponentSegmentation<pcl::PointXYZRGBA,pcl::Label> euclidean_segmentation (euclidean_cluster_comparator_);
   euclidean_segmentation.setInputCloud (cloud_filtered);
   euclidean_segmentation.segment (euclidean_labels, euclidean_label_indices);
-  unsigned int initialIndex = cloud_save_index;
+  int saved_clusters = 0;
   // save detected cluster data
   for (size_t i = 0; i < euclidean_label_indices.size (); i++)
   {
@@ -270,12 +380,42 @@ void cloud_segmenter_and_save(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloud_fil
       std::stringstream ss;
       ss << "_cluster_" << i+1 << "_ground_truth";
 
-      saveCloud(*cloud_cluster,ground_truth_directory, ss.str());
+      saveCloud(cloud_cluster,cloudFilename(frame,ground_truth_directory, ss.str()));
+      ++saved_clusters;
       std::cerr << "\tcluster size: "<< euclidean_label_indices[i].indices.size () << std::endl;
     }
   }
 
-  std::cerr << "Segmented object: " << cloud_save_index - initialIndex <<". Segmentation done.\n Waiting for keypress to get new data \n";
+  std::cerr << "Segmented object: " << saved_clusters <<". Segmentation done.\n Waiting for keypress to get new data \n";
+}
+
+void segmentLoop()
+{
+  CaptureFrame frame;
+  while (segment_queue->pop(frame))
+  {
+    // the original is written as captured, segmentation works on a copy
+    saveCloud(frame.cloud,cloudFilename(frame,original_directory,"_original"));
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGBA>(*frame.cloud));
+    segmentCloudAboveTable(cloud,tableHull);
+    if (doCluster)
+      cloud_segmenter_and_save(cloud,frame);
+    else
+      saveCloud(cloud,cloudFilename(frame,ground_truth_directory,"_ground_truth"));
+  }
+}
+
+// Accept a frame into the pipeline, or count it as dropped when the segmentation queue is full.
+// With drop_frames false the capture waits for room instead.
+void captureFrame(const CaptureFrame &frame)
+{
+  ++frames_captured;
+  bool accepted = drop_frames ? segment_queue->tryPush(frame) : segment_queue->push(frame);
+  if (!accepted)
+  {
+    ++frames_dropped;
+    std::cerr << "Dropped frame " << frame.index << ", pipeline is busy (captured: " << frames_captured << " dropped: " << frames_dropped << ")\n";
+  }
 }
 
 
@@ -311,17 +451,16 @@ void callback(const sensor_msgs::PointCloud2 &pc)
 {
   pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGBA>());
   // convert sensor_msgs::PointCloud2 to pcl::PointXYZRGBA
-  // update the time which will become the leading string of collected data
-  time_to_save = boost::posix_time::second_clock::local_time();
   cloud_save_index++;
   pcl::fromROSMsg(pc, *cloud);
   if (haveTable and keyPress)
   {
-    saveCloud(*cloud,original_directory,"_original");
-    segmentCloudAboveTable(cloud,tableHull);
-    if (doCluster)
-	    cloud_segmenter_and_save(cloud);
-	else saveCloud(*cloud,ground_truth_directory,"_ground_truth");
+    // the capture time becomes the leading string of collected data
+    CaptureFrame frame;
+    frame.cloud = cloud;
+    frame.time = boost::posix_time::second_clock::local_time();
+    frame.index = cloud_save_index;
+    captureFrame(frame);
   }
   else
   {
@@ -371,8 +510,16 @@ void callbackCaptureEnvironment(const sensor_msgs::PointCloud2 &pc)
   pcl::fromROSMsg(pc, *cloud);
   std::stringstream ss;
   ss << save_directory << "environment" << ++cloud_save_index << ".pcd";
-  writer.write<pcl::PointXYZRGBA> (ss.str(), *cloud, true);
-  std::cerr << "Saved " << ss.str() << std::endl;
+  WriteJob job;
+  job.cloud = cloud;
+  job.filename = ss.str();
+  ++frames_captured;
+  bool accepted = drop_frames ? write_queue->tryPush(job) : write_queue->push(job);
+  if (!accepted)
+  {
+    ++frames_dropped;
+    std::cerr << "Dropped " << ss.str() << ", writer is busy (captured: " << frames_captured << " dropped: " << frames_dropped << ")\n";
+  }
 }
 
 int main (int argc, char** argv)
@@ -406,6 +553,13 @@ int main (int argc, char** argv)
   nh.param("aboveTableMin",aboveTableMin,0.135);
   nh.param("aboveTableMax",aboveTableMax,0.50);
 
+  //getting capture pipeline parameters
+  int segment_queue_size, write_queue_size;
+  nh.param("segment_queue_size",segment_queue_size,4);
+  nh.param("write_queue_size",write_queue_size,16);
+  nh.param("drop_frames",drop_frames,true);
+  nh.param("compress_pcd",compress_pcd,true);
+
   listener = new (tf::TransformListener);
 
   bool justCaptureEnvironment;
@@ -415,6 +569,11 @@ int main (int argc, char** argv)
   boost::filesystem::create_directories(original_directory);
   boost::filesystem::create_directories(ground_truth_directory);
 
+  segment_queue = new BoundedQueue<CaptureFrame>(segment_queue_size);
+  write_queue = new BoundedQueue<WriteJob>(write_queue_size);
+  boost::thread write_thread(writeLoop);
+  boost::thread segment_thread;
+
   if (justCaptureEnvironment)
   { 
     pc_sub = nh.subscribe(POINTS_IN,1,callbackCaptureEnvironment);
@@ -435,6 +594,7 @@ int main (int argc, char** argv)
     else
       haveTable = false;
 
+    segment_thread = boost::thread(segmentLoop);
     pc_sub = nh.subscribe(POINTS_IN,1,callback);
     if (!haveTable)
       std::cerr << "1) Remove all object from the table\n2) make sure the AR tag you specified is visible\n3) press the 's' key to save the segmentation plane." << std::endl;
@@ -485,6 +645,18 @@ int main (int argc, char** argv)
       }
     }
   }
+  // finish the accepted frames before leaving
+  pc_sub.shutdown();
+  segment_queue->close();
+  if (segment_thread.joinable())
+    segment_thread.join();
+  write_queue->close();
+  write_thread.join();
+  std::cerr << "Frames captured: " << frames_captured << " dropped: " << frames_dropped
+            << ", files written: " << files_written << " failed: " << files_failed << std::endl;
+
+  delete (segment_queue);
+  delete (write_queue);
   delete (listener);
   ros::shutdown();
   return (0);
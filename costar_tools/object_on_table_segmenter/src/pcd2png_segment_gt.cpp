@@ -38,14 +38,22 @@
 /** \brief PCD 2 PNG converter
  *
  * This converter takes 4 inputs: names of the input PCD and Ground Truth PCD files, the output PNG and PNG Ground Truth files, and the name of the field.
+ * In batch mode a whole capture directory or a list of frames is converted by a pool of worker threads.
  *
  * \author Sergey Alexandrov
  * \author Andrew Hundt <ATHundt@gmail.com>
  *
  */
 
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem/convenience.hpp>
+#include <boost/filesystem/operations.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <pcl/pcl_config.h>
 #include <pcl/console/time.h>
@@ -605,35 +613,13 @@ PointCloudImageExtractorGTLabelFromRGBField<PointT>::extractImpl (const PointClo
       img.step = img.width * sizeof (unsigned char) * 3;
       img.data.resize (img.step * img.height);
 
-      std::srand(std::time(0));
-      std::set<uint32_t> labels;
-      std::map<uint32_t, size_t> colormap;
-
-      // First pass: find unique labels
-      /// @todo should a black label be given in the !pcl::isFinite case?
-      for (size_t i = 0; i < cloud.points.size (); ++i)
-      {
-        // If we need to paint NaN points with black do not waste colors on them
-        if (paint_nans_with_black_ && !pcl::isFinite (cloud.points[i]))
-          continue;
-        // uint32_t val;
-        // pcl::getFieldValue<PointT, uint32_t> (cloud.points[i], offset, val);
-        // labels.insert (val);
-        labels.insert(foreground_label_);
-      }
-
-      // Assign Glasbey colors in ascending order of labels
+      // Every finite point carries the foreground label, so its color is looked up once
+      // instead of collecting the labels of the whole cloud first.
       // Note: the color LUT has a finite size (256 colors), therefore when
       // there are more labels the colors will repeat
-      //size_t color = 0;
-      for (std::set<uint32_t>::iterator iter = labels.begin (); iter != labels.end (); ++iter)
-      {
-        //colormap[*iter] = color % GlasbeyLUT::size ();
-        colormap[*iter] = foreground_label_ % GlasbeyLUT::size ();
-        //++color;
-      }
+      /// @todo should a black label be given in the !pcl::isFinite case?
+      const unsigned char* foreground_color = GlasbeyLUT::data () + (foreground_label_ % GlasbeyLUT::size ()) * 3;
 
-      // Second pass: copy colors from the LUT
       for (size_t i = 0; i < cloud.points.size (); ++i)
       {
         
@@ -643,9 +629,8 @@ PointCloudImageExtractorGTLabelFromRGBField<PointT>::extractImpl (const PointClo
             memcpy (&img.data[i * 3], black, 3);        }
         else
         {
-            std::size_t offset_into_colormap = colormap[foreground_label_];
             // copy the color 3 channel memory addresses into the image
-            memcpy (&img.data[i * 3], GlasbeyLUT::data () + offset_into_colormap * 3, 3);
+            memcpy (&img.data[i * 3], foreground_color, 3);
         }
       }
 
@@ -668,6 +653,7 @@ printHelp (int, char **argv)
   std::cout << "****************************************************************************" << std::endl;
   std::cout << std::endl;
   std::cout << "Usage: " << argv[0] << " [Options] input.pcd input_ground_truth.pcd [output_source_data.png output_ground_truth_data.png]" << std::endl;
+  std::cout << "       " << argv[0] << " [Options] --batch <directory or list file> [Batch Options]" << std::endl;
   std::cout << std::endl;
   std::cout << "Options:" << std::endl;
   std::cout << std::endl;
@@ -706,6 +692,18 @@ printHelp (int, char **argv)
   std::cout << "                If the option is omitted then default scaling (depends on"    << std::endl;
   std::cout << "                the field type) will be used."                                << std::endl;
   std::cout << std::endl;
+  std::cout << "Batch Options:"                                                               << std::endl;
+  std::cout << std::endl;
+  std::cout << "     --batch  : Convert many frames in one process. Supported inputs:"        << std::endl;
+  std::cout << "                - <dir>   : every *_original.pcd file in the directory,"      << std::endl;
+  std::cout << "                            paired with the *_ground_truth.pcd file of the"   << std::endl;
+  std::cout << "                            same name in --gt-dir"                            << std::endl;
+  std::cout << "                - <file>  : one frame per line, written as"                   << std::endl;
+  std::cout << "                            input.pcd input_ground_truth.pcd [out.png out_gt.png]" << std::endl;
+  std::cout << "     --gt-dir : Directory of the ground truth files (default: the --batch dir)" << std::endl;
+  std::cout << "     --output-dir : Directory of the PNG files (default: next to each input)" << std::endl;
+  std::cout << "     --jobs   : Number of worker threads (default: number of cores)"         << std::endl;
+  std::cout << std::endl;
   std::cout << "Notes:"                                                                       << std::endl;
   std::cout << std::endl;
   std::cout << "¹) The Glasbey lookup table is a color table structured in a maximally"       << std::endl;
@@ -718,28 +716,40 @@ printHelp (int, char **argv)
 }
 
 bool
-loadCloud (const std::string &filename, pcl::PCLPointCloud2 &cloud, Eigen::Vector4f& blob_origin, Eigen::Quaternionf& blob_orientation)
+loadCloud (const std::string &filename, pcl::PCLPointCloud2 &cloud, Eigen::Vector4f& blob_origin, Eigen::Quaternionf& blob_orientation, bool verbose = true)
 {
   TicToc tt;
-  print_highlight ("Loading "); print_value ("%s ", filename.c_str ());
+  if (verbose)
+  {
+    print_highlight ("Loading "); print_value ("%s ", filename.c_str ());
+  }
 
   tt.tic ();
   if (loadPCDFile (filename, cloud,blob_origin,blob_orientation) < 0)
     return (false);
-  print_info ("[done, "); print_value ("%g", tt.toc ()); print_info (" ms : "); print_value ("%d", cloud.width * cloud.height); print_info (" points]\n");
-  print_info ("Available dimensions: "); print_value ("%s\n", pcl::getFieldsList (cloud).c_str ());
+  if (verbose)
+  {
+    print_info ("[done, "); print_value ("%g", tt.toc ()); print_info (" ms : "); print_value ("%d", cloud.width * cloud.height); print_info (" points]\n");
+    print_info ("Available dimensions: "); print_value ("%s\n", pcl::getFieldsList (cloud).c_str ());
+  }
 
   return (true);
 }
 
 void
-saveImage (const std::string &filename, const pcl::PCLImage& image)
+saveImage (const std::string &filename, const pcl::PCLImage& image, bool verbose = true)
 {
   TicToc tt;
   tt.tic ();
-  print_highlight ("Saving "); print_value ("%s ", filename.c_str ());
+  if (verbose)
+  {
+    print_highlight ("Saving "); print_value ("%s ", filename.c_str ());
+  }
   savePNGFile (filename, image);
-  print_info ("[done, "); print_value ("%g", tt.toc ()); print_info (" ms : "); print_value ("%d", image.width * image.height); print_info (" points]\n");
+  if (verbose)
+  {
+    print_info ("[done, "); print_value ("%g", tt.toc ()); print_info (" ms : "); print_value ("%d", image.width * image.height); print_info (" points]\n");
+  }
 }
 
 template<typename T> bool
@@ -802,189 +812,365 @@ parseColorsOption (int argc, char** argv, T& pcie)
   return true;
 }
 
+/** \brief One frame to convert: the input and ground truth clouds and the two output images. */
+struct FrameJob
+{
+  std::string pcd_filename;
+  std::string pcd_gt_filename;
+  std::string png_filename;
+  std::string png_gt_filename;
+};
+
+/** \brief Converts frames with a fixed set of options.
+  *
+  * The extractors are configured once from the command line, and the blobs, clouds and images
+  * are kept between frames so a worker converting many frames reuses their memory.
+  * A converter is not thread safe, every worker thread owns a copy.
+  */
+class FrameConverter
+{
+  public:
+
+    FrameConverter (int foreground_class = 1, int background_class = 0)
+      : field_name_ ("rgb"), gt_pcie_ (foreground_class, background_class)
+    {
+    }
+
+    /** \brief Read --field, --nan-class, --colors and --scale, returns false on an invalid option. */
+    bool
+    configure (int argc, char** argv)
+    {
+      bool paint_nans_with_black = !pcl::console::find_switch (argc, argv, "--nan-class");
+      print_info ("Paint infinite points with black: "); print_value ("%s\n", paint_nans_with_black ? "YES" : "NO");
+
+      parse_argument (argc, argv, "--field", field_name_);
+      print_info ("Field name: "); print_value ("%s\n", field_name_.c_str());
+
+      normal_pcie_.setPaintNaNsWithBlack (paint_nans_with_black);
+      rgb_pcie_.setPaintNaNsWithBlack (paint_nans_with_black);
+      label_pcie_.setPaintNaNsWithBlack (paint_nans_with_black);
+      z_pcie_.setPaintNaNsWithBlack (paint_nans_with_black);
+      curvature_pcie_.setPaintNaNsWithBlack (paint_nans_with_black);
+      intensity_pcie_.setPaintNaNsWithBlack (paint_nans_with_black);
+      gt_pcie_.setPaintNaNsWithBlack (paint_nans_with_black);
+
+      if (field_name_ == "label")
+      {
+        if (!parseColorsOption(argc, argv, label_pcie_))
+          return (false);
+      }
+      else if (field_name_ == "z")
+      {
+        if (!parseScaleOption(argc, argv, z_pcie_))
+          return (false);
+      }
+      else if (field_name_ == "curvature")
+      {
+        if (!parseScaleOption(argc, argv, curvature_pcie_))
+          return (false);
+      }
+      else if (field_name_ == "intensity")
+      {
+        if (!parseScaleOption(argc, argv, intensity_pcie_))
+          return (false);
+      }
+      else if (field_name_ != "normal" && field_name_ != "rgb")
+      {
+        print_error ("Unsupported field \"%s\".\n", field_name_.c_str());
+        return (false);
+      }
+
+      return (parseColorsOption(argc, argv, gt_pcie_));
+    }
+
+    /** \brief Convert one frame, returns 0 on success, otherwise the same error bits as the single file mode. */
+    int
+    convert (const FrameJob &job, bool verbose = true)
+    {
+      Eigen::Vector4f blob_origin, blob_gt_origin;
+      Eigen::Quaternionf blob_orientation, blob_gt_orientation;
+
+      if (!loadCloud (job.pcd_filename, blob_, blob_origin, blob_orientation, verbose))
+      {
+        print_error ("Unable to load PCD input file %s.\n", job.pcd_filename.c_str ());
+        return (-1);
+      }
+
+      if (!loadCloud (job.pcd_gt_filename, blob_gt_, blob_gt_origin, blob_gt_orientation, verbose))
+      {
+        print_error ("Unable to load PCD ground truth input file %s.\n", job.pcd_gt_filename.c_str ());
+        return (-1);
+      }
+
+      // Check if the cloud is organized
+      if (blob_.height == 1)
+      {
+        print_error ("Input cloud %s is not organized.\n", job.pcd_filename.c_str ());
+        return (-1);
+      }
+
+      // Check if the cloud is organized
+      if (blob_gt_.height == 1)
+      {
+        print_error ("Input ground truth cloud %s is not organized.\n", job.pcd_gt_filename.c_str ());
+        return (-1);
+      }
+
+      int ret = 0;
+
+      if (!extractField ())
+      {
+        print_error ("Failed to extract original image from field \"%s\" of %s.\n", field_name_.c_str(), job.pcd_filename.c_str ());
+        ret |=1;
+      }
+      else
+      {
+        saveImage (job.png_filename, image_, verbose);
+      }
+
+      // Ground Truth image is always extracted from RGB
+      fromPCLPointCloud2 (blob_gt_, rgb_cloud_);
+      if (!gt_pcie_.extract(rgb_cloud_, gt_image_))
+      {
+        print_error ("Failed to extract ground truth image from field \"%s\" of %s.\n", field_name_.c_str(), job.pcd_gt_filename.c_str ());
+        ret |=3;
+      }
+
+      saveImage (job.png_gt_filename, gt_image_, verbose);
+
+      return (ret);
+    }
+
+  private:
+
+    bool
+    extractField ()
+    {
+      if (field_name_ == "normal")
+      {
+        fromPCLPointCloud2 (blob_, normal_cloud_);
+        return (normal_pcie_.extract(normal_cloud_, image_));
+      }
+      else if (field_name_ == "rgb")
+      {
+        fromPCLPointCloud2 (blob_, rgb_cloud_);
+        return (rgb_pcie_.extract(rgb_cloud_, image_));
+      }
+      else if (field_name_ == "label")
+      {
+        fromPCLPointCloud2 (blob_, label_cloud_);
+        return (label_pcie_.extract(label_cloud_, image_));
+      }
+      else if (field_name_ == "z")
+      {
+        fromPCLPointCloud2 (blob_, z_cloud_);
+        return (z_pcie_.extract(z_cloud_, image_));
+      }
+      else if (field_name_ == "curvature")
+      {
+        fromPCLPointCloud2 (blob_, normal_cloud_);
+        return (curvature_pcie_.extract(normal_cloud_, image_));
+      }
+      else if (field_name_ == "intensity")
+      {
+        fromPCLPointCloud2 (blob_, intensity_cloud_);
+        return (intensity_pcie_.extract(intensity_cloud_, image_));
+      }
+      return (false);
+    }
+
+    std::string field_name_;
+
+    PointCloudImageExtractorFromNormalField<PointNormal> normal_pcie_;
+    PointCloudImageExtractorFromRGBField<PointXYZRGB> rgb_pcie_;
+    PointCloudImageExtractorFromLabelField<PointXYZL> label_pcie_;
+    PointCloudImageExtractorFromZField<PointXYZ> z_pcie_;
+    PointCloudImageExtractorFromCurvatureField<PointNormal> curvature_pcie_;
+    PointCloudImageExtractorFromIntensityField<PointXYZI> intensity_pcie_;
+    PointCloudImageExtractorGTLabelFromRGBField<PointXYZRGB> gt_pcie_;
+
+    // Buffers reused between frames
+    pcl::PCLPointCloud2 blob_;
+    pcl::PCLPointCloud2 blob_gt_;
+    PointCloud<PointNormal> normal_cloud_;
+    PointCloud<PointXYZRGB> rgb_cloud_;
+    PointCloud<PointXYZL> label_cloud_;
+    PointCloud<PointXYZ> z_cloud_;
+    PointCloud<PointXYZI> intensity_cloud_;
+    pcl::PCLImage image_;
+    pcl::PCLImage gt_image_;
+};
+
+bool
+compareJobs (const FrameJob &a, const FrameJob &b)
+{
+  return (a.pcd_filename < b.pcd_filename);
+}
+
+/** \brief Output name of a converted file: the input name with a png extension, optionally moved to output_dir. */
+std::string
+pngFilename (const std::string &pcd_filename, const std::string &output_dir)
+{
+  boost::filesystem::path png_path (pcd_filename);
+  png_path.replace_extension (".png");
+  if (!output_dir.empty ())
+    png_path = boost::filesystem::path (output_dir) / png_path.filename ();
+  return (png_path.string ());
+}
+
+/** \brief Collect the frames of a capture directory or a list file, returns false if nothing could be read. */
+bool
+collectJobs (const std::string &batch_path, const std::string &gt_dir, const std::string &output_dir, std::vector<FrameJob> &jobs)
+{
+  const std::string original_suffix = "_original.pcd";
+  const std::string ground_truth_suffix = "_ground_truth.pcd";
+
+  if (boost::filesystem::is_directory (batch_path))
+  {
+    boost::filesystem::path gt_path (gt_dir.empty () ? batch_path : gt_dir);
+    for (boost::filesystem::directory_iterator it (batch_path); it != boost::filesystem::directory_iterator (); ++it)
+    {
+      std::string name = it->path ().filename ().string ();
+      if (!boost::filesystem::is_regular_file (it->status ()) || name.size () <= original_suffix.size ()
+          || name.compare (name.size () - original_suffix.size (), original_suffix.size (), original_suffix) != 0)
+        continue;
+
+      FrameJob job;
+      job.pcd_filename = it->path ().string ();
+      job.pcd_gt_filename = (gt_path / (name.substr (0, name.size () - original_suffix.size ()) + ground_truth_suffix)).string ();
+      if (!boost::filesystem::exists (job.pcd_gt_filename))
+      {
+        print_warn ("No ground truth for %s, skipping it.\n", job.pcd_filename.c_str ());
+        continue;
+      }
+      job.png_filename = pngFilename (job.pcd_filename, output_dir);
+      job.png_gt_filename = pngFilename (job.pcd_gt_filename, output_dir);
+      jobs.push_back (job);
+    }
+  }
+  else
+  {
+    std::ifstream list (batch_path.c_str ());
+    if (!list.is_open ())
+      return (false);
+    std::string line;
+    while (std::getline (list, line))
+    {
+      std::istringstream iss (line);
+      FrameJob job;
+      if (!(iss >> job.pcd_filename >> job.pcd_gt_filename))
+        continue;
+      if (!(iss >> job.png_filename >> job.png_gt_filename))
+      {
+        job.png_filename = pngFilename (job.pcd_filename, output_dir);
+        job.png_gt_filename = pngFilename (job.pcd_gt_filename, output_dir);
+      }
+      jobs.push_back (job);
+    }
+  }
+
+  // Sorted so the order of the frames, and of the log, does not depend on the file system
+  std::sort (jobs.begin (), jobs.end (), compareJobs);
+  return (true);
+}
+
 /* ---[ */
 int
 main (int argc, char** argv)
 {
   print_info ("Convert a PCD file to PNG format.\nFor more information, use: %s --help\n", argv[0]);
 
-  if (argc < 5 || pcl::console::find_switch (argc, argv, "--help"))
+  std::string batch_path;
+  parse_argument (argc, argv, "--batch", batch_path);
+
+  if ((argc < 5 && batch_path.empty ()) || pcl::console::find_switch (argc, argv, "--help"))
   {
     printHelp (argc, argv);
     return (-1);
   }
 
-  // Parse the command line arguments for .pcd and .png files
-  std::vector<int> pcd_file_index = parse_file_extension_argument (argc, argv, ".pcd");
-  std::vector<int> png_file_index = parse_file_extension_argument (argc, argv, ".png");
-
-  if (pcd_file_index.size () != 2 || (png_file_index.size () != 2 && png_file_index.size() != 0))
-  {
-    print_error ("Need two input PCD files and two output PNG files.\n");
-    return (-1);
-  }
-  
-  std::string png_filename;
-  std::string png_gt_filename;
-  std::string pcd_filename = argv[pcd_file_index[0]];
-  std::string pcd_gt_filename = argv[pcd_file_index[1]];
-  if(png_file_index.size() == 0)
-  {
-    png_filename = pcd_filename;
-    png_gt_filename = pcd_gt_filename;
-    boost::filesystem::change_extension(png_filename, "png").string();
-    boost::filesystem::change_extension(png_gt_filename, "png").string();
-  
-  } else {
-    png_filename = argv[png_file_index[0]];
-    png_gt_filename = argv[png_file_index[1]];
-  }
-  
   int background_class = 0;
   int foreground_class = 1;
   
   parse(argc, argv, "--foreground-class", foreground_class);
   parse(argc, argv, "--background-class", background_class);
 
-
-  // Load the input file
-  pcl::PCLPointCloud2::Ptr blob (new pcl::PCLPointCloud2());
-  pcl::PCLPointCloud2::Ptr blob_gt (new pcl::PCLPointCloud2());
-  Eigen::Vector4f blob_origin, blob_gt_origin;
-  Eigen::Quaternionf blob_orientation, blob_gt_orientation;
-  
-  if (!loadCloud (pcd_filename, *blob,blob_origin,blob_orientation))
-  {
-    print_error ("Unable to load PCD input file 1.\n");
+  FrameConverter converter (foreground_class, background_class);
+  if (!converter.configure (argc, argv))
     return (-1);
-  }
 
-  if (!loadCloud (pcd_gt_filename, *blob_gt,blob_gt_origin,blob_gt_orientation))
+  if (!batch_path.empty ())
   {
-    print_error ("Unable to load PCD ground truth input file 1.\n");
-    return (-1);
-  }
+    std::string gt_dir, output_dir;
+    parse_argument (argc, argv, "--gt-dir", gt_dir);
+    parse_argument (argc, argv, "--output-dir", output_dir);
+    if (!output_dir.empty ())
+      boost::filesystem::create_directories (output_dir);
+
+    std::vector<FrameJob> jobs;
+    if (!collectJobs (batch_path, gt_dir, output_dir, jobs))
+    {
+      print_error ("Unable to read the batch input %s.\n", batch_path.c_str ());
+      return (-1);
+    }
 
-  // Check if the cloud is organized
-  if (blob->height == 1)
-  {
-    print_error ("Input cloud is not organized.\n");
-    return (-1);
-  }
+    int jobs_num = 1;
+#ifdef _OPENMP
+    jobs_num = omp_get_max_threads ();
+#endif
+    parse_argument (argc, argv, "--jobs", jobs_num);
+    jobs_num = std::max (1, std::min (jobs_num, static_cast<int> (jobs.size ())));
+    print_info ("Converting "); print_value ("%d", static_cast<int> (jobs.size ())); print_info (" frames with "); print_value ("%d", jobs_num); print_info (" workers\n");
+
+    TicToc tt;
+    tt.tic ();
+    int ret = 0;
+    int failed = 0;
+    int done = 0;
+    // Every worker owns a copy of the configured converter and keeps its buffers across frames
+#pragma omp parallel num_threads(jobs_num) firstprivate(converter) reduction(|:ret) reduction(+:failed)
+    {
+#pragma omp for schedule(dynamic, 1)
+      for (int i = 0; i < static_cast<int> (jobs.size ()); ++i)
+      {
+        int frame_ret = converter.convert (jobs[i], false);
+        ret |= frame_ret;
+        if (frame_ret != 0)
+          ++failed;
+#pragma omp critical (batch_progress)
+        {
+          ++done;
+          print_info ("[%d/%d] ", done, static_cast<int> (jobs.size ())); print_value ("%s\n", jobs[i].pcd_filename.c_str ());
+        }
+      }
+    }
+    print_info ("[done, "); print_value ("%g", tt.toc ()); print_info (" ms : "); print_value ("%d", static_cast<int> (jobs.size ()) - failed); print_info (" frames converted, "); print_value ("%d", failed); print_info (" failed]\n");
 
-  // Check if the cloud is organized
-  if (blob_gt->height == 1)
-  {
-    print_error ("Input ground truth cloud is not organized.\n");
-    return (-1);
+    return (ret);
   }
 
-  bool paint_nans_with_black = !pcl::console::find_switch (argc, argv, "--nan-class");
-  print_info ("Paint infinite points with black: "); print_value ("%s\n", paint_nans_with_black ? "YES" : "NO");
-
-  std::string field_name = "rgb";
-  parse_argument (argc, argv, "--field", field_name);
-  print_info ("Field name: "); print_value ("%s\n", field_name.c_str());
-
+  // Parse the command line arguments for .pcd and .png files
+  std::vector<int> pcd_file_index = parse_file_extension_argument (argc, argv, ".pcd");
+  std::vector<int> png_file_index = parse_file_extension_argument (argc, argv, ".png");
 
-  pcl::PCLImage image;
-  bool extracted;
-  if (field_name == "normal")
-  {
-    PointCloud<PointNormal> cloud;
-    fromPCLPointCloud2 (*blob, cloud);
-    PointCloudImageExtractorFromNormalField<PointNormal> pcie;
-    pcie.setPaintNaNsWithBlack (paint_nans_with_black);
-    extracted = pcie.extract(cloud, image);
-  }
-  else if (field_name == "rgb")
-  {
-    PointCloud<PointXYZRGB> cloud;
-    fromPCLPointCloud2 (*blob, cloud);
-    PointCloudImageExtractorFromRGBField<PointXYZRGB> pcie;
-    pcie.setPaintNaNsWithBlack (paint_nans_with_black);
-    extracted = pcie.extract(cloud, image);
-  }
-  else if (field_name == "label")
-  {
-    PointCloud<PointXYZL> cloud;
-    fromPCLPointCloud2 (*blob, cloud);
-    PointCloudImageExtractorFromLabelField<PointXYZL> pcie;
-    pcie.setPaintNaNsWithBlack (paint_nans_with_black);
-    if (!parseColorsOption(argc, argv, pcie))
-      return (-1);
-    extracted = pcie.extract(cloud, image);
-  }
-  else if (field_name == "z")
-  {
-    PointCloud<PointXYZ> cloud;
-    fromPCLPointCloud2 (*blob, cloud);
-    PointCloudImageExtractorFromZField<PointXYZ> pcie;
-    pcie.setPaintNaNsWithBlack (paint_nans_with_black);
-    if (!parseScaleOption(argc, argv, pcie))
-      return (-1);
-    extracted = pcie.extract(cloud, image);
-  }
-  else if (field_name == "curvature")
-  {
-    PointCloud<PointNormal> cloud;
-    fromPCLPointCloud2 (*blob, cloud);
-    PointCloudImageExtractorFromCurvatureField<PointNormal> pcie;
-    pcie.setPaintNaNsWithBlack (paint_nans_with_black);
-    if (!parseScaleOption(argc, argv, pcie))
-      return (-1);
-    extracted = pcie.extract(cloud, image);
-  }
-  else if (field_name == "intensity")
-  {
-    PointCloud<PointXYZI> cloud;
-    fromPCLPointCloud2 (*blob, cloud);
-    PointCloudImageExtractorFromIntensityField<PointXYZI> pcie;
-    pcie.setPaintNaNsWithBlack (paint_nans_with_black);
-    if (!parseScaleOption(argc, argv, pcie))
-      return (-1);
-    extracted = pcie.extract(cloud, image);
-  }
-  else
+  if (pcd_file_index.size () != 2 || (png_file_index.size () != 2 && png_file_index.size() != 0))
   {
-    print_error ("Unsupported field \"%s\".\n", field_name.c_str());
+    print_error ("Need two input PCD files and two output PNG files.\n");
     return (-1);
   }
   
-  int ret = 0;
-  
-  if (!extracted)
-  {
-    print_error ("Failed to extract original image from field \"%s\".\n", field_name.c_str());
-    ret |=1;
-  }
-  else
-  {
-    saveImage (png_filename, image);
-  }
-  
-  
-  // Ground Truth image is always extracted from RGB
-  pcl::PCLImage gt_image;
-  
+  FrameJob job;
+  job.pcd_filename = argv[pcd_file_index[0]];
+  job.pcd_gt_filename = argv[pcd_file_index[1]];
+  if(png_file_index.size() == 0)
   {
-
-      PointCloud<PointXYZRGB> gt_cloud;
-      fromPCLPointCloud2 (*blob_gt, gt_cloud);
-      PointCloudImageExtractorGTLabelFromRGBField<PointXYZRGB> pcie(foreground_class,background_class);
-      pcie.setPaintNaNsWithBlack (paint_nans_with_black);
-      if (!parseColorsOption(argc, argv, pcie))
-        return (-1);
-      extracted = pcie.extract(gt_cloud, gt_image);
-  }
+    job.png_filename = pngFilename (job.pcd_filename, "");
+    job.png_gt_filename = pngFilename (job.pcd_gt_filename, "");
   
-  if (!extracted)
-  {
-    print_error ("Failed to extract ground truth image from field \"%s\".\n", field_name.c_str());
-    ret |=3;
+  } else {
+    job.png_filename = argv[png_file_index[0]];
+    job.png_gt_filename = argv[png_file_index[1]];
   }
 
-  saveImage (png_gt_filename, gt_image);
-
-  return (ret);
+  return (converter.convert (job));
 }